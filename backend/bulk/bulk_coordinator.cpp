@@ -0,0 +1,399 @@
+#include "bulk/bulk_coordinator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/socket.h"
+#include "runtime/hash.h"
+#include "storage/results_service.h"
+
+namespace probionis {
+
+namespace {
+
+// Upper bound on one RESULT message, against a confused or hostile peer.
+constexpr std::size_t kMaxResultLines = 1u << 20;
+
+std::vector<std::string> split_words(const std::string& line) {
+    std::vector<std::string> words;
+    std::istringstream in(line);
+    for (std::string word; in >> word;) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+std::uint64_t to_u64(const std::string& s) {
+    return std::strtoull(s.c_str(), nullptr, 10);
+}
+
+}  // namespace
+
+struct BulkCoordinator::Connection {
+    LineSocket socket;
+    std::uint64_t holder = 0;
+    // Unit -> token of every lease handed out on this connection and not
+    // answered yet; only the serving thread touches it.
+    std::map<std::uint32_t, std::uint64_t> leased;
+    std::thread thread;
+    std::atomic<bool> finished{false};
+};
+
+BulkCoordinator::BulkCoordinator(const BulkJobOptions& options, ResultsPrimary& store)
+    : options_(options), store_(store) {
+    std::ifstream manifest(options_.manifest_path);
+    if (!manifest) {
+        throw std::runtime_error("cannot open manifest " + options_.manifest_path);
+    }
+    for (std::string line; std::getline(manifest, line);) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            items_.push_back(std::move(line));
+        }
+    }
+    leases_ = std::make_unique<LeaseTable>(items_.size(), options_.unit_size,
+                                           std::chrono::milliseconds(options_.lease_ms));
+    recover_journal();
+}
+
+BulkCoordinator::~BulkCoordinator() {
+    stop();
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+}
+
+void BulkCoordinator::journal_line(const std::string& text, bool sync) {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    const char* data = text.data();
+    std::size_t left = text.size();
+    bool ok = true;
+    while (ok && left > 0) {
+        const ssize_t n = ::write(journal_fd_, data, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        if (ok) {
+            data += n;
+            left -= static_cast<std::size_t>(n);
+        }
+    }
+    ok = ok && (!sync || ::fdatasync(journal_fd_) == 0);
+    if (!ok) {
+        const std::string reason = std::strerror(errno);
+        // If even this fails, recover_journal() trims the tail on restart.
+        const bool trimmed = ::ftruncate(journal_fd_, static_cast<off_t>(journal_size_)) == 0;
+        throw std::runtime_error("bulk journal write failed: " + reason +
+                                 (trimmed ? "" : " (torn tail left in place)"));
+    }
+    journal_size_ += text.size();
+}
+
+void BulkCoordinator::recover_journal() {
+    // The job identity guards against resuming with a different manifest or
+    // unit size, which would make unit IDs mean different items.
+    std::uint64_t identity = fnv1a64(&options_.unit_size, sizeof(options_.unit_size));
+    for (const auto& item : items_) {
+        identity = fnv1a64(item.data(), item.size() + 1, identity);  // includes the NUL
+    }
+    const std::string header = "J " + std::to_string(identity) + " " +
+                               std::to_string(items_.size()) + " " +
+                               std::to_string(options_.unit_size) + "\n";
+
+    std::ifstream in(options_.journal_path);
+    std::string line;
+    bool fresh = !std::getline(in, line);
+    if (!fresh && line + "\n" != header) {
+        throw std::runtime_error("bulk journal " + options_.journal_path +
+                                 " belongs to a different manifest or unit size");
+    }
+
+    // Committed blocks (C ... E) carry the unit's results; A marks the store
+    // writes as finished. An unterminated final block is an uncommitted
+    // unit and is simply scored again.
+    std::map<std::uint32_t, std::string> committed;
+    std::vector<bool> applied(leases_->unit_count(), false);
+    // End of the last complete entry; anything after it is a torn write.
+    std::streamoff valid_end = fresh ? 0 : static_cast<std::streamoff>(header.size());
+    while (std::getline(in, line) && !in.eof()) {
+        const std::vector<std::string> words = split_words(line);
+        if (words.size() == 3 && words[0] == "C") {
+            const auto unit = static_cast<std::uint32_t>(to_u64(words[1]));
+            const std::uint64_t count = to_u64(words[2]);
+            std::string lines;
+            bool complete = true;
+            for (std::uint64_t i = 0; i < count; ++i) {
+                if (!std::getline(in, line) || in.eof()) {
+                    complete = false;
+                    break;
+                }
+                lines += line + "\n";
+            }
+            if (!complete || !std::getline(in, line) || in.eof() || line != "E " + words[1]) {
+                break;
+            }
+            if (unit < leases_->unit_count()) {
+                committed[unit] = std::move(lines);
+            }
+        } else if (words.size() == 2 && words[0] == "A") {
+            const std::uint64_t unit = to_u64(words[1]);
+            if (unit < applied.size()) {
+                applied[unit] = true;
+            }
+        } else {
+            break;
+        }
+        valid_end = in.tellg();
+    }
+    in.close();
+    if (!fresh && ::truncate(options_.journal_path.c_str(), valid_end) != 0) {
+        throw std::runtime_error("cannot trim bulk journal " + options_.journal_path);
+    }
+
+    journal_fd_ = ::open(options_.journal_path.c_str(),
+                         O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC | (fresh ? O_TRUNC : 0), 0644);
+    if (journal_fd_ < 0) {
+        throw std::runtime_error("cannot open bulk journal " + options_.journal_path);
+    }
+    journal_size_ = static_cast<std::uint64_t>(valid_end);
+    if (fresh) {
+        journal_line(header, true);
+    }
+    for (const auto& [unit, lines] : committed) {
+        leases_->mark_done(unit);
+        if (!applied[unit]) {
+            apply_unit(unit, parse_result_lines(lines), true);
+        }
+    }
+}
+
+void BulkCoordinator::apply_unit(std::uint32_t unit, const std::vector<ResultRecord>& records,
+                                 bool resume) {
+    // A first attempt cannot find its records in the store, so only
+    // resumed units pay for the lookup.
+    const std::vector<ResultRecord> missing = resume ? store_.store().missing(records) : records;
+    store_.write_batch(missing);
+    results_merged_.fetch_add(missing.size(), std::memory_order_relaxed);
+    journal_line("A " + std::to_string(unit) + "\n", false);
+}
+
+void BulkCoordinator::retry_unapplied() {
+    std::map<std::uint32_t, std::vector<ResultRecord>> pending;
+    {
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        pending.swap(unapplied_);
+    }
+    auto it = pending.begin();
+    for (; it != pending.end(); ++it) {
+        try {
+            apply_unit(it->first, it->second, true);
+        } catch (const std::exception&) {
+            break;  // still failing; try again with the next result
+        }
+    }
+    std::lock_guard<std::mutex> lock(commit_mutex_);
+    unapplied_.insert(std::make_move_iterator(it), std::make_move_iterator(pending.end()));
+}
+
+void BulkCoordinator::start() {
+    if (listen_fd_ >= 0) {
+        return;
+    }
+    listen_fd_ = tcp_listen(options_.host, options_.port, &port_);
+    stopping_.store(false);
+    accept_thread_ = std::thread([this] { accept_loop(); });
+}
+
+void BulkCoordinator::stop() {
+    if (listen_fd_ < 0) {
+        return;
+    }
+    stopping_.store(true);
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    std::vector<std::shared_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections.swap(connections_);
+    }
+    for (auto& connection : connections) {
+        ::shutdown(connection->socket.fd(), SHUT_RDWR);
+        connection->thread.join();
+    }
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void BulkCoordinator::accept_loop() {
+    while (!stopping_.load()) {
+        const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (stopping_.load()) break;
+            continue;
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->socket = LineSocket(fd);
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        // Reap workers that have gone away.
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if ((*it)->finished.load()) {
+                (*it)->thread.join();
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        connection->holder = next_holder_++;
+        connection->thread = std::thread([this, connection] { serve(connection); });
+        connections_.push_back(std::move(connection));
+    }
+}
+
+void BulkCoordinator::serve(std::shared_ptr<Connection> connection) {
+    LineSocket& socket = connection->socket;
+    // Lets WAIT replies be short without the worker spinning.
+    const int wait_ms = std::clamp(options_.lease_ms / 4, 50, 1000);
+    std::string line;
+    while (!stopping_.load() && socket.read_line(line)) {
+        const std::vector<std::string> words = split_words(line);
+        std::string reply;
+        if (words.size() == 1 && words[0] == "LEASE") {
+            if (const auto lease = leases_->acquire(connection->holder, LeaseTable::Clock::now())) {
+                const WorkUnit& unit = lease->unit;
+                reply = "UNIT " + std::to_string(unit.id) + " " + std::to_string(lease->token) +
+                        " " + std::to_string(options_.lease_ms) + " " +
+                        std::to_string(unit.end - unit.begin) + "\n";
+                for (std::size_t i = unit.begin; i < unit.end; ++i) {
+                    reply += items_[i] + "\n";
+                }
+                connection->leased[unit.id] = lease->token;
+            } else if (leases_->finished()) {
+                reply = "DONE\n";
+            } else {
+                reply = "WAIT " + std::to_string(wait_ms) + "\n";
+            }
+        } else if (words.size() == 3 && words[0] == "RENEW") {
+            const bool ok = leases_->renew(static_cast<std::uint32_t>(to_u64(words[1])),
+                                           to_u64(words[2]), LeaseTable::Clock::now());
+            reply = ok ? "OK\n" : "LOST\n";
+        } else if (words.size() == 4 && words[0] == "RESULT") {
+            const std::uint64_t count = to_u64(words[3]);
+            if (count > kMaxResultLines) {
+                break;
+            }
+            std::string lines;
+            bool complete = true;
+            for (std::uint64_t i = 0; i < count && complete; ++i) {
+                complete = socket.read_line(line);
+                lines += line + "\n";
+            }
+            if (!complete) {
+                break;
+            }
+            // A late result from an expired lease is as good as any,
+            // provided this worker was given the unit and it is not merged
+            // yet.
+            const auto unit = static_cast<std::uint32_t>(to_u64(words[1]));
+            const std::uint64_t token = to_u64(words[2]);
+            const auto lease = connection->leased.find(unit);
+            if (lease == connection->leased.end() || lease->second != token) {
+                reply = "ERROR unit " + words[1] + " was not leased to this worker\n";
+            } else {
+                connection->leased.erase(lease);
+                try {
+                    reply = handle_result(unit, token, parse_result_lines(lines));
+                } catch (const std::invalid_argument& e) {
+                    leases_->release(unit, token);
+                    reply = std::string("ERROR ") + e.what() + "\n";
+                }
+            }
+        } else {
+            reply = "ERROR unknown command\n";
+        }
+        if (!socket.write(reply)) {
+            break;
+        }
+    }
+    leases_->release_holder(connection->holder);
+    connection->finished.store(true);
+}
+
+std::string BulkCoordinator::handle_result(std::uint32_t unit, std::uint64_t token,
+                                           const std::vector<ResultRecord>& records) {
+    retry_unapplied();
+    {
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        if (leases_->is_done(unit) || !committing_.insert(unit).second) {
+            duplicates_.fetch_add(1, std::memory_order_relaxed);
+            return "DUPLICATE\n";
+        }
+    }
+    // Re-serialise so the journal holds exactly what is merged.
+    std::string block = "C " + std::to_string(unit) + " " + std::to_string(records.size()) + "\n";
+    for (const ResultRecord& record : records) {
+        block += format_result_line(record);
+    }
+    block += "E " + std::to_string(unit) + "\n";
+    bool committed = true;
+    std::string error;
+    try {
+        journal_line(block, true);
+    } catch (const std::exception& e) {
+        committed = false;
+        error = e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        committing_.erase(unit);
+        if (committed) {
+            leases_->mark_done(unit);
+        }
+    }
+    if (!committed) {
+        // Not committed: the unit goes back to be scored again.
+        leases_->release(unit, token);
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        return "FAILED " + error + "\n";
+    }
+    try {
+        apply_unit(unit, records, false);
+    } catch (const std::exception&) {
+        // Committed, so the worker is done with it; the store catches up
+        // from unapplied_ (or the journal, after a restart).
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        unapplied_.emplace(unit, records);
+    }
+    return "OK\n";
+}
+
+BulkJobProgress BulkCoordinator::progress() const {
+    BulkJobProgress progress;
+    progress.leases = leases_->stats();
+    progress.results_merged = results_merged_.load(std::memory_order_relaxed);
+    progress.duplicates = duplicates_.load(std::memory_order_relaxed);
+    progress.failed = failed_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        progress.unapplied = unapplied_.size();
+    }
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    for (const auto& connection : connections_) {
+        progress.workers_connected += connection->finished.load() ? 0 : 1;
+    }
+    return progress;
+}
+
+}  // namespace probionis
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bulk/work_leases.h"
+#include "storage/results_replication.h"
+
+namespace probionis {
+
+struct BulkJobOptions {
+    // Archive manifest: one input path per line, readable by every worker
+    // (shared filesystem or object-store mount).
+    std::string manifest_path;
+    // Progress journal; reopening it resumes the job.
+    std::string journal_path;
+    std::size_t unit_size = 256;
+    int lease_ms = 60000;
+    std::string host = "0.0.0.0";
+    std::uint16_t port = 9500;
+};
+
+struct BulkJobProgress {
+    LeaseStats leases;
+    std::uint64_t results_merged = 0;
+    // Result submissions for units that were already merged, discarded.
+    std::uint64_t duplicates = 0;
+    // Result submissions that could not be committed; the unit is leased
+    // again.
+    std::uint64_t failed = 0;
+    // Committed units whose store write has not succeeded yet. They are
+    // retried with every later result and on restart.
+    std::size_t unapplied = 0;
+    std::size_t workers_connected = 0;
+};
+
+// Coordinates re-scoring of an archive across worker processes on any
+// number of hosts. The manifest is split into units; workers lease units
+// over a line-based TCP protocol, score them and send the results back:
+//
+//   LEASE                        -> UNIT id token lease_ms n + n paths
+//                                   | WAIT ms | DONE
+//   RENEW id token               -> OK | LOST
+//   RESULT id token n + n lines  -> OK | DUPLICATE | FAILED message
+//                                   | ERROR message
+//
+// Result lines use the POST /results format with timestamps. A RESULT must
+// name a unit and token this connection was leased; the lease may have
+// expired since. A worker that disconnects loses its leases at once; one
+// that hangs loses them when they expire. Either way the unit is leased
+// again, as it is after FAILED (the coordinator could not commit it).
+//
+// Each unit is merged into the results store exactly once. The first
+// result for a unit is fsynced to the journal (the commit point) and then
+// written to the store; later results for it are answered DUPLICATE. On
+// restart, committed units whose store writes may not have finished are
+// re-applied skipping records already present.
+class BulkCoordinator {
+public:
+    BulkCoordinator(const BulkJobOptions& options, ResultsPrimary& store);
+    ~BulkCoordinator();
+
+    BulkCoordinator(const BulkCoordinator&) = delete;
+    BulkCoordinator& operator=(const BulkCoordinator&) = delete;
+
+    void start();
+    void stop();
+
+    bool finished() const { return leases_->finished(); }
+    BulkJobProgress progress() const;
+    std::uint16_t port() const { return port_; }
+
+private:
+    struct Connection;
+
+    void recover_journal();
+    void accept_loop();
+    void serve(std::shared_ptr<Connection> connection);
+    std::string handle_result(std::uint32_t unit, std::uint64_t token,
+                              const std::vector<ResultRecord>& records);
+    // Writes a committed unit's records to the store and journals that it
+    // is applied. `resume` is for units an earlier attempt may have
+    // written already: records the store holds are skipped.
+    void apply_unit(std::uint32_t unit, const std::vector<ResultRecord>& records, bool resume);
+    void retry_unapplied();
+    // Appends to the journal; on failure the file is cut back to its last
+    // complete entry, so a torn block never sits in front of later ones.
+    void journal_line(const std::string& text, bool sync);
+
+    BulkJobOptions options_;
+    ResultsPrimary& store_;
+    std::vector<std::string> items_;
+    std::unique_ptr<LeaseTable> leases_;
+
+    // Serialises journal appends; held across their fsync, but nothing
+    // else waits on it.
+    std::mutex journal_mutex_;
+    int journal_fd_ = -1;
+    std::uint64_t journal_size_ = 0;
+    // Guards committing_ and unapplied_ only, never held across I/O.
+    mutable std::mutex commit_mutex_;
+    // Units whose result is being committed; another result for one of
+    // them is a duplicate unless that commit fails.
+    std::set<std::uint32_t> committing_;
+    std::map<std::uint32_t, std::vector<ResultRecord>> unapplied_;
+
+    int listen_fd_ = -1;
+    std::uint16_t port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread accept_thread_;
+    mutable std::mutex connections_mutex_;
+    std::vector<std::shared_ptr<Connection>> connections_;
+    std::uint64_t next_holder_ = 1;
+
+    std::atomic<std::uint64_t> results_merged_{0};
+    std::atomic<std::uint64_t> duplicates_{0};
+    std::atomic<std::uint64_t> failed_{0};
+};
+
+}  // namespace probionis
@@ -0,0 +1,178 @@
+#include "bulk/bulk_worker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "net/socket.h"
+#include "storage/results_service.h"
+
+namespace probionis {
+
+namespace {
+
+// One request/reply at a time on the shared connection; the heartbeat
+// thread and the scoring loop both go through here.
+class CoordinatorChannel {
+public:
+    explicit CoordinatorChannel(LineSocket socket) : socket_(std::move(socket)) {}
+
+    // Sends `request` and reads the one-line reply. False on a broken
+    // connection.
+    bool call(const std::string& request, std::string& reply) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return socket_.write(request) && socket_.read_line(reply);
+    }
+
+    // As call(), also reading the input paths that follow a UNIT reply.
+    bool call_with_payload(const std::string& request, std::string& reply,
+                           std::vector<std::string>& payload) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!socket_.write(request) || !socket_.read_line(reply)) {
+            return false;
+        }
+        payload.clear();
+        std::istringstream words(reply);
+        std::string kind;
+        std::uint64_t id = 0, token = 0, lease_ms = 0, count = 0;
+        words >> kind >> id >> token >> lease_ms >> count;
+        if (kind != "UNIT") {
+            return true;
+        }
+        std::string line;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            if (!socket_.read_line(line)) {
+                return false;
+            }
+            payload.push_back(line);
+        }
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    LineSocket socket_;
+};
+
+// Renews a lease every `period` for as long as it is alive.
+class LeaseHeartbeat {
+public:
+    LeaseHeartbeat(CoordinatorChannel& channel, std::string lease, std::chrono::milliseconds period)
+        : thread_([this, &channel, lease = std::move(lease), period] {
+              std::unique_lock<std::mutex> lock(mutex_);
+              while (!cv_.wait_for(lock, period, [this] { return done_; })) {
+                  lock.unlock();
+                  std::string reply;
+                  if (!channel.call("RENEW " + lease + "\n", reply) || reply != "OK") {
+                      lost_.store(true);
+                  }
+                  lock.lock();
+              }
+          }) {}
+
+    ~LeaseHeartbeat() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    bool lost() const { return lost_.load(); }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    std::atomic<bool> lost_{false};
+    std::thread thread_;
+};
+
+}  // namespace
+
+BulkWorker::BulkWorker(BulkWorkerOptions options, UnitScorer scorer)
+    : options_(std::move(options)), scorer_(std::move(scorer)) {
+    if (!scorer_) {
+        throw std::invalid_argument("BulkWorker: null scorer");
+    }
+}
+
+BulkWorkerStats BulkWorker::run() {
+    BulkWorkerStats stats;
+    while (!stopping_.load()) {
+        const int fd = tcp_connect(options_.coordinator_host, options_.coordinator_port, 0);
+        if (fd < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options_.reconnect_ms));
+            continue;
+        }
+        CoordinatorChannel channel{LineSocket(fd)};
+        std::string reply;
+        std::vector<std::string> inputs;
+        while (!stopping_.load()) {
+            if (!channel.call_with_payload("LEASE\n", reply, inputs)) {
+                break;
+            }
+            std::istringstream words(reply);
+            std::string kind;
+            words >> kind;
+            if (kind == "DONE") {
+                return stats;
+            }
+            if (kind == "WAIT") {
+                int wait_ms = 0;
+                words >> wait_ms;
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::max(wait_ms, 1)));
+                continue;
+            }
+            if (kind != "UNIT") {
+                break;
+            }
+            std::uint64_t unit = 0, token = 0, lease_ms = 0;
+            words >> unit >> token >> lease_ms;
+            const std::string lease = std::to_string(unit) + " " + std::to_string(token);
+
+            std::vector<ResultRecord> results;
+            {
+                const std::chrono::milliseconds period(std::max<std::uint64_t>(lease_ms / 3, 1));
+                LeaseHeartbeat heartbeat(channel, lease, period);
+                results = scorer_(inputs);
+                stats.lost_leases += heartbeat.lost() ? 1 : 0;
+            }
+
+            // Submitted even if the lease was lost: the coordinator merges it
+            // unless another worker's copy got there first.
+            std::string request = "RESULT " + lease + " " + std::to_string(results.size()) + "\n";
+            for (const ResultRecord& record : results) {
+                request += format_result_line(record);
+            }
+            if (!channel.call(request, reply)) {
+                break;
+            }
+            if (reply == "OK") {
+                ++stats.units;
+                stats.results += results.size();
+            } else if (reply == "DUPLICATE") {
+                ++stats.duplicates;
+            } else if (reply.compare(0, 6, "FAILED") == 0) {
+                // The coordinator could not commit it and leases it again.
+                ++stats.failed;
+            } else {
+                throw std::runtime_error("bulk coordinator rejected results: " + reply);
+            }
+        }
+        if (!stopping_.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options_.reconnect_ms));
+        }
+    }
+    return stats;
+}
+
+}  // namespace probionis
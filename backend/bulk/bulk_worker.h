@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "storage/results_store.h"
+
+namespace probionis {
+
+// Scores one unit: reads and preprocesses `inputs` and runs the model,
+// returning one record per scored sample. Inputs that cannot be read are
+// left out rather than failing the unit.
+using UnitScorer = std::function<std::vector<ResultRecord>(const std::vector<std::string>& inputs)>;
+
+struct BulkWorkerOptions {
+    std::string coordinator_host = "127.0.0.1";
+    std::uint16_t coordinator_port = 9500;
+    // Delay before reconnecting after the coordinator goes away; the
+    // worker keeps retrying until stop() or a DONE reply.
+    int reconnect_ms = 1000;
+};
+
+struct BulkWorkerStats {
+    std::uint64_t units = 0;
+    std::uint64_t results = 0;
+    std::uint64_t duplicates = 0;
+    // Units the coordinator could not commit; they are scored again.
+    std::uint64_t failed = 0;
+    std::uint64_t lost_leases = 0;
+};
+
+// Worker side of the bulk-scoring protocol (see BulkCoordinator). The
+// process that hosts the model supplies the UnitScorer and calls run();
+// tools/probionis_bulk_worker.cpp is the stock one. Run one per process or
+// per core; throughput scales with the number of workers because each
+// pulls units independently. While a unit is being scored a heartbeat
+// thread renews its lease at a third of the lease period.
+class BulkWorker {
+public:
+    BulkWorker(BulkWorkerOptions options, UnitScorer scorer);
+
+    // Leases and scores units until the coordinator reports DONE or stop()
+    // is called.
+    BulkWorkerStats run();
+    void stop() { stopping_.store(true); }
+
+private:
+    BulkWorkerOptions options_;
+    UnitScorer scorer_;
+    std::atomic<bool> stopping_{false};
+};
+
+}  // namespace probionis
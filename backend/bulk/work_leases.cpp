@@ -0,0 +1,121 @@
+#include "bulk/work_leases.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace probionis {
+
+LeaseTable::LeaseTable(std::size_t items, std::size_t unit_size,
+                       std::chrono::milliseconds duration)
+    : duration_(duration) {
+    if (unit_size == 0 || duration.count() <= 0) {
+        throw std::invalid_argument("LeaseTable: unit size and lease duration must be positive");
+    }
+    for (std::size_t begin = 0; begin < items; begin += unit_size) {
+        Entry entry;
+        entry.unit.id = static_cast<std::uint32_t>(units_.size());
+        entry.unit.begin = begin;
+        entry.unit.end = std::min(items, begin + unit_size);
+        units_.push_back(entry);
+    }
+}
+
+std::optional<Lease> LeaseTable::acquire(std::uint64_t holder, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* chosen = nullptr;
+    while (next_pending_ < units_.size() && units_[next_pending_].state != State::kPending) {
+        ++next_pending_;
+    }
+    if (next_pending_ < units_.size()) {
+        chosen = &units_[next_pending_++];
+    } else {
+        // Nothing fresh left: take over the lease that expired first.
+        for (Entry& entry : units_) {
+            if (entry.state == State::kLeased && entry.expires <= now &&
+                (!chosen || entry.expires < chosen->expires)) {
+                chosen = &entry;
+            }
+        }
+        if (!chosen) {
+            return std::nullopt;
+        }
+        ++reclaimed_;
+    }
+    chosen->state = State::kLeased;
+    chosen->token = next_token_++;
+    chosen->holder = holder;
+    chosen->expires = now + duration_;
+    return Lease{chosen->unit, chosen->token};
+}
+
+bool LeaseTable::renew(std::uint32_t unit, std::uint64_t token, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unit >= units_.size()) {
+        return false;
+    }
+    Entry& entry = units_[unit];
+    if (entry.state != State::kLeased || entry.token != token) {
+        return false;
+    }
+    entry.expires = now + duration_;
+    return true;
+}
+
+void LeaseTable::release_holder(std::uint64_t holder) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry& entry : units_) {
+        if (entry.state == State::kLeased && entry.holder == holder) {
+            entry.state = State::kPending;
+            ++reclaimed_;
+            next_pending_ = std::min<std::size_t>(next_pending_, entry.unit.id);
+        }
+    }
+}
+
+void LeaseTable::release(std::uint32_t unit, std::uint64_t token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unit >= units_.size()) {
+        return;
+    }
+    Entry& entry = units_[unit];
+    if (entry.state == State::kLeased && entry.token == token) {
+        entry.state = State::kPending;
+        ++reclaimed_;
+        next_pending_ = std::min<std::size_t>(next_pending_, entry.unit.id);
+    }
+}
+
+bool LeaseTable::is_done(std::uint32_t unit) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return unit < units_.size() && units_[unit].state == State::kDone;
+}
+
+bool LeaseTable::mark_done(std::uint32_t unit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unit >= units_.size() || units_[unit].state == State::kDone) {
+        return false;
+    }
+    units_[unit].state = State::kDone;
+    ++done_;
+    return true;
+}
+
+bool LeaseTable::finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_ == units_.size();
+}
+
+LeaseStats LeaseTable::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LeaseStats stats;
+    stats.units = units_.size();
+    stats.done = done_;
+    stats.reclaimed = reclaimed_;
+    for (const Entry& entry : units_) {
+        stats.pending += entry.state == State::kPending ? 1 : 0;
+        stats.leased += entry.state == State::kLeased ? 1 : 0;
+    }
+    return stats;
+}
+
+}  // namespace probionis
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace probionis {
+
+// A contiguous range [begin, end) of archive items scored as one unit.
+struct WorkUnit {
+    std::uint32_t id = 0;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+struct Lease {
+    WorkUnit unit;
+    // Changes every time the unit is handed out, so a renewal from a worker
+    // whose lease already moved on is recognised.
+    std::uint64_t token = 0;
+};
+
+struct LeaseStats {
+    std::size_t units = 0;
+    std::size_t pending = 0;
+    std::size_t leased = 0;
+    std::size_t done = 0;
+    // Leases that expired or whose holder disconnected.
+    std::uint64_t reclaimed = 0;
+};
+
+// Lease bookkeeping for one bulk job. Units are handed out lowest ID first;
+// a lease not renewed within the lease duration, or whose holder is
+// released, makes the unit available again. Completion is tracked here but
+// made durable by the caller.
+class LeaseTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    LeaseTable(std::size_t items, std::size_t unit_size, std::chrono::milliseconds duration);
+
+    // Leases the next available unit to `holder`, or nullopt if every
+    // remaining unit is leased (or everything is done).
+    std::optional<Lease> acquire(std::uint64_t holder, Clock::time_point now);
+    // Extends a live lease; false if `token` no longer holds the unit.
+    bool renew(std::uint32_t unit, std::uint64_t token, Clock::time_point now);
+    // Returns every unit held by `holder` to the pending pool.
+    void release_holder(std::uint64_t holder);
+    // Returns `unit` to the pending pool if `token` still holds it.
+    void release(std::uint32_t unit, std::uint64_t token);
+
+    bool is_done(std::uint32_t unit) const;
+    // Marks the unit done whoever holds it; false if it already was.
+    bool mark_done(std::uint32_t unit);
+
+    bool finished() const;
+    LeaseStats stats() const;
+    std::size_t unit_count() const { return units_.size(); }
+    WorkUnit unit(std::uint32_t id) const { return units_[id].unit; }
+    std::chrono::milliseconds duration() const { return duration_; }
+
+private:
+    enum class State : std::uint8_t { kPending, kLeased, kDone };
+
+    struct Entry {
+        WorkUnit unit;
+        State state = State::kPending;
+        std::uint64_t token = 0;
+        std::uint64_t holder = 0;
+        Clock::time_point expires;
+    };
+
+    std::chrono::milliseconds duration_;
+    mutable std::mutex mutex_;
+    std::vector<Entry> units_;
+    std::size_t next_pending_ = 0;  // no pending unit below this index
+    std::size_t done_ = 0;
+    std::uint64_t next_token_ = 1;
+    std::uint64_t reclaimed_ = 0;
+};
+
+}  // namespace probionis
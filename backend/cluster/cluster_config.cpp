@@ -0,0 +1,140 @@
+#include "cluster/cluster_config.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace probionis {
+
+namespace {
+
+[[noreturn]] void config_error(std::size_t line, const std::string& message) {
+    throw std::runtime_error("cluster config line " + std::to_string(line) + ": " + message);
+}
+
+long parse_number(const std::string& token, std::size_t line, long min, long max) {
+    std::size_t used = 0;
+    long value = 0;
+    try {
+        value = std::stol(token, &used);
+    } catch (const std::exception&) {
+        config_error(line, "expected a number, got '" + token + "'");
+    }
+    if (used != token.size() || value < min || value > max) {
+        config_error(line, "value out of range: '" + token + "'");
+    }
+    return value;
+}
+
+}  // namespace
+
+const char* shard_key_name(ShardKey key) {
+    return key == ShardKey::kTenant ? "tenant" : "sample";
+}
+
+ClusterConfig parse_cluster_config(const std::string& text) {
+    ClusterConfig config;
+    std::istringstream in(text);
+    std::string raw;
+    std::size_t line = 0;
+    while (std::getline(in, raw)) {
+        ++line;
+        const std::size_t hash = raw.find('#');
+        if (hash != std::string::npos) {
+            raw.resize(hash);
+        }
+        std::istringstream fields(raw);
+        std::vector<std::string> tokens;
+        for (std::string token; fields >> token;) {
+            tokens.push_back(token);
+        }
+        if (tokens.empty()) {
+            continue;
+        }
+        const std::string& key = tokens[0];
+        if (key == "node") {
+            if (tokens.size() < 3 || tokens.size() > 4) {
+                config_error(line, "expected: node ID HOST:PORT [WEIGHT]");
+            }
+            ClusterNode node;
+            node.id = tokens[1];
+            const std::size_t colon = tokens[2].rfind(':');
+            if (colon == std::string::npos || colon == 0) {
+                config_error(line, "expected HOST:PORT, got '" + tokens[2] + "'");
+            }
+            node.host = tokens[2].substr(0, colon);
+            node.port = static_cast<std::uint16_t>(
+                parse_number(tokens[2].substr(colon + 1), line, 1, 65535));
+            if (tokens.size() == 4) {
+                node.weight = static_cast<std::size_t>(parse_number(tokens[3], line, 1, 64));
+            }
+            for (const auto& existing : config.nodes) {
+                if (existing.id == node.id) {
+                    config_error(line, "duplicate node '" + node.id + "'");
+                }
+            }
+            config.nodes.push_back(std::move(node));
+            continue;
+        }
+        if (tokens.size() != 2) {
+            config_error(line, "expected: " + key + " VALUE");
+        }
+        const std::string& value = tokens[1];
+        if (key == "shard_key") {
+            if (value == "tenant") {
+                config.shard_key = ShardKey::kTenant;
+            } else if (value == "sample") {
+                config.shard_key = ShardKey::kSample;
+            } else {
+                config_error(line, "shard_key must be 'tenant' or 'sample'");
+            }
+        } else if (key == "virtual_nodes") {
+            config.virtual_nodes = static_cast<std::size_t>(parse_number(value, line, 1, 4096));
+        } else if (key == "attempts") {
+            config.attempts = static_cast<std::size_t>(parse_number(value, line, 1, 16));
+        } else if (key == "health_interval_ms") {
+            config.health_interval_ms = static_cast<int>(parse_number(value, line, 10, 600000));
+        } else if (key == "request_timeout_ms") {
+            config.request_timeout_ms = static_cast<int>(parse_number(value, line, 1, 600000));
+        } else if (key == "unhealthy_after") {
+            config.unhealthy_after = static_cast<int>(parse_number(value, line, 1, 100));
+        } else if (key == "healthy_after") {
+            config.healthy_after = static_cast<int>(parse_number(value, line, 1, 100));
+        } else {
+            config_error(line, "unknown setting '" + key + "'");
+        }
+    }
+    if (config.nodes.empty()) {
+        throw std::runtime_error("cluster config: no nodes");
+    }
+    return config;
+}
+
+ClusterConfig load_cluster_config(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open cluster config " + path);
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse_cluster_config(text.str());
+}
+
+ClusterConfig local_cluster_config(std::size_t count, std::uint16_t base_port) {
+    if (count == 0 || base_port + count > 65536) {
+        throw std::invalid_argument("local_cluster_config: bad node count or port range");
+    }
+    ClusterConfig config;
+    for (std::size_t i = 0; i < count; ++i) {
+        ClusterNode node;
+        node.id = "node-" + std::to_string(i);
+        node.host = "127.0.0.1";
+        node.port = static_cast<std::uint16_t>(base_port + i);
+        config.nodes.push_back(std::move(node));
+    }
+    // Local processes come and go quickly under test; notice it sooner.
+    config.health_interval_ms = 250;
+    return config;
+}
+
+}  // namespace probionis
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace probionis {
+
+struct ClusterNode {
+    std::string id;
+    std::string host;
+    std::uint16_t port = 0;
+    std::size_t weight = 1;
+};
+
+// Which request attribute decides the owning node. Sharding by tenant keeps
+// a hospital's requests (and its cache entries) on one node; sharding by
+// sample spreads a single large tenant across the cluster.
+enum class ShardKey : std::uint8_t { kSample, kTenant };
+
+struct ClusterConfig {
+    std::vector<ClusterNode> nodes;
+    ShardKey shard_key = ShardKey::kSample;
+    std::size_t virtual_nodes = 128;
+    // Nodes tried per request: the owner plus failover successors.
+    std::size_t attempts = 2;
+    int health_interval_ms = 1000;
+    int request_timeout_ms = 10000;
+    // Consecutive failed probes before a node is taken out of rotation, and
+    // consecutive good ones before it is put back.
+    int unhealthy_after = 2;
+    int healthy_after = 2;
+};
+
+// Parses the static membership file every router reads; there is no
+// coordination service, so all routers must be given the same file.
+//
+//   # comment
+//   shard_key tenant            # or: sample
+//   virtual_nodes 128
+//   attempts 2
+//   health_interval_ms 1000
+//   request_timeout_ms 10000
+//   node n1 10.0.0.5:8080 [weight]
+//
+// Throws std::runtime_error with the offending line number.
+ClusterConfig parse_cluster_config(const std::string& text);
+ClusterConfig load_cluster_config(const std::string& path);
+
+// Membership for `count` nodes on 127.0.0.1 at consecutive ports starting
+// at `base_port`, IDs node-0 .. node-(count-1): the local multi-process
+// test layout.
+ClusterConfig local_cluster_config(std::size_t count, std::uint16_t base_port);
+
+const char* shard_key_name(ShardKey key);
+
+}  // namespace probionis
@@ -0,0 +1,112 @@
+#include "cluster/hash_ring.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+const std::string kNoNode;
+
+// FNV-1a alone clusters short, similar keys ("node-1#0", "node-1#1");
+// a splitmix finaliser spreads them over the whole ring.
+std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}  // namespace
+
+HashRing::HashRing(std::size_t virtual_nodes) : virtual_nodes_(virtual_nodes) {
+    if (virtual_nodes == 0) {
+        throw std::invalid_argument("HashRing: virtual_nodes must be positive");
+    }
+}
+
+std::uint64_t HashRing::hash_key(const std::string& key) {
+    return mix(fnv1a64(key.data(), key.size()));
+}
+
+void HashRing::add_node(const std::string& node, std::size_t weight) {
+    if (node.empty() || weight == 0) {
+        throw std::invalid_argument("HashRing::add_node: empty node or zero weight");
+    }
+    if (contains(node)) {
+        throw std::invalid_argument("HashRing::add_node: duplicate node " + node);
+    }
+    nodes_.push_back(node);
+    weights_.push_back(weight);
+    rebuild();
+}
+
+void HashRing::remove_node(const std::string& node) {
+    const auto it = std::find(nodes_.begin(), nodes_.end(), node);
+    if (it == nodes_.end()) {
+        return;
+    }
+    weights_.erase(weights_.begin() + (it - nodes_.begin()));
+    nodes_.erase(it);
+    rebuild();
+}
+
+bool HashRing::contains(const std::string& node) const {
+    return std::find(nodes_.begin(), nodes_.end(), node) != nodes_.end();
+}
+
+void HashRing::rebuild() {
+    points_.clear();
+    for (std::size_t n = 0; n < nodes_.size(); ++n) {
+        const std::size_t replicas = virtual_nodes_ * weights_[n];
+        for (std::size_t r = 0; r < replicas; ++r) {
+            const std::string label = nodes_[n] + "#" + std::to_string(r);
+            points_.push_back({hash_key(label), static_cast<std::uint32_t>(n)});
+        }
+    }
+    // Ties (vanishingly rare) are broken by node ID so every process that
+    // builds the ring from the same membership agrees on ownership.
+    std::sort(points_.begin(), points_.end(), [this](const Point& a, const Point& b) {
+        return a.hash != b.hash ? a.hash < b.hash : nodes_[a.node] < nodes_[b.node];
+    });
+}
+
+std::size_t HashRing::first_point(std::uint64_t hash) const {
+    const auto it = std::lower_bound(points_.begin(), points_.end(), hash,
+                                     [](const Point& p, std::uint64_t h) { return p.hash < h; });
+    return it == points_.end() ? 0 : static_cast<std::size_t>(it - points_.begin());
+}
+
+const std::string& HashRing::owner(const std::string& key) const {
+    if (points_.empty()) {
+        return kNoNode;
+    }
+    return nodes_[points_[first_point(hash_key(key))].node];
+}
+
+std::vector<std::string> HashRing::preference_list(const std::string& key,
+                                                   std::size_t count) const {
+    std::vector<std::string> result;
+    if (points_.empty()) {
+        return result;
+    }
+    count = std::min(count, nodes_.size());
+    result.reserve(count);
+    std::vector<bool> taken(nodes_.size(), false);
+    const std::size_t start = first_point(hash_key(key));
+    for (std::size_t i = 0; i < points_.size() && result.size() < count; ++i) {
+        const std::uint32_t node = points_[(start + i) % points_.size()].node;
+        if (!taken[node]) {
+            taken[node] = true;
+            result.push_back(nodes_[node]);
+        }
+    }
+    return result;
+}
+
+}  // namespace probionis
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace probionis {
+
+// Consistent-hash ring over node IDs. Each node is placed at
+// `virtual_nodes * weight` points so load evens out and adding or removing
+// a node only moves the keys adjacent to its points (about 1/N of them).
+class HashRing {
+public:
+    explicit HashRing(std::size_t virtual_nodes = 128);
+
+    void add_node(const std::string& node, std::size_t weight = 1);
+    void remove_node(const std::string& node);
+    bool contains(const std::string& node) const;
+
+    // Owner of `key`; empty when the ring is empty.
+    const std::string& owner(const std::string& key) const;
+
+    // Up to `count` distinct nodes in ring order starting at the owner of
+    // `key`: the preference list requests fail over along.
+    std::vector<std::string> preference_list(const std::string& key, std::size_t count) const;
+
+    std::size_t node_count() const { return nodes_.size(); }
+    const std::vector<std::string>& nodes() const { return nodes_; }
+
+    static std::uint64_t hash_key(const std::string& key);
+
+private:
+    struct Point {
+        std::uint64_t hash;
+        std::uint32_t node;  // index into nodes_
+    };
+
+    std::size_t first_point(std::uint64_t hash) const;
+    void rebuild();
+
+    std::size_t virtual_nodes_;
+    std::vector<std::string> nodes_;
+    std::vector<std::size_t> weights_;
+    std::vector<Point> points_;  // sorted by hash
+};
+
+}  // namespace probionis
@@ -0,0 +1,333 @@
+#include "cluster/router.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <strings.h>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+// Idle connections kept per node; extra ones are closed on release.
+constexpr std::size_t kMaxIdleConnections = 64;
+
+bool is_idempotent(const HttpRequest& request) {
+    return request.method != "POST" ||
+           find_header(request.headers, kIdempotencyKeyHeader) != nullptr;
+}
+
+bool should_fail_over(int status, bool idempotent) {
+    // The node answered but cannot serve right now; another replica of the
+    // key may. A 503 is a refusal (overloaded, draining), while after a 502
+    // or 504 the node may have done the work, so only idempotent requests
+    // try again.
+    return status == 503 || (idempotent && (status == 502 || status == 504));
+}
+
+}  // namespace
+
+ClusterRouter::ClusterRouter(ClusterConfig config)
+    : config_(std::move(config)),
+      ring_(config_.virtual_nodes),
+      forwarded_(global_metrics().counter("probionis_cluster_forwarded_total",
+                                          "Requests forwarded to a backend node")),
+      failovers_(global_metrics().counter("probionis_cluster_failovers_total",
+                                          "Requests served by a node other than the key owner")),
+      unavailable_(global_metrics().counter("probionis_cluster_unavailable_total",
+                                            "Requests no node could serve")),
+      healthy_nodes_(global_metrics().gauge("probionis_cluster_healthy_nodes",
+                                            "Backend nodes currently in rotation")),
+      stale_retries_(global_metrics().counter(
+          "probionis_cluster_stale_retries_total",
+          "Requests re-sent after a pooled connection was found closed")) {
+    if (config_.nodes.empty()) {
+        throw std::invalid_argument("ClusterRouter: no nodes");
+    }
+    for (const auto& info : config_.nodes) {
+        ring_.add_node(info.id, info.weight);
+        node_index_.emplace(info.id, nodes_.size());
+        auto node = std::make_unique<Node>();
+        node->info = info;
+        nodes_.push_back(std::move(node));
+    }
+    publish_health();
+}
+
+ClusterRouter::~ClusterRouter() {
+    stop();
+}
+
+void ClusterRouter::start() {
+    std::lock_guard<std::mutex> lock(health_mutex_);
+    if (health_thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    health_thread_ = std::thread([this] { run_health_checks(); });
+}
+
+void ClusterRouter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(health_mutex_);
+        stopping_ = true;
+    }
+    health_cv_.notify_all();
+    if (health_thread_.joinable()) {
+        health_thread_.join();
+    }
+}
+
+std::string ClusterRouter::shard_key(const HttpRequest& request) const {
+    const bool tenant = config_.shard_key == ShardKey::kTenant;
+    if (const std::string* value = find_header(request.headers, tenant ? kTenantHeader
+                                                                       : kSampleHeader)) {
+        return *value;
+    }
+    return query_parameter(request.target, tenant ? "tenant" : "sample_id");
+}
+
+std::vector<std::size_t> ClusterRouter::candidates(const std::string& key) const {
+    const std::vector<std::string> preference = ring_.preference_list(key, nodes_.size());
+    std::vector<std::size_t> all;
+    std::vector<std::size_t> healthy;
+    all.reserve(preference.size());
+    for (const auto& id : preference) {
+        const std::size_t index = node_index_.at(id);
+        all.push_back(index);
+        if (nodes_[index]->healthy.load(std::memory_order_relaxed)) {
+            healthy.push_back(index);
+        }
+    }
+    std::vector<std::size_t>& chosen = healthy.empty() ? all : healthy;
+    if (chosen.size() > config_.attempts) {
+        chosen.resize(config_.attempts);
+    }
+    return chosen;
+}
+
+std::vector<std::string> ClusterRouter::route(const std::string& key) const {
+    std::vector<std::string> ids;
+    for (const std::size_t index : candidates(key)) {
+        ids.push_back(nodes_[index]->info.id);
+    }
+    return ids;
+}
+
+bool ClusterRouter::is_owner(const std::string& node_id, const std::string& key) const {
+    return ring_.owner(key) == node_id;
+}
+
+std::size_t ClusterRouter::least_loaded() const {
+    std::size_t best = 0;
+    bool best_healthy = false;
+    std::uint64_t best_load = 0;
+    for (std::size_t i = 0; i < nodes_.size(); ++i) {
+        const bool healthy = nodes_[i]->healthy.load(std::memory_order_relaxed);
+        const std::uint64_t load = nodes_[i]->forwarded.load(std::memory_order_relaxed);
+        if (i == 0 || (healthy && !best_healthy) || (healthy == best_healthy && load < best_load)) {
+            best = i;
+            best_healthy = healthy;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+void ClusterRouter::handle(const HttpRequest& request, HttpResponse& response) {
+    const std::string key = shard_key(request);
+    const std::vector<std::size_t> order =
+        key.empty() ? std::vector<std::size_t>{least_loaded()} : candidates(key);
+    const std::string owner = key.empty() ? std::string() : ring_.owner(key);
+    const bool idempotent = is_idempotent(request);
+
+    // A client could otherwise pose as the router and tell the node it owns
+    // a key it does not; only the router's own routing headers go through.
+    HttpHeaders headers;
+    headers.reserve(request.headers.size() + 2);
+    for (const auto& header : request.headers) {
+        if (strcasecmp(header.first.c_str(), kShardKeyHeader) != 0 &&
+            strcasecmp(header.first.c_str(), kRouteHeader) != 0) {
+            headers.push_back(header);
+        }
+    }
+    headers.emplace_back(kShardKeyHeader, key);
+    headers.emplace_back(kRouteHeader, "owner");
+
+    for (std::size_t attempt = 0; attempt < order.size(); ++attempt) {
+        Node& node = *nodes_[order[attempt]];
+        const bool failover = !key.empty() && node.info.id != owner;
+        headers.back().second = failover ? "failover" : "owner";
+
+        std::unique_ptr<HttpConnection> connection = acquire(node, !idempotent);
+        HttpResponse upstream;
+        if (!send(*connection, request, headers, idempotent, upstream)) {
+            record_failure(node);
+            if (idempotent || connection->failure() == HttpFailure::kConnect) {
+                continue;
+            }
+            // The node may have acted on it; sending it elsewhere could
+            // apply it twice.
+            unavailable_.add();
+            response.status = 502;
+            response.headers.clear();
+            response.headers.emplace_back("X-Probionis-Node", node.info.id);
+            response.body = "node failed while handling the request; not retried\n";
+            return;
+        }
+        record_success(node);
+        node.forwarded.fetch_add(1, std::memory_order_relaxed);
+        forwarded_.add();
+        if (should_fail_over(upstream.status, idempotent) && attempt + 1 < order.size()) {
+            // Error bodies are short; drain it so the connection can be reused.
+            connection->read_chunks([](const std::string&) { return true; });
+            release(node, std::move(connection));
+            continue;
+        }
+        if (failover) {
+            failovers_.add();
+        }
+        response.status = upstream.status;
+        response.headers = std::move(upstream.headers);
+        response.headers.emplace_back("X-Probionis-Node", node.info.id);
+        response.body = std::move(upstream.body);
+        if (!connection->body_pending()) {
+            release(node, std::move(connection));
+            return;
+        }
+        // Chunked replies (progressive scoring) are passed on piece by piece;
+        // the connection goes back to the pool once the body is through.
+        auto held = std::make_shared<std::unique_ptr<HttpConnection>>(std::move(connection));
+        response.stream = [this, &node, held](const HttpBodyWriter& write) {
+            if (!(*held)->read_chunks(write)) {
+                record_failure(node);
+                throw std::runtime_error("node closed the response early");
+            }
+            release(node, std::move(*held));
+        };
+        return;
+    }
+    unavailable_.add();
+    response.status = 503;
+    response.headers.clear();
+    response.body = "no backend node available for this request\n";
+}
+
+bool ClusterRouter::send(HttpConnection& connection, const HttpRequest& request,
+                         const HttpHeaders& headers, bool idempotent, HttpResponse& upstream) {
+    if (connection.exchange_head(request.method, request.target, headers, request.body,
+                                 upstream)) {
+        return true;
+    }
+    if (!idempotent || connection.failure() != HttpFailure::kStale) {
+        // A reset can also mean the node died after reading the request.
+        return false;
+    }
+    // The node closed an idle pooled connection before reading the request;
+    // that says nothing about its health. The connection reconnects on its
+    // own.
+    stale_retries_.add();
+    return connection.exchange_head(request.method, request.target, headers, request.body,
+                                    upstream);
+}
+
+std::unique_ptr<HttpConnection> ClusterRouter::acquire(Node& node, bool checked) {
+    {
+        std::lock_guard<std::mutex> lock(node.pool_mutex);
+        while (!node.idle.empty()) {
+            std::unique_ptr<HttpConnection> connection = std::move(node.idle.back());
+            node.idle.pop_back();
+            if (!checked || !connection->peer_gone()) {
+                return connection;
+            }
+        }
+    }
+    return std::make_unique<HttpConnection>(node.info.host, node.info.port,
+                                            config_.request_timeout_ms);
+}
+
+void ClusterRouter::release(Node& node, std::unique_ptr<HttpConnection> connection) {
+    std::lock_guard<std::mutex> lock(node.pool_mutex);
+    if (node.idle.size() < kMaxIdleConnections) {
+        node.idle.push_back(std::move(connection));
+    }
+}
+
+void ClusterRouter::record_success(Node& node) {
+    node.consecutive_failures.store(0, std::memory_order_relaxed);
+    if (!node.healthy.load(std::memory_order_relaxed) &&
+        node.consecutive_successes.fetch_add(1, std::memory_order_relaxed) + 1 >=
+            config_.healthy_after) {
+        node.healthy.store(true, std::memory_order_relaxed);
+        publish_health();
+    }
+}
+
+void ClusterRouter::record_failure(Node& node) {
+    node.failures.fetch_add(1, std::memory_order_relaxed);
+    node.consecutive_successes.store(0, std::memory_order_relaxed);
+    if (node.consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1 >=
+            config_.unhealthy_after &&
+        node.healthy.exchange(false, std::memory_order_relaxed)) {
+        // Pooled connections to a dead node would each fail once more.
+        std::lock_guard<std::mutex> lock(node.pool_mutex);
+        node.idle.clear();
+        publish_health();
+    }
+}
+
+void ClusterRouter::publish_health() {
+    std::size_t healthy = 0;
+    for (const auto& node : nodes_) {
+        healthy += node->healthy.load(std::memory_order_relaxed) ? 1 : 0;
+    }
+    healthy_nodes_.set(static_cast<double>(healthy));
+}
+
+void ClusterRouter::run_health_checks() {
+    // Probes use their own connections with a short timeout so a hung node
+    // is detected within one interval even while requests are in flight.
+    const int probe_timeout_ms = std::min(config_.health_interval_ms, 1000);
+    std::vector<std::unique_ptr<HttpConnection>> probes;
+    for (const auto& node : nodes_) {
+        probes.push_back(std::make_unique<HttpConnection>(node->info.host, node->info.port,
+                                                          probe_timeout_ms));
+    }
+    const HttpHeaders no_headers;
+    const std::string no_body;
+    HttpResponse response;
+    std::unique_lock<std::mutex> lock(health_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        for (std::size_t i = 0; i < nodes_.size(); ++i) {
+            const bool ok = probes[i]->exchange("GET", "/healthz", no_headers, no_body, response) &&
+                            response.status == 200;
+            if (ok) {
+                record_success(*nodes_[i]);
+            } else {
+                record_failure(*nodes_[i]);
+            }
+        }
+        lock.lock();
+        health_cv_.wait_for(lock, std::chrono::milliseconds(config_.health_interval_ms),
+                            [this] { return stopping_; });
+    }
+}
+
+std::vector<NodeStatus> ClusterRouter::status() const {
+    std::vector<NodeStatus> result;
+    result.reserve(nodes_.size());
+    for (const auto& node : nodes_) {
+        NodeStatus s;
+        s.id = node->info.id;
+        s.healthy = node->healthy.load(std::memory_order_relaxed);
+        s.forwarded = node->forwarded.load(std::memory_order_relaxed);
+        s.failures = node->failures.load(std::memory_order_relaxed);
+        result.push_back(std::move(s));
+    }
+    return result;
+}
+
+}  // namespace probionis
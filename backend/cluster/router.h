@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cluster/cluster_config.h"
+#include "cluster/hash_ring.h"
+#include "net/http.h"
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+// Request headers the router reads the shard key from; the query
+// parameters `tenant` and `sample_id` are accepted as well.
+inline constexpr const char* kTenantHeader = "X-Probionis-Tenant";
+inline constexpr const char* kSampleHeader = "X-Probionis-Sample-Id";
+// Set on forwarded requests: the key the router hashed, and whether the
+// receiving node is the key's owner ("owner") or a failover successor
+// ("failover"). Copies sent by the client are dropped first.
+inline constexpr const char* kShardKeyHeader = "X-Probionis-Shard-Key";
+inline constexpr const char* kRouteHeader = "X-Probionis-Route";
+// A client-chosen key marking a POST as safe to send twice; without it a
+// POST that may have reached a node is not re-sent to another.
+inline constexpr const char* kIdempotencyKeyHeader = "Idempotency-Key";
+
+struct NodeStatus {
+    std::string id;
+    bool healthy = true;
+    std::uint64_t forwarded = 0;
+    std::uint64_t failures = 0;
+};
+
+// Front-end that shards requests across backend nodes with a consistent
+// hash ring. Every router builds the same ring from the same static
+// membership, so any number of routers agree on ownership without talking
+// to each other or to a coordination service.
+//
+// Health is tracked two ways: a background thread probes GET /healthz on
+// every node, and transport failures while forwarding count against the
+// node immediately. Unhealthy nodes are skipped in the preference list, so
+// their keys move to the ring successor and come back when the node does.
+class ClusterRouter {
+public:
+    explicit ClusterRouter(ClusterConfig config);
+    ~ClusterRouter();
+
+    ClusterRouter(const ClusterRouter&) = delete;
+    ClusterRouter& operator=(const ClusterRouter&) = delete;
+
+    // Starts and stops the health-probe thread.
+    void start();
+    void stop();
+
+    // Shard key of `request` under the configured ShardKey; empty if the
+    // request carries none.
+    std::string shard_key(const HttpRequest& request) const;
+
+    // Nodes to try for `key`, owner first, healthy ones only. When every
+    // candidate is down the unfiltered list is returned so requests still
+    // probe for recovery instead of failing without trying.
+    std::vector<std::string> route(const std::string& key) const;
+
+    // HttpHandler entry point: forwards `request` along route(shard key)
+    // and passes back the first usable response, streaming chunked bodies
+    // through as they arrive. Requests without a key go to the healthy
+    // node with the fewest forwarded requests.
+    //
+    // A pooled connection the node had already closed is retried once on a
+    // new one without counting against the node. Failing over to the next
+    // node happens only when the request cannot have been processed: it was
+    // never sent, the node answered 503, or the request is idempotent (not
+    // a POST, or a POST carrying kIdempotencyKeyHeader).
+    void handle(const HttpRequest& request, HttpResponse& response);
+
+    // Whether `node_id` owns `key` on the full ring, ignoring health.
+    bool is_owner(const std::string& node_id, const std::string& key) const;
+
+    std::vector<NodeStatus> status() const;
+    const ClusterConfig& config() const { return config_; }
+
+private:
+    struct Node {
+        ClusterNode info;
+        std::atomic<bool> healthy{true};
+        std::atomic<int> consecutive_failures{0};
+        std::atomic<int> consecutive_successes{0};
+        std::atomic<std::uint64_t> forwarded{0};
+        std::atomic<std::uint64_t> failures{0};
+        std::mutex pool_mutex;
+        std::vector<std::unique_ptr<HttpConnection>> idle;
+    };
+
+    // Indices into nodes_ behind route().
+    std::vector<std::size_t> candidates(const std::string& key) const;
+    std::size_t least_loaded() const;
+    // A pooled connection if one is idle, else a new one. With `checked`,
+    // idle connections the node has already closed are dropped first, for
+    // requests that cannot be re-sent.
+    std::unique_ptr<HttpConnection> acquire(Node& node, bool checked);
+    void release(Node& node, std::unique_ptr<HttpConnection> connection);
+    // Sends the request and reads the reply head. An idempotent request is
+    // sent again, once, if its pooled connection turns out to have been
+    // closed by the node; anything else may have reached the node and is
+    // not.
+    bool send(HttpConnection& connection, const HttpRequest& request,
+              const HttpHeaders& headers, bool idempotent, HttpResponse& upstream);
+    void record_success(Node& node);
+    void record_failure(Node& node);
+    void run_health_checks();
+    void publish_health();
+
+    ClusterConfig config_;
+    HashRing ring_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::unordered_map<std::string, std::size_t> node_index_;
+
+    std::mutex health_mutex_;
+    std::condition_variable health_cv_;
+    bool stopping_ = false;
+    std::thread health_thread_;
+
+    Counter& forwarded_;
+    Counter& failovers_;
+    Counter& unavailable_;
+    Gauge& healthy_nodes_;
+    Counter& stale_retries_;
+};
+
+}  // namespace probionis
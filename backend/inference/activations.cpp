@@ -0,0 +1,58 @@
+#include "inference/activations.h"
+
+#include <algorithm>
+
+#include "runtime/vector_math.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr float kInvSqrt2 = 0.707106781186547524f;
+// Elements per pass of the two-pass layers, small enough to stay in L1.
+constexpr std::size_t kBlock = 1024;
+
+}  // namespace
+
+void sigmoid_inplace(float* x, std::size_t n) { vsigmoid(x, x, n); }
+
+void tanh_inplace(float* x, std::size_t n) { vtanh(x, x, n); }
+
+void gelu_inplace(float* x, std::size_t n) {
+    float scratch[kBlock];
+    for (std::size_t start = 0; start < n; start += kBlock) {
+        const std::size_t count = std::min(kBlock, n - start);
+        float* block = x + start;
+        for (std::size_t i = 0; i < count; ++i) {
+            scratch[i] = block[i] * kInvSqrt2;
+        }
+        verf(scratch, scratch, count);
+        for (std::size_t i = 0; i < count; ++i) {
+            block[i] = 0.5f * block[i] * (1.0f + scratch[i]);
+        }
+    }
+}
+
+void softmax_rows(float* x, std::size_t rows, std::size_t width, std::size_t stride) {
+    if (width == 0) {
+        return;
+    }
+    for (std::size_t r = 0; r < rows; ++r) {
+        float* row = x + r * stride;
+        const float peak = *std::max_element(row, row + width);
+        for (std::size_t i = 0; i < width; ++i) {
+            row[i] -= peak;
+        }
+        vexp(row, row, width);
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < width; ++i) {
+            sum += row[i];
+        }
+        const float scale = 1.0f / sum;
+        for (std::size_t i = 0; i < width; ++i) {
+            row[i] *= scale;
+        }
+    }
+}
+
+}  // namespace probionis
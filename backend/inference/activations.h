@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace probionis {
+
+// In-place activation layers over model buffers, built on the vector math
+// kernels so they run at memory bandwidth and give the same bits on every
+// ISA.
+void sigmoid_inplace(float* x, std::size_t n);
+void tanh_inplace(float* x, std::size_t n);
+// Exact GELU, x * (1 + erf(x / sqrt 2)) / 2, not the tanh approximation.
+void gelu_inplace(float* x, std::size_t n);
+// Softmax over each of `rows` rows of `width` values, `stride` floats apart.
+void softmax_rows(float* x, std::size_t rows, std::size_t width, std::size_t stride);
+
+}  // namespace probionis
@@ -0,0 +1,285 @@
+#include "inference/batch_scheduler.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+BatchSchedulerOptions latency_lane_options(BatchSchedulerOptions options) {
+    options.max_batch = 4;
+    options.max_delay = std::chrono::microseconds(250);
+    options.priority = TaskPriority::kInteractive;
+    return options;
+}
+
+BatchSchedulerOptions throughput_lane_options(BatchSchedulerOptions options) {
+    options.max_batch = 256;
+    options.max_delay = std::chrono::milliseconds(20);
+    options.priority = TaskPriority::kNormal;
+    return options;
+}
+
+BatchScheduler::BatchScheduler(BatchSchedulerOptions options, BatchHandler handler,
+                               Executor& executor, DeadlineTimer& timer)
+    : options_(std::move(options)),
+      handler_(std::move(handler)),
+      executor_(executor),
+      timer_(timer),
+      batches_(global_metrics().counter("probionis_batch_dispatched_total",
+                                        "Model batches dispatched from slabs")),
+      rows_(global_metrics().counter("probionis_batch_rows_total",
+                                     "Samples dispatched in model batches")),
+      abandoned_(global_metrics().counter("probionis_batch_abandoned_rows_total",
+                                          "Claimed batch rows released without a sample")),
+      deadline_seals_(global_metrics().counter("probionis_batch_deadline_seals_total",
+                                               "Batches sealed by max_delay before filling")),
+      failures_(global_metrics().counter("probionis_batch_failures_total",
+                                         "Batches whose preprocessing or model threw")),
+      qc_rejected_(global_metrics().counter("probionis_batch_qc_rejected_total",
+                                            "Claimed batch rows rejected by the QC gate")) {
+    if (options_.channels == 0 || options_.max_batch == 0 || options_.slabs == 0) {
+        throw std::invalid_argument(
+            "BatchScheduler: channels, max_batch and slabs must be positive");
+    }
+    if (!options_.axis.empty() && options_.axis.size() != options_.channels) {
+        throw std::invalid_argument("BatchScheduler: axis length mismatch");
+    }
+    limits_ = {options_.max_batch, options_.max_delay};
+    if (options_.tuner) {
+        // kInteractive batches run on the latency lane when there is one.
+        const std::size_t latency = executor_.lane_worker_count(ExecutionLane::kLatency);
+        options_.tuner->set_parallelism(
+            options_.priority == TaskPriority::kInteractive && latency > 0
+                ? latency
+                : executor_.lane_worker_count(ExecutionLane::kThroughput));
+        options_.tuner->cap_batch(options_.max_batch);
+        limits_ = options_.tuner->limits();
+    }
+    std::size_t row_multiple = options_.row_multiple;
+    if (options_.pipeline) {
+        row_multiple = std::max(row_multiple, options_.pipeline->row_multiple());
+    }
+    slabs_.reserve(options_.slabs);
+    for (std::size_t i = 0; i < options_.slabs; ++i) {
+        auto slab = std::make_unique<BatchSlab>(options_.max_batch, options_.channels,
+                                                row_multiple, options_.output_width);
+        if (!options_.axis.empty()) {
+            slab->batch().set_axis(options_.axis);
+        }
+        slab->set_on_ready([this](BatchSlab& s) { on_ready(s); });
+        slab->set_on_release([this](BatchSlab& s) { on_release(s); });
+        free_.push_back(slab.get());
+        slabs_.push_back(std::move(slab));
+    }
+}
+
+BatchScheduler::~BatchScheduler() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    BatchSlab* open = take_open_locked();
+    if (deadline_timer_ != 0 && timer_.cancel(deadline_timer_)) {
+        --deadlines_pending_;
+    }
+    slab_free_.notify_all();
+    lock.unlock();
+    if (open) {
+        open->seal();
+    }
+    lock.lock();
+    slab_free_.wait(lock, [this] {
+        return free_.size() == slabs_.size() && deadlines_pending_ == 0;
+    });
+}
+
+SlabSlot BatchScheduler::claim() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (stopping_) {
+            throw std::runtime_error("BatchScheduler: shutting down");
+        }
+        if (!open_) {
+            if (free_.empty()) {
+                // Another claimer may open a slab while we sleep; start over.
+                slab_free_.wait(lock);
+                continue;
+            }
+            open_ = free_.back();
+            free_.pop_back();
+            open_->reset();
+            ++open_generation_;
+            const Clock::time_point now = Clock::now();
+            opened_at_[open_] = now;
+            open_deadline_ = now + limits_.max_delay;
+            arm_deadline_locked();
+        }
+        bool last = false;
+        SlabSlot slot = open_->try_claim(limits_.max_batch, last);
+        if (!last) {
+            return slot;
+        }
+        BatchSlab* full = take_open_locked();
+        lock.unlock();
+        full->seal();
+        return slot;
+    }
+}
+
+QcResult BatchScheduler::commit(SlabSlot& slot, SlabTicket& ticket, std::string sample_id,
+                                std::string instrument_id) {
+    QcResult qc;
+    if (options_.pipeline) {
+        qc = options_.pipeline->screen(slot.data(), slot.channels());
+    }
+    if (!qc.ok()) {
+        qc_rejected_.add();
+        slot.abandon();
+        return qc;
+    }
+    ticket = slot.commit(std::move(sample_id), std::move(instrument_id));
+    return qc;
+}
+
+void BatchScheduler::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    BatchSlab* open = take_open_locked();
+    lock.unlock();
+    if (open) {
+        open->seal();
+    }
+}
+
+BatchSlab* BatchScheduler::take_open_locked() { return std::exchange(open_, nullptr); }
+
+void BatchScheduler::set_limits(const BatchLimits& limits) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    limits_.max_batch = std::clamp<std::size_t>(limits.max_batch, 1, options_.max_batch);
+    limits_.max_delay = limits.max_delay;
+    BatchSlab* full = nullptr;
+    if (open_) {
+        const Clock::time_point deadline = opened_at_[open_] + limits_.max_delay;
+        if (deadline < open_deadline_) {
+            open_deadline_ = deadline;
+            arm_deadline_locked();
+        }
+        // Claims fail once the limit is reached, so seal it here instead.
+        if (open_->claimed() >= limits_.max_batch) {
+            full = take_open_locked();
+        }
+    }
+    lock.unlock();
+    if (full) {
+        full->seal();
+    }
+}
+
+BatchLimits BatchScheduler::limits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limits_;
+}
+
+void BatchScheduler::arm_deadline_locked() {
+    // A callback already running finds its generation or deadline stale.
+    if (deadline_timer_ != 0 && timer_.cancel(deadline_timer_)) {
+        --deadlines_pending_;
+    }
+    ++deadlines_pending_;
+    const std::uint64_t generation = open_generation_;
+    deadline_timer_ =
+        timer_.schedule(open_deadline_, [this, generation] { on_deadline(generation); });
+}
+
+void BatchScheduler::on_deadline(std::uint64_t generation) {
+    // Runs on the timer thread; sealing only hands the batch to the
+    // executor.
+    std::unique_lock<std::mutex> lock(mutex_);
+    BatchSlab* expired = nullptr;
+    if (!stopping_ && open_ && generation == open_generation_ &&
+        Clock::now() >= open_deadline_) {
+        deadline_seals_.add();
+        expired = take_open_locked();
+    }
+    lock.unlock();
+    if (expired) {
+        expired->seal();
+    }
+    lock.lock();
+    if (--deadlines_pending_ == 0) {
+        slab_free_.notify_all();
+    }
+}
+
+void BatchScheduler::on_ready(BatchSlab& slab) {
+    // Called by whichever thread resolved the last row; the batch itself
+    // runs on the executor.
+    abandoned_.add(slab.abandoned());
+    if (slab.batch().size() == 0) {
+        slab.complete();
+        return;
+    }
+    executor_.submit(
+        [this, &slab] {
+            SpectrumBatch& batch = slab.batch();
+            const Clock::time_point started = Clock::now();
+            Clock::time_point opened = started;
+            if (options_.tuner) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                opened = opened_at_[&slab];
+            }
+            std::chrono::nanoseconds latency{0};
+            try {
+                // A step may have moved the slab's last batch onto another
+                // axis (calibration transfer); rows arrive on the shared one.
+                if (!options_.axis.empty() && batch.axis() != options_.axis) {
+                    batch.set_axis(options_.axis);
+                }
+                if (options_.pipeline) {
+                    options_.pipeline->run_batch(batch);
+                }
+                const Clock::time_point model_started = Clock::now();
+                handler_(batch, slab.outputs());
+                latency = Clock::now() - model_started;
+            } catch (const std::exception& e) {
+                failures_.add();
+                slab.fail(e.what());
+                return;
+            }
+            const Clock::time_point finished = Clock::now();
+            const std::size_t rows = batch.size();
+            batches_.add();
+            rows_.add(rows);
+            if (!options_.shadow && !options_.tuner) {
+                slab.complete();
+                return;
+            }
+            // Replies go out first. The extra hold keeps the slab, and the
+            // scheduler with it, alive for the follow-up work.
+            slab.retain();
+            slab.complete();
+            if (options_.shadow) {
+                try {
+                    options_.shadow->observe(batch, slab.outputs(), options_.output_width,
+                                             latency);
+                } catch (const std::exception&) {
+                    // Shadow scoring is best effort and never fails the batch.
+                }
+            }
+            if (options_.tuner) {
+                if (auto next = options_.tuner->observe(rows, started - opened,
+                                                        finished - started)) {
+                    set_limits(*next);
+                }
+            }
+            slab.release();
+        },
+        options_.priority);
+}
+
+void BatchScheduler::on_release(BatchSlab& slab) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(&slab);
+    slab_free_.notify_all();
+}
+
+}  // namespace probionis
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "inference/batch_tuner.h"
+#include "inference/shadow_evaluator.h"
+#include "preprocess/pipeline.h"
+#include "runtime/deadline_timer.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+#include "spectrum/batch_slab.h"
+
+namespace probionis {
+
+struct BatchSchedulerOptions {
+    std::size_t channels = 0;
+    // Row padding the pipeline and model kernels need; see
+    // Pipeline::row_multiple().
+    std::size_t row_multiple = SpectrumBatch::kRowMultiple;
+    // Model output floats per sample.
+    std::size_t output_width = 1;
+    // A slab is sealed once it holds this many rows (also the slab
+    // capacity, so the upper bound for set_limits())...
+    std::size_t max_batch = 64;
+    // ...or this long after its first claim, whichever comes first.
+    std::chrono::microseconds max_delay{2000};
+    // Slabs in the pool: one filling, the rest in flight. Claims wait when
+    // all of them are busy.
+    std::size_t slabs = 4;
+    // With a partitioned executor (ExecutorOptions::latency_threads), run
+    // one scheduler per lane; see latency_lane_options().
+    TaskPriority priority = TaskPriority::kNormal;
+    // Shared axis of every batch (channels values).
+    std::vector<float> axis;
+    // Run in place on each sealed batch before the handler, if set; its
+    // QC gate screens each row at commit().
+    std::shared_ptr<const Pipeline> pipeline;
+    // Receives every scored batch once its replies are out, if set.
+    std::shared_ptr<ShadowEvaluator> shadow;
+    // Sets max_batch and max_delay online from observed batches, if set;
+    // the scheduler caps the tuner at max_batch, gives it its lane's worker
+    // count as parallelism and starts from its limits.
+    std::shared_ptr<BatchTuner> tuner;
+};
+
+// Presets for the two schedulers of a partitioned executor
+// (ExecutorOptions::latency_threads), applied over `options`. The latency
+// lane seals batches of at most 4 rows within 250 us and runs them at
+// kInteractive on the reserved workers; the throughput lane fills batches
+// of up to 256 rows within 20 ms at kNormal on the rest. A tuner passed in
+// `options` overrides both limits, so give it the same bounds.
+BatchSchedulerOptions latency_lane_options(BatchSchedulerOptions options);
+BatchSchedulerOptions throughput_lane_options(BatchSchedulerOptions options);
+
+// Groups single-sample requests into model batches without copying them:
+// each request claims a row of the open slab, decodes its body straight
+// into it and commits it through the scheduler, and the sealed slab is
+// preprocessed and handed to the handler on the executor as is.
+//
+//     SlabSlot slot = scheduler.claim();
+//     decode_intensities(body.data(), body.size(), encoding, slot.data(), slot.channels());
+//     SlabTicket ticket;
+//     const QcResult qc = scheduler.commit(slot, ticket, sample_id, instrument_id);
+//     if (!qc.ok()) return reject(qc);  // 422; the rest of the batch is unaffected
+//     ticket.wait();
+//     respond(ticket.output(), ticket.output_width());
+class BatchScheduler {
+public:
+    // Seal deadlines run on `timer`, shared with other schedulers.
+    BatchScheduler(BatchSchedulerOptions options, BatchHandler handler,
+                   Executor& executor = shared_executor(),
+                   DeadlineTimer& timer = shared_timer());
+    // Seals the open slab and waits for every batch in flight.
+    ~BatchScheduler();
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    // Reserves a row in the open slab, waiting while every slab is busy.
+    SlabSlot claim();
+
+    // Screens the decoded row with the pipeline's QC gate, on the calling
+    // thread, and commits it into `ticket` if it passes. A rejected row is
+    // abandoned, so it never reaches the batch and cannot fail the requests
+    // it would have shared it with; `ticket` is left empty.
+    QcResult commit(SlabSlot& slot, SlabTicket& ticket, std::string sample_id,
+                    std::string instrument_id = {});
+
+    // Seals the open slab now instead of at its deadline.
+    void flush();
+
+    // Changes where slabs are sealed; max_batch is clamped to
+    // [1, options().max_batch]. The open slab is sealed at once if it
+    // already holds max_batch rows, and its deadline is brought forward if
+    // the new delay is shorter.
+    void set_limits(const BatchLimits& limits);
+    BatchLimits limits() const;
+
+    const BatchSchedulerOptions& options() const { return options_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Detaches the open slab; the caller seals it after unlocking, since
+    // sealing may release the slab back to the pool.
+    BatchSlab* take_open_locked();
+    // Replaces the pending deadline with one at open_deadline_.
+    void arm_deadline_locked();
+    void on_deadline(std::uint64_t generation);
+    void on_ready(BatchSlab& slab);
+    void on_release(BatchSlab& slab);
+
+    BatchSchedulerOptions options_;
+    BatchHandler handler_;
+    Executor& executor_;
+    DeadlineTimer& timer_;
+
+    std::vector<std::unique_ptr<BatchSlab>> slabs_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable slab_free_;
+    std::vector<BatchSlab*> free_;
+    BatchSlab* open_ = nullptr;
+    // Counts slab openings, so a deadline meant for an earlier fill of the
+    // same slab is recognised and ignored.
+    std::uint64_t open_generation_ = 0;
+    Clock::time_point open_deadline_;
+    DeadlineTimer::Id deadline_timer_ = 0;
+    // Deadline callbacks scheduled and not yet cancelled or finished; the
+    // destructor waits for them, since they use the scheduler.
+    std::size_t deadlines_pending_ = 0;
+    BatchLimits limits_;
+    // When each slab took its first claim, for queueing delay.
+    std::unordered_map<const BatchSlab*, Clock::time_point> opened_at_;
+    bool stopping_ = false;
+
+    Counter& batches_;
+    Counter& rows_;
+    Counter& abandoned_;
+    Counter& deadline_seals_;
+    Counter& failures_;
+    Counter& qc_rejected_;
+};
+
+}  // namespace probionis
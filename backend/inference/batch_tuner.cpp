@@ -0,0 +1,302 @@
+#include "inference/batch_tuner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace probionis {
+
+namespace {
+
+// Share of the p99 target a batch's deadline may spend; the rest absorbs
+// queueing and noise.
+constexpr double kHeadroom = 0.8;
+// Highest model utilization a decision accepts; beyond it the executor
+// queue grows without bound whatever the latency budget says.
+constexpr double kMaxUtilization = 0.9;
+// Weight of the newest batch in the per-size service time.
+constexpr double kServiceSmoothing = 0.2;
+// Samples per batch size that count fully in the fit.
+constexpr double kMaxFitWeight = 32.0;
+// Deadline as a multiple of the expected time to fill a batch.
+constexpr double kDeadlineSlack = 1.25;
+constexpr double kBudgetCut = 0.75;
+constexpr double kBudgetGrowth = 1.1;
+constexpr double kMinBudgetScale = 0.1;
+// Observed p99 below this fraction of the target lets the budget grow back.
+constexpr double kComfortable = 0.6;
+// Choices predicted this close to the fastest count as equally fast.
+constexpr double kNearlyFastest = 1.1;
+constexpr double kNearlyFastestUs = 50.0;
+
+double to_us(std::chrono::nanoseconds d) { return static_cast<double>(d.count()) / 1e3; }
+
+std::string labeled(const char* metric, const std::string& scheduler) {
+    return labeled_name(metric, "scheduler", scheduler);
+}
+
+}  // namespace
+
+BatchTuner::BatchTuner(BatchTunerOptions options)
+    : options_(options),
+      parallelism_(options.parallelism ? options.parallelism : 1),
+      min_batch_(options.min_batch),
+      max_batch_(options.max_batch),
+      window_start_(Clock::now()),
+      queue_delay_(global_metrics().histogram(
+          labeled("probionis_batch_queue_delay_us", options_.name), latency_buckets_us(),
+          "Wait of a batch's oldest row before the batch started, filling included")),
+      service_(global_metrics().histogram(labeled("probionis_batch_service_us", options_.name),
+                                          latency_buckets_us(),
+                                          "Preprocessing plus model time per batch")),
+      batch_gauge_(global_metrics().gauge(labeled("probionis_batch_tuner_max_batch",
+                                                  options_.name),
+                                          "Batch size limit chosen by the tuner")),
+      delay_gauge_(global_metrics().gauge(labeled("probionis_batch_tuner_max_delay_us",
+                                                  options_.name),
+                                          "Batching deadline chosen by the tuner")),
+      p99_gauge_(global_metrics().gauge(labeled("probionis_batch_tuner_observed_p99_us",
+                                                options_.name),
+                                        "Batch latency p99 over the last tuning window")),
+      predicted_gauge_(global_metrics().gauge(
+          labeled("probionis_batch_tuner_predicted_latency_us", options_.name),
+          "Latency the tuner predicted for the limits it chose")),
+      arrival_gauge_(global_metrics().gauge(
+          labeled("probionis_batch_tuner_arrival_rows_per_second", options_.name),
+          "Row arrival rate over the last tuning window")),
+      decisions_(global_metrics().counter(labeled("probionis_batch_tuner_decisions_total",
+                                                  options_.name),
+                                          "Tuning windows evaluated")),
+      raised_(global_metrics().counter(labeled("probionis_batch_tuner_raised_total",
+                                               options_.name),
+                                       "Decisions that raised the batch size limit")),
+      lowered_(global_metrics().counter(labeled("probionis_batch_tuner_lowered_total",
+                                                options_.name),
+                                        "Decisions that lowered the batch size limit")) {
+    if (options_.min_batch == 0 || options_.min_batch > options_.max_batch ||
+        options_.min_delay.count() <= 0 || options_.min_delay > options_.max_delay ||
+        options_.p99_target.count() <= 0 || options_.window == 0) {
+        throw std::invalid_argument("BatchTuner: inconsistent bounds");
+    }
+    limits_.max_batch = std::clamp(options_.max_batch / 4, options_.min_batch, options_.max_batch);
+    limits_.max_delay = std::clamp(std::chrono::microseconds{1000}, options_.min_delay,
+                                   options_.max_delay);
+    service_us_.assign(options_.max_batch + 1, 0.0);
+    service_count_.assign(options_.max_batch + 1, 0);
+    latency_us_.reserve(options_.window);
+    batch_gauge_.set(static_cast<double>(limits_.max_batch));
+    delay_gauge_.set(static_cast<double>(limits_.max_delay.count()));
+}
+
+BatchLimits BatchTuner::limits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limits_;
+}
+
+void BatchTuner::cap_batch(std::size_t cap) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_batch_ = std::clamp<std::size_t>(cap, 1, max_batch_);
+    min_batch_ = std::min(min_batch_, max_batch_);
+    limits_.max_batch = std::min(limits_.max_batch, max_batch_);
+    batch_gauge_.set(static_cast<double>(limits_.max_batch));
+}
+
+void BatchTuner::set_parallelism(std::size_t workers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (options_.parallelism == 0) {
+        parallelism_ = std::max<std::size_t>(1, workers);
+    }
+}
+
+std::size_t BatchTuner::parallelism() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return parallelism_;
+}
+
+std::optional<BatchLimits> BatchTuner::observe(std::size_t rows, std::chrono::nanoseconds queued,
+                                               std::chrono::nanoseconds service) {
+    const double queued_us = to_us(queued);
+    const double service_us = to_us(service);
+    queue_delay_.record(queued_us);
+    service_.record(service_us);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rows > 0) {
+        if (rows >= service_us_.size()) {
+            service_us_.resize(rows + 1, 0.0);
+            service_count_.resize(rows + 1, 0);
+        }
+        double& smoothed = service_us_[rows];
+        smoothed = service_count_[rows]++ == 0
+                       ? service_us
+                       : smoothed + kServiceSmoothing * (service_us - smoothed);
+    }
+    latency_us_.push_back(queued_us + service_us);
+    queued_us_sum_ += queued_us;
+    window_rows_ += rows;
+
+    const Clock::time_point now = Clock::now();
+    const bool full = latency_us_.size() >= options_.window;
+    const bool timed_out = now - window_start_ >= options_.interval &&
+                           latency_us_.size() >= std::max<std::size_t>(1, options_.window / 10);
+    if (!full && !timed_out) {
+        return std::nullopt;
+    }
+    return decide_locked(now);
+}
+
+void BatchTuner::fit_locked(double& a, double& c) const {
+    double sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+    std::size_t sizes = 0;
+    for (std::size_t b = 1; b < service_us_.size(); ++b) {
+        if (service_count_[b] == 0) {
+            continue;
+        }
+        const double w = std::min<double>(service_count_[b], kMaxFitWeight);
+        const double x = static_cast<double>(b);
+        const double y = service_us_[b];
+        sw += w;
+        sx += w * x;
+        sy += w * y;
+        sxx += w * x * x;
+        sxy += w * x * y;
+        ++sizes;
+    }
+    a = 0.0;
+    c = 0.0;
+    if (sizes == 0) {
+        return;
+    }
+    const double det = sw * sxx - sx * sx;
+    if (sizes >= 2 && det > 0.0) {
+        c = (sw * sxy - sx * sy) / det;
+        a = (sy - c * sx) / sw;
+    }
+    if (sizes < 2 || det <= 0.0 || a < 0.0) {
+        // One size seen, or a negative intercept: assume proportional cost,
+        // which never overstates what a bigger batch saves.
+        a = 0.0;
+        c = sxy / sxx;
+    } else if (c < 0.0) {
+        c = 0.0;
+        a = sy / sw;
+    }
+}
+
+std::optional<BatchLimits> BatchTuner::decide_locked(Clock::time_point now) {
+    const std::size_t n = latency_us_.size();
+    const double elapsed_us = std::max(1.0, to_us(now - window_start_));
+    // Rows per microsecond.
+    const double lambda = static_cast<double>(window_rows_) / elapsed_us;
+    const auto p99_at = latency_us_.begin() + static_cast<std::ptrdiff_t>(0.99 * (n - 1));
+    std::nth_element(latency_us_.begin(), p99_at, latency_us_.end());
+    const double p99 = *p99_at;
+    const double target = static_cast<double>(options_.p99_target.count());
+
+    double a = 0.0;
+    double c = 0.0;
+    fit_locked(a, c);
+    const double min_delay = static_cast<double>(options_.min_delay.count());
+    const double max_delay = static_cast<double>(options_.max_delay.count());
+
+    if (p99 > target) {
+        budget_scale_ = std::max(kMinBudgetScale, budget_scale_ * kBudgetCut);
+    } else if (p99 < kComfortable * target) {
+        budget_scale_ = std::min(1.0, budget_scale_ * kBudgetGrowth);
+    }
+    const double budget = target * kHeadroom * budget_scale_;
+
+    struct Choice {
+        std::size_t batch = 0;
+        double delay = 0.0;
+        double rows = 0.0;
+        double utilization = 0.0;
+        double queueing = 0.0;
+        double predicted = 0.0;
+    };
+    // Latency of the oldest row of a batch of `b`: filling, then queueing
+    // behind other batches (M/D/1 over the model's parallelism), then
+    // service. The deadline is long enough to fill the batch at the
+    // current rate, but never so long that filling alone spends the budget.
+    const auto evaluate = [&](std::size_t b, double delay, double extra) {
+        Choice choice;
+        choice.batch = b;
+        const double fill = b == 1 ? 0.0
+                            : lambda > 0.0 ? static_cast<double>(b - 1) / lambda
+                                           : max_delay;
+        choice.delay = delay > 0.0 ? delay
+                                   : std::clamp(std::min(fill * kDeadlineSlack, budget - a - c * b),
+                                                min_delay, max_delay);
+        choice.rows = std::min(static_cast<double>(b), 1.0 + lambda * choice.delay);
+        const double service = a + c * choice.rows;
+        choice.utilization =
+            lambda * service / choice.rows / static_cast<double>(parallelism_);
+        choice.queueing = choice.utilization < 1.0
+                              ? service * choice.utilization / (2.0 * (1.0 - choice.utilization))
+                              : HUGE_VAL;
+        choice.predicted = std::min(fill, choice.delay) + choice.queueing + extra + service;
+        return choice;
+    };
+
+    // Queueing the model does not explain (executor contention, other
+    // schedulers) is carried over to every choice.
+    const double mean_rows = static_cast<double>(window_rows_) / static_cast<double>(n);
+    const Choice now_choice =
+        evaluate(limits_.max_batch, static_cast<double>(limits_.max_delay.count()), 0.0);
+    const double fill_now =
+        lambda > 0.0 ? std::min(std::max(mean_rows - 1.0, 0.0) / lambda, now_choice.delay) : 0.0;
+    const double queueing_now = std::isfinite(now_choice.queueing) ? now_choice.queueing : 0.0;
+    const double extra =
+        std::max(0.0, queued_us_sum_ / static_cast<double>(n) - fill_now - queueing_now);
+
+    // Lowest predicted latency the model can sustain; among choices within
+    // a small margin of it, the largest batch, which costs the least CPU.
+    // If no size is sustainable, the largest, for throughput. The step from
+    // the current size is then limited, so one noisy window cannot swing it.
+    double fastest = HUGE_VAL;
+    std::size_t best = max_batch_;
+    std::vector<Choice> sustainable;
+    for (std::size_t b = min_batch_; b <= max_batch_; ++b) {
+        const Choice choice = evaluate(b, 0.0, extra);
+        if (choice.utilization <= kMaxUtilization) {
+            sustainable.push_back(choice);
+            fastest = std::min(fastest, choice.predicted);
+        }
+    }
+    for (const Choice& choice : sustainable) {
+        if (choice.predicted <= fastest * kNearlyFastest + kNearlyFastestUs) {
+            best = choice.batch;
+        }
+    }
+    best = std::clamp(best, std::max<std::size_t>(1, limits_.max_batch / 2),
+                      std::min(limits_.max_batch * 2, max_batch_));
+    const Choice chosen = evaluate(best, 0.0, extra);
+
+    const BatchLimits previous = limits_;
+    limits_.max_batch = chosen.batch;
+    limits_.max_delay = std::chrono::microseconds(static_cast<std::int64_t>(std::llround(
+        chosen.delay)));
+
+    decisions_.add();
+    if (limits_.max_batch > previous.max_batch) {
+        raised_.add();
+    } else if (limits_.max_batch < previous.max_batch) {
+        lowered_.add();
+    }
+    batch_gauge_.set(static_cast<double>(limits_.max_batch));
+    delay_gauge_.set(static_cast<double>(limits_.max_delay.count()));
+    p99_gauge_.set(p99);
+    predicted_gauge_.set(chosen.predicted);
+    arrival_gauge_.set(lambda * 1e6);
+
+    window_start_ = now;
+    latency_us_.clear();
+    queued_us_sum_ = 0.0;
+    window_rows_ = 0;
+    if (limits_ == previous) {
+        return std::nullopt;
+    }
+    return limits_;
+}
+
+}  // namespace probionis
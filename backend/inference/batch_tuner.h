@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+// Where a BatchScheduler seals a slab: at max_batch rows or max_delay
+// after its first claim.
+struct BatchLimits {
+    std::size_t max_batch = 0;
+    std::chrono::microseconds max_delay{0};
+
+    bool operator==(const BatchLimits& other) const {
+        return max_batch == other.max_batch && max_delay == other.max_delay;
+    }
+    bool operator!=(const BatchLimits& other) const { return !(*this == other); }
+};
+
+struct BatchTunerOptions {
+    // Labels the tuner's metrics, as `name{scheduler="<name>"}`; give the
+    // tuner of each scheduler its own.
+    std::string name = "default";
+    // Latency the oldest row of a batch should stay within, from its claim
+    // to its reply, at the 99th percentile.
+    std::chrono::microseconds p99_target{25000};
+    // Bounds the tuner never leaves. max_batch is further capped by the
+    // scheduler's slab capacity (see cap_batch()).
+    std::size_t min_batch = 1;
+    std::size_t max_batch = 64;
+    std::chrono::microseconds min_delay{100};
+    std::chrono::microseconds max_delay{10000};
+    // A decision is taken after this many batches, or after `interval`
+    // once at least a tenth of them have been seen.
+    std::size_t window = 128;
+    std::chrono::milliseconds interval{1000};
+    // Batches the model runs at once. 0 takes the worker count of the
+    // executor lane the scheduler's batches run on, which BatchScheduler
+    // passes to set_parallelism(); 1 until then.
+    std::size_t parallelism = 0;
+};
+
+// Feedback controller for a BatchScheduler's batch size and deadline.
+//
+// Every batch reports its size, how long its oldest row waited before the
+// batch started (filling plus executor queueing) and how long the batch
+// took. The tuner keeps a per-size service time, fits it as a + c * size,
+// and measures the arrival rate. Each decision predicts, per candidate
+// size, the oldest row's latency: time to fill the batch at the current
+// rate, queueing behind other batches at the resulting model utilization,
+// and service. It picks the fastest size the model can sustain, or a
+// larger one when that is nearly as fast, since bigger batches cost less
+// CPU per sample. Deadlines are just long enough to fill the chosen size
+// and may spend at most 80% of the p99 target, a budget that shrinks
+// while the observed p99 misses the target. Under low load this settles
+// on small batches and short deadlines; as load approaches capacity the
+// queueing term pushes the size up. Changes are limited to a factor of
+// two per decision.
+class BatchTuner {
+public:
+    explicit BatchTuner(BatchTunerOptions options = {});
+
+    BatchTuner(const BatchTuner&) = delete;
+    BatchTuner& operator=(const BatchTuner&) = delete;
+
+    // Current limits; the scheduler starts from these.
+    BatchLimits limits() const;
+
+    // Lowers the largest batch size considered to `cap`, the most rows a
+    // scheduler's slab holds, so decisions only pick sizes that can run.
+    // BatchScheduler calls it with its capacity.
+    void cap_batch(std::size_t cap);
+
+    // Workers that run the scheduler's batches; ignored when
+    // options().parallelism is set. BatchScheduler calls it with the
+    // worker count of its lane.
+    void set_parallelism(std::size_t workers);
+    std::size_t parallelism() const;
+
+    // Records one dispatched batch. Returns new limits when this batch
+    // completed a window and the decision changed them.
+    std::optional<BatchLimits> observe(std::size_t rows, std::chrono::nanoseconds queued,
+                                       std::chrono::nanoseconds service);
+
+    const BatchTunerOptions& options() const { return options_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::optional<BatchLimits> decide_locked(Clock::time_point now);
+    // Service time fit a + c * rows, in microseconds.
+    void fit_locked(double& a, double& c) const;
+
+    BatchTunerOptions options_;
+
+    mutable std::mutex mutex_;
+    std::size_t parallelism_;
+    // options_ batch bounds after cap_batch().
+    std::size_t min_batch_;
+    std::size_t max_batch_;
+    BatchLimits limits_;
+    // Scales the latency budget; below 1 after missed targets.
+    double budget_scale_ = 1.0;
+    // Smoothed service time and sample count per batch size.
+    std::vector<double> service_us_;
+    std::vector<std::uint32_t> service_count_;
+    // Current window.
+    Clock::time_point window_start_;
+    std::vector<double> latency_us_;
+    double queued_us_sum_ = 0.0;
+    std::size_t window_rows_ = 0;
+
+    Histogram& queue_delay_;
+    Histogram& service_;
+    Gauge& batch_gauge_;
+    Gauge& delay_gauge_;
+    Gauge& p99_gauge_;
+    Gauge& predicted_gauge_;
+    Gauge& arrival_gauge_;
+    Counter& decisions_;
+    Counter& raised_;
+    Counter& lowered_;
+};
+
+}  // namespace probionis
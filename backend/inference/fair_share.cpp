@@ -0,0 +1,140 @@
+#include "inference/fair_share.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+// Cost charged for a tenant's first task before any has been measured.
+constexpr double kInitialCostNs = 100e3;
+// Weight of the newest measurement in a tenant's expected task cost.
+constexpr double kCostSmoothing = 0.2;
+
+}  // namespace
+
+struct FairShareScheduler::Tenant {
+    std::string name;
+    int affinity = -1;
+    double share = 1.0;
+    // CPU nanoseconds per unit of share, charged at dispatch with the
+    // expected cost and corrected when the task finishes.
+    double virtual_time = 0.0;
+    double expected_ns = kInitialCostNs;
+    std::deque<Task> queue;
+    std::uint64_t cpu_ns = 0;
+    Counter* cpu_us = nullptr;
+};
+
+FairShareScheduler::FairShareScheduler(FairShareOptions options, Executor& executor)
+    : options_(options),
+      executor_(executor),
+      slots_(options.slots ? options.slots : std::max<std::size_t>(1, executor.worker_count())) {}
+
+FairShareScheduler::~FairShareScheduler() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return running_ == 0 && queued_ == 0; });
+}
+
+FairShareScheduler::Tenant& FairShareScheduler::tenant_locked(const std::string& name) {
+    auto& slot = tenants_[name];
+    if (!slot) {
+        slot = std::make_unique<Tenant>();
+        slot->name = name;
+        slot->affinity = static_cast<int>(fnv1a64(name.data(), name.size()) & 0x7fffffff);
+        slot->cpu_us = &global_metrics().counter(
+            labeled_name("probionis_tenant_cpu_us_total", "tenant", name),
+            "Thread CPU time used by a tenant's scoring tasks");
+    }
+    return *slot;
+}
+
+void FairShareScheduler::set_share(const std::string& tenant, double share) {
+    if (!(share > 0.0)) {
+        throw std::invalid_argument("FairShareScheduler::set_share: share must be positive");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    tenant_locked(tenant).share = share;
+}
+
+void FairShareScheduler::submit(const std::string& tenant, Task task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Tenant& t = tenant_locked(tenant);
+    if (t.queue.empty()) {
+        t.virtual_time = std::max(t.virtual_time, virtual_time_);
+        backlogged_.push_back(&t);
+    }
+    t.queue.push_back(std::move(task));
+    ++queued_;
+    dispatch_locked();
+}
+
+void FairShareScheduler::dispatch_locked() {
+    while (running_ < slots_ && !backlogged_.empty()) {
+        auto next = std::min_element(backlogged_.begin(), backlogged_.end(),
+                                     [](const Tenant* a, const Tenant* b) {
+                                         return a->virtual_time < b->virtual_time;
+                                     });
+        Tenant& t = **next;
+        Task task = std::move(t.queue.front());
+        t.queue.pop_front();
+        --queued_;
+        if (t.queue.empty()) {
+            *next = backlogged_.back();
+            backlogged_.pop_back();
+        }
+
+        virtual_time_ = std::max(virtual_time_, t.virtual_time);
+        const double expected = t.expected_ns;
+        t.virtual_time += expected / t.share;
+        ++running_;
+        executor_.submit(
+            [this, &t, expected, task = std::move(task)] {
+                // Helper chunks the task fans out (split GEMMs) run on other
+                // workers and are charged here, so splitting does not make a
+                // tenant's work look cheaper than it is.
+                CpuAccount helpers;
+                const std::uint64_t start = thread_cpu_ns();
+                try {
+                    ScopedCpuAccount scope(&helpers);
+                    task();
+                } catch (...) {
+                    finish(t, expected, thread_cpu_ns() - start + helpers.charged());
+                    throw;
+                }
+                finish(t, expected, thread_cpu_ns() - start + helpers.charged());
+            },
+            options_.priority, t.affinity);
+    }
+}
+
+void FairShareScheduler::finish(Tenant& tenant, double expected_ns, std::uint64_t cpu_ns) {
+    tenant.cpu_us->add(cpu_ns / 1000);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double actual = static_cast<double>(cpu_ns);
+    tenant.virtual_time += (actual - expected_ns) / tenant.share;
+    tenant.expected_ns += kCostSmoothing * (actual - tenant.expected_ns);
+    tenant.cpu_ns += cpu_ns;
+    --running_;
+    dispatch_locked();
+    if (running_ == 0 && queued_ == 0) {
+        idle_.notify_all();
+    }
+}
+
+std::uint64_t FairShareScheduler::cpu_ns(const std::string& tenant) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = tenants_.find(tenant);
+    return it == tenants_.end() ? 0 : it->second->cpu_ns;
+}
+
+std::size_t FairShareScheduler::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+}  // namespace probionis
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+struct FairShareOptions {
+    // Tasks running at once across all tenants. 0 means one per compute
+    // worker, so a tenant's backlog never sits in the executor ahead of
+    // another tenant's work.
+    std::size_t slots = 0;
+    TaskPriority priority = TaskPriority::kNormal;
+};
+
+// Splits executor time between tenants in proportion to their shares.
+// Tasks wait in per-tenant queues and are released to the executor, one
+// per free slot, from the tenant that has used the least CPU per unit of
+// share (start-time fair queueing on measured thread CPU time, including
+// CPU that helper threads charge to the task's CpuAccount). An idle
+// tenant is started level with the busiest rather than banking credit, so
+// a flood from one tenant delays the others by at most one task per slot.
+// Work-conserving: a lone tenant may use every slot.
+class FairShareScheduler {
+public:
+    explicit FairShareScheduler(FairShareOptions options = {},
+                                Executor& executor = shared_executor());
+    // Waits for queued and running tasks.
+    ~FairShareScheduler();
+
+    FairShareScheduler(const FairShareScheduler&) = delete;
+    FairShareScheduler& operator=(const FairShareScheduler&) = delete;
+
+    // Relative weight of `tenant`; unknown tenants get 1.
+    void set_share(const std::string& tenant, double share);
+    void submit(const std::string& tenant, Task task);
+
+    // CPU time consumed by `tenant`'s tasks so far, on any thread.
+    std::uint64_t cpu_ns(const std::string& tenant) const;
+    std::size_t queued() const;
+
+private:
+    struct Tenant;
+
+    Tenant& tenant_locked(const std::string& name);
+    void dispatch_locked();
+    void finish(Tenant& tenant, double expected_ns, std::uint64_t cpu_ns);
+
+    FairShareOptions options_;
+    Executor& executor_;
+    std::size_t slots_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::unordered_map<std::string, std::unique_ptr<Tenant>> tenants_;
+    // Tenants with queued tasks.
+    std::vector<Tenant*> backlogged_;
+    std::size_t running_ = 0;
+    std::size_t queued_ = 0;
+    // Start tag of the most recently dispatched task.
+    double virtual_time_ = 0.0;
+};
+
+}  // namespace probionis
@@ -0,0 +1,582 @@
+// Every ISA must give the same bits, so the kernels' mul + add pairs are
+// never fused, including those written with intrinsics.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "inference/gemm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace probionis {
+
+namespace {
+
+// Lane operations of the kernels; fmadd(a, b, c) = a * b + c, rounded
+// after the multiply and again after the add on every ISA. lookup16
+// and lookup256 read kWidth codebook indices (4-bit from an even column of
+// a packed row, or bytes) and return their codebook values.
+
+struct ScalarOps {
+    using V = float;
+    using Table16 = const float*;
+    static constexpr std::size_t kWidth = 1;
+
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V v) { *p = v; }
+    static V set(float v) { return v; }
+    static V fmadd(V a, V b, V c) { return a * b + c; }
+
+    static Table16 table16(const float* codebook) { return codebook; }
+    static V lookup16(Table16 table, const std::uint8_t* row, std::size_t column) {
+        return table[(row[column / 2] >> (column % 2 * 4)) & 0x0f];
+    }
+    static V lookup256(const float* codebook, const std::uint8_t* p) { return codebook[*p]; }
+};
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+// `count` bytes holding 2 * count nibbles -> one byte per nibble, in order.
+inline __m128i unpack_nibbles(__m128i bytes) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    return _mm_unpacklo_epi8(_mm_and_si128(bytes, mask),
+                             _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+}
+#endif
+
+#if defined(__AVX2__)
+struct Avx2Ops {
+    using V = __m256;
+    static constexpr std::size_t kWidth = 8;
+
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V set(float v) { return _mm256_set1_ps(v); }
+    static V fmadd(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+
+    // permutevar8x32 indexes 8 entries: look up in both halves and pick by
+    // bit 3 of the index.
+    struct Table16 {
+        __m256 low;
+        __m256 high;
+    };
+    static Table16 table16(const float* codebook) {
+        return {_mm256_loadu_ps(codebook), _mm256_loadu_ps(codebook + 8)};
+    }
+    static V lookup16(const Table16& table, const std::uint8_t* row, std::size_t column) {
+        std::int32_t packed;
+        std::memcpy(&packed, row + column / 2, sizeof(packed));
+        const __m256i index = _mm256_cvtepu8_epi32(unpack_nibbles(_mm_cvtsi32_si128(packed)));
+        return _mm256_blendv_ps(_mm256_permutevar8x32_ps(table.low, index),
+                                _mm256_permutevar8x32_ps(table.high, index),
+                                _mm256_castsi256_ps(_mm256_slli_epi32(index, 28)));
+    }
+    static V lookup256(const float* codebook, const std::uint8_t* p) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+        return _mm256_i32gather_ps(codebook, _mm256_cvtepu8_epi32(bytes), sizeof(float));
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct Avx512Ops {
+    using V = __m512;
+    static constexpr std::size_t kWidth = 16;
+
+    static V load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, V v) { _mm512_storeu_ps(p, v); }
+    static V set(float v) { return _mm512_set1_ps(v); }
+    static V fmadd(V a, V b, V c) { return _mm512_add_ps(_mm512_mul_ps(a, b), c); }
+
+    // The whole 16-entry codebook fits one register.
+    using Table16 = __m512;
+    static Table16 table16(const float* codebook) { return _mm512_loadu_ps(codebook); }
+    static V lookup16(Table16 table, const std::uint8_t* row, std::size_t column) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + column / 2));
+        return _mm512_permutexvar_ps(_mm512_cvtepu8_epi32(unpack_nibbles(bytes)), table);
+    }
+    static V lookup256(const float* codebook, const std::uint8_t* p) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return _mm512_i32gather_ps(_mm512_cvtepu8_epi32(bytes), codebook, sizeof(float));
+    }
+};
+#endif
+
+// One register tile: R rows by V vectors of columns, over `depth` inputs
+// from row `row0` and column `column0` of the weight matrix. Accumulators
+// start from `init` (the bias on the first pass over the inputs, the
+// partial sums in `out` on later ones), so every output adds its products
+// in input order whatever the blocking.
+struct TileArgs {
+    const float* in;
+    std::size_t in_stride;
+    const void* w;
+    // Elements of the matrix storage (floats or bytes) per input row.
+    std::size_t w_stride;
+    std::size_t row0;
+    std::size_t column0;
+    const float* codebook;
+    std::size_t depth;
+    const float* init;
+    std::size_t init_stride;
+    float* out;
+    std::size_t out_stride;
+};
+
+using TileKernel = void (*)(const TileArgs&);
+
+// Weight readers, one per WeightFormat: load(k, c) is the vector of
+// weights at input k and column c of the tile. The codebook readers keep
+// their table in registers for the whole tile.
+template <typename Ops>
+class FloatWeights {
+public:
+    explicit FloatWeights(const TileArgs& t)
+        : p_(static_cast<const float*>(t.w) + t.row0 * t.w_stride + t.column0),
+          stride_(t.w_stride) {}
+    typename Ops::V load(std::size_t k, std::size_t c) const {
+        return Ops::load(p_ + k * stride_ + c);
+    }
+
+private:
+    const float* p_;
+    std::size_t stride_;
+};
+
+template <typename Ops>
+class Codebook8Weights {
+public:
+    explicit Codebook8Weights(const TileArgs& t)
+        : p_(static_cast<const std::uint8_t*>(t.w) + t.row0 * t.w_stride + t.column0),
+          stride_(t.w_stride),
+          codebook_(t.codebook) {}
+    typename Ops::V load(std::size_t k, std::size_t c) const {
+        return Ops::lookup256(codebook_, p_ + k * stride_ + c);
+    }
+
+private:
+    const std::uint8_t* p_;
+    std::size_t stride_;
+    const float* codebook_;
+};
+
+template <typename Ops>
+class Codebook4Weights {
+public:
+    explicit Codebook4Weights(const TileArgs& t)
+        : p_(static_cast<const std::uint8_t*>(t.w) + t.row0 * t.w_stride),
+          stride_(t.w_stride),
+          column0_(t.column0),
+          table_(Ops::table16(t.codebook)) {}
+    typename Ops::V load(std::size_t k, std::size_t c) const {
+        return Ops::lookup16(table_, p_ + k * stride_, column0_ + c);
+    }
+
+private:
+    const std::uint8_t* p_;
+    std::size_t stride_;
+    std::size_t column0_;
+    typename Ops::Table16 table_;
+};
+
+template <typename Ops, template <typename> class Weights, int R, int V>
+void tile(const TileArgs& t) {
+    const Weights<Ops> weights(t);
+    typename Ops::V acc[R][V];
+    for (int r = 0; r < R; ++r) {
+        for (int v = 0; v < V; ++v) {
+            acc[r][v] = Ops::load(t.init + r * t.init_stride + v * Ops::kWidth);
+        }
+    }
+    for (std::size_t k = 0; k < t.depth; ++k) {
+        typename Ops::V wk[V];
+        for (int v = 0; v < V; ++v) {
+            wk[v] = weights.load(k, v * Ops::kWidth);
+        }
+        for (int r = 0; r < R; ++r) {
+            const typename Ops::V a = Ops::set(t.in[r * t.in_stride + k]);
+            for (int v = 0; v < V; ++v) {
+                acc[r][v] = Ops::fmadd(a, wk[v], acc[r][v]);
+            }
+        }
+    }
+    for (int r = 0; r < R; ++r) {
+        for (int v = 0; v < V; ++v) {
+            Ops::store(t.out + r * t.out_stride + v * Ops::kWidth, acc[r][v]);
+        }
+    }
+}
+
+struct TileShape {
+    std::uint8_t rows;
+    std::uint8_t vectors;
+};
+
+// Tiles every ISA is instantiated for; gemm_tiles() drops those needing
+// more accumulators than the ISA has registers to spare.
+constexpr TileShape kTiles[] = {{1, 1}, {1, 2}, {1, 4}, {2, 1}, {2, 2}, {2, 4}, {4, 1},
+                                {4, 2}, {4, 4}, {6, 1}, {6, 2}, {6, 4}, {8, 1}, {8, 2}};
+
+template <typename Ops, template <typename> class W>
+TileKernel tile_kernel(int rows, int vectors) {
+    switch (rows * 16 + vectors) {
+        case 0x11: return &tile<Ops, W, 1, 1>;
+        case 0x12: return &tile<Ops, W, 1, 2>;
+        case 0x14: return &tile<Ops, W, 1, 4>;
+        case 0x21: return &tile<Ops, W, 2, 1>;
+        case 0x22: return &tile<Ops, W, 2, 2>;
+        case 0x24: return &tile<Ops, W, 2, 4>;
+        case 0x41: return &tile<Ops, W, 4, 1>;
+        case 0x42: return &tile<Ops, W, 4, 2>;
+        case 0x44: return &tile<Ops, W, 4, 4>;
+        case 0x61: return &tile<Ops, W, 6, 1>;
+        case 0x62: return &tile<Ops, W, 6, 2>;
+        case 0x64: return &tile<Ops, W, 6, 4>;
+        case 0x81: return &tile<Ops, W, 8, 1>;
+        case 0x82: return &tile<Ops, W, 8, 2>;
+        default: return nullptr;
+    }
+}
+
+std::size_t accumulator_registers(GemmIsa isa) {
+    // Of 32 (AVX-512) or 16 registers, leave room for the weight vectors
+    // and the broadcast input.
+    return isa == GemmIsa::kAvx512 ? 24 : 12;
+}
+
+bool supported(GemmIsa isa, unsigned rows, unsigned vectors) {
+    const std::vector<GemmIsa> isas = gemm_isas();
+    if (std::find(isas.begin(), isas.end(), isa) == isas.end()) {
+        return false;
+    }
+    for (const auto& [r, v] : gemm_tiles(isa)) {
+        if (r == rows && v == vectors) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Columns [c0, c1) of the output for all rows. Tiles sweep the rows for
+// one column slice at a time, so the slice of the weight panel stays in
+// L1 while the inputs stream past.
+template <typename Ops, template <typename> class W>
+void gemm_columns(const float* in, std::size_t in_stride, std::size_t rows,
+                  const GemmWeights& w, std::size_t w_stride, std::size_t inputs,
+                  const float* bias, float* out, std::size_t out_stride,
+                  const GemmConfig& config, std::size_t c0, std::size_t c1) {
+    const std::size_t tile_rows = config.tile_rows;
+    const std::size_t tile_columns = config.tile_vectors * Ops::kWidth;
+    const TileKernel full = tile_kernel<Ops, W>(config.tile_rows, config.tile_vectors);
+    const TileKernel row_tail = tile_kernel<Ops, W>(1, config.tile_vectors);
+    const TileKernel narrow = tile_kernel<Ops, W>(config.tile_rows, 1);
+    const TileKernel narrow_row_tail = tile_kernel<Ops, W>(1, 1);
+    const TileKernel scalar = tile_kernel<ScalarOps, W>(1, 1);
+    const std::size_t k_block = config.k_block ? config.k_block : inputs;
+
+    for (std::size_t k0 = 0; k0 < inputs; k0 += k_block) {
+        TileArgs t;
+        t.in_stride = in_stride;
+        t.w = w.data;
+        t.w_stride = w_stride;
+        t.row0 = k0;
+        t.codebook = w.codebook;
+        t.depth = std::min(k_block, inputs - k0);
+        t.out_stride = out_stride;
+        t.init_stride = k0 == 0 ? 0 : out_stride;
+        const auto run = [&](TileKernel kernel, std::size_t r, std::size_t c) {
+            t.in = in + r * in_stride + k0;
+            t.column0 = c;
+            t.out = out + r * out_stride + c;
+            t.init = k0 == 0 ? bias + c : t.out;
+            kernel(t);
+        };
+        const auto sweep_rows = [&](TileKernel block, std::size_t block_rows,
+                                    TileKernel single, std::size_t c) {
+            std::size_t r = 0;
+            for (; r + block_rows <= rows; r += block_rows) {
+                run(block, r, c);
+            }
+            for (; r < rows; ++r) {
+                run(single, r, c);
+            }
+        };
+
+        std::size_t c = c0;
+        for (; c + tile_columns <= c1; c += tile_columns) {
+            sweep_rows(full, tile_rows, row_tail, c);
+        }
+        for (; c + Ops::kWidth <= c1; c += Ops::kWidth) {
+            sweep_rows(narrow, tile_rows, narrow_row_tail, c);
+        }
+        for (; c < c1; ++c) {
+            sweep_rows(scalar, 1, scalar, c);
+        }
+    }
+}
+
+// Runs fn(0) .. fn(chunks - 1) on up to `chunks` threads, the caller
+// included. Helpers claim chunks from a shared counter, and the caller
+// only waits for chunks a helper has already started, so a helper still
+// queued behind the caller's own worker cannot stall it. Helpers charge
+// their CPU to the caller's CpuAccount, if it has one.
+void run_chunks(std::size_t chunks, Executor& executor,
+                const std::function<void(std::size_t)>& fn) {
+    struct Shared {
+        std::atomic<std::size_t> next{0};
+        std::size_t chunks = 0;
+        const std::function<void(std::size_t)>* fn = nullptr;
+        CpuAccount* account = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::size_t done = 0;
+        std::exception_ptr error;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->chunks = chunks;
+    shared->fn = &fn;
+    shared->account = current_cpu_account();
+    // A helper that starts after every chunk is claimed returns without
+    // touching `fn` or `account`, which may be gone by then; `shared`
+    // outlives it. A chunk is charged before it counts as done, and counts
+    // as done even if it throws: the first exception is kept and rethrown
+    // on the caller once no helper can still be inside `fn`.
+    const auto work = [](Shared& s, bool helper) {
+        CpuAccount* account = helper ? s.account : nullptr;
+        for (std::size_t i; (i = s.next.fetch_add(1, std::memory_order_relaxed)) < s.chunks;) {
+            std::exception_ptr error;
+            try {
+                if (account) {
+                    ScopedCpuAccount scope(account);
+                    const std::uint64_t start = thread_cpu_ns();
+                    (*s.fn)(i);
+                    account->charge(thread_cpu_ns() - start);
+                } else {
+                    (*s.fn)(i);
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (error && !s.error) {
+                s.error = error;
+            }
+            if (++s.done == s.chunks) {
+                s.finished.notify_all();
+            }
+        }
+    };
+    // Helpers run at the caller's priority: an interactive request's split
+    // stays interactive, while a bulk batch or a split from outside the
+    // executor (e.g. the tuner's benchmark) does not take the latency lane.
+    const TaskPriority priority = executor.current_priority();
+    for (std::size_t i = 1; i < chunks; ++i) {
+        executor.submit([shared, work] { work(*shared, true); }, priority);
+    }
+    work(*shared, false);
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&] { return shared->done == chunks; });
+    if (shared->error) {
+        std::rethrow_exception(shared->error);
+    }
+}
+
+template <typename Ops, template <typename> class W>
+void gemm_format(const float* in, std::size_t in_stride, std::size_t rows, const GemmWeights& w,
+                 std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+                 std::size_t out_stride, const GemmConfig& config, Executor& executor) {
+    const std::size_t w_stride = w.format == WeightFormat::kFloat32
+                                     ? outputs
+                                     : weight_row_bytes(w.format, outputs);
+    // Column ranges on vector boundaries, so splitting never adds tails.
+    const std::size_t vectors = (outputs + Ops::kWidth - 1) / Ops::kWidth;
+    const std::size_t splits = std::min<std::size_t>(std::max<std::size_t>(config.splits, 1),
+                                                     vectors);
+    if (splits <= 1) {
+        gemm_columns<Ops, W>(in, in_stride, rows, w, w_stride, inputs, bias, out, out_stride,
+                             config, 0, outputs);
+        return;
+    }
+    run_chunks(splits, executor, [&](std::size_t i) {
+        const std::size_t c0 = std::min(outputs, vectors * i / splits * Ops::kWidth);
+        const std::size_t c1 = std::min(outputs, vectors * (i + 1) / splits * Ops::kWidth);
+        gemm_columns<Ops, W>(in, in_stride, rows, w, w_stride, inputs, bias, out, out_stride,
+                             config, c0, c1);
+    });
+}
+
+template <typename Ops>
+void gemm_isa(const float* in, std::size_t in_stride, std::size_t rows, const GemmWeights& w,
+              std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+              std::size_t out_stride, const GemmConfig& config, Executor& executor) {
+    switch (w.format) {
+        case WeightFormat::kFloat32:
+            gemm_format<Ops, FloatWeights>(in, in_stride, rows, w, inputs, outputs, bias, out,
+                                           out_stride, config, executor);
+            return;
+        case WeightFormat::kCodebook8:
+            gemm_format<Ops, Codebook8Weights>(in, in_stride, rows, w, inputs, outputs, bias,
+                                               out, out_stride, config, executor);
+            return;
+        case WeightFormat::kCodebook4:
+            gemm_format<Ops, Codebook4Weights>(in, in_stride, rows, w, inputs, outputs, bias,
+                                               out, out_stride, config, executor);
+            return;
+    }
+    throw std::invalid_argument("gemm_bias: unknown weight format");
+}
+
+}  // namespace
+
+const char* gemm_isa_name(GemmIsa isa) {
+    switch (isa) {
+        case GemmIsa::kScalar: return "scalar";
+        case GemmIsa::kAvx2: return "avx2";
+        case GemmIsa::kAvx512: return "avx512";
+    }
+    return "unknown";
+}
+
+const char* weight_format_name(WeightFormat format) {
+    switch (format) {
+        case WeightFormat::kFloat32: return "float32";
+        case WeightFormat::kCodebook8: return "codebook8";
+        case WeightFormat::kCodebook4: return "codebook4";
+    }
+    return "unknown";
+}
+
+std::size_t codebook_entries(WeightFormat format) {
+    switch (format) {
+        case WeightFormat::kCodebook8: return 256;
+        case WeightFormat::kCodebook4: return 16;
+        default: return 0;
+    }
+}
+
+std::size_t weight_row_bytes(WeightFormat format, std::size_t outputs) {
+    switch (format) {
+        case WeightFormat::kCodebook8: return outputs;
+        case WeightFormat::kCodebook4: return (outputs + 1) / 2;
+        default: return outputs * sizeof(float);
+    }
+}
+
+std::string format_gemm_config(const GemmConfig& config) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "%s:%ux%u:k%u:s%u", gemm_isa_name(config.isa),
+                  unsigned{config.tile_rows}, unsigned{config.tile_vectors},
+                  unsigned{config.k_block}, unsigned{config.splits});
+    return text;
+}
+
+GemmConfig parse_gemm_config(const std::string& text) {
+    char isa[16] = {};
+    unsigned rows = 0, vectors = 0, k_block = 0, splits = 0;
+    char tail = 0;
+    if (std::sscanf(text.c_str(), "%15[a-z0-9]:%ux%u:k%u:s%u%c", isa, &rows, &vectors, &k_block,
+                    &splits, &tail) != 5) {
+        throw std::invalid_argument("parse_gemm_config: malformed '" + text + "'");
+    }
+    GemmConfig config;
+    bool known = false;
+    for (GemmIsa candidate : gemm_isas()) {
+        if (std::strcmp(isa, gemm_isa_name(candidate)) == 0) {
+            config.isa = candidate;
+            known = true;
+        }
+    }
+    if (!known || !supported(config.isa, rows, vectors) || splits == 0 || splits > 255) {
+        throw std::invalid_argument("parse_gemm_config: unsupported '" + text + "'");
+    }
+    config.tile_rows = static_cast<std::uint8_t>(rows);
+    config.tile_vectors = static_cast<std::uint8_t>(vectors);
+    config.k_block = k_block;
+    config.splits = static_cast<std::uint8_t>(splits);
+    return config;
+}
+
+std::vector<GemmIsa> gemm_isas() {
+    std::vector<GemmIsa> isas;
+#if defined(__AVX512F__)
+    isas.push_back(GemmIsa::kAvx512);
+#endif
+#if defined(__AVX2__)
+    isas.push_back(GemmIsa::kAvx2);
+#endif
+    isas.push_back(GemmIsa::kScalar);
+    return isas;
+}
+
+std::vector<std::pair<std::uint8_t, std::uint8_t>> gemm_tiles(GemmIsa isa) {
+    std::vector<std::pair<std::uint8_t, std::uint8_t>> tiles;
+    for (const TileShape& shape : kTiles) {
+        if (std::size_t{shape.rows} * shape.vectors <= accumulator_registers(isa)) {
+            tiles.emplace_back(shape.rows, shape.vectors);
+        }
+    }
+    return tiles;
+}
+
+GemmConfig default_gemm_config() {
+    GemmConfig config;
+    config.isa = gemm_isas().front();
+    config.tile_rows = 4;
+    config.tile_vectors = 2;
+    return config;
+}
+
+void gemm_bias(const float* in, std::size_t in_stride, std::size_t rows, const float* w,
+               std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+               std::size_t out_stride, const GemmConfig& config, Executor& executor) {
+    GemmWeights weights;
+    weights.data = w;
+    gemm_bias(in, in_stride, rows, weights, inputs, outputs, bias, out, out_stride, config,
+              executor);
+}
+
+void gemm_bias(const float* in, std::size_t in_stride, std::size_t rows, const GemmWeights& w,
+               std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+               std::size_t out_stride, const GemmConfig& config, Executor& executor) {
+    if (rows == 0 || outputs == 0) {
+        return;
+    }
+    if (!supported(config.isa, config.tile_rows, config.tile_vectors)) {
+        throw std::invalid_argument("gemm_bias: unsupported config " +
+                                    format_gemm_config(config));
+    }
+    switch (config.isa) {
+#if defined(__AVX512F__)
+        case GemmIsa::kAvx512:
+            gemm_isa<Avx512Ops>(in, in_stride, rows, w, inputs, outputs, bias, out, out_stride,
+                                config, executor);
+            return;
+#endif
+#if defined(__AVX2__)
+        case GemmIsa::kAvx2:
+            gemm_isa<Avx2Ops>(in, in_stride, rows, w, inputs, outputs, bias, out, out_stride,
+                              config, executor);
+            return;
+#endif
+        default:
+            gemm_isa<ScalarOps>(in, in_stride, rows, w, inputs, outputs, bias, out, out_stride,
+                                config, executor);
+            return;
+    }
+}
+
+}  // namespace probionis
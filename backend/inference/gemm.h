@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "runtime/executor.h"
+
+namespace probionis {
+
+// Instruction set of a GEMM kernel. Only sets this binary was compiled for
+// are available; see gemm_isas().
+enum class GemmIsa : std::uint8_t { kScalar = 0, kAvx2 = 1, kAvx512 = 2 };
+
+const char* gemm_isa_name(GemmIsa isa);
+
+// How one dense layer is computed. Every configuration, on every ISA, adds
+// the products for an output in the same order with the same rounding, so
+// configurations differ in speed only, never in results.
+struct GemmConfig {
+    GemmIsa isa = GemmIsa::kScalar;
+    // Register tile: rows of the batch by vectors of output columns.
+    std::uint8_t tile_rows = 1;
+    std::uint8_t tile_vectors = 1;
+    // Inputs per pass over the weights, so a panel of them stays in cache;
+    // 0 means all.
+    std::uint32_t k_block = 0;
+    // Column ranges computed in parallel on the executor.
+    std::uint8_t splits = 1;
+
+    bool operator==(const GemmConfig& other) const {
+        return isa == other.isa && tile_rows == other.tile_rows &&
+               tile_vectors == other.tile_vectors && k_block == other.k_block &&
+               splits == other.splits;
+    }
+    bool operator!=(const GemmConfig& other) const { return !(*this == other); }
+};
+
+// Storage of a layer's weight matrix. The codebook formats hold, per
+// weight, an index into a per-layer table of float values (k-means
+// centroids, see inference/weight_codebook.h); kernels look the values up
+// in registers as they go, so the matrix is never expanded in memory.
+enum class WeightFormat : std::uint8_t {
+    kFloat32 = 0,
+    // One byte per weight, 256-entry codebook.
+    kCodebook8 = 1,
+    // Two weights per byte, low nibble first, 16-entry codebook. Rows of
+    // an odd output count end on a padding nibble.
+    kCodebook4 = 2,
+};
+
+const char* weight_format_name(WeightFormat format);
+// Entries of the codebook for `format`; 0 for kFloat32.
+std::size_t codebook_entries(WeightFormat format);
+// Bytes per input row of the matrix.
+std::size_t weight_row_bytes(WeightFormat format, std::size_t outputs);
+
+// A weight matrix as the kernels read it, input-major ([inputs][outputs]).
+struct GemmWeights {
+    WeightFormat format = WeightFormat::kFloat32;
+    // Floats, or indices for the codebook formats.
+    const void* data = nullptr;
+    // codebook_entries(format) values.
+    const float* codebook = nullptr;
+};
+
+// "avx512:4x2:k256:s1"; parse_gemm_config() accepts the same form and
+// throws std::invalid_argument on anything else, including an ISA or tile
+// this binary lacks.
+std::string format_gemm_config(const GemmConfig& config);
+GemmConfig parse_gemm_config(const std::string& text);
+
+// ISAs compiled in, widest first.
+std::vector<GemmIsa> gemm_isas();
+// Register tiles the kernels are instantiated for on `isa`.
+std::vector<std::pair<std::uint8_t, std::uint8_t>> gemm_tiles(GemmIsa isa);
+// A reasonable configuration without tuning: widest ISA, mid-sized tile.
+GemmConfig default_gemm_config();
+
+// out[r][j] = bias[j] + sum_k in[r][k] * w[k][j] for `rows` rows, with the
+// weights stored input-major ([inputs][outputs]). Splits run on `executor`
+// with the calling thread taking part, so calling from a worker is safe.
+void gemm_bias(const float* in, std::size_t in_stride, std::size_t rows, const float* w,
+               std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+               std::size_t out_stride, const GemmConfig& config,
+               Executor& executor = shared_executor());
+
+// The same over weights in any format. A codebook layer gives exactly the
+// result of its float-expanded matrix.
+void gemm_bias(const float* in, std::size_t in_stride, std::size_t rows, const GemmWeights& w,
+               std::size_t inputs, std::size_t outputs, const float* bias, float* out,
+               std::size_t out_stride, const GemmConfig& config,
+               Executor& executor = shared_executor());
+
+}  // namespace probionis
@@ -0,0 +1,343 @@
+#include "inference/kernel_tuner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Version 2 added the largest split to each entry's key.
+constexpr char kCacheHeader[] = "probionis-kernel-cache 2";
+// Input blocks tried for the fastest tile; larger ones only matter when
+// a layer's weight panel outgrows L2.
+constexpr std::uint32_t kBlocks[] = {64, 128, 256, 512, 1024};
+constexpr std::size_t kMaxSplits = 8;
+
+std::string trim(const std::string& text) {
+    const std::size_t begin = text.find_first_not_of(" \t");
+    const std::size_t end = text.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+}
+
+// Holds flock(LOCK_EX) on `path`, created if missing, for the scope. The
+// cache file itself is replaced by rename, so it cannot carry the lock.
+class CacheFileLock {
+public:
+    explicit CacheFileLock(const std::string& path)
+        : fd_(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+        if (fd_ < 0) {
+            throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+        }
+        while (::flock(fd_, LOCK_EX) != 0 && errno == EINTR) {
+        }
+    }
+    ~CacheFileLock() { ::close(fd_); }
+
+    CacheFileLock(const CacheFileLock&) = delete;
+    CacheFileLock& operator=(const CacheFileLock&) = delete;
+
+private:
+    int fd_;
+};
+
+}  // namespace
+
+std::string cpu_model_name() {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        const std::size_t colon = line.find(':');
+        if (colon != std::string::npos && trim(line.substr(0, colon)) == "model name") {
+            std::string name = trim(line.substr(colon + 1));
+            // Tabs separate the fields of the cache file.
+            std::replace(name.begin(), name.end(), '\t', ' ');
+            return name.empty() ? "unknown" : name;
+        }
+    }
+    return "unknown";
+}
+
+std::uint64_t model_shape_hash(const Model& model, std::size_t rows) {
+    const std::uint64_t batch = rows;
+    std::uint64_t hash = fnv1a64(&batch, sizeof(batch));
+    for (const DenseLayer& layer : model.layers()) {
+        const std::uint64_t dims[2] = {layer.weights->inputs, layer.weights->outputs};
+        hash = fnv1a64(dims, sizeof(dims), hash);
+        // Float layers hash as before codebooks existed, keeping old caches.
+        if (layer.weights->format != WeightFormat::kFloat32) {
+            const auto format = static_cast<std::uint8_t>(layer.weights->format);
+            hash = fnv1a64(&format, sizeof(format), hash);
+        }
+    }
+    return hash;
+}
+
+KernelTuner::KernelTuner(KernelTunerOptions options, Executor& executor)
+    : options_(std::move(options)),
+      executor_(executor),
+      cpu_(cpu_model_name()),
+      max_splits_(std::min(options_.max_splits ? options_.max_splits : executor.worker_count(),
+                           kMaxSplits)),
+      hits_(global_metrics().counter("probionis_kernel_tuning_cache_hits_total",
+                                     "Models configured from the kernel tuning cache")),
+      tuned_(global_metrics().counter("probionis_kernel_tuning_models_total",
+                                      "Models whose kernels were benchmarked")),
+      tuning_ms_(global_metrics().counter("probionis_kernel_tuning_ms_total",
+                                          "Milliseconds spent benchmarking kernels")),
+      save_failures_(global_metrics().counter(
+          "probionis_kernel_tuning_cache_save_failures_total",
+          "Kernel tuning results that could not be written to the cache file")) {
+    if (options_.rows == 0 || options_.repetitions == 0) {
+        throw std::invalid_argument("KernelTuner: rows and repetitions must be positive");
+    }
+    if (!options_.cache_path.empty()) {
+        read_cache(options_.cache_path, cache_);
+    }
+}
+
+bool KernelTuner::tune(Model& model) {
+    const Key key(cpu_, max_splits_, model_shape_hash(model, options_.rows));
+    const auto configure_cached = [&] {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(key);
+        if (it == cache_.end() || it->second.size() != model.layers().size()) {
+            return false;
+        }
+        model.set_gemm_configs(it->second);
+        hits_.add();
+        return true;
+    };
+    if (configure_cached()) {
+        return true;
+    }
+    // A model of the same shape may have been tuned while this one waited.
+    std::lock_guard<std::mutex> tuning(tuning_mutex_);
+    if (configure_cached()) {
+        return true;
+    }
+
+    const Clock::time_point start = Clock::now();
+    std::vector<GemmConfig> configs;
+    for (const DenseLayer& layer : model.layers()) {
+        // Models often repeat a shape; benchmark it once.
+        GemmConfig config;
+        bool seen = false;
+        for (std::size_t i = 0; i < configs.size() && !seen; ++i) {
+            const LayerWeights& earlier = *model.layers()[i].weights;
+            if (earlier.inputs == layer.weights->inputs &&
+                earlier.outputs == layer.weights->outputs &&
+                earlier.format == layer.weights->format) {
+                config = configs[i];
+                seen = true;
+            }
+        }
+        configs.push_back(seen ? config
+                               : tune_layer(layer.weights->inputs, layer.weights->outputs,
+                                            layer.weights->format));
+    }
+    model.set_gemm_configs(configs);
+    tuned_.add();
+    tuning_ms_.add(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count()));
+    Cache entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_[key] = std::move(configs);
+        if (!options_.cache_path.empty()) {
+            entries = cache_;
+        }
+    }
+    try {
+        save_cache(entries);
+    } catch (const std::exception& e) {
+        save_failures_.add();
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_save_error_ = e.what();
+    }
+    return false;
+}
+
+GemmConfig KernelTuner::tune_layer(std::size_t inputs, std::size_t outputs,
+                                   WeightFormat format) {
+    const std::size_t rows = options_.rows;
+    std::vector<float> in(rows * inputs);
+    std::vector<float> codebook(codebook_entries(format));
+    std::vector<float> bias(outputs);
+    std::vector<float> out(rows * outputs);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (std::vector<float>* v : {&in, &codebook, &bias}) {
+        std::generate(v->begin(), v->end(), [&] { return uniform(rng); });
+    }
+    // Weights in [-1, 1) for float layers, random indices for codebooks.
+    const std::size_t matrix_bytes = inputs * weight_row_bytes(format, outputs);
+    std::vector<std::uint8_t> matrix(matrix_bytes);
+    if (format == WeightFormat::kFloat32) {
+        auto* w = reinterpret_cast<float*>(matrix.data());
+        std::generate(w, w + inputs * outputs, [&] { return uniform(rng); });
+    } else {
+        std::generate(matrix.begin(), matrix.end(),
+                      [&] { return static_cast<std::uint8_t>(rng()); });
+    }
+    const GemmWeights weights{format, matrix.data(), codebook.data()};
+    const auto time = [&](const GemmConfig& config) {
+        return measure(config, in.data(), weights, bias.data(), out.data(), inputs, outputs);
+    };
+
+    GemmConfig best;
+    double best_seconds = HUGE_VAL;
+    const auto consider = [&](const GemmConfig& config) {
+        const double seconds = time(config);
+        if (seconds < best_seconds) {
+            best_seconds = seconds;
+            best = config;
+        }
+    };
+    for (GemmIsa isa : gemm_isas()) {
+        for (const auto& [tile_rows, tile_vectors] : gemm_tiles(isa)) {
+            GemmConfig config;
+            config.isa = isa;
+            config.tile_rows = tile_rows;
+            config.tile_vectors = tile_vectors;
+            consider(config);
+        }
+    }
+    const GemmConfig unblocked = best;
+    for (std::uint32_t block : kBlocks) {
+        if (block < inputs) {
+            GemmConfig config = unblocked;
+            config.k_block = block;
+            consider(config);
+        }
+    }
+    const GemmConfig single = best;
+    for (std::size_t splits = 2; splits <= max_splits_; splits *= 2) {
+        GemmConfig config = single;
+        config.splits = static_cast<std::uint8_t>(splits);
+        consider(config);
+    }
+    return best;
+}
+
+double KernelTuner::measure(const GemmConfig& config, const float* in, const GemmWeights& w,
+                            const float* bias, float* out, std::size_t inputs,
+                            std::size_t outputs) {
+    const std::size_t rows = options_.rows;
+    // One untimed run pulls the weights into cache, as in steady state.
+    gemm_bias(in, inputs, rows, w, inputs, outputs, bias, out, outputs, config, executor_);
+    std::vector<double> seconds(options_.repetitions);
+    for (double& s : seconds) {
+        const Clock::time_point start = Clock::now();
+        gemm_bias(in, inputs, rows, w, inputs, outputs, bias, out, outputs, config, executor_);
+        s = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    std::nth_element(seconds.begin(), seconds.begin() + seconds.size() / 2, seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+std::size_t KernelTuner::cached_models() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_.size();
+}
+
+std::string KernelTuner::last_save_error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_save_error_;
+}
+
+bool KernelTuner::read_cache(const std::string& path, Cache& cache) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != kCacheHeader) {
+        // Missing or from another format: start over, it is only a cache.
+        return false;
+    }
+    while (std::getline(in, line)) {
+        std::size_t tab[3];
+        tab[0] = line.find('\t');
+        tab[1] = tab[0] == std::string::npos ? tab[0] : line.find('\t', tab[0] + 1);
+        tab[2] = tab[1] == std::string::npos ? tab[1] : line.find('\t', tab[1] + 1);
+        if (tab[2] == std::string::npos) {
+            continue;
+        }
+        try {
+            const std::size_t splits = std::stoul(line.substr(tab[0] + 1, tab[1] - tab[0] - 1));
+            const std::uint64_t hash =
+                std::stoull(line.substr(tab[1] + 1, tab[2] - tab[1] - 1), nullptr, 16);
+            std::vector<GemmConfig> configs;
+            std::istringstream list(line.substr(tab[2] + 1));
+            for (std::string item; std::getline(list, item, ';');) {
+                configs.push_back(parse_gemm_config(item));
+                if (configs.back().splits > splits) {
+                    throw std::invalid_argument("split above the entry's limit");
+                }
+            }
+            if (!configs.empty()) {
+                cache[Key(line.substr(0, tab[0]), splits, hash)] = std::move(configs);
+            }
+        } catch (const std::exception&) {
+            // Written by a build with other kernels; that model is retuned.
+        }
+    }
+    return true;
+}
+
+void KernelTuner::save_cache(const Cache& entries) const {
+    if (options_.cache_path.empty()) {
+        return;
+    }
+    // Other processes (local cluster nodes, hosts of a fleet sharing the
+    // file) save too: under the lock, merge what they wrote, then replace
+    // the file through a name unique to this save, so a crash never leaves
+    // half a cache.
+    const CacheFileLock lock(options_.cache_path + ".lock");
+    Cache merged;
+    read_cache(options_.cache_path, merged);
+    for (const auto& [key, configs] : entries) {
+        merged[key] = configs;
+    }
+    const std::string partial = options_.cache_path + ".partial." +
+                                std::to_string(::getpid()) + "." +
+                                std::to_string(std::random_device()());
+    {
+        std::ofstream out(partial, std::ios::trunc);
+        out << kCacheHeader << '\n';
+        for (const auto& [key, configs] : merged) {
+            char hash[24];
+            std::snprintf(hash, sizeof(hash), "%016llx",
+                          static_cast<unsigned long long>(std::get<2>(key)));
+            out << std::get<0>(key) << '\t' << std::get<1>(key) << '\t' << hash << '\t';
+            for (std::size_t i = 0; i < configs.size(); ++i) {
+                out << (i ? ";" : "") << format_gemm_config(configs[i]);
+            }
+            out << '\n';
+        }
+        if (!out) {
+            out.close();
+            std::remove(partial.c_str());
+            throw std::runtime_error("cannot write " + partial);
+        }
+    }
+    if (std::rename(partial.c_str(), options_.cache_path.c_str()) != 0) {
+        std::remove(partial.c_str());
+        throw std::runtime_error("cannot rename " + partial);
+    }
+}
+
+}  // namespace probionis
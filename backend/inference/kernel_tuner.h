@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "inference/gemm.h"
+#include "inference/model.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+struct KernelTunerOptions {
+    // Tuning cache file; empty benchmarks on every start. Saves lock
+    // `cache_path`.lock, created beside it.
+    std::string cache_path;
+    // Batch rows layers are benchmarked at; the scheduler's usual batch.
+    std::size_t rows = 32;
+    // Timed runs per candidate; the median counts.
+    std::size_t repetitions = 5;
+    // Largest thread split tried; 0 means the executor's worker count,
+    // at most 8.
+    std::size_t max_splits = 0;
+};
+
+// Name of the CPU model, from /proc/cpuinfo, or "unknown".
+std::string cpu_model_name();
+
+// Hash of the layer shapes (and weight formats) of `model` at a batch
+// size. Kernel speed depends on these only, so variants of one
+// architecture share it.
+std::uint64_t model_shape_hash(const Model& model, std::size_t rows);
+
+// Picks the GEMM configuration of each model layer on this machine.
+//
+// Tile shape, input blocking, thread split and ISA are benchmarked for
+// the exact layer shapes of a model: every tile of every ISA first, then
+// input blocks and splits for the fastest. The result is cached under the
+// CPU model name, the largest split allowed and the model's shape hash,
+// and persisted to `cache_path`, so later starts on the same CPU model
+// with the same thread budget configure a model without benchmarking.
+// Benchmarks run one model at a time so they do not skew each other.
+//
+// Processes may share the cache file: each save merges into what is on
+// disk under a lock, and a save that fails is counted and kept for
+// last_save_error(), never thrown, since the tuned model is usable either
+// way. Lookups of cached models do not wait for a benchmark in progress.
+class KernelTuner {
+public:
+    explicit KernelTuner(KernelTunerOptions options = {}, Executor& executor = shared_executor());
+
+    KernelTuner(const KernelTuner&) = delete;
+    KernelTuner& operator=(const KernelTuner&) = delete;
+
+    // Sets the configurations of `model`, benchmarking it unless cached.
+    // Returns true if the cache had them.
+    bool tune(Model& model);
+
+    // Fastest configuration for one layer shape.
+    GemmConfig tune_layer(std::size_t inputs, std::size_t outputs,
+                          WeightFormat format = WeightFormat::kFloat32);
+
+    std::size_t cached_models() const;
+    // Why the most recent failed save of the cache file failed; empty if
+    // none has.
+    std::string last_save_error() const;
+
+private:
+    // CPU model, largest split, model shape hash.
+    using Key = std::tuple<std::string, std::size_t, std::uint64_t>;
+    using Cache = std::map<Key, std::vector<GemmConfig>>;
+
+    // Median seconds of one GEMM run with `config`.
+    double measure(const GemmConfig& config, const float* in, const GemmWeights& w,
+                   const float* bias, float* out, std::size_t inputs, std::size_t outputs);
+    // Merges the entries in `path` into `cache`; false if the file is
+    // missing or in another format.
+    static bool read_cache(const std::string& path, Cache& cache);
+    // Merges `entries` into the file under its lock file; throws on
+    // failure.
+    void save_cache(const Cache& entries) const;
+
+    KernelTunerOptions options_;
+    Executor& executor_;
+    std::string cpu_;
+    std::size_t max_splits_;
+
+    // Held while benchmarking and saving, so benchmarks do not skew each
+    // other; mutex_ guards the members below and is never held that long.
+    std::mutex tuning_mutex_;
+    mutable std::mutex mutex_;
+    Cache cache_;
+    std::string last_save_error_;
+
+    Counter& hits_;
+    Counter& tuned_;
+    Counter& tuning_ms_;
+    Counter& save_failures_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,338 @@
+#include "inference/model.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "inference/activations.h"
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr char kModelMagic[4] = {'P', 'B', 'M', 'D'};
+// Version 2 added the weight format and codebook of each layer.
+constexpr std::uint32_t kModelFormatVersion = 2;
+// Bound on a layer's inputs and outputs, checked before anything is sized
+// from them; products of two bounded widths cannot overflow.
+constexpr std::uint32_t kMaxLayerWidth = 1u << 20;
+
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+void read_pod(std::ifstream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+// Bytes from the read position to the end of the file.
+std::uint64_t remaining_bytes(std::ifstream& in) {
+    const std::istream::pos_type here = in.tellg();
+    if (here == std::istream::pos_type(-1) || !in.seekg(0, std::ios::end)) {
+        in.clear();
+        return UINT64_MAX;
+    }
+    const std::istream::pos_type end = in.tellg();
+    in.seekg(here);
+    return static_cast<std::uint64_t>(end - here);
+}
+
+std::uint64_t fingerprint(const LayerWeights& layer) {
+    const std::uint64_t dims[3] = {layer.inputs, layer.outputs,
+                                   static_cast<std::uint64_t>(layer.format)};
+    std::uint64_t hash = fnv1a64(dims, sizeof(dims));
+    hash = fnv1a64(layer.weights.data(), layer.weights.size(), hash);
+    hash = fnv1a64(layer.codebook.data(), layer.codebook.size() * sizeof(float), hash);
+    return fnv1a64(layer.bias.data(), layer.bias.size() * sizeof(float), hash);
+}
+
+bool same_contents(const LayerWeights& a, const LayerWeights& b) {
+    return a.inputs == b.inputs && a.outputs == b.outputs && a.format == b.format &&
+           a.codebook == b.codebook &&
+           std::memcmp(a.weights.data(), b.weights.data(), a.weights.size()) == 0 &&
+           std::memcmp(a.bias.data(), b.bias.data(), a.bias.size() * sizeof(float)) == 0;
+}
+
+void activate(Activation activation, float* x, std::size_t rows, std::size_t width,
+              std::size_t stride) {
+    if (activation == Activation::kNone) {
+        return;
+    }
+    if (activation == Activation::kSoftmax) {
+        softmax_rows(x, rows, width, stride);
+        return;
+    }
+    for (std::size_t r = 0; r < rows; ++r) {
+        float* row = x + r * stride;
+        switch (activation) {
+            case Activation::kRelu:
+                for (std::size_t j = 0; j < width; ++j) {
+                    row[j] = std::max(row[j], 0.0f);
+                }
+                break;
+            case Activation::kSigmoid: sigmoid_inplace(row, width); break;
+            case Activation::kTanh: tanh_inplace(row, width); break;
+            case Activation::kGelu: gelu_inplace(row, width); break;
+            default: break;
+        }
+    }
+}
+
+}  // namespace
+
+float LayerWeights::weight(std::size_t k, std::size_t j) const {
+    const auto* row = weights.as<const std::uint8_t>() + k * weight_row_bytes(format, outputs);
+    switch (format) {
+        case WeightFormat::kCodebook8: return codebook[row[j]];
+        case WeightFormat::kCodebook4: return codebook[(row[j / 2] >> (j % 2 * 4)) & 0x0f];
+        default: return weights.as<const float>()[k * outputs + j];
+    }
+}
+
+std::shared_ptr<LayerStore> LayerStore::create() {
+    return std::shared_ptr<LayerStore>(new LayerStore());
+}
+
+std::shared_ptr<const LayerWeights> LayerStore::intern(LayerWeights layer) {
+    layer.fingerprint = fingerprint(layer);
+    // Candidates stay referenced until after the lock is released: dropping
+    // the last reference runs forget(), which takes the lock.
+    std::vector<std::shared_ptr<const LayerWeights>> candidates;
+    std::weak_ptr<LayerStore> self = weak_from_this();
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto range = layers_.equal_range(layer.fingerprint);
+    for (auto it = range.first; it != range.second; ++it) {
+        candidates.push_back(it->second.lock());
+        if (candidates.back() && same_contents(*candidates.back(), layer)) {
+            return candidates.back();
+        }
+    }
+
+    std::shared_ptr<const LayerWeights> stored(
+        new LayerWeights(std::move(layer)), [self](const LayerWeights* p) {
+            if (auto store = self.lock()) {
+                store->forget(p);
+            }
+            delete p;
+        });
+    resident_bytes_ += stored->bytes();
+    layers_.emplace(stored->fingerprint, stored);
+    return stored;
+}
+
+void LayerStore::forget(const LayerWeights* layer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto range = layers_.equal_range(layer->fingerprint);
+    for (auto it = range.first; it != range.second; ++it) {
+        // Expired entries with this fingerprint can only be `layer` or
+        // layers whose own forget() is waiting on the lock; either way the
+        // count is released exactly once per layer.
+        if (it->second.expired()) {
+            layers_.erase(it);
+            resident_bytes_ -= layer->bytes();
+            return;
+        }
+    }
+}
+
+std::size_t LayerStore::resident_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resident_bytes_;
+}
+
+std::size_t LayerStore::layer_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return layers_.size();
+}
+
+Model::Model(std::string version, std::vector<DenseLayer> layers)
+    : version_(std::move(version)), layers_(std::move(layers)) {
+    if (layers_.empty()) {
+        throw std::invalid_argument("Model: no layers");
+    }
+    for (std::size_t i = 0; i < layers_.size(); ++i) {
+        const LayerWeights* w = layers_[i].weights.get();
+        if (!w || w->inputs == 0 || w->outputs == 0) {
+            throw std::invalid_argument("Model: empty layer");
+        }
+        if (w->inputs > kMaxLayerWidth || w->outputs > kMaxLayerWidth) {
+            throw std::invalid_argument("Model: layer wider than " +
+                                        std::to_string(kMaxLayerWidth));
+        }
+        if (w->codebook.size() != codebook_entries(w->format) ||
+            w->weights.size() != w->inputs * weight_row_bytes(w->format, w->outputs) ||
+            w->bias.size() != w->outputs) {
+            throw std::invalid_argument("Model: weights do not match their format");
+        }
+        if (i > 0 && w->inputs != layers_[i - 1].weights->outputs) {
+            throw std::invalid_argument("Model: layer dimensions do not chain");
+        }
+        max_width_ = std::max(max_width_, w->outputs);
+    }
+    gemm_configs_.assign(layers_.size(), default_gemm_config());
+}
+
+std::size_t Model::bytes() const {
+    std::size_t total = 0;
+    for (const DenseLayer& layer : layers_) {
+        total += layer.weights->bytes();
+    }
+    return total;
+}
+
+void Model::set_gemm_configs(std::vector<GemmConfig> configs) {
+    if (configs.size() != layers_.size()) {
+        throw std::invalid_argument("Model::set_gemm_configs: " + std::to_string(configs.size()) +
+                                    " configs for " + std::to_string(layers_.size()) +
+                                    " layers");
+    }
+    gemm_configs_ = std::move(configs);
+}
+
+void Model::run(const SpectrumBatch& batch, float* outputs) const {
+    if (batch.channels() != input_channels()) {
+        throw std::invalid_argument("Model::run: batch has " + std::to_string(batch.channels()) +
+                                    " channels, model " + version_ + " expects " +
+                                    std::to_string(input_channels()));
+    }
+    const std::size_t rows = batch.size();
+    if (rows == 0) {
+        return;
+    }
+    // Ping-pong activations for the hidden layers, reused across batches
+    // and on huge pages once large enough (MemoryKind::kActivations).
+    thread_local HugePageBuffer front;
+    thread_local HugePageBuffer back;
+    if (layers_.size() > 1) {
+        const std::size_t bytes = rows * max_width_ * sizeof(float);
+        if (front.size() < bytes) {
+            front = HugePageBuffer(bytes, MemoryKind::kActivations);
+            back = HugePageBuffer(bytes, MemoryKind::kActivations);
+        }
+    }
+
+    const float* in = batch.data();
+    std::size_t in_stride = batch.stride();
+    for (std::size_t i = 0; i < layers_.size(); ++i) {
+        const DenseLayer& layer = layers_[i];
+        const LayerWeights& w = *layer.weights;
+        const std::size_t width = w.outputs;
+        float* out = i + 1 == layers_.size() ? outputs : (i % 2 == 0 ? front : back).as<float>();
+        gemm_bias(in, in_stride, rows, w.gemm_weights(), w.inputs, width, w.bias.data(), out,
+                  width, gemm_configs_[i]);
+        activate(layer.activation, out, rows, width, width);
+        in = out;
+        in_stride = width;
+    }
+}
+
+std::shared_ptr<Model> load_model(const std::string& path, LayerStore& store) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("load_model: cannot open " + path);
+    }
+    char magic[4] = {};
+    std::uint32_t format = 0;
+    in.read(magic, sizeof(magic));
+    read_pod(in, format);
+    if (!in || std::memcmp(magic, kModelMagic, sizeof(magic)) != 0 || format == 0 ||
+        format > kModelFormatVersion) {
+        throw std::runtime_error("load_model: bad header in " + path);
+    }
+
+    std::uint32_t version_length = 0;
+    read_pod(in, version_length);
+    if (!in || version_length > 4096) {
+        throw std::runtime_error("load_model: bad version string in " + path);
+    }
+    std::string version(version_length, '\0');
+    in.read(&version[0], version_length);
+
+    std::uint32_t layer_count = 0;
+    read_pod(in, layer_count);
+    if (!in || layer_count == 0 || layer_count > 1024) {
+        throw std::runtime_error("load_model: bad layer count in " + path);
+    }
+
+    std::vector<DenseLayer> layers;
+    layers.reserve(layer_count);
+    for (std::uint32_t i = 0; i < layer_count; ++i) {
+        std::uint32_t inputs = 0;
+        std::uint32_t outputs = 0;
+        std::uint8_t activation = 0;
+        read_pod(in, inputs);
+        read_pod(in, outputs);
+        read_pod(in, activation);
+        if (!in || inputs == 0 || outputs == 0 || inputs > kMaxLayerWidth ||
+            outputs > kMaxLayerWidth ||
+            activation > static_cast<std::uint8_t>(Activation::kSoftmax)) {
+            throw std::runtime_error("load_model: bad layer header in " + path);
+        }
+
+        LayerWeights weights;
+        weights.inputs = inputs;
+        weights.outputs = outputs;
+        if (format >= 2) {
+            std::uint8_t weight_format = 0;
+            read_pod(in, weight_format);
+            if (!in || weight_format > static_cast<std::uint8_t>(WeightFormat::kCodebook4)) {
+                throw std::runtime_error("load_model: bad weight format in " + path);
+            }
+            weights.format = static_cast<WeightFormat>(weight_format);
+            weights.codebook.resize(codebook_entries(weights.format));
+            in.read(reinterpret_cast<char*>(weights.codebook.data()),
+                    static_cast<std::streamsize>(weights.codebook.size() * sizeof(float)));
+        }
+        // Both widths are bounded, so these products fit; the file must
+        // still hold them before anything is allocated.
+        const std::uint64_t matrix_bytes =
+            std::uint64_t{inputs} * weight_row_bytes(weights.format, outputs);
+        if (!in || matrix_bytes + std::uint64_t{outputs} * sizeof(float) > remaining_bytes(in)) {
+            throw std::runtime_error("load_model: truncated file " + path);
+        }
+        weights.weights = HugePageBuffer(matrix_bytes, MemoryKind::kWeights);
+        in.read(weights.weights.as<char>(), static_cast<std::streamsize>(matrix_bytes));
+        weights.bias.resize(outputs);
+        in.read(reinterpret_cast<char*>(weights.bias.data()),
+                static_cast<std::streamsize>(outputs * sizeof(float)));
+        if (!in) {
+            throw std::runtime_error("load_model: truncated file " + path);
+        }
+        layers.push_back({store.intern(std::move(weights)), static_cast<Activation>(activation)});
+    }
+    return std::make_shared<Model>(std::move(version), std::move(layers));
+}
+
+void save_model(const std::string& path, const Model& model) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("save_model: cannot open " + path);
+    }
+    out.write(kModelMagic, sizeof(kModelMagic));
+    write_pod(out, kModelFormatVersion);
+    write_pod(out, static_cast<std::uint32_t>(model.version().size()));
+    out.write(model.version().data(), static_cast<std::streamsize>(model.version().size()));
+    write_pod(out, static_cast<std::uint32_t>(model.layers().size()));
+    for (const DenseLayer& layer : model.layers()) {
+        const LayerWeights& w = *layer.weights;
+        write_pod(out, static_cast<std::uint32_t>(w.inputs));
+        write_pod(out, static_cast<std::uint32_t>(w.outputs));
+        write_pod(out, static_cast<std::uint8_t>(layer.activation));
+        write_pod(out, static_cast<std::uint8_t>(w.format));
+        out.write(reinterpret_cast<const char*>(w.codebook.data()),
+                  static_cast<std::streamsize>(w.codebook.size() * sizeof(float)));
+        out.write(w.weights.as<const char>(), static_cast<std::streamsize>(w.weights.size()));
+        out.write(reinterpret_cast<const char*>(w.bias.data()),
+                  static_cast<std::streamsize>(w.bias.size() * sizeof(float)));
+    }
+    if (!out) {
+        throw std::runtime_error("save_model: write failed for " + path);
+    }
+}
+
+}  // namespace probionis
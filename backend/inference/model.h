@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "inference/gemm.h"
+#include "runtime/huge_page_allocator.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+enum class Activation : std::uint8_t {
+    kNone = 0,
+    kRelu = 1,
+    kSigmoid = 2,
+    kTanh = 3,
+    kGelu = 4,
+    kSoftmax = 5,
+};
+
+// Weights and bias of one dense layer. The matrix is stored input-major
+// ([inputs][outputs]) so the forward pass streams contiguous rows of it,
+// as floats or as codebook indices (see WeightFormat). Immutable once
+// interned; shared by every model whose layer has the same contents.
+struct LayerWeights {
+    std::size_t inputs = 0;
+    std::size_t outputs = 0;
+    WeightFormat format = WeightFormat::kFloat32;
+    // inputs * weight_row_bytes(format, outputs) bytes.
+    HugePageBuffer weights;
+    // codebook_entries(format) values, unused ones zero.
+    std::vector<float> codebook;
+    std::vector<float> bias;
+    // fnv1a64 over dimensions, format, weights, codebook and bias.
+    std::uint64_t fingerprint = 0;
+
+    std::size_t bytes() const {
+        return weights.size() + (codebook.size() + bias.size()) * sizeof(float);
+    }
+    GemmWeights gemm_weights() const { return {format, weights.data(), codebook.data()}; }
+    // Weight (k, j) as a float, whatever the format.
+    float weight(std::size_t k, std::size_t j) const;
+};
+
+struct DenseLayer {
+    std::shared_ptr<const LayerWeights> weights;
+    Activation activation = Activation::kNone;
+};
+
+// Deduplicates layer weights across loaded models. Fine-tuned variants
+// usually retrain only the head, so the frozen layers of every variant
+// resolve to one copy. Holds the layers weakly: a layer is freed once no
+// model uses it, and resident_bytes() counts each live layer once.
+class LayerStore : public std::enable_shared_from_this<LayerStore> {
+public:
+    static std::shared_ptr<LayerStore> create();
+
+    // Returns the stored copy of a layer with these contents, adopting
+    // `layer` if there is none.
+    std::shared_ptr<const LayerWeights> intern(LayerWeights layer);
+
+    std::size_t resident_bytes() const;
+    std::size_t layer_count() const;
+
+private:
+    LayerStore() = default;
+    void forget(const LayerWeights* layer);
+
+    mutable std::mutex mutex_;
+    std::unordered_multimap<std::uint64_t, std::weak_ptr<const LayerWeights>> layers_;
+    std::size_t resident_bytes_ = 0;
+};
+
+// A feed-forward scoring model over preprocessed spectra: dense layers,
+// each followed by an activation. Immutable once shared and safe to run
+// from many threads at once.
+class Model {
+public:
+    Model(std::string version, std::vector<DenseLayer> layers);
+
+    const std::string& version() const { return version_; }
+    std::size_t input_channels() const { return layers_.front().weights->inputs; }
+    std::size_t output_width() const { return layers_.back().weights->outputs; }
+    const std::vector<DenseLayer>& layers() const { return layers_; }
+    // Weight bytes this model references, shared layers included.
+    std::size_t bytes() const;
+
+    // Kernel configuration per layer; default_gemm_config() until tuned
+    // (see KernelTuner). Set before the model is shared.
+    const std::vector<GemmConfig>& gemm_configs() const { return gemm_configs_; }
+    void set_gemm_configs(std::vector<GemmConfig> configs);
+
+    // Scores every row of `batch`, writing output_width() floats per row.
+    void run(const SpectrumBatch& batch, float* outputs) const;
+
+private:
+    std::string version_;
+    std::vector<DenseLayer> layers_;
+    std::vector<GemmConfig> gemm_configs_;
+    std::size_t max_width_ = 0;
+};
+
+// Binary model format: "PBMD", format version, model version string,
+// layer count, then per layer its dimensions, activation, weight format
+// (from version 2), codebook, weights (input-major) and bias, all
+// little-endian. Version 1 files, float weights only, still load.
+std::shared_ptr<Model> load_model(const std::string& path, LayerStore& store);
+void save_model(const std::string& path, const Model& model);
+
+}  // namespace probionis
@@ -0,0 +1,410 @@
+#include "inference/progressive_scorer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "io/parse_error.h"
+#include "io/wire_decode.h"
+
+namespace probionis {
+
+namespace {
+
+std::string path_of(const std::string& target) {
+    return target.substr(0, target.find('?'));
+}
+
+void append_json_string(std::string& out, const std::string& s) {
+    out.push_back('"');
+    for (const char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+void append_json_number(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.9g", value);
+    out += number;
+}
+
+template <typename T>
+void append_json_array(std::string& out, const std::vector<T>& values) {
+    out.push_back('[');
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) {
+            out.push_back(',');
+        }
+        append_json_number(out, static_cast<double>(values[i]));
+    }
+    out.push_back(']');
+}
+
+std::vector<float> run_one(const Model& model, const SpectrumBatch& sample) {
+    std::vector<float> outputs(sample.size() * model.output_width());
+    model.run(sample, outputs.data());
+    return outputs;
+}
+
+}  // namespace
+
+StageFunction model_stage(std::shared_ptr<const Model> model) {
+    if (!model) {
+        throw std::invalid_argument("model_stage: null model");
+    }
+    return [model](const SpectrumBatch& sample) {
+        std::string out = "\"outputs\":";
+        append_json_array(out, run_one(*model, sample));
+        return out;
+    };
+}
+
+StageFunction ensemble_stage(std::vector<std::shared_ptr<const Model>> members) {
+    if (members.empty()) {
+        throw std::invalid_argument("ensemble_stage: no members");
+    }
+    for (const auto& member : members) {
+        if (!member || member->output_width() != members.front()->output_width()) {
+            throw std::invalid_argument("ensemble_stage: members differ in output width");
+        }
+    }
+    return [members](const SpectrumBatch& sample) {
+        const std::size_t width = members.front()->output_width();
+        std::vector<double> sum(width, 0.0);
+        std::vector<double> sum_squares(width, 0.0);
+        for (const auto& member : members) {
+            const std::vector<float> outputs = run_one(*member, sample);
+            for (std::size_t j = 0; j < width; ++j) {
+                sum[j] += outputs[j];
+                sum_squares[j] += static_cast<double>(outputs[j]) * outputs[j];
+            }
+        }
+        const double n = static_cast<double>(members.size());
+        std::vector<double> mean(width);
+        std::vector<double> stddev(width);
+        for (std::size_t j = 0; j < width; ++j) {
+            mean[j] = sum[j] / n;
+            stddev[j] = std::sqrt(std::max(0.0, sum_squares[j] / n - mean[j] * mean[j]));
+        }
+        std::string out = "\"outputs\":";
+        append_json_array(out, mean);
+        out += ",\"stddev\":";
+        append_json_array(out, stddev);
+        return out;
+    };
+}
+
+StageFunction occlusion_stage(std::shared_ptr<const Model> model, std::size_t bands) {
+    if (!model || bands == 0) {
+        throw std::invalid_argument("occlusion_stage: need a model and at least one band");
+    }
+    return [model, bands](const SpectrumBatch& sample) {
+        const std::size_t channels = sample.channels();
+        const std::size_t count = std::min(bands, channels);
+        const std::vector<float> base = run_one(*model, sample);
+        const std::size_t target = static_cast<std::size_t>(
+            std::max_element(base.begin(), base.begin() + model->output_width()) - base.begin());
+
+        // One row per band, the sample with that band zeroed.
+        SpectrumBatch occluded(count, channels);
+        std::vector<std::size_t> starts(count + 1);
+        for (std::size_t b = 0; b <= count; ++b) {
+            starts[b] = channels * b / count;
+        }
+        for (std::size_t b = 0; b < count; ++b) {
+            float* row = occluded.row(b);
+            std::memcpy(row, sample.row(0), channels * sizeof(float));
+            std::fill(row + starts[b], row + starts[b + 1], 0.0f);
+        }
+        occluded.adopt_rows(count, std::vector<std::string>(count, sample.sample_id(0)),
+                            std::vector<std::string>(count, sample.instrument_id(0)));
+        const std::vector<float> outputs = run_one(*model, occluded);
+
+        std::vector<float> attribution(count);
+        std::vector<float> band_starts(count);
+        for (std::size_t b = 0; b < count; ++b) {
+            attribution[b] = base[target] - outputs[b * model->output_width() + target];
+            band_starts[b] = sample.axis().empty() ? static_cast<float>(starts[b])
+                                                   : sample.axis()[starts[b]];
+        }
+        std::string out = "\"target\":" + std::to_string(target) + ",\"attribution\":";
+        append_json_array(out, attribution);
+        out += ",\"band_starts\":";
+        append_json_array(out, band_starts);
+        return out;
+    };
+}
+
+struct ProgressiveScorer::Request {
+    SpectrumBatch sample;
+    Clock::time_point arrived;
+    std::atomic<bool> abandoned{false};
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Per stage, its line without the closing "remaining" member, once done.
+    std::vector<std::optional<std::string>> lines;
+
+    Request(std::size_t channels, std::size_t stages) : sample(1, channels), lines(stages) {}
+};
+
+ProgressiveScorer::ProgressiveScorer(ProgressiveOptions options, Executor& executor)
+    : options_(std::move(options)),
+      executor_(executor),
+      timeouts_(global_metrics().counter("probionis_progressive_timeouts_total",
+                                         "Progressive stages reported as timed out")),
+      abandoned_(global_metrics().counter(
+          "probionis_progressive_abandoned_total",
+          "Progressive responses whose client left before the last stage")) {
+    if (options_.axis.empty() || options_.stages.empty()) {
+        throw std::invalid_argument("ProgressiveScorer: need an axis and at least one stage");
+    }
+    for (const ProgressiveStage& stage : options_.stages) {
+        if (!stage.compute) {
+            throw std::invalid_argument("ProgressiveScorer: stage " + stage.name +
+                                        " has no function");
+        }
+        stage_us_.push_back(&global_metrics().histogram(
+            labeled_name("probionis_progressive_stage_us", "stage", stage.name),
+            latency_buckets_us(), "Time from request arrival to a progressive stage's result"));
+    }
+}
+
+ProgressiveScorer::~ProgressiveScorer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+}
+
+std::shared_ptr<ProgressiveScorer::Request> ProgressiveScorer::start(
+    const Spectrum& preprocessed, Clock::time_point arrived) {
+    if (preprocessed.empty()) {
+        throw std::invalid_argument("ProgressiveScorer: empty spectrum");
+    }
+    auto request = std::make_shared<Request>(preprocessed.size(), options_.stages.size());
+    request->arrived = arrived;
+    std::copy(preprocessed.intensity.begin(), preprocessed.intensity.end(),
+              request->sample.row(0));
+    request->sample.adopt_rows(1, {preprocessed.sample_id}, {preprocessed.instrument_id});
+    if (preprocessed.axis.size() == preprocessed.size()) {
+        request->sample.set_axis(preprocessed.axis);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_ += options_.stages.size();
+    }
+    for (std::size_t i = 0; i < options_.stages.size(); ++i) {
+        executor_.submit([this, request, i] { run_stage(*request, i); },
+                         options_.stages[i].priority);
+    }
+    return request;
+}
+
+void ProgressiveScorer::run_stage(Request& request, std::size_t index) {
+    // Counted out however the stage ends, so the destructor never waits on
+    // one that threw.
+    struct Finished {
+        ProgressiveScorer& scorer;
+        ~Finished() {
+            std::lock_guard<std::mutex> lock(scorer.mutex_);
+            if (--scorer.in_flight_ == 0) {
+                scorer.idle_.notify_all();
+            }
+        }
+    } finished{*this};
+
+    const ProgressiveStage& stage = options_.stages[index];
+    std::string line = "{\"sample_id\":";
+    append_json_string(line, request.sample.sample_id(0));
+    line += ",\"stage\":";
+    append_json_string(line, stage.name);
+    // Nobody will read it; leave the CPU to live requests.
+    if (!request.abandoned.load(std::memory_order_relaxed)) {
+        std::string result;
+        try {
+            result = stage.compute(request.sample);
+        } catch (const std::exception& e) {
+            result = "\"error\":";
+            append_json_string(result, e.what());
+        } catch (...) {
+            result = "\"error\":\"unknown exception\"";
+        }
+        const double elapsed_us =
+            std::chrono::duration<double, std::micro>(Clock::now() - request.arrived).count();
+        stage_us_[index]->record(elapsed_us);
+        line += ",\"elapsed_ms\":";
+        append_json_number(line, elapsed_us / 1e3);
+        if (!result.empty()) {
+            line += "," + result;
+        }
+        std::lock_guard<std::mutex> lock(request.mutex);
+        request.lines[index] = std::move(line);
+        request.changed.notify_all();
+    }
+}
+
+void ProgressiveScorer::stream(Request& request, const HttpBodyWriter& write) {
+    const Clock::time_point deadline = request.arrived + options_.deadline;
+    const std::size_t stages = options_.stages.size();
+    std::vector<bool> sent(stages, false);
+    std::size_t remaining = stages;
+    const auto send = [&](std::size_t index, std::string line) {
+        sent[index] = true;
+        --remaining;
+        line += ",\"remaining\":" + std::to_string(remaining) + "}\n";
+        return write(line);
+    };
+
+    std::unique_lock<std::mutex> lock(request.mutex);
+    while (remaining > 0) {
+        // The screening result leads; the rest go in completion order.
+        std::size_t ready = stages;
+        for (std::size_t i = 0; i < stages && ready == stages; ++i) {
+            if (!sent[i] && request.lines[i] && (i == 0 || sent[0])) {
+                ready = i;
+            }
+        }
+        if (ready == stages) {
+            if (request.changed.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
+            }
+            continue;
+        }
+        std::string line = std::move(*request.lines[ready]);
+        lock.unlock();
+        if (!send(ready, std::move(line))) {
+            request.abandoned.store(true, std::memory_order_relaxed);
+            abandoned_.add();
+            return;
+        }
+        lock.lock();
+    }
+    if (remaining == 0) {
+        return;
+    }
+    // Past the deadline. Results that are in, including those held back
+    // behind an unsent screening line, still go out; only stages with no
+    // result yet are reported as timed out.
+    std::vector<std::optional<std::string>> ready(stages);
+    for (std::size_t i = 0; i < stages; ++i) {
+        if (!sent[i]) {
+            ready[i] = std::move(request.lines[i]);
+        }
+    }
+    lock.unlock();
+    request.abandoned.store(true, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < stages; ++i) {
+        if (sent[i]) {
+            continue;
+        }
+        std::string line;
+        if (ready[i]) {
+            line = std::move(*ready[i]);
+        } else {
+            timeouts_.add();
+            line = "{\"sample_id\":";
+            append_json_string(line, request.sample.sample_id(0));
+            line += ",\"stage\":";
+            append_json_string(line, options_.stages[i].name);
+            line += ",\"timed_out\":true";
+        }
+        if (!send(i, std::move(line))) {
+            return;
+        }
+    }
+}
+
+void ProgressiveScorer::score(const Spectrum& preprocessed, const HttpBodyWriter& write) {
+    const std::shared_ptr<Request> request = start(preprocessed, Clock::now());
+    stream(*request, write);
+}
+
+bool ProgressiveScorer::handle(const HttpRequest& request, HttpResponse& response) {
+    if (path_of(request.target) != "/score/progressive") {
+        return false;
+    }
+    const Clock::time_point arrived = Clock::now();
+    if (request.method != "POST") {
+        response.status = 400;
+        response.body = "POST the intensities\n";
+        return true;
+    }
+    Spectrum spectrum;
+    spectrum.sample_id = query_parameter(request.target, "sample_id");
+    if (spectrum.sample_id.empty()) {
+        response.status = 400;
+        response.body = "sample_id is required\n";
+        return true;
+    }
+    const WireEncoding encoding =
+        wire_encoding_for(find_header(request.headers, "Content-Type"));
+    spectrum.axis = options_.axis;
+    spectrum.intensity.resize(options_.axis.size());
+    try {
+        decode_intensities(request.body.data(), request.body.size(), encoding,
+                           spectrum.intensity.data(), spectrum.intensity.size());
+    } catch (const ParseError& e) {
+        response.status = 400;
+        response.body = std::string(e.what()) + "\n";
+        return true;
+    }
+
+    // QC and preprocessing on a compute worker, like batched requests.
+    QcResult qc;
+    if (options_.pipeline) {
+        std::promise<QcResult> done;
+        std::future<QcResult> result = done.get_future();
+        executor_.submit(
+            [&] {
+                try {
+                    done.set_value(options_.pipeline->run(spectrum));
+                } catch (...) {
+                    done.set_exception(std::current_exception());
+                }
+            },
+            TaskPriority::kInteractive);
+        qc = result.get();
+    }
+    if (!qc.ok()) {
+        response.status = 422;
+        response.headers.emplace_back("Content-Type", "application/json");
+        response.body = "{\"sample_id\":";
+        append_json_string(response.body, spectrum.sample_id);
+        response.body += ",\"qc\":";
+        append_json_string(response.body, qc_reason_name(qc.reason));
+        response.body += "}\n";
+        return true;
+    }
+
+    std::shared_ptr<Request> scoring = start(spectrum, arrived);
+    response.status = 200;
+    response.headers.emplace_back("Content-Type", "application/x-ndjson");
+    response.headers.emplace_back("Cache-Control", "no-store");
+    response.stream = [this, scoring](const HttpBodyWriter& write) { stream(*scoring, write); };
+    return true;
+}
+
+}  // namespace probionis
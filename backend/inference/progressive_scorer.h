@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "inference/model.h"
+#include "net/http.h"
+#include "preprocess/pipeline.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+// Computes one stage's result for a single preprocessed sample, returned
+// as the members of a JSON object without the braces, e.g.
+// "\"outputs\":[0.1,0.9]". Throwing reports the stage as failed.
+using StageFunction = std::function<std::string(const SpectrumBatch& sample)>;
+
+struct ProgressiveStage {
+    // Reported as "stage" on the result line.
+    std::string name;
+    StageFunction compute;
+    TaskPriority priority = TaskPriority::kNormal;
+};
+
+struct ProgressiveOptions {
+    // Axis of the raw spectra handle() receives; its size is the channel
+    // count of a request body.
+    std::vector<float> axis;
+    // QC gate and preprocessing run before any stage, if set.
+    std::shared_ptr<const Pipeline> pipeline;
+    // The first stage is the screening prediction: it should be cheap, run
+    // at kInteractive, and is always sent first. The others are sent as
+    // they complete.
+    std::vector<ProgressiveStage> stages;
+    // Stages still running this long after the request arrived are
+    // reported as timed out, and the response ends.
+    std::chrono::milliseconds deadline{30000};
+};
+
+// Stage functions for the usual refinements.
+//
+// model_stage: "outputs" of one model.
+// ensemble_stage: "outputs" averaged over the members and their "stddev",
+// the members' disagreement, as the uncertainty of the prediction.
+// occlusion_stage: "attribution" per band of `bands` equal channel ranges
+// (starting at "band_starts" on the axis): how much the model's top
+// output drops when the band is zeroed. All bands are scored in one batch.
+StageFunction model_stage(std::shared_ptr<const Model> model);
+StageFunction ensemble_stage(std::vector<std::shared_ptr<const Model>> members);
+StageFunction occlusion_stage(std::shared_ptr<const Model> model, std::size_t bands);
+
+// Answers a scoring request progressively: the screening prediction goes
+// out as soon as it is ready, and refined results (full model, ensemble
+// uncertainty, explanation) follow on the same response as they complete.
+// Every stage is queued on the executor at once, at its own priority, so
+// the expensive outputs cost no extra latency but the UI never waits for
+// them. If the client goes away, stages not yet started are skipped.
+//
+// The body is newline-delimited JSON, one line per stage:
+//
+//     {"sample_id":"S1","stage":"screening","elapsed_ms":1.8,"outputs":[0.93],"remaining":3}
+//
+// A failed stage carries "error" and a late one "timed_out":true instead
+// of its results; "remaining" counts the lines still to come.
+class ProgressiveScorer {
+public:
+    ProgressiveScorer(ProgressiveOptions options, Executor& executor = shared_executor());
+    // Waits for stages still running.
+    ~ProgressiveScorer();
+
+    ProgressiveScorer(const ProgressiveScorer&) = delete;
+    ProgressiveScorer& operator=(const ProgressiveScorer&) = delete;
+
+    // Runs every stage on an already preprocessed spectrum and passes each
+    // result line to `write` as it completes; returns after the last one.
+    void score(const Spectrum& preprocessed, const HttpBodyWriter& write);
+
+    // POST /score/progressive?sample_id=ID with the intensities as the
+    // body, in the encoding its Content-Type names (see wire_encoding_for):
+    // float32 little-endian, decimals, or encoded repeats, which are
+    // averaged first.
+    // Streams the result lines; 400 on a malformed body, 422 with the QC
+    // reason when the gate rejects the sample. Returns false for any other
+    // target.
+    bool handle(const HttpRequest& request, HttpResponse& response);
+
+    const ProgressiveOptions& options() const { return options_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Request;
+
+    std::shared_ptr<Request> start(const Spectrum& preprocessed, Clock::time_point arrived);
+    void run_stage(Request& request, std::size_t index);
+    void stream(Request& request, const HttpBodyWriter& write);
+
+    ProgressiveOptions options_;
+    Executor& executor_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::size_t in_flight_ = 0;
+
+    std::vector<Histogram*> stage_us_;
+    Counter& timeouts_;
+    Counter& abandoned_;
+};
+
+}  // namespace probionis
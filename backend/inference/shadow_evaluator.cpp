@@ -0,0 +1,222 @@
+#include "inference/shadow_evaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// FNV alone spreads short IDs poorly over the high bits; finish with a
+// murmur-style mix before comparing against the threshold.
+std::uint64_t sample_hash(const std::string& id) {
+    std::uint64_t h = fnv1a64(id.data(), id.size());
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// `name{model="...",role="..."}`; the model version is escaped, the role
+// is one of ours.
+std::string model_metric(const std::string& name, const char* role, const std::string& model) {
+    std::string labeled = labeled_name(name, "model", model);
+    labeled.pop_back();
+    return labeled + ",role=\"" + role + "\"}";
+}
+
+double to_us(std::chrono::nanoseconds d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+}  // namespace
+
+struct ShadowEvaluator::Job {
+    std::unique_ptr<SpectrumBatch> batch;
+    std::vector<float> primary_outputs;
+    std::size_t output_width = 0;
+};
+
+ShadowEvaluator::ShadowEvaluator(ShadowOptions options, BatchHandler candidate,
+                                 Executor& executor)
+    : options_(std::move(options)),
+      candidate_(std::move(candidate)),
+      executor_(executor),
+      sample_all_(options_.sample_rate >= 1.0),
+      sample_threshold_(sample_all_ ? 0
+                                    : static_cast<std::uint64_t>(
+                                          std::max(0.0, options_.sample_rate) * 0x1p64)),
+      primary_latency_(global_metrics().histogram(
+          model_metric("probionis_model_batch_latency_us", "primary", options_.primary_model),
+          latency_buckets_us(), "Model batch latency by model version")),
+      candidate_latency_(global_metrics().histogram(
+          model_metric("probionis_model_batch_latency_us", "shadow", options_.candidate_model),
+          latency_buckets_us(), "Model batch latency by model version")),
+      sampled_(global_metrics().counter(
+          labeled_name("probionis_shadow_sampled_total", "candidate", options_.candidate_model),
+          "Samples selected for shadow scoring")),
+      dropped_(global_metrics().counter(
+          labeled_name("probionis_shadow_dropped_total", "candidate", options_.candidate_model),
+          "Sampled rows skipped because the shadow queue was full")),
+      compared_(global_metrics().counter(
+          labeled_name("probionis_shadow_compared_total", "candidate", options_.candidate_model),
+          "Rows scored by both the primary and the candidate")),
+      agreed_(global_metrics().counter(
+          labeled_name("probionis_shadow_agreed_total", "candidate", options_.candidate_model),
+          "Compared rows where the candidate reached the primary's decision")),
+      failures_(global_metrics().counter(
+          labeled_name("probionis_shadow_failures_total", "candidate", options_.candidate_model),
+          "Shadow batches whose candidate model threw")),
+      agreement_(global_metrics().gauge(
+          labeled_name("probionis_shadow_agreement_ratio", "candidate", options_.candidate_model),
+          "Fraction of compared rows in agreement")),
+      mean_abs_delta_(global_metrics().gauge(
+          labeled_name("probionis_shadow_mean_abs_delta", "candidate", options_.candidate_model),
+          "Mean absolute difference between primary and candidate outputs")) {
+    if (!candidate_) {
+        throw std::invalid_argument("ShadowEvaluator: no candidate handler");
+    }
+    if (options_.max_in_flight == 0) {
+        throw std::invalid_argument("ShadowEvaluator: max_in_flight must be positive");
+    }
+}
+
+ShadowEvaluator::~ShadowEvaluator() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+}
+
+bool ShadowEvaluator::sampled(const std::string& sample_id) const {
+    return sample_all_ || sample_hash(sample_id) < sample_threshold_;
+}
+
+void ShadowEvaluator::observe(const SpectrumBatch& batch, const float* outputs,
+                              std::size_t output_width,
+                              std::chrono::nanoseconds primary_latency) {
+    primary_latency_.record(to_us(primary_latency));
+
+    std::vector<std::size_t> rows;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (sampled(batch.sample_id(i))) {
+            rows.push_back(i);
+        }
+    }
+    if (rows.empty()) {
+        return;
+    }
+    sampled_.add(rows.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (in_flight_ >= options_.max_in_flight) {
+            dropped_.add(rows.size());
+            return;
+        }
+        ++in_flight_;
+    }
+
+    auto job = std::make_shared<Job>();
+    try {
+        job->batch = std::make_unique<SpectrumBatch>(rows.size(), batch.channels(),
+                                                     batch.stride());
+        job->output_width = output_width;
+        job->primary_outputs.reserve(rows.size() * output_width);
+        std::vector<std::string> sample_ids;
+        std::vector<std::string> instrument_ids;
+        for (std::size_t k = 0; k < rows.size(); ++k) {
+            std::memcpy(job->batch->row(k), batch.row(rows[k]), batch.stride() * sizeof(float));
+            sample_ids.push_back(batch.sample_id(rows[k]));
+            instrument_ids.push_back(batch.instrument_id(rows[k]));
+            const float* out = outputs + rows[k] * output_width;
+            job->primary_outputs.insert(job->primary_outputs.end(), out, out + output_width);
+        }
+        job->batch->adopt_rows(rows.size(), std::move(sample_ids), std::move(instrument_ids));
+        if (!batch.axis().empty()) {
+            job->batch->set_axis(batch.axis());
+        }
+        executor_.submit([this, job] { run(*job); }, TaskPriority::kBackground);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --in_flight_;
+        idle_.notify_all();
+        throw;
+    }
+}
+
+void ShadowEvaluator::run(Job& job) {
+    SpectrumBatch& batch = *job.batch;
+    const std::size_t width = job.output_width;
+    std::vector<float> outputs(batch.size() * width);
+    bool ok = true;
+    const Clock::time_point started = Clock::now();
+    try {
+        candidate_(batch, outputs.data());
+    } catch (...) {
+        // Whatever it throws, in_flight_ must come down below.
+        ok = false;
+    }
+    candidate_latency_.record(to_us(Clock::now() - started));
+
+    std::uint64_t agreed = 0;
+    double abs_delta = 0.0;
+    if (ok) {
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const float* p = job.primary_outputs.data() + i * width;
+            const float* c = outputs.data() + i * width;
+            agreed += agree(p, c, width) ? 1 : 0;
+            for (std::size_t k = 0; k < width; ++k) {
+                abs_delta += std::fabs(static_cast<double>(p[k]) - c[k]);
+            }
+        }
+    }
+
+    // Counted together with freeing the slot, so whoever sees the batch in
+    // stats() also finds the slot free.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        failures_.add();
+    } else {
+        compared_.add(batch.size());
+        agreed_.add(agreed);
+        abs_delta_sum_ += abs_delta;
+        delta_count_ += batch.size() * width;
+        const std::uint64_t compared = compared_.value();
+        agreement_.set(compared ? static_cast<double>(agreed_.value()) / compared : 0.0);
+        mean_abs_delta_.set(delta_count_ ? abs_delta_sum_ / delta_count_ : 0.0);
+    }
+    --in_flight_;
+    idle_.notify_all();
+}
+
+bool ShadowEvaluator::agree(const float* primary, const float* candidate,
+                            std::size_t width) const {
+    if (width == 1) {
+        return (primary[0] >= options_.decision_threshold) ==
+               (candidate[0] >= options_.decision_threshold);
+    }
+    return std::max_element(primary, primary + width) - primary ==
+           std::max_element(candidate, candidate + width) - candidate;
+}
+
+ShadowStats ShadowEvaluator::stats() const {
+    ShadowStats stats;
+    stats.sampled = sampled_.value();
+    stats.dropped = dropped_.value();
+    stats.compared = compared_.value();
+    stats.agreed = agreed_.value();
+    stats.failed_batches = failures_.value();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.mean_abs_delta = delta_count_ ? abs_delta_sum_ / delta_count_ : 0.0;
+    return stats;
+}
+
+}  // namespace probionis
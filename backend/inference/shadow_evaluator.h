@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+// Runs the model on a dense batch, writing output_width floats per row.
+using BatchHandler = std::function<void(SpectrumBatch& batch, float* outputs)>;
+
+struct ShadowOptions {
+    // Version labels for metrics.
+    std::string primary_model;
+    std::string candidate_model;
+    // Fraction of samples also scored by the candidate, chosen by sample ID
+    // so a given sample is always or never shadowed.
+    double sample_rate = 0.01;
+    // Shadow batches queued or running at once. Beyond it samples are
+    // dropped rather than left to compete with primary work.
+    std::size_t max_in_flight = 2;
+    // Single-output models agree when both scores fall on the same side of
+    // this; wider outputs agree when their argmax matches.
+    float decision_threshold = 0.5f;
+};
+
+struct ShadowStats {
+    std::uint64_t sampled = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t compared = 0;
+    std::uint64_t agreed = 0;
+    std::uint64_t failed_batches = 0;
+    double mean_abs_delta = 0.0;
+};
+
+// Scores a sample of live traffic with a candidate model without touching
+// responses. The primary path hands over each batch after its replies are
+// out; sampled rows, already preprocessed, are copied with the primary's
+// outputs and scored by the candidate at background priority. Agreement
+// and per-model batch latency are exported as metrics.
+class ShadowEvaluator {
+public:
+    ShadowEvaluator(ShadowOptions options, BatchHandler candidate,
+                    Executor& executor = shared_executor());
+    // Waits for shadow batches still in flight.
+    ~ShadowEvaluator();
+
+    ShadowEvaluator(const ShadowEvaluator&) = delete;
+    ShadowEvaluator& operator=(const ShadowEvaluator&) = delete;
+
+    bool sampled(const std::string& sample_id) const;
+
+    // Records the primary's latency and queues the sampled rows of `batch`.
+    // Copies what it needs before returning.
+    void observe(const SpectrumBatch& batch, const float* outputs, std::size_t output_width,
+                 std::chrono::nanoseconds primary_latency);
+
+    ShadowStats stats() const;
+    const ShadowOptions& options() const { return options_; }
+
+private:
+    struct Job;
+
+    void run(Job& job);
+    bool agree(const float* primary, const float* candidate, std::size_t width) const;
+
+    ShadowOptions options_;
+    BatchHandler candidate_;
+    Executor& executor_;
+    // Hashes below the threshold are sampled.
+    bool sample_all_;
+    std::uint64_t sample_threshold_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::size_t in_flight_ = 0;
+    double abs_delta_sum_ = 0.0;
+    std::uint64_t delta_count_ = 0;
+
+    Histogram& primary_latency_;
+    Histogram& candidate_latency_;
+    Counter& sampled_;
+    Counter& dropped_;
+    Counter& compared_;
+    Counter& agreed_;
+    Counter& failures_;
+    Gauge& agreement_;
+    Gauge& mean_abs_delta_;
+};
+
+}  // namespace probionis
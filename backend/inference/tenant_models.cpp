@@ -0,0 +1,292 @@
+#include "inference/tenant_models.h"
+
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+constexpr std::size_t kMaxTenantLength = 128;
+
+// Tenant names become file names and metric labels.
+void check_tenant(const std::string& tenant) {
+    bool ok = !tenant.empty() && tenant.size() <= kMaxTenantLength && tenant[0] != '.';
+    for (const char c : tenant) {
+        ok = ok && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.');
+    }
+    if (!ok) {
+        throw std::invalid_argument("TenantModelHost: bad tenant name '" + tenant + "'");
+    }
+}
+
+std::string join_path(const std::string& dir, const std::string& name) {
+    if (dir.empty()) {
+        return name;
+    }
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
+
+}  // namespace
+
+struct TenantModelHost::Entry {
+    TenantQuota quota;
+    std::shared_ptr<const Model> model;
+    bool loading = false;
+    // Host clock value at the last acquire; the smallest is evicted first.
+    std::uint64_t last_used = 0;
+};
+
+TenantModelHost::TenantModelHost(TenantModelOptions options, Executor& executor)
+    : options_(std::move(options)),
+      executor_(executor),
+      store_(LayerStore::create()),
+      scheduler_(options_.scheduling, executor),
+      load_counter_(global_metrics().counter("probionis_tenant_model_loads_total",
+                                             "Tenant models loaded from disk")),
+      eviction_counter_(global_metrics().counter(
+          "probionis_tenant_model_evictions_total",
+          "Idle tenant models unloaded to stay under the memory budget")),
+      load_failures_(global_metrics().counter("probionis_tenant_model_load_failures_total",
+                                              "Tenant model loads that failed or were over quota")),
+      loaded_models_(global_metrics().gauge("probionis_tenant_models_loaded",
+                                            "Tenant models currently resident")),
+      resident_bytes_(global_metrics().gauge(
+          "probionis_tenant_model_resident_bytes",
+          "Weight bytes resident for tenant models, shared layers counted once")),
+      shared_bytes_(global_metrics().gauge(
+          "probionis_tenant_model_shared_bytes",
+          "Weight bytes saved by sharing identical layers across tenant models")) {
+    if (!(options_.default_quota.cpu_share > 0.0)) {
+        throw std::invalid_argument("TenantModelHost: default cpu_share must be positive");
+    }
+}
+
+TenantModelHost::~TenantModelHost() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    loaded_.wait(lock, [this] { return pending_loads_ == 0 && running_ == 0; });
+}
+
+TenantModelHost::Entry& TenantModelHost::entry_locked(const std::string& tenant) {
+    auto& slot = entries_[tenant];
+    if (!slot) {
+        slot = std::make_unique<Entry>();
+        slot->quota = options_.default_quota;
+        scheduler_.set_share(tenant, slot->quota.cpu_share);
+    }
+    return *slot;
+}
+
+void TenantModelHost::set_quota(const std::string& tenant, const TenantQuota& quota) {
+    check_tenant(tenant);
+    if (!(quota.cpu_share > 0.0)) {
+        throw std::invalid_argument("TenantModelHost::set_quota: cpu_share must be positive");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entry_locked(tenant);
+    entry.quota = quota;
+    scheduler_.set_share(tenant, quota.cpu_share);
+    // Unload a model the lowered quota no longer admits, unless a batch is
+    // using it; its next use reloads and fails.
+    if (quota.memory_bytes && entry.model && entry.model.use_count() == 1 &&
+        entry.model->bytes() > quota.memory_bytes) {
+        entry.model.reset();
+        update_gauges_locked();
+    }
+}
+
+std::shared_ptr<const Model> TenantModelHost::load(const std::string& tenant,
+                                                   const TenantQuota& quota) {
+    std::string path = join_path(options_.model_dir, tenant + ".pbmd");
+    if (!std::ifstream(path)) {
+        path = join_path(options_.model_dir, options_.default_model);
+    }
+    std::shared_ptr<Model> model = load_model(path, *store_);
+    if (quota.memory_bytes && model->bytes() > quota.memory_bytes) {
+        throw std::runtime_error("TenantModelHost: model " + model->version() + " for tenant " +
+                                 tenant + " needs " + std::to_string(model->bytes()) +
+                                 " bytes, quota is " + std::to_string(quota.memory_bytes));
+    }
+    if (options_.kernel_tuner) {
+        options_.kernel_tuner->tune(*model);
+    }
+    return model;
+}
+
+std::shared_ptr<const Model> TenantModelHost::acquire(const std::string& tenant) {
+    check_tenant(tenant);
+    std::unique_lock<std::mutex> lock(mutex_);
+    Entry& entry = entry_locked(tenant);
+    // One load per tenant at a time; concurrent first requests wait for it.
+    while (!entry.model && entry.loading) {
+        loaded_.wait(lock);
+    }
+    if (entry.model) {
+        entry.last_used = ++clock_;
+        // Models released since the last load may have left the host over
+        // budget.
+        evict_locked(&entry);
+        update_gauges_locked();
+        return entry.model;
+    }
+
+    entry.loading = true;
+    const TenantQuota quota = entry.quota;
+    lock.unlock();
+    std::shared_ptr<const Model> model;
+    try {
+        model = load(tenant, quota);
+    } catch (...) {
+        load_failures_.add();
+        lock.lock();
+        entry.loading = false;
+        loaded_.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    entry.loading = false;
+    entry.model = model;
+    entry.last_used = ++clock_;
+    ++loads_;
+    load_counter_.add();
+    evict_locked(&entry);
+    update_gauges_locked();
+    loaded_.notify_all();
+    return model;
+}
+
+void TenantModelHost::evict_locked(const Entry* keep) {
+    while (store_->resident_bytes() > options_.memory_budget_bytes) {
+        Entry* victim = nullptr;
+        for (auto& [tenant, entry] : entries_) {
+            // use_count() cannot rise while the lock is held: new references
+            // only come from acquire().
+            if (entry.get() == keep || !entry->model || entry->model.use_count() > 1) {
+                continue;
+            }
+            if (!victim || entry->last_used < victim->last_used) {
+                victim = entry.get();
+            }
+        }
+        if (!victim) {
+            // Everything else is running; stay over budget until it is not.
+            return;
+        }
+        victim->model.reset();
+        ++evictions_;
+        eviction_counter_.add();
+    }
+}
+
+void TenantModelHost::submit(const std::string& tenant, SpectrumBatch& batch, float* outputs,
+                             Done done) {
+    check_tenant(tenant);
+    std::shared_ptr<const Model> model;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entry_locked(tenant);
+        if (entry.model) {
+            model = entry.model;
+            entry.last_used = ++clock_;
+            evict_locked(&entry);
+            update_gauges_locked();
+        } else {
+            ++pending_loads_;
+        }
+    }
+    if (model) {
+        run(tenant, std::move(model), batch, outputs, std::move(done));
+        return;
+    }
+
+    // First use: read the model on the blocking pool, not a compute worker.
+    executor_.submit_blocking([this, tenant, &batch, outputs, done = std::move(done)]() mutable {
+        try {
+            run(tenant, acquire(tenant), batch, outputs, done);
+        } catch (...) {
+            done(std::current_exception());
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        --pending_loads_;
+        loaded_.notify_all();
+    });
+}
+
+void TenantModelHost::run(const std::string& tenant, std::shared_ptr<const Model> model,
+                          SpectrumBatch& batch, float* outputs, Done done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++running_;
+    }
+    scheduler_.submit(tenant, [this, model = std::move(model), &batch, outputs,
+                               done = std::move(done)]() mutable {
+        std::exception_ptr error;
+        try {
+            model->run(batch, outputs);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Drop the batch's reference first, so the model is idle (and can be
+        // evicted) once the caller hears it is done.
+        model.reset();
+        {
+            // Nothing below touches the host, so the destructor may go on
+            // once running_ drops.
+            std::lock_guard<std::mutex> lock(mutex_);
+            evict_locked(nullptr);
+            update_gauges_locked();
+            --running_;
+            loaded_.notify_all();
+        }
+        done(error);
+    });
+}
+
+void TenantModelHost::score(const std::string& tenant, SpectrumBatch& batch, float* outputs) {
+    std::promise<void> finished;
+    std::future<void> result = finished.get_future();
+    submit(tenant, batch, outputs, [&finished](std::exception_ptr error) {
+        if (error) {
+            finished.set_exception(error);
+        } else {
+            finished.set_value();
+        }
+    });
+    result.get();
+}
+
+TenantHostStats TenantModelHost::stats_locked() const {
+    TenantHostStats stats;
+    stats.tenants = entries_.size();
+    std::size_t referenced = 0;
+    for (const auto& [tenant, entry] : entries_) {
+        if (entry->model) {
+            ++stats.loaded_models;
+            referenced += entry->model->bytes();
+        }
+    }
+    stats.resident_bytes = store_->resident_bytes();
+    // Evicted models still finishing a batch are resident but unreferenced.
+    stats.shared_bytes = referenced > stats.resident_bytes ? referenced - stats.resident_bytes : 0;
+    stats.loads = loads_;
+    stats.evictions = evictions_;
+    return stats;
+}
+
+void TenantModelHost::update_gauges_locked() {
+    const TenantHostStats stats = stats_locked();
+    loaded_models_.set(static_cast<double>(stats.loaded_models));
+    resident_bytes_.set(static_cast<double>(stats.resident_bytes));
+    shared_bytes_.set(static_cast<double>(stats.shared_bytes));
+}
+
+TenantHostStats TenantModelHost::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_locked();
+}
+
+}  // namespace probionis
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "inference/fair_share.h"
+#include "inference/kernel_tuner.h"
+#include "inference/model.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+struct TenantQuota {
+    // Relative CPU weight against other tenants while they compete.
+    double cpu_share = 1.0;
+    // Weight bytes the tenant's model may reference, shared layers
+    // included; 0 for no limit. A model over quota fails to load.
+    std::size_t memory_bytes = 0;
+};
+
+struct TenantModelOptions {
+    // Tenant T loads <model_dir>/T.pbmd, or the shared default model when
+    // it has no variant of its own.
+    std::string model_dir;
+    std::string default_model = "default.pbmd";
+    // Weight bytes kept resident across all tenants, each shared layer
+    // counted once. Beyond it the least recently used idle models are
+    // unloaded; models running a batch are never unloaded, but go as soon
+    // as the batch finishes if the host is still over budget.
+    std::size_t memory_budget_bytes = std::size_t{8} << 30;
+    TenantQuota default_quota;
+    FairShareOptions scheduling;
+    // Configures the kernels of every loaded model; null keeps defaults.
+    std::shared_ptr<KernelTuner> kernel_tuner;
+};
+
+struct TenantHostStats {
+    std::size_t tenants = 0;
+    std::size_t loaded_models = 0;
+    std::size_t resident_bytes = 0;
+    // Bytes the loaded models would take without layer sharing, less
+    // resident_bytes.
+    std::size_t shared_bytes = 0;
+    std::uint64_t loads = 0;
+    std::uint64_t evictions = 0;
+};
+
+// Hosts per-tenant model variants on one process. A tenant's model is
+// loaded on its first request (off the compute workers for asynchronous
+// requests) and unloaded when idle and memory runs over budget. Layers
+// identical across variants are stored once (see LayerStore), so hundreds
+// of head-only fine-tunes cost little more than their heads. Scoring runs
+// through a FairShareScheduler, so a tenant flooding the host gets its
+// share of the CPU and no more while others have work.
+class TenantModelHost {
+public:
+    using Done = std::function<void(std::exception_ptr error)>;
+
+    explicit TenantModelHost(TenantModelOptions options, Executor& executor = shared_executor());
+    // Waits for queued and running batches.
+    ~TenantModelHost();
+
+    TenantModelHost(const TenantModelHost&) = delete;
+    TenantModelHost& operator=(const TenantModelHost&) = delete;
+
+    void set_quota(const std::string& tenant, const TenantQuota& quota);
+
+    // The tenant's model, loading it on first use. Blocks on disk; callers
+    // on compute workers should use submit(). Holding the pointer keeps
+    // the model resident.
+    std::shared_ptr<const Model> acquire(const std::string& tenant);
+
+    // Scores `batch` with the tenant's model into `outputs`
+    // (output_width() floats per row), then calls `done` from a worker.
+    // `batch` and `outputs` must stay valid until then.
+    void submit(const std::string& tenant, SpectrumBatch& batch, float* outputs, Done done);
+    // Synchronous submit() for threads outside the executor.
+    void score(const std::string& tenant, SpectrumBatch& batch, float* outputs);
+
+    TenantHostStats stats() const;
+
+private:
+    struct Entry;
+
+    Entry& entry_locked(const std::string& tenant);
+    std::shared_ptr<const Model> load(const std::string& tenant, const TenantQuota& quota);
+    void evict_locked(const Entry* keep);
+    void run(const std::string& tenant, std::shared_ptr<const Model> model,
+             SpectrumBatch& batch, float* outputs, Done done);
+    TenantHostStats stats_locked() const;
+    void update_gauges_locked();
+
+    TenantModelOptions options_;
+    Executor& executor_;
+    std::shared_ptr<LayerStore> store_;
+    FairShareScheduler scheduler_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable loaded_;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries_;
+    std::uint64_t clock_ = 0;
+    // Loads queued on the blocking pool and batches handed to scheduler_;
+    // both touch the host when they finish.
+    std::size_t pending_loads_ = 0;
+    std::size_t running_ = 0;
+    std::uint64_t loads_ = 0;
+    std::uint64_t evictions_ = 0;
+
+    Counter& load_counter_;
+    Counter& eviction_counter_;
+    Counter& load_failures_;
+    Gauge& loaded_models_;
+    Gauge& resident_bytes_;
+    Gauge& shared_bytes_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,209 @@
+#include "inference/weight_codebook.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+// 1-D k-means over sorted values. Clusters are contiguous runs of the
+// sorted weights split at the midpoints between centroids, so with prefix
+// sums one Lloyd iteration costs a binary search per centroid.
+std::vector<double> kmeans_1d(const std::vector<float>& sorted, std::size_t clusters,
+                              std::size_t max_iterations) {
+    const std::size_t n = sorted.size();
+    std::vector<double> centroids;
+    for (std::size_t i = 0; i < clusters; ++i) {
+        const double start = sorted[(2 * i + 1) * n / (2 * clusters)];
+        if (centroids.empty() || start != centroids.back()) {
+            centroids.push_back(start);
+        }
+    }
+    std::vector<double> prefix(n + 1);
+    for (std::size_t i = 0; i < n; ++i) {
+        prefix[i + 1] = prefix[i] + sorted[i];
+    }
+
+    for (std::size_t iteration = 0; iteration < max_iterations; ++iteration) {
+        bool moved = false;
+        std::size_t begin = 0;
+        for (std::size_t i = 0; i < centroids.size(); ++i) {
+            std::size_t end = n;
+            if (i + 1 < centroids.size()) {
+                const double split = 0.5 * (centroids[i] + centroids[i + 1]);
+                end = static_cast<std::size_t>(
+                    std::upper_bound(sorted.begin() + begin, sorted.end(), split,
+                                     [](double a, float b) { return a < b; }) -
+                    sorted.begin());
+            }
+            if (end > begin) {
+                const double mean =
+                    (prefix[end] - prefix[begin]) / static_cast<double>(end - begin);
+                moved = moved || mean != centroids[i];
+                centroids[i] = mean;
+            }
+            begin = end;
+        }
+        if (!moved) {
+            break;
+        }
+    }
+    return centroids;
+}
+
+double weight_rms(const LayerWeights& layer) {
+    double sum = 0.0;
+    for (std::size_t k = 0; k < layer.inputs; ++k) {
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            const double w = layer.weight(k, j);
+            sum += w * w;
+        }
+    }
+    return std::sqrt(sum / static_cast<double>(layer.inputs * layer.outputs));
+}
+
+double error_rms(const LayerWeights& a, const LayerWeights& b) {
+    double sum = 0.0;
+    for (std::size_t k = 0; k < a.inputs; ++k) {
+        for (std::size_t j = 0; j < a.outputs; ++j) {
+            const double d = static_cast<double>(a.weight(k, j)) - b.weight(k, j);
+            sum += d * d;
+        }
+    }
+    return std::sqrt(sum / static_cast<double>(a.inputs * a.outputs));
+}
+
+}  // namespace
+
+LayerWeights cluster_layer(const LayerWeights& layer, WeightFormat format,
+                           std::size_t max_iterations) {
+    const std::size_t entries = codebook_entries(format);
+    if (entries == 0) {
+        throw std::invalid_argument("cluster_layer: " + std::string(weight_format_name(format)) +
+                                    " is not a codebook format");
+    }
+    if (layer.inputs * layer.outputs == 0) {
+        throw std::invalid_argument("cluster_layer: layer has no weights");
+    }
+    std::vector<float> sorted;
+    sorted.reserve(layer.inputs * layer.outputs);
+    for (std::size_t k = 0; k < layer.inputs; ++k) {
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            sorted.push_back(layer.weight(k, j));
+            if (!std::isfinite(sorted.back())) {
+                throw std::invalid_argument("cluster_layer: non-finite weight");
+            }
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    const std::vector<double> centroids = kmeans_1d(sorted, entries, max_iterations);
+
+    LayerWeights clustered;
+    clustered.inputs = layer.inputs;
+    clustered.outputs = layer.outputs;
+    clustered.format = format;
+    clustered.bias = layer.bias;
+    clustered.codebook.assign(entries, 0.0f);
+    for (std::size_t i = 0; i < centroids.size(); ++i) {
+        clustered.codebook[i] = static_cast<float>(centroids[i]);
+    }
+    // Each weight takes the nearest codebook value: the index is the number
+    // of midpoints below it.
+    std::vector<double> splits;
+    for (std::size_t i = 0; i + 1 < centroids.size(); ++i) {
+        splits.push_back(0.5 * (static_cast<double>(clustered.codebook[i]) +
+                                clustered.codebook[i + 1]));
+    }
+    const std::size_t row_bytes = weight_row_bytes(format, layer.outputs);
+    clustered.weights = HugePageBuffer(layer.inputs * row_bytes, MemoryKind::kWeights);
+    auto* indices = clustered.weights.as<std::uint8_t>();
+    std::memset(indices, 0, clustered.weights.size());
+    for (std::size_t k = 0; k < layer.inputs; ++k) {
+        std::uint8_t* row = indices + k * row_bytes;
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            const double w = layer.weight(k, j);
+            const auto index = static_cast<std::uint8_t>(
+                std::lower_bound(splits.begin(), splits.end(), w) - splits.begin());
+            if (format == WeightFormat::kCodebook8) {
+                row[j] = index;
+            } else {
+                row[j / 2] |= static_cast<std::uint8_t>(index << (j % 2 * 4));
+            }
+        }
+    }
+    return clustered;
+}
+
+std::shared_ptr<Model> compress_model(const Model& model, LayerStore& store,
+                                      const CodebookOptions& options, CodebookReport* report) {
+    if (codebook_entries(options.format) == 0) {
+        throw std::invalid_argument("compress_model: " +
+                                    std::string(weight_format_name(options.format)) +
+                                    " is not a codebook format");
+    }
+    CodebookReport summary;
+    std::vector<DenseLayer> layers;
+    for (const DenseLayer& layer : model.layers()) {
+        const LayerWeights& original = *layer.weights;
+        LayerCodebookReport entry;
+        entry.bytes_before = original.bytes();
+        const std::size_t weights = original.inputs * original.outputs;
+        entry.weight_rms = weights > 0 ? weight_rms(original) : 0.0;
+        if (original.format == WeightFormat::kFloat32 && weights > 0 &&
+            weights >= options.min_weights) {
+            LayerWeights clustered = cluster_layer(original, options.format,
+                                                   options.max_iterations);
+            entry.error_rms = error_rms(original, clustered);
+            layers.push_back({store.intern(std::move(clustered)), layer.activation});
+        } else {
+            layers.push_back(layer);
+        }
+        entry.format = layers.back().weights->format;
+        entry.bytes_after = layers.back().weights->bytes();
+        summary.bytes_before += entry.bytes_before;
+        summary.bytes_after += entry.bytes_after;
+        summary.layers.push_back(entry);
+    }
+    if (report) {
+        *report = std::move(summary);
+    }
+    return std::make_shared<Model>(model.version() + "+" + weight_format_name(options.format),
+                                   std::move(layers));
+}
+
+OutputDrift compare_models(const Model& reference, const Model& candidate,
+                           const SpectrumBatch& batch) {
+    const std::size_t width = reference.output_width();
+    if (candidate.output_width() != width) {
+        throw std::invalid_argument("compare_models: output widths differ");
+    }
+    const std::size_t rows = batch.size();
+    OutputDrift drift;
+    if (rows == 0) {
+        return drift;
+    }
+    std::vector<float> expected(rows * width);
+    std::vector<float> actual(rows * width);
+    reference.run(batch, expected.data());
+    candidate.run(batch, actual.data());
+    std::size_t agree = 0;
+    for (std::size_t r = 0; r < rows; ++r) {
+        const float* e = expected.data() + r * width;
+        const float* a = actual.data() + r * width;
+        for (std::size_t j = 0; j < width; ++j) {
+            const double d = std::fabs(static_cast<double>(e[j]) - a[j]);
+            drift.max_abs = std::max(drift.max_abs, d);
+            drift.mean_abs += d;
+        }
+        agree += std::max_element(e, e + width) - e == std::max_element(a, a + width) - a;
+    }
+    drift.mean_abs /= static_cast<double>(rows * width);
+    drift.top1_agreement = static_cast<double>(agree) / static_cast<double>(rows);
+    return drift;
+}
+
+}  // namespace probionis
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "inference/gemm.h"
+#include "inference/model.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+// Weight sharing for memory-bound deployments: each layer's weights are
+// clustered with k-means into 16 or 256 values, and the matrix keeps only
+// 4- or 8-bit indices into that codebook. The GEMM kernels dequantize in
+// registers, so resident weights shrink about 8x (4-bit) or 4x (8-bit) and
+// the weights of small models fit in cache.
+struct CodebookOptions {
+    // kCodebook8 or kCodebook4.
+    WeightFormat format = WeightFormat::kCodebook8;
+    // Layers with fewer weights stay float: the codebook would cost about
+    // as much as it saves, and small output heads are where clustering
+    // error shows most.
+    std::size_t min_weights = 4096;
+    // Lloyd iterations; clustering stops earlier once no centroid moves.
+    std::size_t max_iterations = 100;
+};
+
+// One layer clustered into `format`. Deterministic: centroids start at
+// evenly spaced quantiles of the weights. Throws std::invalid_argument for
+// a layer without weights or with a non-finite one.
+LayerWeights cluster_layer(const LayerWeights& layer, WeightFormat format,
+                           std::size_t max_iterations = 100);
+
+struct LayerCodebookReport {
+    WeightFormat format = WeightFormat::kFloat32;
+    std::size_t bytes_before = 0;
+    std::size_t bytes_after = 0;
+    // RMS of the original weights and of the clustering error.
+    double weight_rms = 0.0;
+    double error_rms = 0.0;
+};
+
+struct CodebookReport {
+    std::vector<LayerCodebookReport> layers;
+    std::size_t bytes_before = 0;
+    std::size_t bytes_after = 0;
+};
+
+// A copy of `model` with its large layers clustered; the others are
+// shared with `model`. The version gets a "+codebook8" or "+codebook4"
+// suffix, since its scores differ slightly.
+std::shared_ptr<Model> compress_model(const Model& model, LayerStore& store,
+                                      const CodebookOptions& options = {},
+                                      CodebookReport* report = nullptr);
+
+// How far `candidate`'s outputs are from `reference`'s over a batch.
+struct OutputDrift {
+    double max_abs = 0.0;
+    double mean_abs = 0.0;
+    // Rows whose largest output is at the same index in both.
+    double top1_agreement = 0.0;
+};
+
+OutputDrift compare_models(const Model& reference, const Model& candidate,
+                           const SpectrumBatch& batch);
+
+}  // namespace probionis
@@ -0,0 +1,166 @@
+#include "io/delimited_reader.h"
+
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "io/fast_float.h"
+#include "io/parse_error.h"
+
+namespace probionis {
+
+namespace {
+
+const char kFormat[] = "delimited text";
+
+struct Line {
+    const char* begin;
+    const char* end;
+};
+
+// Returns the next line that is neither blank nor a comment, or false.
+bool next_line(const char*& p, const char* end, char comment, Line& line,
+               std::size_t& number) {
+    while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        const char* line_end = eol ? eol : end;
+        const char* begin = p;
+        p = eol ? eol + 1 : end;
+        ++number;
+        if (line_end != begin && line_end[-1] == '\r') --line_end;
+        const char* first = begin;
+        while (first != line_end && (*first == ' ' || *first == '\t')) ++first;
+        if (first == line_end || *first == comment) {
+            continue;
+        }
+        line = {begin, line_end};
+        return true;
+    }
+    return false;
+}
+
+char detect_delimiter(const Line& line) {
+    const std::size_t length = static_cast<std::size_t>(line.end - line.begin);
+    if (std::memchr(line.begin, '\t', length)) return '\t';
+    if (std::memchr(line.begin, ';', length)) return ';';
+    if (std::memchr(line.begin, ',', length)) return ',';
+    return ' ';
+}
+
+// Splits a line into fields. A space delimiter treats any run of blanks as
+// one separator; other delimiters keep empty fields.
+template <typename Visitor>
+void for_each_field(const Line& line, char delimiter, Visitor&& visit) {
+    const char* p = line.begin;
+    std::size_t column = 0;
+    if (delimiter == ' ') {
+        while (p != line.end) {
+            while (p != line.end && (*p == ' ' || *p == '\t')) ++p;
+            if (p == line.end) break;
+            const char* start = p;
+            while (p != line.end && *p != ' ' && *p != '\t') ++p;
+            visit(column++, start, p);
+        }
+        return;
+    }
+    while (true) {
+        const char* start = p;
+        while (p != line.end && *p != delimiter) ++p;
+        const char* first = start;
+        const char* last = p;
+        while (first != last && (*first == ' ' || *first == '"')) ++first;
+        while (last != first && (last[-1] == ' ' || last[-1] == '"')) --last;
+        visit(column++, first, last);
+        if (p == line.end) break;
+        ++p;
+    }
+}
+
+bool parse_field(const char* first, const char* last, float* value) {
+    if (first == last) {
+        *value = std::numeric_limits<float>::quiet_NaN();
+        return true;
+    }
+    return parse_float(first, last, value) == last;
+}
+
+}  // namespace
+
+std::vector<Spectrum> parse_delimited(const char* data, std::size_t size,
+                                      const DelimitedOptions& options) {
+    const char* p = data;
+    const char* const end = data + size;
+    std::size_t number = 0;
+    Line line{};
+    if (!next_line(p, end, options.comment, line, number)) {
+        throw ParseError(kFormat, "no data");
+    }
+    const char delimiter = options.delimiter ? options.delimiter : detect_delimiter(line);
+
+    std::vector<std::string> names;
+    bool numeric = true;
+    for_each_field(line, delimiter, [&](std::size_t, const char* first, const char* last) {
+        names.emplace_back(first, last);
+        float ignored = 0.0f;
+        numeric = numeric && parse_field(first, last, &ignored);
+    });
+    if (names.size() < 2) {
+        throw ParseError(kFormat, "need an axis column and at least one spectrum column", number);
+    }
+    const std::size_t columns = names.size();
+
+    std::vector<Spectrum> spectra(columns - 1);
+    std::vector<float> axis;
+    // Estimate the row count from the first line so the buffers are sized
+    // once up front instead of growing during the parse.
+    const std::size_t line_bytes = static_cast<std::size_t>(line.end - line.begin) + 1;
+    const std::size_t estimated_rows = size / line_bytes + 1;
+    axis.reserve(estimated_rows);
+    for (auto& spectrum : spectra) {
+        spectrum.intensity.reserve(estimated_rows);
+    }
+
+    bool have_line = true;
+    if (!numeric) {
+        for (std::size_t c = 1; c < columns; ++c) {
+            spectra[c - 1].sample_id = names[c];
+        }
+        have_line = next_line(p, end, options.comment, line, number);
+    }
+
+    while (have_line) {
+        std::size_t seen = 0;
+        for_each_field(line, delimiter, [&](std::size_t column, const char* first, const char* last) {
+            if (column >= columns) {
+                throw ParseError(kFormat, "too many columns", number);
+            }
+            float value = 0.0f;
+            if (!parse_field(first, last, &value)) {
+                throw ParseError(kFormat, "bad number '" + std::string(first, last) + "'", number);
+            }
+            if (column == 0) {
+                axis.push_back(value);
+            } else {
+                spectra[column - 1].intensity.push_back(value);
+            }
+            ++seen;
+        });
+        if (seen != columns) {
+            throw ParseError(kFormat, "expected " + std::to_string(columns) + " columns", number);
+        }
+        have_line = next_line(p, end, options.comment, line, number);
+    }
+
+    for (std::size_t s = 0; s < spectra.size(); ++s) {
+        // All but the last spectrum get a copy of the shared axis.
+        if (s + 1 == spectra.size()) {
+            spectra[s].axis = std::move(axis);
+        } else {
+            spectra[s].axis = axis;
+        }
+        make_axis_ascending(spectra[s]);
+    }
+    return spectra;
+}
+
+}  // namespace probionis
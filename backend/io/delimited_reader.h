@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+struct DelimitedOptions {
+    // 0 auto-detects from the first data line: tab, then ';', then ',',
+    // otherwise runs of spaces.
+    char delimiter = 0;
+    // Lines starting with this character are skipped.
+    char comment = '#';
+};
+
+// Decodes column-oriented text exports: the first column is the axis and
+// every further column is one spectrum sharing it. A non-numeric first line
+// is taken as a header whose column names become the sample IDs.
+std::vector<Spectrum> parse_delimited(const char* data, std::size_t size,
+                                      const DelimitedOptions& options = {});
+
+}  // namespace probionis
@@ -0,0 +1,203 @@
+#include "io/fast_float.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+#include <stdlib.h>
+#include <string>
+
+namespace probionis {
+
+namespace {
+
+constexpr double kExactPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+constexpr std::uint64_t kMaxExactMantissa = std::uint64_t{1} << 53;
+constexpr int kMaxMantissaDigits = 19;
+constexpr std::ptrdiff_t kMaxDigitRun = 1 << 24;
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+inline std::uint64_t load_eight(const char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline bool is_eight_digits(std::uint64_t v) {
+    return ((v & 0xF0F0F0F0F0F0F0F0) |
+            (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+// Converts eight ASCII digits (first digit in the lowest byte) to their
+// value with three multiplies instead of eight dependent ones.
+inline std::uint32_t eight_digits_value(std::uint64_t v) {
+    constexpr std::uint64_t kMask = 0x000000FF000000FF;
+    constexpr std::uint64_t kMul1 = 0x000F424000000064;  // 100 + (1000000 << 32)
+    constexpr std::uint64_t kMul2 = 0x0000271000000001;  // 1 + (10000 << 32)
+    v -= 0x3030303030303030;
+    v = (v * 10) + (v >> 8);
+    return static_cast<std::uint32_t>(
+        (((v & kMask) * kMul1) + (((v >> 16) & kMask) * kMul2)) >> 32);
+}
+#define PROBIONIS_SWAR_DIGITS 1
+#endif
+
+// Accumulates a run of digits into `mantissa`. `significant` counts digits
+// from the first non-zero one (conservatively for SWAR chunks), and once 19
+// are held further digits only set `truncated` so the caller takes the slow
+// path. Returns the end of the run; `count` receives its length.
+inline const char* consume_digits(const char* p, const char* last,
+                                  std::uint64_t& mantissa, int& significant,
+                                  int& count, bool& truncated) {
+    const char* start = p;
+#if defined(PROBIONIS_SWAR_DIGITS)
+    while (last - p >= 8 && significant + 8 <= kMaxMantissaDigits) {
+        const std::uint64_t chunk = load_eight(p);
+        if (!is_eight_digits(chunk)) {
+            break;
+        }
+        mantissa = mantissa * 100000000 + eight_digits_value(chunk);
+        if (mantissa != 0) {
+            significant += 8;
+        }
+        p += 8;
+    }
+#endif
+    for (; p != last && is_digit(*p); ++p) {
+        if (significant >= kMaxMantissaDigits) {
+            truncated = true;
+            continue;
+        }
+        mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+        if (mantissa != 0) {
+            ++significant;
+        }
+    }
+    // Saturated, so a pathological run cannot overflow the exponent sum.
+    count = static_cast<int>(std::min<std::ptrdiff_t>(p - start, kMaxDigitRun));
+    return p;
+}
+
+// The "C" locale for strtod_l: plain strtod follows the process locale,
+// where e.g. "de_DE" reads "3.25" as 3.
+locale_t c_locale() {
+    static const locale_t locale = newlocale(LC_ALL_MASK, "C", locale_t{});
+    return locale;
+}
+
+const char* parse_slow(const char* first, const char* last, double* value) {
+    // strtod_l needs a terminated buffer; numbers are short, so copy.
+    // std::from_chars would need neither, but leaves out-of-range values
+    // unset where strtod gives infinity or zero.
+    std::string buffer(first, static_cast<std::size_t>(last - first));
+    char* end = nullptr;
+    const double parsed = strtod_l(buffer.c_str(), &end, c_locale());
+    if (end == buffer.c_str()) {
+        return first;
+    }
+    *value = parsed;
+    return first + (end - buffer.c_str());
+}
+
+// True when `d` lies exactly halfway between two floats, where rounding the
+// already rounded double again may pick the wrong neighbour.
+bool float_midpoint(double d) {
+    const float f = static_cast<float>(d);
+    if (!std::isfinite(f) || static_cast<double>(f) == d) {
+        return false;
+    }
+    const float other = std::nextafter(f, d > f ? HUGE_VALF : -HUGE_VALF);
+    return d - static_cast<double>(f) == static_cast<double>(other) - d;
+}
+
+}  // namespace
+
+const char* parse_double(const char* first, const char* last, double* value) {
+    const char* p = first;
+    bool negative = false;
+    if (p != last && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p != last && (*p == 'i' || *p == 'I' || *p == 'n' || *p == 'N')) {
+        return parse_slow(first, last, value);
+    }
+
+    std::uint64_t mantissa = 0;
+    int significant = 0;
+    bool truncated = false;
+    int integer_digits = 0;
+    p = consume_digits(p, last, mantissa, significant, integer_digits, truncated);
+
+    int exponent = 0;
+    int fraction_digits = 0;
+    if (p != last && *p == '.') {
+        ++p;
+        p = consume_digits(p, last, mantissa, significant, fraction_digits, truncated);
+        exponent = -fraction_digits;
+    }
+    if (integer_digits + fraction_digits == 0) {
+        return first;
+    }
+
+    if (p != last && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool exponent_negative = false;
+        if (e != last && (*e == '-' || *e == '+')) {
+            exponent_negative = *e == '-';
+            ++e;
+        }
+        if (e != last && is_digit(*e)) {
+            int explicit_exponent = 0;
+            for (; e != last && is_digit(*e); ++e) {
+                if (explicit_exponent < 100000) {
+                    explicit_exponent = explicit_exponent * 10 + (*e - '0');
+                }
+            }
+            exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+            p = e;
+        }
+    }
+
+    if (truncated || mantissa > kMaxExactMantissa ||
+        exponent < -22 || exponent > 22) {
+        return parse_slow(first, p, value) == first ? first : p;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0) {
+        result /= kExactPowersOfTen[-exponent];
+    } else {
+        result *= kExactPowersOfTen[exponent];
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+const char* parse_float(const char* first, const char* last, float* value) {
+    double parsed = 0.0;
+    const char* end = parse_double(first, last, &parsed);
+    if (end == first) {
+        return end;
+    }
+    if (float_midpoint(parsed)) {
+        // Digits past the double's precision decide the direction; only a
+        // direct conversion sees them.
+        const std::string buffer(first, static_cast<std::size_t>(end - first));
+        *value = strtof_l(buffer.c_str(), nullptr, c_locale());
+        return end;
+    }
+    *value = static_cast<float>(parsed);
+    return end;
+}
+
+}  // namespace probionis
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+namespace probionis {
+
+// Locale-independent decimal parser for the text spectrum formats. Accepts
+// an optional sign, digits with an optional '.', and an optional exponent
+// ("1", "-.5", "3.25E+04"). Leading whitespace is not skipped.
+//
+// Runs of eight digits are converted with one SWAR multiply chain, and
+// values with at most 19 significant digits and a small decimal exponent
+// are computed exactly in double precision (Clinger's fast path). Anything
+// else, e.g. "inf" or very long mantissas, falls back to strtod_l in the
+// "C" locale. parse_float converts a value that lands exactly halfway
+// between two floats again with strtof_l, so it is rounded only once.
+//
+// Returns one past the last character consumed, or `first` if no number
+// starts there.
+const char* parse_double(const char* first, const char* last, double* value);
+const char* parse_float(const char* first, const char* last, float* value);
+
+}  // namespace probionis
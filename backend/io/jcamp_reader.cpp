@@ -0,0 +1,416 @@
+#include "io/jcamp_reader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "io/fast_float.h"
+#include "io/parse_error.h"
+
+namespace probionis {
+
+namespace {
+
+const char kFormat[] = "JCAMP-DX";
+
+// Points per table. DUP runs can expand a few bytes into any number of
+// values, so tables are bounded outright rather than by the input size.
+constexpr std::size_t kMaxPoints = std::size_t{1} << 24;
+
+enum class TableKind { kNone, kEquallySpaced, kPairs };
+
+// Labelled-data-record values that shape the next data table. Reset at
+// every ##TITLE so linked blocks do not inherit each other's scaling.
+struct BlockHeader {
+    std::string title;
+    std::string instrument;
+    double first_x = std::numeric_limits<double>::quiet_NaN();
+    double last_x = std::numeric_limits<double>::quiet_NaN();
+    double delta_x = std::numeric_limits<double>::quiet_NaN();
+    double x_factor = 1.0;
+    double y_factor = 1.0;
+    long points = -1;
+};
+
+enum class TokenKind { kAbsolute, kDifference, kDuplicate };
+
+struct Token {
+    TokenKind kind;
+    double value;
+};
+
+// ASDF state carried from one data line to the next.
+struct AsdfState {
+    double previous = 0.0;
+    double last_difference = 0.0;
+    TokenKind last_kind = TokenKind::kAbsolute;
+    bool have_previous = false;
+};
+
+std::string normalize_label(const char* first, const char* last) {
+    std::string label;
+    label.reserve(static_cast<std::size_t>(last - first));
+    for (const char* p = first; p != last; ++p) {
+        const char c = *p;
+        if (c == ' ' || c == '-' || c == '/' || c == '_' || c == '\t') {
+            continue;
+        }
+        label.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+    return label;
+}
+
+std::string trim(const char* first, const char* last) {
+    while (first != last && std::isspace(static_cast<unsigned char>(*first))) ++first;
+    while (last != first && std::isspace(static_cast<unsigned char>(last[-1]))) --last;
+    return std::string(first, last);
+}
+
+double parse_ldr_number(const std::string& value, std::size_t line) {
+    double result = 0.0;
+    const char* begin = value.data();
+    const char* end = begin + value.size();
+    if (parse_double(begin, end, &result) == begin) {
+        throw ParseError(kFormat, "expected a number, got '" + value + "'", line);
+    }
+    return result;
+}
+
+bool is_separator(char c) { return c == ' ' || c == '\t' || c == ',' || c == ';'; }
+bool is_plain_digit(char c) { return (c >= '0' && c <= '9') || c == '.'; }
+
+// Reads the next token of a data line, or returns false at end of line or at
+// a "$$" comment. Pseudo-digits encode the leading digit and the token
+// kind: SQZ '@A-I' / 'a-i', DIF '%J-R' / 'j-r', DUP 'S-Z' / 's'.
+bool next_token(const char*& p, const char* end, Token& token, std::size_t line) {
+    while (p != end && is_separator(*p)) ++p;
+    if (p == end || (*p == '$' && p + 1 != end && p[1] == '$')) {
+        return false;
+    }
+
+    const char c = *p;
+    if (is_plain_digit(c) || c == '+' || c == '-') {
+        // AFFN / PAC. An exponent is only accepted in its signed form, since
+        // a bare 'E' is the SQZ digit +5.
+        const char* q = p + ((c == '+' || c == '-') ? 1 : 0);
+        while (q != end && is_plain_digit(*q)) ++q;
+        if (end - q > 2 && (*q == 'E' || *q == 'e') && (q[1] == '+' || q[1] == '-') &&
+            std::isdigit(static_cast<unsigned char>(q[2]))) {
+            q += 2;
+            while (q != end && std::isdigit(static_cast<unsigned char>(*q))) ++q;
+        }
+        if (parse_double(p, q, &token.value) != q) {
+            throw ParseError(kFormat, "malformed number", line);
+        }
+        token.kind = TokenKind::kAbsolute;
+        p = q;
+        return true;
+    }
+    if (c == '?') {
+        token.kind = TokenKind::kAbsolute;
+        token.value = std::numeric_limits<double>::quiet_NaN();
+        ++p;
+        return true;
+    }
+
+    int lead = 0;
+    bool negative = false;
+    if (c == '@') {
+        token.kind = TokenKind::kAbsolute;
+    } else if (c >= 'A' && c <= 'I') {
+        token.kind = TokenKind::kAbsolute;
+        lead = c - 'A' + 1;
+    } else if (c >= 'a' && c <= 'i') {
+        token.kind = TokenKind::kAbsolute;
+        lead = c - 'a' + 1;
+        negative = true;
+    } else if (c == '%') {
+        token.kind = TokenKind::kDifference;
+    } else if (c >= 'J' && c <= 'R') {
+        token.kind = TokenKind::kDifference;
+        lead = c - 'J' + 1;
+    } else if (c >= 'j' && c <= 'r') {
+        token.kind = TokenKind::kDifference;
+        lead = c - 'j' + 1;
+        negative = true;
+    } else if (c >= 'S' && c <= 'Z') {
+        token.kind = TokenKind::kDuplicate;
+        lead = c - 'S' + 1;
+    } else if (c == 's') {
+        token.kind = TokenKind::kDuplicate;
+        lead = 9;
+    } else {
+        throw ParseError(kFormat, std::string("unexpected character '") + c + "'", line);
+    }
+    ++p;
+
+    // Remaining digits follow verbatim; integers (the common case) are
+    // accumulated directly, decimals go through the float parser.
+    const char* q = p;
+    while (q != end && is_plain_digit(*q)) ++q;
+    if (std::memchr(p, '.', static_cast<std::size_t>(q - p)) == nullptr) {
+        double value = lead;
+        for (const char* d = p; d != q; ++d) {
+            value = value * 10.0 + (*d - '0');
+        }
+        token.value = value;
+    } else {
+        std::string digits(1, static_cast<char>('0' + lead));
+        digits.append(p, q);
+        token.value = parse_ldr_number(digits, line);
+    }
+    if (negative) {
+        token.value = -token.value;
+    }
+    p = q;
+    return true;
+}
+
+// Decodes one (X++(Y..Y)) line, appending scaled Y values to `out`.
+void decode_equally_spaced_line(const char* p, const char* end, AsdfState& state,
+                                double y_factor, std::vector<float>& out,
+                                double* line_x, std::size_t line) {
+    Token token{};
+    if (!next_token(p, end, token, line)) {
+        return;
+    }
+    if (token.kind != TokenKind::kAbsolute) {
+        throw ParseError(kFormat, "data line does not start with an X value", line);
+    }
+    *line_x = token.value;
+
+    // After a line ending in DIF form, the first Y repeats the previous
+    // line's last value as a check and must not be emitted again.
+    bool skip_check = state.have_previous && state.last_kind == TokenKind::kDifference;
+    auto emit = [&](double y) {
+        state.previous = y;
+        state.have_previous = true;
+        out.push_back(static_cast<float>(y * y_factor));
+    };
+
+    while (next_token(p, end, token, line)) {
+        switch (token.kind) {
+            case TokenKind::kAbsolute:
+                if (skip_check) {
+                    skip_check = false;
+                    state.previous = token.value;
+                    state.last_kind = TokenKind::kAbsolute;
+                    break;
+                }
+                emit(token.value);
+                state.last_kind = TokenKind::kAbsolute;
+                break;
+            case TokenKind::kDifference:
+                if (!state.have_previous) {
+                    throw ParseError(kFormat, "DIF value without a preceding value", line);
+                }
+                skip_check = false;
+                emit(state.previous + token.value);
+                state.last_difference = token.value;
+                state.last_kind = TokenKind::kDifference;
+                break;
+            case TokenKind::kDuplicate: {
+                if (!state.have_previous || token.value < 1) {
+                    throw ParseError(kFormat, "DUP count without a preceding value", line);
+                }
+                if (static_cast<double>(out.size()) + token.value >
+                    static_cast<double>(kMaxPoints)) {
+                    throw ParseError(kFormat, "DUP count exceeds the point limit", line);
+                }
+                const long repeats = static_cast<long>(token.value) - 1;
+                for (long r = 0; r < repeats; ++r) {
+                    emit(state.last_kind == TokenKind::kDifference
+                             ? state.previous + state.last_difference
+                             : state.previous);
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Decodes one (XY..XY) line of `group`-sized tuples, keeping X and Y.
+void decode_pairs_line(const char* p, const char* end, const BlockHeader& header,
+                       int group, int& position, Spectrum& spectrum,
+                       std::size_t line) {
+    Token token{};
+    while (next_token(p, end, token, line)) {
+        if (token.kind != TokenKind::kAbsolute) {
+            throw ParseError(kFormat, "compressed values in an (XY..XY) table", line);
+        }
+        if (position == 0) {
+            spectrum.axis.push_back(static_cast<float>(token.value * header.x_factor));
+        } else if (position == 1) {
+            spectrum.intensity.push_back(static_cast<float>(token.value * header.y_factor));
+        }
+        position = (position + 1) % group;
+    }
+}
+
+void finish_equally_spaced(const BlockHeader& header, double first_line_x,
+                           Spectrum& spectrum, std::size_t line) {
+    const std::size_t count = spectrum.intensity.size();
+    if (header.points >= 0 && static_cast<std::size_t>(header.points) != count) {
+        throw ParseError(kFormat,
+                         "##NPOINTS=" + std::to_string(header.points) + " but table has " +
+                             std::to_string(count) + " values",
+                         line);
+    }
+    double first = header.first_x;
+    double step = std::numeric_limits<double>::quiet_NaN();
+    if (!std::isnan(first) && !std::isnan(header.last_x) && count > 1) {
+        step = (header.last_x - first) / static_cast<double>(count - 1);
+    } else {
+        if (std::isnan(first)) {
+            first = first_line_x * header.x_factor;
+        }
+        step = header.delta_x;
+    }
+    if (std::isnan(first) || (count > 1 && std::isnan(step))) {
+        throw ParseError(kFormat, "cannot derive the X axis (need ##FIRSTX/##LASTX or ##DELTAX)", line);
+    }
+    spectrum.axis.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        spectrum.axis[i] = static_cast<float>(first + step * static_cast<double>(i));
+    }
+}
+
+// Capacity to reserve for a table: ##NPOINTS, but never more than one
+// value per remaining input byte, so a lying header cannot force a huge
+// allocation.
+std::size_t reserve_for(const BlockHeader& header, const char* p, const char* end) {
+    if (header.points <= 0) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>(header.points), static_cast<std::size_t>(end - p));
+}
+
+int pair_group_size(const std::string& variables) {
+    // "(XY..XY)" -> 2, "(XYW..XYW)" -> 3.
+    const std::size_t open = variables.find('(');
+    const std::size_t dots = variables.find("..");
+    if (open == std::string::npos || dots == std::string::npos || dots <= open + 1) {
+        return 2;
+    }
+    const int group = static_cast<int>(dots - open - 1);
+    return group < 2 ? 2 : group;
+}
+
+}  // namespace
+
+std::vector<Spectrum> parse_jcamp(const char* data, std::size_t size) {
+    std::vector<Spectrum> spectra;
+    BlockHeader header;
+    TableKind table = TableKind::kNone;
+    Spectrum current;
+    AsdfState asdf;
+    double first_line_x = std::numeric_limits<double>::quiet_NaN();
+    int pair_group = 2;
+    int pair_position = 0;
+    bool saw_header = false;
+
+    const char* p = data;
+    const char* const end = data + size;
+    std::size_t line = 0;
+
+    auto finish_table = [&]() {
+        if (table == TableKind::kNone) {
+            return;
+        }
+        if (table == TableKind::kEquallySpaced) {
+            finish_equally_spaced(header, first_line_x, current, line);
+        } else if (current.axis.size() != current.intensity.size()) {
+            throw ParseError(kFormat, "unpaired value in (XY..XY) table", line);
+        }
+        if (current.intensity.empty()) {
+            // Declared but empty tables (e.g. a bare ##PEAK TABLE) are dropped.
+            current = Spectrum();
+            table = TableKind::kNone;
+            return;
+        }
+        current.sample_id = header.title;
+        current.instrument_id = header.instrument;
+        make_axis_ascending(current);
+        spectra.push_back(std::move(current));
+        current = Spectrum();
+        table = TableKind::kNone;
+    };
+
+    while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        const char* line_end = eol ? eol : end;
+        const char* next = eol ? eol + 1 : end;
+        if (line_end != p && line_end[-1] == '\r') --line_end;
+        ++line;
+
+        if (line_end - p >= 2 && p[0] == '#' && p[1] == '#') {
+            finish_table();
+            const char* eq = static_cast<const char*>(std::memchr(p, '=', static_cast<std::size_t>(line_end - p)));
+            if (!eq) {
+                throw ParseError(kFormat, "labelled data record without '='", line);
+            }
+            const std::string label = normalize_label(p + 2, eq);
+            const std::string value = trim(eq + 1, line_end);
+            saw_header = true;
+
+            if (label == "TITLE") {
+                header = BlockHeader();
+                header.title = value;
+            } else if (label == "SPECTROMETERDATASYSTEM" || label == "INSTRUMENT") {
+                header.instrument = value;
+            } else if (label == "FIRSTX") {
+                header.first_x = parse_ldr_number(value, line);
+            } else if (label == "LASTX") {
+                header.last_x = parse_ldr_number(value, line);
+            } else if (label == "DELTAX") {
+                header.delta_x = parse_ldr_number(value, line);
+            } else if (label == "XFACTOR") {
+                header.x_factor = parse_ldr_number(value, line);
+            } else if (label == "YFACTOR") {
+                header.y_factor = parse_ldr_number(value, line);
+            } else if (label == "NPOINTS") {
+                const double points = parse_ldr_number(value, line);
+                if (!(points >= 0.0 && points <= static_cast<double>(kMaxPoints))) {
+                    throw ParseError(kFormat, "bad ##NPOINTS=" + value, line);
+                }
+                header.points = static_cast<long>(points);
+            } else if (label == "XYDATA") {
+                if (value.find("++") == std::string::npos) {
+                    throw ParseError(kFormat, "unsupported ##XYDATA form " + value, line);
+                }
+                table = TableKind::kEquallySpaced;
+                asdf = AsdfState();
+                first_line_x = std::numeric_limits<double>::quiet_NaN();
+                current.intensity.reserve(reserve_for(header, next, end));
+            } else if (label == "XYPOINTS" || label == "PEAKTABLE") {
+                table = TableKind::kPairs;
+                pair_group = pair_group_size(value);
+                pair_position = 0;
+                current.axis.reserve(reserve_for(header, next, end));
+                current.intensity.reserve(reserve_for(header, next, end));
+            }
+        } else if (table == TableKind::kEquallySpaced) {
+            double line_x = 0.0;
+            const std::size_t before = current.intensity.size();
+            decode_equally_spaced_line(p, line_end, asdf, header.y_factor,
+                                       current.intensity, &line_x, line);
+            if (before == 0 && current.intensity.size() > 0) {
+                first_line_x = line_x;
+            }
+        } else if (table == TableKind::kPairs) {
+            decode_pairs_line(p, line_end, header, pair_group, pair_position, current, line);
+        }
+        p = next;
+    }
+    finish_table();
+
+    if (!saw_header) {
+        throw ParseError(kFormat, "no labelled data records found");
+    }
+    return spectra;
+}
+
+}  // namespace probionis
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// Decodes JCAMP-DX 4.24/5.x spectra. Handles ##XYDATA=(X++(Y..Y)) tables in
+// AFFN and every ASDF compression form (SQZ, DIF, DUP, PAC, including the
+// DIF Y-check value that repeats at the start of each line), as well as
+// ##XYPOINTS / ##PEAK TABLE=(XY..XY) pairs. Linked files with several
+// blocks yield one spectrum per data table.
+std::vector<Spectrum> parse_jcamp(const char* data, std::size_t size);
+
+}  // namespace probionis
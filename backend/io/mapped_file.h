@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace probionis {
+
+// Read-only memory mapping of a whole file. The readers parse straight out
+// of the mapping, so archive ingest never copies the raw bytes into a
+// separate buffer first.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const char* data() const { return static_cast<const char*>(data_); }
+    std::size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    void release();
+
+    std::string path_;
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+}  // namespace probionis
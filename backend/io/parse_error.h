@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+namespace probionis {
+
+// Raised by the vendor format readers for malformed or unsupported input.
+class ParseError : public std::runtime_error {
+public:
+    ParseError(const std::string& format, const std::string& message,
+               std::size_t line = 0)
+        : std::runtime_error(format + ": " + message +
+                             (line ? " (line " + std::to_string(line) + ")" : "")),
+          line_(line) {}
+
+    std::size_t line() const { return line_; }
+
+private:
+    std::size_t line_;
+};
+
+}  // namespace probionis
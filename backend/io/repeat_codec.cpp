@@ -0,0 +1,395 @@
+#include "io/repeat_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "io/parse_error.h"
+#include "runtime/varint.h"
+
+namespace probionis {
+
+namespace {
+
+const char kFormat[] = "repeat encoding";
+constexpr char kMagic[4] = {'P', 'B', 'R', 'P'};
+constexpr std::uint32_t kVersion = 1;
+// Channels sharing one Rice parameter: short enough to follow the noise
+// level along the spectrum, long enough that the 6-bit parameter is cheap.
+constexpr std::size_t kBlock = 64;
+constexpr unsigned kParameterBits = 6;
+// Zigzagged residuals are below 2^33.
+constexpr unsigned kMaxParameter = 33;
+constexpr unsigned kValueBits = 34;
+// A quotient this long is written as an escape and the value in full, so
+// a cosmic-ray hit costs 66 bits instead of a run of millions of ones.
+constexpr unsigned kEscape = 32;
+
+// Float bits mapped to an unsigned key that orders like the floats, so
+// the difference of two keys is their distance in ULPs.
+std::uint32_t ordered_key(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+float from_key(std::uint32_t key) {
+    const std::uint32_t bits = (key & 0x80000000u) ? key & 0x7fffffffu : ~key;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::uint64_t zigzag(std::int64_t v) {
+    return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t v) {
+    return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+// The prediction for the next repeat: the mean of the ones before it,
+// rounded to float the same way on both ends.
+float predict(double sum, std::size_t count) {
+    return static_cast<float>(sum / static_cast<double>(count));
+}
+
+void put_float_le(std::string& out, float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bits = __builtin_bswap32(bits);
+#endif
+    out.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+}
+
+float get_float_le(const char* p) {
+    std::uint32_t bits;
+    std::memcpy(&bits, p, sizeof(bits));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bits = __builtin_bswap32(bits);
+#endif
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// LSB-first bit packing.
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out) : out_(out) {}
+
+    // `count` <= 56.
+    void put(std::uint64_t value, unsigned count) {
+        acc_ |= value << bits_;
+        bits_ += count;
+        while (bits_ >= 8) {
+            out_.push_back(static_cast<char>(acc_ & 0xff));
+            acc_ >>= 8;
+            bits_ -= 8;
+        }
+    }
+
+    void flush() {
+        if (bits_ > 0) {
+            out_.push_back(static_cast<char>(acc_ & 0xff));
+        }
+        acc_ = 0;
+        bits_ = 0;
+    }
+
+private:
+    std::string& out_;
+    std::uint64_t acc_ = 0;
+    unsigned bits_ = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const char* data, std::size_t size)
+        : begin_(reinterpret_cast<const unsigned char*>(data)), p_(begin_), end_(begin_ + size) {}
+
+    // `count` <= 56.
+    std::uint64_t get(unsigned count) {
+        if (bits_ < count) {
+            refill();
+            if (bits_ < count) {
+                throw ParseError(kFormat, "truncated residuals");
+            }
+        }
+        const std::uint64_t value = acc_ & ((std::uint64_t{1} << count) - 1);
+        consume(count);
+        return value;
+    }
+
+    // Counts 1 bits up to a 0 (consumed) or `limit` of them (not followed
+    // by a 0).
+    unsigned unary(unsigned limit) {
+        unsigned ones = 0;
+        while (true) {
+            if (bits_ == 0) {
+                refill();
+                if (bits_ == 0) {
+                    throw ParseError(kFormat, "truncated residuals");
+                }
+            }
+            const std::uint64_t valid = bits_ == 64 ? ~std::uint64_t{0}
+                                                    : (std::uint64_t{1} << bits_) - 1;
+            const std::uint64_t zeros = ~acc_ & valid;
+            const unsigned run = zeros ? static_cast<unsigned>(__builtin_ctzll(zeros)) : bits_;
+            if (ones + run >= limit) {
+                consume(limit - ones);
+                return limit;
+            }
+            if (run < bits_) {
+                consume(run + 1);
+                return ones + run;
+            }
+            ones += run;
+            consume(run);
+        }
+    }
+
+    // Skips to the next byte boundary; returns the bytes consumed so far.
+    std::size_t align() {
+        consume(bits_ % 8);
+        return static_cast<std::size_t>(p_ - begin_) - bits_ / 8;
+    }
+
+private:
+    void refill() {
+        while (bits_ <= 56 && p_ != end_) {
+            acc_ |= static_cast<std::uint64_t>(*p_++) << bits_;
+            bits_ += 8;
+        }
+    }
+
+    void consume(unsigned count) {
+        acc_ = count >= 64 ? 0 : acc_ >> count;
+        bits_ -= count;
+    }
+
+    const unsigned char* begin_;
+    const unsigned char* p_;
+    const unsigned char* end_;
+    std::uint64_t acc_ = 0;
+    unsigned bits_ = 0;
+};
+
+std::uint64_t coded_bits(std::uint64_t value, unsigned parameter) {
+    const std::uint64_t quotient = value >> parameter;
+    return quotient < kEscape ? quotient + 1 + parameter : kEscape + kValueBits;
+}
+
+void put_block(BitWriter& writer, const std::uint64_t* values, std::size_t n) {
+    unsigned best = 0;
+    std::uint64_t best_bits = std::numeric_limits<std::uint64_t>::max();
+    for (unsigned parameter = 0; parameter <= kMaxParameter; ++parameter) {
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            bits += coded_bits(values[i], parameter);
+        }
+        if (bits < best_bits) {
+            best_bits = bits;
+            best = parameter;
+        }
+    }
+    writer.put(best, kParameterBits);
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::uint64_t quotient = values[i] >> best;
+        if (quotient >= kEscape) {
+            writer.put((std::uint64_t{1} << kEscape) - 1, kEscape);
+            writer.put(values[i], kValueBits);
+        } else {
+            writer.put((std::uint64_t{1} << quotient) - 1, static_cast<unsigned>(quotient) + 1);
+            writer.put(values[i] & ((std::uint64_t{1} << best) - 1), best);
+        }
+    }
+}
+
+}  // namespace
+
+RepeatEncoder::RepeatEncoder(std::size_t channels)
+    : channels_(channels), sum_(channels), residuals_(channels) {
+    if (channels == 0) {
+        throw std::invalid_argument("RepeatEncoder: no channels");
+    }
+}
+
+void RepeatEncoder::add(const float* acquisition) {
+    if (repeats_ == 0) {
+        for (std::size_t c = 0; c < channels_; ++c) {
+            put_float_le(stream_, acquisition[c]);
+            sum_[c] = acquisition[c];
+        }
+        ++repeats_;
+        return;
+    }
+    for (std::size_t c = 0; c < channels_; ++c) {
+        const float predicted = predict(sum_[c], repeats_);
+        residuals_[c] = zigzag(static_cast<std::int64_t>(ordered_key(acquisition[c])) -
+                           static_cast<std::int64_t>(ordered_key(predicted)));
+        sum_[c] += acquisition[c];
+    }
+    BitWriter writer(stream_);
+    for (std::size_t c = 0; c < channels_; c += kBlock) {
+        put_block(writer, residuals_.data() + c, std::min(kBlock, channels_ - c));
+    }
+    writer.flush();
+    ++repeats_;
+}
+
+std::string RepeatEncoder::bytes() const {
+    std::string out(kMagic, sizeof(kMagic));
+    const std::uint32_t version = kVersion;
+    out.append(reinterpret_cast<const char*>(&version), sizeof(version));
+    put_varint(out, channels_);
+    put_varint(out, repeats_);
+    return out + stream_;
+}
+
+RepeatDecoder::RepeatDecoder(const char* data, std::size_t size) : data_(data), size_(size) {
+    std::uint32_t version = 0;
+    if (size < sizeof(kMagic) + sizeof(version) ||
+        std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        throw ParseError(kFormat, "missing PBRP header");
+    }
+    std::memcpy(&version, data + sizeof(kMagic), sizeof(version));
+    if (version != kVersion) {
+        throw ParseError(kFormat, "unsupported version " + std::to_string(version));
+    }
+    offset_ = sizeof(kMagic) + sizeof(version);
+    std::uint64_t channels = 0;
+    std::uint64_t repeats = 0;
+    if (!get_varint(data, size, offset_, channels) || !get_varint(data, size, offset_, repeats) ||
+        channels == 0 || repeats == 0 || channels > (size - offset_) / sizeof(float)) {
+        throw ParseError(kFormat, "bad header");
+    }
+    channels_ = static_cast<std::size_t>(channels);
+    repeats_ = static_cast<std::size_t>(repeats);
+    sum_.resize(channels_);
+}
+
+bool RepeatDecoder::next(float* out) {
+    if (read_ == repeats_) {
+        return false;
+    }
+    if (read_ == 0) {
+        for (std::size_t c = 0; c < channels_; ++c) {
+            out[c] = get_float_le(data_ + offset_ + c * sizeof(float));
+            sum_[c] = out[c];
+        }
+        offset_ += channels_ * sizeof(float);
+    } else {
+        BitReader reader(data_ + offset_, size_ - offset_);
+        for (std::size_t block = 0; block < channels_; block += kBlock) {
+            const unsigned parameter = static_cast<unsigned>(reader.get(kParameterBits));
+            if (parameter > kMaxParameter) {
+                throw ParseError(kFormat, "bad Rice parameter");
+            }
+            const std::size_t end = std::min(block + kBlock, channels_);
+            for (std::size_t c = block; c < end; ++c) {
+                const unsigned quotient = reader.unary(kEscape);
+                const std::uint64_t value =
+                    quotient == kEscape
+                        ? reader.get(kValueBits)
+                        : (std::uint64_t{quotient} << parameter) | reader.get(parameter);
+                const std::int64_t key =
+                    static_cast<std::int64_t>(ordered_key(predict(sum_[c], read_))) +
+                    unzigzag(value);
+                if (key < 0 || key > 0xffffffffll) {
+                    throw ParseError(kFormat, "residual out of range");
+                }
+                out[c] = from_key(static_cast<std::uint32_t>(key));
+            }
+        }
+        offset_ += reader.align();
+        for (std::size_t c = 0; c < channels_; ++c) {
+            sum_[c] += out[c];
+        }
+    }
+    if (++read_ == repeats_ && offset_ != size_) {
+        throw ParseError(kFormat, std::to_string(size_ - offset_) + " trailing bytes");
+    }
+    return true;
+}
+
+RepeatSummary reduce_repeats(const char* data, std::size_t size, std::size_t channels,
+                             float* out, const RepeatReduceOptions& options) {
+    RepeatDecoder first(data, size);
+    if (first.channels() != channels) {
+        throw ParseError(kFormat, "expected " + std::to_string(channels) + " channels, got " +
+                                      std::to_string(first.channels()));
+    }
+    RepeatSummary summary;
+    summary.repeats = first.repeats();
+    std::vector<float> row(channels);
+
+    if (options.method == RepeatReduction::kMean || summary.repeats < 3) {
+        while (first.next(row.data())) {
+        }
+        for (std::size_t c = 0; c < channels; ++c) {
+            out[c] = predict(first.sum()[c], summary.repeats);
+        }
+        return summary;
+    }
+
+    // Pass 1: moments of every channel's finite values, taken as
+    // deviations from the first acquisition so the sums stay well
+    // conditioned.
+    std::vector<double> reference(channels);
+    std::vector<double> s(channels);
+    std::vector<double> q(channels);
+    std::vector<std::uint32_t> n(channels);
+    first.next(row.data());
+    for (std::size_t c = 0; c < channels; ++c) {
+        reference[c] = std::isfinite(row[c]) ? row[c] : 0.0;
+    }
+    do {
+        for (std::size_t c = 0; c < channels; ++c) {
+            if (std::isfinite(row[c])) {
+                const double d = row[c] - reference[c];
+                s[c] += d;
+                q[c] += d * d;
+                ++n[c];
+            }
+        }
+    } while (first.next(row.data()));
+
+    // Pass 2: keep each value unless it is an outlier against the mean and
+    // spread of the channel's other repeats (leave-one-out, so a single
+    // large outlier cannot hide by inflating the spread).
+    const double clip = options.clip_sigma;
+    std::vector<double> kept_sum(channels);
+    std::vector<std::uint32_t> kept(channels);
+    RepeatDecoder second(data, size);
+    while (second.next(row.data())) {
+        for (std::size_t c = 0; c < channels; ++c) {
+            if (!std::isfinite(row[c])) {
+                ++summary.rejected;
+                continue;
+            }
+            const double d = row[c] - reference[c];
+            if (n[c] >= 3) {
+                const double others = n[c] - 1.0;
+                const double mean = (s[c] - d) / others;
+                const double variance = (q[c] - d * d - others * mean * mean) / (others - 1.0);
+                if (variance > 0.0 && std::fabs(d - mean) > clip * std::sqrt(variance)) {
+                    ++summary.rejected;
+                    continue;
+                }
+            }
+            kept_sum[c] += d;
+            ++kept[c];
+        }
+    }
+    for (std::size_t c = 0; c < channels; ++c) {
+        out[c] = kept[c] ? static_cast<float>(reference[c] + kept_sum[c] / kept[c])
+                         : std::numeric_limits<float>::quiet_NaN();
+    }
+    return summary;
+}
+
+}  // namespace probionis
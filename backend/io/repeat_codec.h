@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace probionis {
+
+// Compact encoding of repeated acquisitions of one sample, for the wire
+// and for storage. Protocols take 10-50 repeats that differ only by noise,
+// so after the first acquisition, which is stored in full, each repeat is
+// stored as the difference from the mean of the repeats before it:
+// residuals in float ULPs, Rice-coded in blocks of 64 channels. The coding
+// is lossless (NaN payloads and signed zeros included); each repeat of a
+// shot-noise-limited spectrum takes about half its float32 size, quieter
+// spectra less.
+//
+// Layout: "PBRP" magic, u32 version, varint channels, varint repeats, the
+// first acquisition as float32 LE, then one byte-aligned bit stream per
+// further repeat.
+class RepeatEncoder {
+public:
+    explicit RepeatEncoder(std::size_t channels);
+
+    // Appends one acquisition of channels() floats.
+    void add(const float* acquisition);
+
+    std::size_t channels() const { return channels_; }
+    std::size_t repeats() const { return repeats_; }
+
+    // The encoding of every acquisition added so far.
+    std::string bytes() const;
+
+private:
+    std::size_t channels_;
+    std::size_t repeats_ = 0;
+    std::string stream_;
+    std::vector<double> sum_;
+    // Zigzagged residuals of the repeat being added.
+    std::vector<std::uint64_t> residuals_;
+};
+
+// Decodes the repeats one at a time, so a consumer holds one acquisition
+// rather than all of them. Throws ParseError on malformed input.
+class RepeatDecoder {
+public:
+    RepeatDecoder(const char* data, std::size_t size);
+
+    std::size_t channels() const { return channels_; }
+    std::size_t repeats() const { return repeats_; }
+
+    // Writes the next acquisition to `out` (channels() floats); false once
+    // every repeat has been read.
+    bool next(float* out);
+
+    // Per-channel sum of the acquisitions read so far, and their number.
+    const std::vector<double>& sum() const { return sum_; }
+    std::size_t read() const { return read_; }
+
+private:
+    const char* data_;
+    std::size_t size_;
+    std::size_t offset_ = 0;
+    std::size_t channels_ = 0;
+    std::size_t repeats_ = 0;
+    std::size_t read_ = 0;
+    std::vector<double> sum_;
+};
+
+enum class RepeatReduction : std::uint8_t {
+    kMean = 0,
+    // Mean without outliers: a value is dropped when it lies more than
+    // `clip_sigma` standard deviations from the mean of the other repeats
+    // of its channel (cosmic-ray hits, a repeat taken during a shutter
+    // glitch). Non-finite values are always dropped. Needs 3 repeats.
+    kClippedMean = 1,
+};
+
+struct RepeatReduceOptions {
+    RepeatReduction method = RepeatReduction::kClippedMean;
+    float clip_sigma = 4.0f;
+};
+
+struct RepeatSummary {
+    std::size_t repeats = 0;
+    // Values dropped by clipping, over all channels and repeats.
+    std::size_t rejected = 0;
+};
+
+// Reduces encoded repeats to one spectrum of `channels` floats in `out`,
+// streaming: at most two decoding passes and a few rows of state, however
+// many repeats there are. Throws ParseError on malformed input or a
+// channel count mismatch.
+RepeatSummary reduce_repeats(const char* data, std::size_t size, std::size_t channels,
+                             float* out, const RepeatReduceOptions& options = {});
+
+}  // namespace probionis
@@ -0,0 +1,202 @@
+#include "io/spc_reader.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "io/parse_error.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr std::size_t kMainHeaderSize = 512;
+constexpr std::size_t kSubHeaderSize = 32;
+
+constexpr std::uint8_t kVersionNewLsb = 0x4B;
+constexpr std::uint8_t kVersionNewMsb = 0x4C;
+constexpr std::uint8_t kVersionOld = 0x4D;
+
+// ftflgs bits.
+constexpr std::uint8_t kFlag16BitY = 0x01;
+constexpr std::uint8_t kFlagMulti = 0x04;
+constexpr std::uint8_t kFlagXyxy = 0x40;
+constexpr std::uint8_t kFlagXValues = 0x80;
+
+// Exponent value marking IEEE float Y data.
+constexpr std::int8_t kFloatExponent = -128;
+
+// Field offsets within the 512-byte main header.
+constexpr std::size_t kOffFlags = 0;
+constexpr std::size_t kOffVersion = 1;
+constexpr std::size_t kOffExponent = 3;
+constexpr std::size_t kOffPoints = 4;
+constexpr std::size_t kOffFirstX = 8;
+constexpr std::size_t kOffLastX = 16;
+constexpr std::size_t kOffSubfiles = 24;
+constexpr std::size_t kOffSource = 45;
+
+// Field offsets within a subfile header.
+constexpr std::size_t kOffSubExponent = 1;
+constexpr std::size_t kOffSubPoints = 16;
+
+template <typename T>
+T read_le(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+class Cursor {
+public:
+    Cursor(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+    const char* take(std::size_t bytes) {
+        if (bytes > size_ - offset_) {
+            throw ParseError("SPC", "file truncated at byte " + std::to_string(offset_));
+        }
+        const char* p = data_ + offset_;
+        offset_ += bytes;
+        return p;
+    }
+
+    std::size_t remaining() const { return size_ - offset_; }
+
+    // Throws unless `count` items of at least `bytes` each could still
+    // follow, so header counts are bounded before anything is allocated.
+    void expect(std::size_t count, std::size_t bytes) const {
+        if (count > remaining() / bytes) {
+            throw ParseError("SPC", "declared size " + std::to_string(count) +
+                                        " exceeds the file");
+        }
+    }
+
+private:
+    const char* data_;
+    std::size_t size_;
+    std::size_t offset_ = 0;
+};
+
+void decode_y(const char* src, std::size_t points, std::int8_t exponent,
+              bool sixteen_bit, float* out) {
+    if (exponent == kFloatExponent) {
+        std::memcpy(out, src, points * sizeof(float));
+        return;
+    }
+    // Scaled integers: y = raw * 2^exponent / 2^bits.
+    if (sixteen_bit) {
+        const float scale = std::ldexp(1.0f, exponent - 16);
+        for (std::size_t i = 0; i < points; ++i) {
+            out[i] = static_cast<float>(read_le<std::int16_t>(src + 2 * i)) * scale;
+        }
+    } else {
+        const double scale = std::ldexp(1.0, exponent - 32);
+        for (std::size_t i = 0; i < points; ++i) {
+            out[i] = static_cast<float>(read_le<std::int32_t>(src + 4 * i) * scale);
+        }
+    }
+}
+
+std::string trimmed_field(const char* p, std::size_t max_length) {
+    std::size_t length = strnlen(p, max_length);
+    while (length > 0 && (p[length - 1] == ' ' || p[length - 1] == '\0')) {
+        --length;
+    }
+    return std::string(p, length);
+}
+
+}  // namespace
+
+std::vector<Spectrum> parse_spc(const char* data, std::size_t size) {
+    static_assert(sizeof(float) == 4, "SPC decoding assumes 32-bit floats");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    throw ParseError("SPC", "big-endian hosts are not supported");
+#endif
+    Cursor cursor(data, size);
+    const char* header = cursor.take(kMainHeaderSize);
+
+    const std::uint8_t version = static_cast<std::uint8_t>(header[kOffVersion]);
+    if (version == kVersionOld || version == kVersionNewMsb) {
+        throw ParseError("SPC", "unsupported file version");
+    }
+    if (version != kVersionNewLsb) {
+        throw ParseError("SPC", "not an SPC file");
+    }
+
+    const std::uint8_t flags = static_cast<std::uint8_t>(header[kOffFlags]);
+    const std::int8_t file_exponent = static_cast<std::int8_t>(header[kOffExponent]);
+    const std::int32_t file_points = read_le<std::int32_t>(header + kOffPoints);
+    const double first_x = read_le<double>(header + kOffFirstX);
+    const double last_x = read_le<double>(header + kOffLastX);
+    const bool multi = (flags & kFlagMulti) != 0;
+    const bool xyxy = (flags & kFlagXyxy) != 0;
+    const bool sixteen_bit = (flags & kFlag16BitY) != 0;
+    const std::int32_t subfiles =
+        multi ? read_le<std::int32_t>(header + kOffSubfiles) : 1;
+    const std::string source = trimmed_field(header + kOffSource, 9);
+
+    if (subfiles <= 0 || (!xyxy && file_points <= 0)) {
+        throw ParseError("SPC", "bad point or subfile count");
+    }
+
+    // Every subfile has at least its header and, with a shared axis, a
+    // 16-bit Y value per point; the per-subfile copies of the axis are
+    // bounded by that too.
+    std::size_t min_subfile_bytes = kSubHeaderSize;
+    if (!xyxy) {
+        cursor.expect(static_cast<std::size_t>(file_points), 2);
+        min_subfile_bytes += 2 * static_cast<std::size_t>(file_points);
+    }
+    cursor.expect(static_cast<std::size_t>(subfiles), min_subfile_bytes);
+
+    // Shared X axis: explicit array after the header, or evenly spaced.
+    std::vector<float> shared_axis;
+    if (!xyxy) {
+        shared_axis.resize(static_cast<std::size_t>(file_points));
+        if (flags & kFlagXValues) {
+            const char* x = cursor.take(shared_axis.size() * sizeof(float));
+            std::memcpy(shared_axis.data(), x, shared_axis.size() * sizeof(float));
+        } else {
+            const double step = file_points > 1 ? (last_x - first_x) / (file_points - 1) : 0.0;
+            for (std::size_t i = 0; i < shared_axis.size(); ++i) {
+                shared_axis[i] = static_cast<float>(first_x + step * static_cast<double>(i));
+            }
+        }
+    }
+
+    std::vector<Spectrum> spectra(static_cast<std::size_t>(subfiles));
+    for (auto& spectrum : spectra) {
+        const char* sub = cursor.take(kSubHeaderSize);
+        std::int8_t exponent = static_cast<std::int8_t>(sub[kOffSubExponent]);
+        if (!multi && exponent == 0) {
+            exponent = file_exponent;
+        }
+
+        std::size_t points = shared_axis.size();
+        if (xyxy) {
+            const std::int32_t sub_points = read_le<std::int32_t>(sub + kOffSubPoints);
+            if (sub_points <= 0) {
+                throw ParseError("SPC", "bad subfile point count");
+            }
+            points = static_cast<std::size_t>(sub_points);
+            cursor.expect(points, sizeof(float));
+            spectrum.axis.resize(points);
+            const char* x = cursor.take(points * sizeof(float));
+            std::memcpy(spectrum.axis.data(), x, points * sizeof(float));
+        } else {
+            spectrum.axis = shared_axis;
+        }
+
+        const std::size_t y_bytes =
+            points * (exponent != kFloatExponent && sixteen_bit ? 2 : 4);
+        const char* y = cursor.take(y_bytes);
+        spectrum.intensity.resize(points);
+        decode_y(y, points, exponent, sixteen_bit, spectrum.intensity.data());
+        spectrum.instrument_id = source;
+        make_axis_ascending(spectrum);
+    }
+    return spectra;
+}
+
+}  // namespace probionis
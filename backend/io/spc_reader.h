@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// Decodes a Thermo/Galactic SPC file in the "new" little-endian layout
+// (version byte 0x4B): single or multi-subfile, evenly spaced or explicit
+// X values (including XYXY per-subfile axes), and IEEE float, 32-bit or
+// 16-bit scaled-integer Y data. Returns one spectrum per subfile. The
+// obsolete 0x4D layout and big-endian 0x4C files raise ParseError.
+std::vector<Spectrum> parse_spc(const char* data, std::size_t size);
+
+}  // namespace probionis
@@ -0,0 +1,86 @@
+#include "io/spectrum_reader.h"
+
+#include <cctype>
+#include <cstdint>
+
+#include "io/delimited_reader.h"
+#include "io/jcamp_reader.h"
+#include "io/mapped_file.h"
+#include "io/parse_error.h"
+#include "io/spc_reader.h"
+
+namespace probionis {
+
+namespace {
+
+std::string lower_extension(const std::string& path) {
+    const std::size_t dot = path.find_last_of('.');
+    const std::size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return std::string();
+    }
+    std::string ext = path.substr(dot + 1);
+    for (char& c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return ext;
+}
+
+std::string file_stem(const std::string& path) {
+    const std::size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const std::size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+}  // namespace
+
+SpectrumFormat detect_spectrum_format(const std::string& path, const char* data,
+                                      std::size_t size) {
+    if (size >= 2 && (static_cast<std::uint8_t>(data[1]) == 0x4B ||
+                      static_cast<std::uint8_t>(data[1]) == 0x4C ||
+                      static_cast<std::uint8_t>(data[1]) == 0x4D) &&
+        lower_extension(path) == "spc") {
+        return SpectrumFormat::kSpc;
+    }
+    std::size_t i = 0;
+    while (i < size && std::isspace(static_cast<unsigned char>(data[i]))) ++i;
+    if (size - i >= 2 && data[i] == '#' && data[i + 1] == '#') {
+        return SpectrumFormat::kJcampDx;
+    }
+    const std::string ext = lower_extension(path);
+    if (ext == "jdx" || ext == "dx" || ext == "jcm") {
+        return SpectrumFormat::kJcampDx;
+    }
+    if (ext == "csv" || ext == "tsv" || ext == "txt" || ext == "dat" || ext == "xy") {
+        return SpectrumFormat::kDelimited;
+    }
+    return SpectrumFormat::kUnknown;
+}
+
+std::vector<Spectrum> read_spectrum_file(const std::string& path) {
+    MappedFile file(path);
+    std::vector<Spectrum> spectra;
+    switch (detect_spectrum_format(path, file.data(), file.size())) {
+        case SpectrumFormat::kSpc:
+            spectra = parse_spc(file.data(), file.size());
+            break;
+        case SpectrumFormat::kJcampDx:
+            spectra = parse_jcamp(file.data(), file.size());
+            break;
+        case SpectrumFormat::kDelimited:
+            spectra = parse_delimited(file.data(), file.size());
+            break;
+        case SpectrumFormat::kUnknown:
+            throw ParseError(path, "unrecognized spectrum format");
+    }
+
+    const std::string stem = file_stem(path);
+    for (std::size_t i = 0; i < spectra.size(); ++i) {
+        if (spectra[i].sample_id.empty()) {
+            spectra[i].sample_id =
+                spectra.size() == 1 ? stem : stem + "#" + std::to_string(i);
+        }
+    }
+    return spectra;
+}
+
+}  // namespace probionis
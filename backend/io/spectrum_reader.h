@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+enum class SpectrumFormat { kUnknown, kSpc, kJcampDx, kDelimited };
+
+// Identifies the format from the leading bytes, falling back to the file
+// extension for plain text.
+SpectrumFormat detect_spectrum_format(const std::string& path, const char* data,
+                                      std::size_t size);
+
+// Maps `path` and decodes it with the matching reader. Spectra without a
+// sample ID in the file get the file name stem, numbered when the file
+// holds several.
+std::vector<Spectrum> read_spectrum_file(const std::string& path);
+
+}  // namespace probionis
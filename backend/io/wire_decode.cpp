@@ -0,0 +1,93 @@
+#include "io/wire_decode.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "io/fast_float.h"
+#include "io/parse_error.h"
+#include "io/repeat_codec.h"
+
+namespace probionis {
+
+namespace {
+
+const char kFormat[] = "wire spectrum";
+const char kRepeatsType[] = "application/x-probionis-repeats";
+
+bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '\n';
+}
+
+void decode_float32le(const char* data, std::size_t size, float* out, std::size_t channels) {
+    if (size != channels * sizeof(float)) {
+        throw ParseError(kFormat, "expected " + std::to_string(channels * sizeof(float)) +
+                                      " bytes, got " + std::to_string(size));
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (std::size_t i = 0; i < channels; ++i) {
+        std::uint32_t bits;
+        std::memcpy(&bits, data + i * sizeof(float), sizeof(bits));
+        bits = __builtin_bswap32(bits);
+        std::memcpy(out + i, &bits, sizeof(bits));
+    }
+#else
+    std::memcpy(out, data, size);
+#endif
+}
+
+void decode_text(const char* data, std::size_t size, float* out, std::size_t channels) {
+    const char* p = data;
+    const char* const end = data + size;
+    std::size_t count = 0;
+    while (true) {
+        while (p != end && is_separator(*p)) ++p;
+        if (p == end) break;
+        if (count == channels) {
+            throw ParseError(kFormat, "more than " + std::to_string(channels) + " values");
+        }
+        const char* next = parse_float(p, end, out + count);
+        if (next == p || (next != end && !is_separator(*next))) {
+            throw ParseError(kFormat, "bad number at value " + std::to_string(count + 1));
+        }
+        ++count;
+        p = next;
+    }
+    if (count != channels) {
+        throw ParseError(kFormat, "expected " + std::to_string(channels) + " values, got " +
+                                      std::to_string(count));
+    }
+}
+
+}  // namespace
+
+WireEncoding wire_encoding_for(const std::string* content_type) {
+    if (!content_type) {
+        return WireEncoding::kFloat32LE;
+    }
+    if (content_type->compare(0, 5, "text/") == 0) {
+        return WireEncoding::kText;
+    }
+    if (content_type->compare(0, sizeof(kRepeatsType) - 1, kRepeatsType) == 0) {
+        return WireEncoding::kRepeats;
+    }
+    return WireEncoding::kFloat32LE;
+}
+
+void decode_intensities(const char* data, std::size_t size, WireEncoding encoding,
+                        float* out, std::size_t channels) {
+    switch (encoding) {
+        case WireEncoding::kFloat32LE:
+            decode_float32le(data, size, out, channels);
+            return;
+        case WireEncoding::kText:
+            decode_text(data, size, out, channels);
+            return;
+        case WireEncoding::kRepeats:
+            reduce_repeats(data, size, channels, out);
+            return;
+    }
+    throw ParseError(kFormat, "unknown encoding");
+}
+
+}  // namespace probionis
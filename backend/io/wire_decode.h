@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace probionis {
+
+// Encodings accepted for a spectrum's intensities in a scoring request
+// body. The axis is fixed per deployment and never sent.
+enum class WireEncoding {
+    kFloat32LE,  // packed little-endian IEEE floats
+    kText,       // decimals separated by blanks, commas or newlines
+    // Repeated acquisitions of one sample (io/repeat_codec.h), reduced to
+    // their outlier-clipped mean while decoding.
+    kRepeats,
+};
+
+// Content-Type of a request body -> its encoding: text/* is kText,
+// application/x-probionis-repeats is kRepeats, anything else kFloat32LE.
+WireEncoding wire_encoding_for(const std::string* content_type);
+
+// Decodes exactly `channels` intensities from `data` straight into `out`,
+// typically a SlabSlot row, so the request body is the only other copy.
+// Throws ParseError on malformed input or a channel count mismatch; `out`
+// may then hold a partial row.
+void decode_intensities(const char* data, std::size_t size, WireEncoding encoding,
+                        float* out, std::size_t channels);
+
+}  // namespace probionis
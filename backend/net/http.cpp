@@ -0,0 +1,271 @@
+#include "net/http.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/socket.h"
+
+namespace probionis {
+
+namespace {
+
+bool is_framing_header(const std::string& name) {
+    // Regenerated for each connection rather than forwarded.
+    return strcasecmp(name.c_str(), "host") == 0 ||
+           strcasecmp(name.c_str(), "content-length") == 0 ||
+           strcasecmp(name.c_str(), "transfer-encoding") == 0 ||
+           strcasecmp(name.c_str(), "connection") == 0;
+}
+
+}  // namespace
+
+const std::string* find_header(const HttpHeaders& headers, const char* name) {
+    for (const auto& header : headers) {
+        if (strcasecmp(header.first.c_str(), name) == 0) {
+            return &header.second;
+        }
+    }
+    return nullptr;
+}
+
+std::string query_parameter(const std::string& target, const char* name) {
+    const std::size_t query = target.find('?');
+    if (query == std::string::npos) {
+        return {};
+    }
+    const std::size_t name_len = std::strlen(name);
+    std::size_t pos = query + 1;
+    while (pos < target.size()) {
+        std::size_t end = target.find('&', pos);
+        if (end == std::string::npos) {
+            end = target.size();
+        }
+        if (end - pos > name_len && target[pos + name_len] == '=' &&
+            target.compare(pos, name_len, name) == 0) {
+            return target.substr(pos + name_len + 1, end - pos - name_len - 1);
+        }
+        pos = end + 1;
+    }
+    return {};
+}
+
+HttpConnection::HttpConnection(std::string host, std::uint16_t port, int timeout_ms)
+    : host_(std::move(host)), port_(port), timeout_ms_(timeout_ms) {}
+
+HttpConnection::~HttpConnection() {
+    disconnect();
+}
+
+bool HttpConnection::exchange(const std::string& method, const std::string& target,
+                              const HttpHeaders& headers, const std::string& body,
+                              HttpResponse& response) {
+    if (!exchange_head(method, target, headers, body, response)) {
+        return false;
+    }
+    return !body_pending_ || read_chunks([&response](const std::string& piece) {
+        response.body += piece;
+        return true;
+    });
+}
+
+bool HttpConnection::exchange_head(const std::string& method, const std::string& target,
+                                   const HttpHeaders& headers, const std::string& body,
+                                   HttpResponse& response) {
+    if (!send_request(method, target, headers, body)) {
+        return false;
+    }
+    if (!read_head(response)) {
+        fail();
+        return false;
+    }
+    close_after_body_ = !response.keep_alive;
+    if (!body_pending_ && close_after_body_) {
+        disconnect();
+    }
+    return true;
+}
+
+bool HttpConnection::read_chunks(const HttpBodyWriter& write) {
+    std::string line;
+    std::string piece;
+    while (body_pending_) {
+        if (!read_line(line)) {
+            fail();
+            return false;
+        }
+        const std::size_t size = std::strtoul(line.c_str(), nullptr, 16);
+        if (size == 0) {
+            // Trailers end with an empty line.
+            while (read_line(line) && !line.empty()) {
+            }
+            body_pending_ = false;
+            break;
+        }
+        piece.clear();
+        if (!read_exact(size, piece) || !read_line(line)) {
+            fail();
+            return false;
+        }
+        if (!write(piece)) {
+            // The rest of the body stays unread, so the socket is unusable.
+            disconnect();
+            return true;
+        }
+    }
+    if (close_after_body_) {
+        disconnect();
+    }
+    return true;
+}
+
+bool HttpConnection::send_request(const std::string& method, const std::string& target,
+                                  const HttpHeaders& headers, const std::string& body) {
+    failure_ = HttpFailure::kNone;
+    body_pending_ = false;
+    received_ = false;
+    peer_closed_ = false;
+    reused_ = fd_ >= 0;
+    if (!reused_ && !connect()) {
+        failure_ = HttpFailure::kConnect;
+        return false;
+    }
+    std::string wire;
+    wire.reserve(256 + body.size());
+    wire += method + " " + target + " HTTP/1.1\r\n";
+    wire += "Host: " + host_ + ":" + std::to_string(port_) + "\r\n";
+    for (const auto& [name, value] : headers) {
+        if (!is_framing_header(name)) {
+            wire += name + ": " + value + "\r\n";
+        }
+    }
+    wire += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    wire += body;
+    if (!send_all(fd_, wire.data(), wire.size())) {
+        peer_closed_ = errno == EPIPE || errno == ECONNRESET;
+        fail();
+        return false;
+    }
+    return true;
+}
+
+bool HttpConnection::peer_gone() const {
+    if (fd_ < 0) {
+        return false;
+    }
+    pollfd p{fd_, POLLIN | POLLRDHUP, 0};
+    return ::poll(&p, 1, 0) != 0;
+}
+
+void HttpConnection::fail() {
+    if (received_) {
+        failure_ = HttpFailure::kResponse;
+    } else if (reused_ && peer_closed_) {
+        failure_ = HttpFailure::kStale;
+    } else {
+        failure_ = HttpFailure::kNoResponse;
+    }
+    body_pending_ = false;
+    disconnect();
+}
+
+bool HttpConnection::connect() {
+    fd_ = tcp_connect(host_, port_, timeout_ms_);
+    buffer_.clear();
+    return fd_ >= 0;
+}
+
+void HttpConnection::disconnect() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    buffer_.clear();
+}
+
+bool HttpConnection::fill() {
+    char chunk[16384];
+    const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+        // An orderly close or reset, as opposed to a receive timeout.
+        peer_closed_ = n == 0 || errno == ECONNRESET;
+        return false;
+    }
+    received_ = true;
+    buffer_.append(chunk, static_cast<std::size_t>(n));
+    return true;
+}
+
+bool HttpConnection::read_line(std::string& line) {
+    std::size_t eol;
+    while ((eol = buffer_.find("\r\n")) == std::string::npos) {
+        if (!fill()) return false;
+    }
+    line = buffer_.substr(0, eol);
+    buffer_.erase(0, eol + 2);
+    return true;
+}
+
+bool HttpConnection::read_exact(std::size_t count, std::string& out) {
+    while (buffer_.size() < count) {
+        if (!fill()) return false;
+    }
+    out.append(buffer_, 0, count);
+    buffer_.erase(0, count);
+    return true;
+}
+
+bool HttpConnection::read_head(HttpResponse& response) {
+    std::string line;
+    if (!read_line(line) || line.compare(0, 5, "HTTP/") != 0) {
+        return false;
+    }
+    const std::size_t space = line.find(' ');
+    response.status = space == std::string::npos ? 0 : std::atoi(line.c_str() + space + 1);
+    response.keep_alive = line.compare(0, 8, "HTTP/1.0") != 0;
+    response.headers.clear();
+    response.body.clear();
+
+    long content_length = -1;
+    bool chunked = false;
+    while (read_line(line) && !line.empty()) {
+        const std::size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        if (strcasecmp(name.c_str(), "content-length") == 0) {
+            content_length = std::atol(value.c_str());
+        } else if (strcasecmp(name.c_str(), "transfer-encoding") == 0 &&
+                   strcasecmp(value.c_str(), "chunked") == 0) {
+            chunked = true;
+        } else if (strcasecmp(name.c_str(), "connection") == 0) {
+            response.keep_alive = strcasecmp(value.c_str(), "close") != 0;
+        } else {
+            response.headers.emplace_back(std::move(name), std::move(value));
+        }
+    }
+    if (!line.empty()) {
+        return false;
+    }
+
+    if (chunked) {
+        body_pending_ = true;
+        return true;
+    }
+    if (content_length >= 0) {
+        return read_exact(static_cast<std::size_t>(content_length), response.body);
+    }
+    // No framing: body runs to connection close.
+    while (fill()) {
+    }
+    response.body.swap(buffer_);
+    response.keep_alive = false;
+    return true;
+}
+
+}  // namespace probionis
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace probionis {
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+struct HttpRequest {
+    std::string method;
+    std::string target;
+    HttpHeaders headers;
+    std::string body;
+};
+
+// Sends one piece of a streamed response body; false once the client is
+// gone.
+using HttpBodyWriter = std::function<bool(const std::string& piece)>;
+
+struct HttpResponse {
+    int status = 0;
+    HttpHeaders headers;
+    std::string body;
+    bool keep_alive = true;
+    // When set, the body is streamed instead: the server sends the status
+    // and headers, then calls this on the connection thread, putting each
+    // piece on the wire as soon as it is written (chunked on HTTP/1.1).
+    std::function<void(const HttpBodyWriter& write)> stream;
+};
+
+// Case-insensitive header lookup; nullptr when absent.
+const std::string* find_header(const HttpHeaders& headers, const char* name);
+
+// Value of `name` in the query string of `target`, or empty.
+std::string query_parameter(const std::string& target, const char* name);
+
+// Why the last HttpConnection exchange failed.
+enum class HttpFailure : std::uint8_t {
+    kNone = 0,
+    kConnect,     // no connection could be made; nothing was sent
+    kStale,       // a kept-alive connection was closed by the server before
+                  // any reply byte, the usual fate of an idle pooled socket
+    kNoResponse,  // sent, but no reply arrived (timeout or reset)
+    kResponse,    // the reply was cut short
+};
+
+// One keep-alive HTTP/1.1 client connection. Reconnects lazily after the
+// server closes or an I/O error. With a nonzero timeout, connect, send and
+// each receive give up after that many milliseconds.
+class HttpConnection {
+public:
+    HttpConnection(std::string host, std::uint16_t port, int timeout_ms = 0);
+    ~HttpConnection();
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // False on any transport failure; `response` is then unspecified.
+    bool exchange(const std::string& method, const std::string& target,
+                  const HttpHeaders& headers, const std::string& body, HttpResponse& response);
+    bool exchange(const HttpRequest& request, HttpResponse& response) {
+        return exchange(request.method, request.target, request.headers, request.body, response);
+    }
+
+    // Like exchange(), but a chunked reply body is left on the connection:
+    // `response.body` stays empty and body_pending() is true until
+    // read_chunks() has passed every chunk on. Other bodies are read here.
+    bool exchange_head(const std::string& method, const std::string& target,
+                       const HttpHeaders& headers, const std::string& body,
+                       HttpResponse& response);
+    bool body_pending() const { return body_pending_; }
+    // Hands each chunk of a pending body to `write` as it arrives. False on
+    // a transport failure; if `write` refuses a piece, the rest is dropped
+    // with the connection and the call still succeeds.
+    bool read_chunks(const HttpBodyWriter& write);
+
+    HttpFailure failure() const { return failure_; }
+    // True if the server has closed this idle connection (or sent something
+    // unasked), checked without blocking: a request on it would fail as
+    // kStale. False before the first connect.
+    bool peer_gone() const;
+
+    const std::string& host() const { return host_; }
+    std::uint16_t port() const { return port_; }
+
+private:
+    bool connect();
+    void disconnect();
+    bool send_request(const std::string& method, const std::string& target,
+                      const HttpHeaders& headers, const std::string& body);
+    // Disconnects and classifies the failure into failure_.
+    void fail();
+    bool fill();
+    bool read_line(std::string& line);
+    bool read_exact(std::size_t count, std::string& out);
+    bool read_head(HttpResponse& response);
+
+    std::string host_;
+    std::uint16_t port_;
+    int timeout_ms_;
+    int fd_ = -1;
+    std::string buffer_;
+    HttpFailure failure_ = HttpFailure::kNone;
+    // State of the exchange in progress.
+    bool reused_ = false;
+    bool received_ = false;
+    bool peer_closed_ = false;
+    bool body_pending_ = false;
+    bool close_after_body_ = false;
+};
+
+}  // namespace probionis
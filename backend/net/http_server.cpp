@@ -0,0 +1,324 @@
+#include "net/http_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/socket.h"
+#include "runtime/executor.h"
+#include "runtime/hash.h"
+#include "runtime/huge_page_allocator.h"
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+namespace {
+
+const char* reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Entity";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Status";
+    }
+}
+
+// Reads one request from `fd`, keeping leftover bytes in `buffer` for the
+// next request on the connection. Returns 0 on success, an HTTP status to
+// reply with on malformed input, or -1 when the connection is gone.
+int read_request(int fd, std::string& buffer, std::size_t max_body, HttpRequest& request,
+                 bool& keep_alive, bool& http10) {
+    auto fill = [&]() {
+        char chunk[16384];
+        const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<std::size_t>(n));
+        return true;
+    };
+    std::size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > 64 * 1024) return 400;
+        if (!fill()) return -1;
+    }
+
+    request.headers.clear();
+    request.body.clear();
+    std::size_t line_end = buffer.find("\r\n");
+    const std::string request_line = buffer.substr(0, line_end);
+    const std::size_t sp1 = request_line.find(' ');
+    const std::size_t sp2 = request_line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) {
+        return 400;
+    }
+    request.method = request_line.substr(0, sp1);
+    request.target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    http10 = request_line.compare(sp2 + 1, std::string::npos, "HTTP/1.0") == 0;
+    keep_alive = !http10;
+
+    std::size_t content_length = 0;
+    std::size_t pos = line_end + 2;
+    while (pos < head_end) {
+        line_end = buffer.find("\r\n", pos);
+        const std::size_t colon = buffer.find(':', pos);
+        if (colon != std::string::npos && colon < line_end) {
+            std::string name = buffer.substr(pos, colon - pos);
+            std::string value = buffer.substr(colon + 1, line_end - colon - 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if (strcasecmp(name.c_str(), "content-length") == 0) {
+                content_length = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (strcasecmp(name.c_str(), "transfer-encoding") == 0) {
+                return 400;  // chunked request bodies are not accepted
+            } else if (strcasecmp(name.c_str(), "connection") == 0) {
+                keep_alive = strcasecmp(value.c_str(), "close") != 0;
+            } else {
+                request.headers.emplace_back(std::move(name), std::move(value));
+            }
+        }
+        pos = line_end + 2;
+    }
+    if (content_length > max_body) {
+        return 413;
+    }
+    buffer.erase(0, head_end + 4);
+    while (buffer.size() < content_length) {
+        if (!fill()) return -1;
+    }
+    request.body.assign(buffer, 0, content_length);
+    buffer.erase(0, content_length);
+    return 0;
+}
+
+std::string response_head(const HttpResponse& response) {
+    std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                       reason_phrase(response.status) + "\r\n";
+    for (const auto& [name, value] : response.headers) {
+        if (strcasecmp(name.c_str(), "content-length") == 0 ||
+            strcasecmp(name.c_str(), "connection") == 0 ||
+            strcasecmp(name.c_str(), "transfer-encoding") == 0) {
+            continue;
+        }
+        head += name + ": " + value + "\r\n";
+    }
+    return head;
+}
+
+bool write_response(int fd, const HttpResponse& response, bool keep_alive) {
+    std::string wire = response_head(response);
+    wire.reserve(wire.size() + 64 + response.body.size());
+    wire += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    wire += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    wire += response.body;
+    return send_all(fd, wire.data(), wire.size());
+}
+
+// Streams response.stream's pieces as chunks, or for HTTP/1.0 clients as a
+// body ended by closing the connection. Returns false if the connection
+// must close.
+bool write_streamed_response(int fd, const HttpResponse& response, bool keep_alive,
+                             bool http10) {
+    keep_alive = keep_alive && !http10;
+    std::string head = response_head(response);
+    if (!http10) {
+        head += "Transfer-Encoding: chunked\r\n";
+    }
+    head += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    bool open = send_all(fd, head.data(), head.size());
+    const HttpBodyWriter write = [&](const std::string& piece) {
+        if (!open || piece.empty()) {
+            return open;
+        }
+        if (http10) {
+            open = send_all(fd, piece.data(), piece.size());
+            return open;
+        }
+        char size[24];
+        std::snprintf(size, sizeof(size), "%zx\r\n", piece.size());
+        std::string chunk = size;
+        chunk.reserve(chunk.size() + piece.size() + 2);
+        chunk += piece;
+        chunk += "\r\n";
+        open = send_all(fd, chunk.data(), chunk.size());
+        return open;
+    };
+    if (open) {
+        try {
+            response.stream(write);
+        } catch (const std::exception&) {
+            // The status is already out; cutting the body short without the
+            // final chunk tells the client it is incomplete.
+            return false;
+        }
+    }
+    if (open && !http10) {
+        open = send_all(fd, "0\r\n\r\n", 5);
+    }
+    return open && keep_alive;
+}
+
+CapturedRequest captured(const HttpRequest& request, std::uint64_t offset_ns, int status,
+                         std::uint64_t response_hash) {
+    CapturedRequest record;
+    record.offset_ns = offset_ns;
+    record.method = request.method;
+    record.target = request.target;
+    for (const auto& header : request.headers) {
+        if (!is_credential_header(header.first)) {
+            record.headers.push_back(header);
+        }
+    }
+    record.body = request.body;
+    record.status = static_cast<std::uint16_t>(status);
+    record.response_hash = response_hash;
+    return record;
+}
+
+}  // namespace
+
+HttpServer::HttpServer(const HttpServerOptions& options, HttpHandler handler)
+    : options_(options), handler_(std::move(handler)) {
+    if (!handler_) {
+        throw std::invalid_argument("HttpServer: null handler");
+    }
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+void HttpServer::start() {
+    listen_fd_ = tcp_listen(options_.host, options_.port, &port_);
+    stopping_.store(false);
+    const std::size_t count =
+        options_.connection_threads != 0
+            ? options_.connection_threads
+            : std::max<std::size_t>(
+                  1, split_thread_budget(shared_executor_options()).connections);
+    threads_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        threads_.emplace_back([this] { run_connections(); });
+    }
+}
+
+void HttpServer::stop() {
+    if (listen_fd_ < 0) {
+        return;
+    }
+    stopping_.store(true);
+    // Wakes every thread blocked in accept().
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void HttpServer::run_connections() {
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (stopping_.load()) break;
+            continue;
+        }
+        serve(fd);
+        ::close(fd);
+    }
+}
+
+void HttpServer::serve(int fd) {
+    const int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // Bounds how long an idle keep-alive connection (or stop()) waits.
+    set_receive_timeout(fd, std::max(1, options_.idle_timeout_ms));
+
+    std::string buffer;
+    HttpRequest request;
+    HttpResponse response;
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        bool keep_alive = true;
+        bool http10 = false;
+        const int status =
+            read_request(fd, buffer, options_.max_body_bytes, request, keep_alive, http10);
+        if (status < 0) {
+            return;
+        }
+        response = HttpResponse{};
+        if (status > 0) {
+            response.status = status;
+            write_response(fd, response, false);
+            return;
+        }
+        CaptureWriter* capture = options_.capture.get();
+        const std::uint64_t arrival = capture ? capture->now_offset_ns() : 0;
+        response.status = 200;
+        try {
+            handler_(request, response);
+        } catch (const std::exception& e) {
+            response = HttpResponse{};
+            response.status = 500;
+            response.body = e.what();
+        }
+        keep_alive = keep_alive && response.keep_alive && !stopping_.load();
+        if (response.stream) {
+            // The body hash covers the pieces as they go out, which is what
+            // a replay client reassembles.
+            std::uint64_t hash = fnv1a64(nullptr, 0);
+            if (capture) {
+                response.stream = [&hash, stream = std::move(response.stream)](
+                                      const HttpBodyWriter& write) {
+                    stream([&](const std::string& piece) {
+                        hash = fnv1a64(piece.data(), piece.size(), hash);
+                        return write(piece);
+                    });
+                };
+            }
+            const bool open = write_streamed_response(fd, response, keep_alive, http10);
+            if (capture) {
+                capture->record(captured(request, arrival, response.status, hash));
+            }
+            if (!open) {
+                return;
+            }
+            continue;
+        }
+        if (capture) {
+            capture->record(captured(request, arrival, response.status,
+                                     fnv1a64(response.body.data(), response.body.size())));
+        }
+        if (!write_response(fd, response, keep_alive) || !keep_alive) {
+            return;
+        }
+    }
+}
+
+bool handle_metrics(const HttpRequest& request, HttpResponse& response) {
+    if (request.target != "/metrics") {
+        return false;
+    }
+    HugePageAllocator::instance().publish_metrics(global_metrics());
+    response.headers.emplace_back("Content-Type", "text/plain; version=0.0.4");
+    response.body = global_metrics().render_prometheus();
+    return true;
+}
+
+}  // namespace probionis
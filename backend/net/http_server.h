@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/http.h"
+#include "replay/capture_log.h"
+
+namespace probionis {
+
+using HttpHandler = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+struct HttpServerOptions {
+    std::string host = "0.0.0.0";
+    // 0 binds an ephemeral port; see HttpServer::port().
+    std::uint16_t port = 8080;
+    // Connections served concurrently; each thread owns one connection at
+    // a time and accepts the next when it closes. 0 takes the connection
+    // share of the shared executor's thread budget
+    // (ExecutorOptions::connection_threads), at least one, so the server
+    // and the executor together stay within it.
+    std::size_t connection_threads = 0;
+    // Idle keep-alive connections are closed after this long.
+    int idle_timeout_ms = 5000;
+    std::size_t max_body_bytes = 64u << 20;
+    // When set, every request the handler answers is recorded with its
+    // arrival time, status and a hash of the body sent, for replay.
+    std::shared_ptr<CaptureWriter> capture;
+};
+
+// Minimal blocking HTTP/1.1 server: Content-Length framed requests,
+// keep-alive, chunked responses for handlers that stream, one handler for
+// every route. Enough for internal hops (router to node, health checks)
+// without pulling in a framework.
+class HttpServer {
+public:
+    HttpServer(const HttpServerOptions& options, HttpHandler handler);
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Binds and starts the connection threads; throws std::runtime_error
+    // if the address cannot be bound.
+    void start();
+    void stop();
+
+    std::uint16_t port() const { return port_; }
+
+private:
+    void run_connections();
+    void serve(int fd);
+
+    HttpServerOptions options_;
+    HttpHandler handler_;
+    int listen_fd_ = -1;
+    std::uint16_t port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::vector<std::thread> threads_;
+};
+
+// Answers GET /metrics with every metric in global_metrics(), the
+// huge-page allocator's gauges refreshed first, in Prometheus text format.
+// False for any other target, so a tool's handler can try it before its
+// own routes.
+bool handle_metrics(const HttpRequest& request, HttpResponse& response);
+
+}  // namespace probionis
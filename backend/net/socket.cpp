@@ -0,0 +1,171 @@
+#include "net/socket.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+bool connect_with_timeout(int fd, const sockaddr* addr, socklen_t len, int timeout_ms) {
+    if (timeout_ms <= 0) {
+        return ::connect(fd, addr, len) == 0;
+    }
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    bool ok = ::connect(fd, addr, len) == 0;
+    if (!ok && errno == EINPROGRESS) {
+        pollfd pfd{fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        ok = ::poll(&pfd, 1, timeout_ms) == 1 &&
+             ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0;
+    }
+    ::fcntl(fd, F_SETFL, flags);
+    if (ok) {
+        timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    return ok;
+}
+
+}  // namespace
+
+int tcp_connect(const std::string& host, std::uint16_t port, int timeout_ms) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    const std::string service = std::to_string(port);
+    if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect_with_timeout(fd, ai->ai_addr, ai->ai_addrlen, timeout_ms)) {
+            const int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(result);
+    return fd;
+}
+
+int tcp_listen(const std::string& host, std::uint16_t port, std::uint16_t* bound_port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    const std::string service = std::to_string(port);
+    if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+        throw std::runtime_error("cannot resolve " + host);
+    }
+    int fd = -1;
+    for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        const int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 512) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(result);
+    if (fd < 0) {
+        throw std::runtime_error("cannot bind " + host + ":" + service + ": " +
+                                 std::strerror(errno));
+    }
+    if (bound_port) {
+        sockaddr_storage bound{};
+        socklen_t bound_len = sizeof(bound);
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &bound_len);
+        *bound_port = ntohs(bound.ss_family == AF_INET6
+                                ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+    }
+    return fd;
+}
+
+void set_receive_timeout(int fd, int timeout_ms) {
+    timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+bool send_all(int fd, const char* data, std::size_t size) {
+    std::size_t sent = 0;
+    while (sent < size) {
+        const ssize_t n = ::send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+LineSocket::~LineSocket() {
+    close();
+}
+
+LineSocket::LineSocket(LineSocket&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), buffer_(std::move(other.buffer_)) {}
+
+LineSocket& LineSocket::operator=(LineSocket&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = std::exchange(other.fd_, -1);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+bool LineSocket::read_line(std::string& line) {
+    std::size_t eol;
+    while ((eol = buffer_.find('\n')) == std::string::npos) {
+        char chunk[16384];
+        const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        buffer_.append(chunk, static_cast<std::size_t>(n));
+    }
+    line.assign(buffer_, 0, eol > 0 && buffer_[eol - 1] == '\r' ? eol - 1 : eol);
+    buffer_.erase(0, eol + 1);
+    return true;
+}
+
+void LineSocket::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    buffer_.clear();
+}
+
+}  // namespace probionis
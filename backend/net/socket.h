@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace probionis {
+
+// Connects a TCP socket (TCP_NODELAY, close-on-exec). With a nonzero
+// timeout, connecting and every later send/receive give up after that many
+// milliseconds. Returns -1 on failure.
+int tcp_connect(const std::string& host, std::uint16_t port, int timeout_ms);
+
+// Binds and listens; port 0 picks an ephemeral port, reported through
+// `bound_port`. Throws std::runtime_error on failure.
+int tcp_listen(const std::string& host, std::uint16_t port, std::uint16_t* bound_port);
+
+// Sets SO_RCVTIMEO so blocking reads return periodically.
+void set_receive_timeout(int fd, int timeout_ms);
+
+bool send_all(int fd, const char* data, std::size_t size);
+
+// Buffered line-oriented I/O over a connected socket, for the plain-text
+// control protocols between backend processes. Owns the descriptor.
+class LineSocket {
+public:
+    explicit LineSocket(int fd = -1) : fd_(fd) {}
+    ~LineSocket();
+
+    LineSocket(LineSocket&& other) noexcept;
+    LineSocket& operator=(LineSocket&& other) noexcept;
+    LineSocket(const LineSocket&) = delete;
+    LineSocket& operator=(const LineSocket&) = delete;
+
+    // Reads up to and excluding the next '\n' (a trailing '\r' is dropped).
+    // False on close, error or timeout.
+    bool read_line(std::string& line);
+    bool write(const std::string& data) { return send_all(fd_, data.data(), data.size()); }
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+    std::string buffer_;
+};
+
+}  // namespace probionis
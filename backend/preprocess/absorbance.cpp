@@ -0,0 +1,44 @@
+#include "preprocess/absorbance.h"
+
+#include <stdexcept>
+
+#include "runtime/vector_math.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr float kMinusInvLn10 = -0.434294481903251828f;
+
+}  // namespace
+
+AbsorbanceStep::AbsorbanceStep(float floor) : floor_(floor) {
+    if (!(floor > 0.0f)) {
+        throw std::invalid_argument("AbsorbanceStep: floor must be positive");
+    }
+}
+
+void AbsorbanceStep::transform(float* values, std::size_t n) const {
+    // Three passes over a row that stays in L1; the clamp and scale loops
+    // vectorize on their own and vlog() carries the transcendental work.
+    for (std::size_t i = 0; i < n; ++i) {
+        values[i] = values[i] > floor_ ? values[i] : floor_;
+    }
+    vlog(values, values, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        values[i] *= kMinusInvLn10;
+    }
+}
+
+void AbsorbanceStep::apply(Spectrum& spectrum) const {
+    transform(spectrum.intensity.data(), spectrum.intensity.size());
+}
+
+void AbsorbanceStep::apply_batch(SpectrumBatch& batch) const {
+    // Only the valid channels: log of the zero padding would be -inf.
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        transform(batch.row(i), batch.channels());
+    }
+}
+
+}  // namespace probionis
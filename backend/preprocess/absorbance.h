@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+#include "preprocess/pipeline.h"
+
+namespace probionis {
+
+// Converts reflectance or transmittance to absorbance, A = -log10(R).
+// Readings at or below `floor` (dark pixels, detector zeros) are clamped
+// to it so the output stays finite.
+class AbsorbanceStep : public PreprocessStep {
+public:
+    explicit AbsorbanceStep(float floor = 1e-6f);
+
+    const char* name() const override { return "absorbance"; }
+    void apply(Spectrum& spectrum) const override;
+    void apply_batch(SpectrumBatch& batch) const override;
+
+private:
+    void transform(float* values, std::size_t n) const;
+
+    float floor_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,546 @@
+// The browser build must reproduce the server's output bit-for-bit, so
+// products and sums are never fused into FMAs, whatever the target.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "preprocess/calibration_transfer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "runtime/hash.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace probionis {
+
+namespace {
+
+constexpr char kCalibrationMagic[4] = {'P', 'B', 'C', 'T'};
+constexpr std::uint32_t kCalibrationVersion = 1;
+// Bounds a header is checked against before allocating, for streams that
+// cannot report their size.
+constexpr std::uint32_t kMaxCalibrationChannels = 1u << 20;
+constexpr std::uint32_t kMaxHalfBandwidth = 4096;
+
+// Scalar evaluation of a single output row with bounds checks; used for the
+// rows whose window runs off either end of the spectrum and for the tail.
+inline float apply_row(const BandedOperator& op, const float* in,
+                       std::size_t row) {
+    const std::size_t n = op.channels();
+    const std::size_t w = op.half_bandwidth();
+    float acc = op.offset()[row];
+    for (std::size_t k = 0; k < op.diagonal_count(); ++k) {
+        const std::ptrdiff_t col = static_cast<std::ptrdiff_t>(row + k) -
+                                   static_cast<std::ptrdiff_t>(w);
+        if (col < 0 || col >= static_cast<std::ptrdiff_t>(n)) {
+            continue;
+        }
+        acc += op.coefficient(row, k) * in[col];
+    }
+    return acc;
+}
+
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+void read_pod(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+// Bytes left in `in`, or UINT64_MAX if it cannot seek. Counts read from a
+// file are checked against this before anything is sized from them.
+std::uint64_t remaining_bytes(std::istream& in) {
+    const std::istream::pos_type here = in.tellg();
+    if (here == std::istream::pos_type(-1) || !in.seekg(0, std::ios::end)) {
+        in.clear();
+        return UINT64_MAX;
+    }
+    const std::istream::pos_type end = in.tellg();
+    in.seekg(here);
+    return static_cast<std::uint64_t>(end - here);
+}
+
+void write_floats(std::ofstream& out, const std::vector<float>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()),
+              static_cast<std::streamsize>(values.size() * sizeof(float)));
+}
+
+void read_floats(std::istream& in, std::vector<float>& values,
+                 std::size_t count) {
+    values.resize(count);
+    in.read(reinterpret_cast<char*>(values.data()),
+            static_cast<std::streamsize>(count * sizeof(float)));
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+BandedOperator::BandedOperator(std::size_t channels, std::size_t half_bandwidth)
+    : channels_(channels),
+      half_bandwidth_(half_bandwidth),
+      diagonals_((2 * half_bandwidth + 1) * channels, 0.0f),
+      offset_(channels, 0.0f) {}
+
+BandedOperator BandedOperator::from_row_windows(std::size_t channels,
+                                                std::size_t half_bandwidth,
+                                                const std::vector<float>& rows,
+                                                std::vector<float> offset) {
+    BandedOperator op(channels, half_bandwidth);
+    const std::size_t width = op.diagonal_count();
+    if (rows.size() != channels * width) {
+        throw std::invalid_argument(
+            "BandedOperator::from_row_windows: coefficient count mismatch");
+    }
+    if (!offset.empty() && offset.size() != channels) {
+        throw std::invalid_argument(
+            "BandedOperator::from_row_windows: offset length mismatch");
+    }
+    for (std::size_t i = 0; i < channels; ++i) {
+        for (std::size_t k = 0; k < width; ++k) {
+            const std::ptrdiff_t col = static_cast<std::ptrdiff_t>(i + k) -
+                                       static_cast<std::ptrdiff_t>(half_bandwidth);
+            if (col < 0 || col >= static_cast<std::ptrdiff_t>(channels)) {
+                continue;
+            }
+            op.coefficient(i, k) = rows[i * width + k];
+        }
+    }
+    if (!offset.empty()) {
+        op.offset_ = std::move(offset);
+    }
+    return op;
+}
+
+BandedOperator BandedOperator::wavelength_intensity_correction(
+    const std::vector<float>& source_axis, const std::vector<float>& target_axis,
+    std::size_t half_bandwidth, const std::vector<float>& gain,
+    const std::vector<float>& offset) {
+    const std::size_t n = source_axis.size();
+    if (n < 2 || target_axis.size() != n) {
+        throw std::invalid_argument(
+            "wavelength_intensity_correction: axes must have equal length >= 2");
+    }
+    if ((!gain.empty() && gain.size() != n) ||
+        (!offset.empty() && offset.size() != n)) {
+        throw std::invalid_argument(
+            "wavelength_intensity_correction: gain/offset length mismatch");
+    }
+    BandedOperator op(n, std::max<std::size_t>(half_bandwidth, 1));
+    const std::ptrdiff_t w = static_cast<std::ptrdiff_t>(op.half_bandwidth());
+
+    for (std::size_t i = 0; i < n; ++i) {
+        const float t = target_axis[i];
+        // Index of the left neighbour of t on the source axis, clamped so
+        // that targets outside the measured range extrapolate linearly.
+        auto it = std::upper_bound(source_axis.begin(), source_axis.end(), t);
+        std::ptrdiff_t j = (it - source_axis.begin()) - 1;
+        j = std::clamp<std::ptrdiff_t>(j, 0, static_cast<std::ptrdiff_t>(n) - 2);
+
+        const float x0 = source_axis[j];
+        const float x1 = source_axis[j + 1];
+        const float frac = x1 != x0 ? (t - x0) / (x1 - x0) : 0.0f;
+        const std::ptrdiff_t row = static_cast<std::ptrdiff_t>(i);
+        if (j - row < -w || j + 1 - row > w) {
+            throw std::invalid_argument(
+                "wavelength_intensity_correction: axis shift exceeds bandwidth");
+        }
+        const float g = gain.empty() ? 1.0f : gain[i];
+        op.coefficient(i, static_cast<std::size_t>(j - row + w)) += g * (1.0f - frac);
+        op.coefficient(i, static_cast<std::size_t>(j + 1 - row + w)) += g * frac;
+    }
+    if (!offset.empty()) {
+        op.offset_ = offset;
+    }
+    op.target_axis_ = target_axis;
+    return op;
+}
+
+BandedOperator BandedOperator::compose(const BandedOperator& first,
+                                       const BandedOperator& second) {
+    if (first.channels() != second.channels()) {
+        throw std::invalid_argument("BandedOperator::compose: channel mismatch");
+    }
+    const std::size_t n = first.channels();
+    const std::ptrdiff_t wf = static_cast<std::ptrdiff_t>(first.half_bandwidth());
+    const std::ptrdiff_t ws = static_cast<std::ptrdiff_t>(second.half_bandwidth());
+    BandedOperator op(n, first.half_bandwidth() + second.half_bandwidth());
+    const std::ptrdiff_t wc = wf + ws;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        float off = second.offset_[i];
+        for (std::ptrdiff_t ks = 0; ks <= 2 * ws; ++ks) {
+            const std::ptrdiff_t m = static_cast<std::ptrdiff_t>(i) + ks - ws;
+            if (m < 0 || m >= static_cast<std::ptrdiff_t>(n)) {
+                continue;
+            }
+            const float s = second.coefficient(i, static_cast<std::size_t>(ks));
+            if (s == 0.0f) {
+                continue;
+            }
+            off += s * first.offset_[m];
+            for (std::ptrdiff_t kf = 0; kf <= 2 * wf; ++kf) {
+                const std::ptrdiff_t j = m + kf - wf;
+                if (j < 0 || j >= static_cast<std::ptrdiff_t>(n)) {
+                    continue;
+                }
+                const std::ptrdiff_t kc = j - static_cast<std::ptrdiff_t>(i) + wc;
+                op.coefficient(i, static_cast<std::size_t>(kc)) +=
+                    s * first.coefficient(static_cast<std::size_t>(m),
+                                          static_cast<std::size_t>(kf));
+            }
+        }
+        op.offset_[i] = off;
+    }
+    op.target_axis_ = !second.target_axis_.empty() ? second.target_axis_
+                                                   : first.target_axis_;
+    return op;
+}
+
+void BandedOperator::set_target_axis(std::vector<float> axis) {
+    if (!axis.empty() && axis.size() != channels_) {
+        throw std::invalid_argument("BandedOperator: target axis length mismatch");
+    }
+    target_axis_ = std::move(axis);
+}
+
+std::uint64_t BandedOperator::fingerprint() const {
+    const std::uint64_t shape[2] = {channels_, half_bandwidth_};
+    std::uint64_t hash = fnv1a64(shape, sizeof(shape));
+    for (const std::vector<float>* part : {&diagonals_, &offset_, &target_axis_}) {
+        const std::uint64_t size = part->size();
+        hash = fnv1a64(&size, sizeof(size), hash);
+        hash = fnv1a64(part->data(), part->size() * sizeof(float), hash);
+    }
+    return hash;
+}
+
+void BandedOperator::apply(const float* in, float* out) const {
+    const std::size_t n = channels_;
+    const std::size_t w = half_bandwidth_;
+    const std::size_t width = diagonal_count();
+    if (n == 0) {
+        return;
+    }
+    if (n <= 2 * w) {
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = apply_row(*this, in, i);
+        }
+        return;
+    }
+
+    // Rows [w, n - w) see a full window, so every diagonal can be streamed
+    // without bounds checks. Products are accumulated with separate multiply
+    // and add (no FMA) so the vector and scalar paths round identically.
+    const std::size_t begin = w;
+    const std::size_t end = n - w;
+    const float* diag = diagonals_.data();
+    const float* off = offset_.data();
+    std::size_t i = begin;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= end; i += 16) {
+        __m512 acc = _mm512_loadu_ps(off + i);
+        for (std::size_t k = 0; k < width; ++k) {
+            const __m512 c = _mm512_loadu_ps(diag + k * n + i);
+            const __m512 x = _mm512_loadu_ps(in + i + k - w);
+            acc = _mm512_add_ps(acc, _mm512_mul_ps(c, x));
+        }
+        _mm512_storeu_ps(out + i, acc);
+    }
+#endif
+#if defined(__AVX2__)
+    for (; i + 8 <= end; i += 8) {
+        __m256 acc = _mm256_loadu_ps(off + i);
+        for (std::size_t k = 0; k < width; ++k) {
+            const __m256 c = _mm256_loadu_ps(diag + k * n + i);
+            const __m256 x = _mm256_loadu_ps(in + i + k - w);
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(c, x));
+        }
+        _mm256_storeu_ps(out + i, acc);
+    }
+#endif
+#if defined(__wasm_simd128__)
+    for (; i + 4 <= end; i += 4) {
+        v128_t acc = wasm_v128_load(off + i);
+        for (std::size_t k = 0; k < width; ++k) {
+            const v128_t c = wasm_v128_load(diag + k * n + i);
+            const v128_t x = wasm_v128_load(in + i + k - w);
+            acc = wasm_f32x4_add(acc, wasm_f32x4_mul(c, x));
+        }
+        wasm_v128_store(out + i, acc);
+    }
+#endif
+    for (; i < end; ++i) {
+        float acc = off[i];
+        for (std::size_t k = 0; k < width; ++k) {
+            acc += diag[k * n + i] * in[i + k - w];
+        }
+        out[i] = acc;
+    }
+
+    for (std::size_t r = 0; r < begin; ++r) {
+        out[r] = apply_row(*this, in, r);
+    }
+    for (std::size_t r = end; r < n; ++r) {
+        out[r] = apply_row(*this, in, r);
+    }
+}
+
+void save_calibration(const std::string& path, const std::string& instrument_id,
+                      const BandedOperator& op) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("save_calibration: cannot open " + path);
+    }
+    out.write(kCalibrationMagic, sizeof(kCalibrationMagic));
+    write_pod(out, kCalibrationVersion);
+    write_pod(out, static_cast<std::uint32_t>(instrument_id.size()));
+    out.write(instrument_id.data(), static_cast<std::streamsize>(instrument_id.size()));
+    write_pod(out, static_cast<std::uint32_t>(op.channels()));
+    write_pod(out, static_cast<std::uint32_t>(op.half_bandwidth()));
+    write_pod(out, static_cast<std::uint8_t>(op.target_axis().empty() ? 0 : 1));
+
+    std::vector<float> diagonals(op.diagonal_count() * op.channels());
+    for (std::size_t k = 0; k < op.diagonal_count(); ++k) {
+        for (std::size_t i = 0; i < op.channels(); ++i) {
+            diagonals[k * op.channels() + i] = op.coefficient(i, k);
+        }
+    }
+    write_floats(out, diagonals);
+    write_floats(out, op.offset());
+    write_floats(out, op.target_axis());
+    if (!out) {
+        throw std::runtime_error("save_calibration: write failed for " + path);
+    }
+}
+
+BandedOperator load_calibration(const std::string& path,
+                                std::string* instrument_id) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("load_calibration: cannot open " + path);
+    }
+    return read_calibration(in, path, instrument_id);
+}
+
+BandedOperator read_calibration(std::istream& in, const std::string& source,
+                                std::string* instrument_id) {
+    char magic[4] = {};
+    std::uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    read_pod(in, version);
+    if (!in || std::memcmp(magic, kCalibrationMagic, sizeof(magic)) != 0 ||
+        version != kCalibrationVersion) {
+        throw std::runtime_error("load_calibration: bad header in " + source);
+    }
+
+    std::uint32_t id_length = 0;
+    read_pod(in, id_length);
+    if (!in || id_length > 4096 || id_length > remaining_bytes(in)) {
+        throw std::runtime_error("load_calibration: bad instrument id in " + source);
+    }
+    std::string id(id_length, '\0');
+    in.read(&id[0], id_length);
+
+    std::uint32_t channels = 0;
+    std::uint32_t half_bandwidth = 0;
+    std::uint8_t has_axis = 0;
+    read_pod(in, channels);
+    read_pod(in, half_bandwidth);
+    read_pod(in, has_axis);
+    if (!in || half_bandwidth >= channels || channels > kMaxCalibrationChannels ||
+        half_bandwidth > kMaxHalfBandwidth) {
+        throw std::runtime_error("load_calibration: bad dimensions in " + source);
+    }
+    // Diagonals, offsets and the optional axis, all float32.
+    const std::uint64_t floats = (2ull * half_bandwidth + 2 + (has_axis ? 1 : 0)) * channels;
+    if (floats * sizeof(float) > remaining_bytes(in)) {
+        throw std::runtime_error("load_calibration: truncated file " + source);
+    }
+
+    BandedOperator op(channels, half_bandwidth);
+    std::vector<float> diagonals;
+    std::vector<float> offset;
+    std::vector<float> axis;
+    read_floats(in, diagonals, op.diagonal_count() * channels);
+    read_floats(in, offset, channels);
+    if (has_axis) {
+        read_floats(in, axis, channels);
+    }
+    if (!in) {
+        throw std::runtime_error("load_calibration: truncated file " + source);
+    }
+
+    std::vector<float> rows(op.diagonal_count() * channels);
+    for (std::size_t k = 0; k < op.diagonal_count(); ++k) {
+        for (std::size_t i = 0; i < channels; ++i) {
+            rows[i * op.diagonal_count() + k] = diagonals[k * channels + i];
+        }
+    }
+    op = BandedOperator::from_row_windows(channels, half_bandwidth, rows,
+                                          std::move(offset));
+    op.set_target_axis(std::move(axis));
+    if (instrument_id) {
+        *instrument_id = std::move(id);
+    }
+    return op;
+}
+
+void CalibrationRegistry::put(const std::string& instrument_id,
+                              std::shared_ptr<const BandedOperator> op) {
+    Entry entry;
+    entry.fingerprint = op ? op->fingerprint() : 0;
+    entry.op = std::move(op);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    operators_[instrument_id] = std::move(entry);
+}
+
+bool CalibrationRegistry::remove(const std::string& instrument_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return operators_.erase(instrument_id) > 0;
+}
+
+std::shared_ptr<const BandedOperator> CalibrationRegistry::find(
+    const std::string& instrument_id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = operators_.find(instrument_id);
+    return it == operators_.end() ? nullptr : it->second.op;
+}
+
+std::uint64_t CalibrationRegistry::fingerprint(const std::string& instrument_id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = operators_.find(instrument_id);
+    return it == operators_.end() ? 0 : it->second.fingerprint;
+}
+
+std::size_t CalibrationRegistry::load_directory(const std::string& directory) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        throw std::runtime_error("CalibrationRegistry: cannot open " + directory);
+    }
+    std::size_t loaded = 0;
+    while (dirent* entry = readdir(dir)) {
+        const std::string file = entry->d_name;
+        if (!ends_with(file, ".pbcal")) {
+            continue;
+        }
+        std::string id;
+        try {
+            auto op = std::make_shared<BandedOperator>(
+                load_calibration(directory + "/" + file, &id));
+            put(id, std::move(op));
+        } catch (...) {
+            closedir(dir);
+            throw;
+        }
+        ++loaded;
+    }
+    closedir(dir);
+    return loaded;
+}
+
+std::size_t CalibrationRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return operators_.size();
+}
+
+CalibrationTransferStep::CalibrationTransferStep(
+    std::shared_ptr<const CalibrationRegistry> registry, bool require_calibration)
+    : registry_(std::move(registry)), require_calibration_(require_calibration) {
+    if (!registry_) {
+        throw std::invalid_argument("CalibrationTransferStep: null registry");
+    }
+}
+
+std::uint64_t CalibrationTransferStep::state_fingerprint(const Spectrum& spectrum) const {
+    return registry_->fingerprint(spectrum.instrument_id);
+}
+
+std::shared_ptr<const BandedOperator> CalibrationTransferStep::operator_for(
+    const std::string& instrument_id, std::size_t channels) const {
+    auto op = registry_->find(instrument_id);
+    if (!op) {
+        if (require_calibration_) {
+            throw std::runtime_error("no calibration for instrument '" + instrument_id + "'");
+        }
+        return op;
+    }
+    if (op->channels() != channels) {
+        throw std::runtime_error("calibration for instrument '" + instrument_id +
+                                 "' expects a different channel count");
+    }
+    return op;
+}
+
+void CalibrationTransferStep::apply(Spectrum& spectrum) const {
+    auto op = operator_for(spectrum.instrument_id, spectrum.size());
+    if (!op) {
+        return;
+    }
+
+    // The operator reads neighbouring channels, so it cannot run in place;
+    // a per-thread scratch buffer avoids an allocation per sample.
+    thread_local std::vector<float> scratch;
+    scratch.assign(spectrum.intensity.begin(), spectrum.intensity.end());
+    op->apply(scratch.data(), spectrum.intensity.data());
+    if (!op->target_axis().empty()) {
+        spectrum.axis = op->target_axis();
+    }
+}
+
+void CalibrationTransferStep::apply_batch(SpectrumBatch& batch) const {
+    const std::size_t channels = batch.channels();
+    // Every operator is looked up and the output axis agreed on before any
+    // row changes, so a rejected batch is left as it came in.
+    std::vector<std::shared_ptr<const BandedOperator>> ops(batch.size());
+    const std::vector<float>* axis = nullptr;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        ops[i] = operator_for(batch.instrument_id(i), channels);
+        const std::vector<float>& row_axis =
+            ops[i] && !ops[i]->target_axis().empty() ? ops[i]->target_axis() : batch.axis();
+        if (!axis) {
+            axis = &row_axis;
+        } else if (axis != &row_axis && *axis != row_axis) {
+            throw std::runtime_error("calibration for instrument '" + batch.instrument_id(i) +
+                                     "' maps onto a different axis than the rest of the batch");
+        }
+    }
+
+    thread_local std::vector<float> scratch;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (!ops[i]) {
+            continue;
+        }
+        float* row = batch.row(i);
+        scratch.assign(row, row + channels);
+        ops[i]->apply(scratch.data(), row);
+    }
+    if (axis && axis != &batch.axis()) {
+        batch.set_axis(*axis);
+    }
+}
+
+}  // namespace probionis
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "preprocess/pipeline.h"
+
+namespace probionis {
+
+// Linear map y = B x + offset where B only has non-zeros within
+// `half_bandwidth` of the main diagonal. This covers piecewise direct
+// standardization (each target channel regressed on a window of source
+// channels), wavelength-axis correction by interpolation and per-channel
+// intensity gain, so one instrument needs exactly one operator.
+//
+// Coefficients are kept in diagonal (DIA) order: diagonal k holds
+// B[i][i + k - half_bandwidth] for every row i, which lets the apply kernel
+// stream all diagonals for a block of output channels in a single pass.
+class BandedOperator {
+public:
+    BandedOperator() = default;
+    BandedOperator(std::size_t channels, std::size_t half_bandwidth);
+
+    // `rows` is channels x (2 * half_bandwidth + 1), row-major, where entry
+    // (i, k) multiplies source channel i + k - half_bandwidth. Entries that
+    // fall outside the spectrum are ignored.
+    static BandedOperator from_row_windows(std::size_t channels,
+                                           std::size_t half_bandwidth,
+                                           const std::vector<float>& rows,
+                                           std::vector<float> offset);
+
+    // Resamples a spectrum measured on `source_axis` onto `target_axis` by
+    // linear interpolation, then applies per-channel `gain` and `offset`
+    // (either may be empty for identity). Throws if the axes drift further
+    // apart than `half_bandwidth` channels.
+    static BandedOperator wavelength_intensity_correction(
+        const std::vector<float>& source_axis,
+        const std::vector<float>& target_axis, std::size_t half_bandwidth,
+        const std::vector<float>& gain, const std::vector<float>& offset);
+
+    // Operator equivalent to applying `first` and then `second`.
+    static BandedOperator compose(const BandedOperator& first,
+                                  const BandedOperator& second);
+
+    std::size_t channels() const { return channels_; }
+    std::size_t half_bandwidth() const { return half_bandwidth_; }
+    std::size_t diagonal_count() const { return 2 * half_bandwidth_ + 1; }
+
+    float coefficient(std::size_t row, std::size_t diagonal) const {
+        return diagonals_[diagonal * channels_ + row];
+    }
+    float& coefficient(std::size_t row, std::size_t diagonal) {
+        return diagonals_[diagonal * channels_ + row];
+    }
+    const std::vector<float>& offset() const { return offset_; }
+
+    // Axis the output lives on; empty if the operator keeps the input axis.
+    const std::vector<float>& target_axis() const { return target_axis_; }
+    void set_target_axis(std::vector<float> axis);
+
+    // `in` and `out` hold channels() floats each and must not overlap.
+    void apply(const float* in, float* out) const;
+
+    // Hash of every coefficient, offset and the target axis; equal
+    // fingerprints mean the same transform in any process.
+    std::uint64_t fingerprint() const;
+
+private:
+    std::size_t channels_ = 0;
+    std::size_t half_bandwidth_ = 0;
+    std::vector<float> diagonals_;
+    std::vector<float> offset_;
+    std::vector<float> target_axis_;
+};
+
+// Binary on-disk form, one operator per file.
+void save_calibration(const std::string& path, const std::string& instrument_id,
+                      const BandedOperator& op);
+BandedOperator load_calibration(const std::string& path,
+                                std::string* instrument_id);
+// The same format from a stream, e.g. the bytes of a .pbcal file fetched
+// by the browser build; `source` names it in error messages.
+BandedOperator read_calibration(std::istream& in, const std::string& source,
+                                std::string* instrument_id);
+
+// Instrument ID -> calibration operator. Lookups take a shared lock and hand
+// out a reference-counted operator, so an operator can be replaced while
+// requests are still using the previous one.
+class CalibrationRegistry {
+public:
+    void put(const std::string& instrument_id,
+             std::shared_ptr<const BandedOperator> op);
+    bool remove(const std::string& instrument_id);
+
+    std::shared_ptr<const BandedOperator> find(
+        const std::string& instrument_id) const;
+    // BandedOperator::fingerprint of the registered operator, computed once
+    // by put(); 0 when the instrument has none.
+    std::uint64_t fingerprint(const std::string& instrument_id) const;
+
+    // Loads every *.pbcal file in `directory`; returns the number loaded.
+    std::size_t load_directory(const std::string& directory);
+
+    std::size_t size() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<const BandedOperator> op;
+        std::uint64_t fingerprint = 0;
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, Entry> operators_;
+};
+
+// Pipeline step mapping each spectrum onto the reference instrument using
+// the operator registered for its instrument ID.
+//
+// A batch keeps one axis, so apply_batch() throws, leaving the batch
+// untouched, when its rows would end up on different axes: operators with
+// different target axes, or a remapped row next to one that keeps the batch
+// axis. Deployments calibrate every instrument onto the same reference axis.
+class CalibrationTransferStep : public PreprocessStep {
+public:
+    // With `require_calibration` set, spectra from unknown instruments are
+    // rejected instead of passed through unchanged.
+    explicit CalibrationTransferStep(
+        std::shared_ptr<const CalibrationRegistry> registry,
+        bool require_calibration = false);
+
+    const char* name() const override { return "calibration_transfer"; }
+    void apply(Spectrum& spectrum) const override;
+    void apply_batch(SpectrumBatch& batch) const override;
+    std::uint64_t state_fingerprint(const Spectrum& spectrum) const override;
+
+private:
+    // Null when the instrument has none and calibration is optional.
+    std::shared_ptr<const BandedOperator> operator_for(const std::string& instrument_id,
+                                                       std::size_t channels) const;
+
+    std::shared_ptr<const CalibrationRegistry> registry_;
+    bool require_calibration_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,88 @@
+#include "preprocess/pipeline.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+void PreprocessStep::apply_batch(SpectrumBatch& batch) const {
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        Spectrum spectrum = batch.extract(i);
+        apply(spectrum);
+        if (spectrum.size() != batch.channels()) {
+            throw std::runtime_error(std::string(name()) +
+                                     ": step changed the channel count of a batched spectrum");
+        }
+        std::copy(spectrum.intensity.begin(), spectrum.intensity.end(), batch.row(i));
+        if (i + 1 == batch.size()) {
+            batch.set_axis(std::move(spectrum.axis));
+        }
+    }
+}
+
+void Pipeline::add(std::shared_ptr<const PreprocessStep> step) {
+    if (!step) {
+        throw std::invalid_argument("Pipeline::add: null step");
+    }
+    steps_.push_back(std::move(step));
+}
+
+void Pipeline::set_qc_gate(std::shared_ptr<const QcGate> gate) {
+    qc_gate_ = std::move(gate);
+}
+
+QcResult Pipeline::run(Spectrum& spectrum) const {
+    QcResult result;
+    if (qc_gate_) {
+        result = qc_gate_->screen(spectrum);
+        if (!result.ok()) {
+            return result;
+        }
+    }
+    for (const auto& step : steps_) {
+        step->apply(spectrum);
+    }
+    return result;
+}
+
+QcResult Pipeline::screen(const float* intensity, std::size_t count) const {
+    return qc_gate_ ? qc_gate_->screen(intensity, count) : QcResult{};
+}
+
+void Pipeline::run_batch(SpectrumBatch& batch) const {
+    for (const auto& step : steps_) {
+        step->apply_batch(batch);
+    }
+}
+
+std::uint64_t Pipeline::state_fingerprint(const Spectrum& spectrum) const {
+    std::uint64_t hash = fnv1a64(nullptr, 0);
+    for (const auto& step : steps_) {
+        const std::uint64_t state = step->state_fingerprint(spectrum);
+        hash = fnv1a64(&state, sizeof(state), hash);
+    }
+    return hash;
+}
+
+std::size_t Pipeline::row_multiple() const {
+    std::size_t multiple = SpectrumBatch::kRowMultiple;
+    for (const auto& step : steps_) {
+        multiple = std::lcm(multiple, std::max<std::size_t>(1, step->row_multiple()));
+    }
+    return multiple;
+}
+
+std::vector<std::string> Pipeline::step_names() const {
+    std::vector<std::string> names;
+    names.reserve(steps_.size());
+    for (const auto& step : steps_) {
+        names.emplace_back(step->name());
+    }
+    return names;
+}
+
+}  // namespace probionis
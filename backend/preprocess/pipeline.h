@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "preprocess/qc_gate.h"
+#include "spectrum/spectrum.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+// One stage of the preprocessing pipeline. Steps transform the spectrum in
+// place and must be safe to call concurrently on different spectra.
+class PreprocessStep {
+public:
+    virtual ~PreprocessStep() = default;
+
+    virtual const char* name() const = 0;
+    virtual void apply(Spectrum& spectrum) const = 0;
+
+    // Transforms every row of `batch` in place. The default runs apply()
+    // per row through a temporary spectrum; steps with a native batch
+    // kernel override it.
+    virtual void apply_batch(SpectrumBatch& batch) const;
+
+    // Floats per block the batch kernel works in; batches handed to this
+    // step need a stride that is a multiple of it.
+    virtual std::size_t row_multiple() const { return 1; }
+
+    // Identity of state the step looks up per spectrum and that can change
+    // while the pipeline lives, such as the calibration operator registered
+    // for the spectrum's instrument. 0 when there is none.
+    virtual std::uint64_t state_fingerprint(const Spectrum& spectrum) const {
+        (void)spectrum;
+        return 0;
+    }
+};
+
+// Ordered list of steps applied to every sample before inference. When a
+// QC gate is installed it screens the raw spectrum first, and rejected
+// samples skip every step.
+class Pipeline {
+public:
+    void add(std::shared_ptr<const PreprocessStep> step);
+    void set_qc_gate(std::shared_ptr<const QcGate> gate);
+
+    // Returns the gate verdict; steps only ran if the result is ok().
+    QcResult run(Spectrum& spectrum) const;
+
+    // The gate's verdict alone, ok() when no gate is installed. Batched
+    // rows are screened with this one by one before they join a batch.
+    QcResult screen(const float* intensity, std::size_t count) const;
+
+    // Runs every step over a batch of spectra that already passed QC.
+    void run_batch(SpectrumBatch& batch) const;
+
+    // Combined PreprocessStep::state_fingerprint of every step: together
+    // with the raw spectrum and the recipe it determines the output.
+    std::uint64_t state_fingerprint(const Spectrum& spectrum) const;
+
+    std::size_t size() const { return steps_.size(); }
+    // Row multiple satisfying every step, for sizing SpectrumBatch.
+    std::size_t row_multiple() const;
+    std::vector<std::string> step_names() const;
+
+private:
+    std::vector<std::shared_ptr<const PreprocessStep>> steps_;
+    std::shared_ptr<const QcGate> qc_gate_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,89 @@
+/*
+ * Stable C ABI for site-specific preprocessing plugins.
+ *
+ * A plugin is a shared object exporting
+ *
+ *     const probionis_plugin* probionis_plugin_entry(void);
+ *
+ * The returned descriptor must stay valid until the library is unloaded.
+ * The backend calls `process` with whole batches laid out as one padded
+ * row-major matrix and expects the plugin to transform it in place; there
+ * are no per-sample calls and no copies on either side.
+ *
+ * Compatibility rules: fields are only ever appended to these structs,
+ * `struct_size` tells each side how much the other knows about, and
+ * PROBIONIS_PLUGIN_ABI_VERSION changes only for incompatible revisions.
+ * This header is plain C99 so plugins can be built with any toolchain.
+ */
+#ifndef PROBIONIS_PREPROCESS_PLUGIN_ABI_H
+#define PROBIONIS_PREPROCESS_PLUGIN_ABI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROBIONIS_PLUGIN_ABI_VERSION 1u
+#define PROBIONIS_PLUGIN_ENTRY_SYMBOL "probionis_plugin_entry"
+
+/* Status codes returned by `process` and `create`. */
+#define PROBIONIS_PLUGIN_OK 0
+#define PROBIONIS_PLUGIN_ERROR 1
+
+typedef struct probionis_batch {
+    uint32_t struct_size;
+    /* Spectra in the batch. */
+    uint32_t count;
+    /* Valid channels per spectrum. */
+    uint32_t channels;
+    /* Floats between consecutive spectra: >= channels, a multiple of the
+     * plugin's channel_multiple. Floats past `channels` are zero padding
+     * the plugin may read and overwrite; the host zeroes them again once
+     * `process` returns. */
+    uint32_t stride;
+    /* count * stride floats; row i starts at intensity + i * stride and is
+     * aligned to at least the plugin's requested alignment. */
+    float* intensity;
+    /* `channels` axis positions shared by every row. */
+    const float* axis;
+    /* `count` NUL-terminated instrument IDs, parallel to the rows. */
+    const char* const* instrument_ids;
+} probionis_batch;
+
+typedef struct probionis_plugin_requirements {
+    /* Required byte alignment of every row (power of two, <= 64). */
+    uint32_t alignment;
+    /* Accepted channel counts; 0 means no bound. */
+    uint32_t min_channels;
+    uint32_t max_channels;
+    /* The plugin processes rows in blocks of this many floats and may touch
+     * padding up to the next multiple; 0 or 1 means no blocking. */
+    uint32_t channel_multiple;
+} probionis_plugin_requirements;
+
+typedef struct probionis_plugin {
+    uint32_t abi_version;
+    uint32_t struct_size;
+    const char* name;
+    const char* version;
+    probionis_plugin_requirements requirements;
+
+    /* Builds per-instance state from a configuration string (may be empty).
+     * On failure returns NULL and writes a message into `error`. */
+    void* (*create)(const char* config, char* error, size_t error_size);
+    void (*destroy)(void* state);
+
+    /* Transforms the batch in place. Must be safe to call concurrently on
+     * different batches with the same state. */
+    int (*process)(void* state, probionis_batch* batch, char* error, size_t error_size);
+} probionis_plugin;
+
+typedef const probionis_plugin* (*probionis_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROBIONIS_PREPROCESS_PLUGIN_ABI_H */
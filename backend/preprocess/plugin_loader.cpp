@@ -0,0 +1,156 @@
+#include "preprocess/plugin_loader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <dlfcn.h>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace probionis {
+
+namespace {
+
+constexpr std::size_t kErrorBufferSize = 512;
+
+// Smallest descriptor size that still carries every field this build reads.
+constexpr std::uint32_t kMinDescriptorSize =
+    static_cast<std::uint32_t>(offsetof(probionis_plugin, process) + sizeof(void*));
+
+std::string plugin_error(const std::string& plugin, const char* what, const char* detail) {
+    std::string message = "plugin " + plugin + ": " + what;
+    if (detail && detail[0] != '\0') {
+        message += ": ";
+        message += detail;
+    }
+    return message;
+}
+
+}  // namespace
+
+std::shared_ptr<PluginLibrary> PluginLibrary::open(const std::string& path) {
+    // RTLD_LOCAL keeps plugin symbols from resolving against each other.
+    void* handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        throw std::runtime_error(plugin_error(path, "dlopen failed", ::dlerror()));
+    }
+    auto entry = reinterpret_cast<probionis_plugin_entry_fn>(
+        ::dlsym(handle, PROBIONIS_PLUGIN_ENTRY_SYMBOL));
+    const probionis_plugin* descriptor = entry ? entry() : nullptr;
+
+    const char* problem = nullptr;
+    if (!entry) {
+        problem = "missing " PROBIONIS_PLUGIN_ENTRY_SYMBOL;
+    } else if (!descriptor) {
+        problem = "entry point returned no descriptor";
+    } else if (descriptor->abi_version != PROBIONIS_PLUGIN_ABI_VERSION) {
+        problem = "incompatible ABI version";
+    } else if (descriptor->struct_size < kMinDescriptorSize) {
+        problem = "descriptor is truncated";
+    } else if (!descriptor->name || !descriptor->create || !descriptor->destroy ||
+               !descriptor->process) {
+        problem = "descriptor is missing required fields";
+    } else {
+        const std::uint32_t alignment = descriptor->requirements.alignment;
+        if (alignment > SpectrumBatch::kAlignment || (alignment & (alignment - 1)) != 0) {
+            problem = "unsupported row alignment";
+        }
+    }
+    if (problem) {
+        ::dlclose(handle);
+        throw std::runtime_error(plugin_error(path, problem, nullptr));
+    }
+    return std::shared_ptr<PluginLibrary>(new PluginLibrary(path, handle, descriptor));
+}
+
+PluginLibrary::PluginLibrary(std::string path, void* handle, const probionis_plugin* descriptor)
+    : path_(std::move(path)), handle_(handle), descriptor_(descriptor) {}
+
+PluginLibrary::~PluginLibrary() {
+    ::dlclose(handle_);
+}
+
+PluginStep::PluginStep(std::shared_ptr<PluginLibrary> library, const std::string& config)
+    : library_(std::move(library)) {
+    if (!library_) {
+        throw std::invalid_argument("PluginStep: null library");
+    }
+    const probionis_plugin& plugin = library_->descriptor();
+    name_ = plugin.name;
+    char error[kErrorBufferSize] = {};
+    state_ = plugin.create(config.c_str(), error, sizeof(error));
+    // A plugin that fills the buffer need not terminate it.
+    error[sizeof(error) - 1] = '\0';
+    if (!state_) {
+        throw std::runtime_error(plugin_error(name_, "create failed", error));
+    }
+}
+
+PluginStep::~PluginStep() {
+    library_->descriptor().destroy(state_);
+}
+
+std::size_t PluginStep::row_multiple() const {
+    return std::max<std::uint32_t>(1, library_->descriptor().requirements.channel_multiple);
+}
+
+void PluginStep::apply_batch(SpectrumBatch& batch) const {
+    if (batch.size() == 0) {
+        return;
+    }
+    const probionis_plugin& plugin = library_->descriptor();
+    const probionis_plugin_requirements& req = plugin.requirements;
+    if ((req.min_channels != 0 && batch.channels() < req.min_channels) ||
+        (req.max_channels != 0 && batch.channels() > req.max_channels)) {
+        throw std::runtime_error(plugin_error(name_, "channel count out of range", nullptr));
+    }
+    // The ABI promises `channels` axis positions, never a null pointer.
+    if (batch.axis().size() != batch.channels()) {
+        throw std::runtime_error(plugin_error(name_, "batch has no axis", nullptr));
+    }
+    if (batch.stride() % row_multiple() != 0) {
+        throw std::runtime_error(
+            plugin_error(name_, "batch stride is not a multiple of the plugin block", nullptr));
+    }
+    if (batch.stride() > std::numeric_limits<std::uint32_t>::max() ||
+        batch.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error(plugin_error(name_, "batch too large", nullptr));
+    }
+
+    std::vector<const char*> instrument_ids(batch.size());
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        instrument_ids[i] = batch.instrument_id(i).c_str();
+    }
+
+    probionis_batch view{};
+    view.struct_size = sizeof(view);
+    view.count = static_cast<std::uint32_t>(batch.size());
+    view.channels = static_cast<std::uint32_t>(batch.channels());
+    view.stride = static_cast<std::uint32_t>(batch.stride());
+    view.intensity = batch.data();
+    view.axis = batch.axis().data();
+    view.instrument_ids = instrument_ids.data();
+
+    char error[kErrorBufferSize] = {};
+    const int status = plugin.process(state_, &view, error, sizeof(error));
+    error[sizeof(error) - 1] = '\0';
+    // Later steps and the model rely on zero padding, which the ABI lets
+    // the plugin overwrite.
+    batch.zero_padding();
+    if (status != PROBIONIS_PLUGIN_OK) {
+        throw std::runtime_error(plugin_error(name_, "process failed", error));
+    }
+}
+
+void PluginStep::apply(Spectrum& spectrum) const {
+    if (spectrum.empty()) {
+        return;
+    }
+    SpectrumBatch batch(1, spectrum.size(), row_multiple());
+    batch.push(spectrum);
+    apply_batch(batch);
+    std::copy(batch.row(0), batch.row(0) + batch.channels(), spectrum.intensity.begin());
+}
+
+}  // namespace probionis
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "preprocess/pipeline.h"
+#include "preprocess/plugin_abi.h"
+
+namespace probionis {
+
+// A loaded plugin shared object. The library stays mapped for as long as
+// any PluginStep created from it is alive.
+class PluginLibrary {
+public:
+    // Opens `path`, resolves the entry symbol and validates the descriptor;
+    // throws std::runtime_error on any mismatch.
+    static std::shared_ptr<PluginLibrary> open(const std::string& path);
+
+    ~PluginLibrary();
+    PluginLibrary(const PluginLibrary&) = delete;
+    PluginLibrary& operator=(const PluginLibrary&) = delete;
+
+    const probionis_plugin& descriptor() const { return *descriptor_; }
+    const std::string& path() const { return path_; }
+
+private:
+    PluginLibrary(std::string path, void* handle, const probionis_plugin* descriptor);
+
+    std::string path_;
+    void* handle_;
+    const probionis_plugin* descriptor_;
+};
+
+// Pipeline step backed by a plugin instance. Batches are handed to the
+// plugin in place; single spectra go through a one-row scratch batch.
+// Batches (and spectra) without an axis of their channel count are
+// refused with std::runtime_error before the plugin sees them.
+// See preprocess/plugins/ for an example plugin.
+class PluginStep : public PreprocessStep {
+public:
+    PluginStep(std::shared_ptr<PluginLibrary> library, const std::string& config);
+    ~PluginStep() override;
+
+    const char* name() const override { return name_.c_str(); }
+    void apply(Spectrum& spectrum) const override;
+    void apply_batch(SpectrumBatch& batch) const override;
+    std::size_t row_multiple() const override;
+
+private:
+    std::shared_ptr<PluginLibrary> library_;
+    std::string name_;
+    void* state_ = nullptr;
+};
+
+}  // namespace probionis
@@ -0,0 +1,88 @@
+/*
+ * Example preprocessing plugin: removes a straight baseline from every
+ * spectrum, drawn through the mean of the first and of the last `anchor`
+ * channels against the axis. Plain C99 against plugin_abi.h only:
+ *
+ *     cc -std=c99 -O2 -shared -fPIC -I backend \
+ *        backend/preprocess/plugins/linear_baseline.c -o linear_baseline.so
+ *
+ * Configuration: empty, or "anchor=N" with 1 <= N (default 1). Spectra with
+ * fewer than 2 * N channels are refused.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preprocess/plugin_abi.h"
+
+typedef struct linear_baseline {
+    unsigned long anchor;
+} linear_baseline;
+
+static void* linear_baseline_create(const char* config, char* error, size_t error_size) {
+    unsigned long anchor = 1;
+    if (config[0] != '\0') {
+        char* end = NULL;
+        if (strncmp(config, "anchor=", 7) != 0 ||
+            (anchor = strtoul(config + 7, &end, 10)) == 0 || *end != '\0') {
+            snprintf(error, error_size, "expected anchor=N with N >= 1, got \"%s\"", config);
+            return NULL;
+        }
+    }
+    linear_baseline* state = (linear_baseline*)malloc(sizeof(linear_baseline));
+    if (!state) {
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+    state->anchor = anchor;
+    return state;
+}
+
+static void linear_baseline_destroy(void* state) { free(state); }
+
+static double mean(const float* values, unsigned long count) {
+    double sum = 0.0;
+    for (unsigned long i = 0; i < count; ++i) {
+        sum += values[i];
+    }
+    return sum / (double)count;
+}
+
+static int linear_baseline_process(void* opaque, probionis_batch* batch, char* error,
+                                   size_t error_size) {
+    const linear_baseline* state = (const linear_baseline*)opaque;
+    const unsigned long n = batch->channels;
+    const unsigned long k = state->anchor;
+    if (n < 2 * k) {
+        snprintf(error, error_size, "%lu channels, need at least %lu", n, 2 * k);
+        return PROBIONIS_PLUGIN_ERROR;
+    }
+    const double x0 = mean(batch->axis, k);
+    const double x1 = mean(batch->axis + n - k, k);
+    if (x1 == x0) {
+        snprintf(error, error_size, "axis does not span a range");
+        return PROBIONIS_PLUGIN_ERROR;
+    }
+    for (uint32_t r = 0; r < batch->count; ++r) {
+        float* row = batch->intensity + (size_t)r * batch->stride;
+        const double y0 = mean(row, k);
+        const double slope = (mean(row + n - k, k) - y0) / (x1 - x0);
+        for (unsigned long j = 0; j < n; ++j) {
+            row[j] = (float)(row[j] - (y0 + slope * (batch->axis[j] - x0)));
+        }
+    }
+    return PROBIONIS_PLUGIN_OK;
+}
+
+static const probionis_plugin kDescriptor = {
+    PROBIONIS_PLUGIN_ABI_VERSION,
+    sizeof(probionis_plugin),
+    "linear_baseline",
+    "1.0",
+    {16, 2, 0, 1},
+    linear_baseline_create,
+    linear_baseline_destroy,
+    linear_baseline_process,
+};
+
+const probionis_plugin* probionis_plugin_entry(void) { return &kDescriptor; }
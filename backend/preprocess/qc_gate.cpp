@@ -0,0 +1,391 @@
+#include "preprocess/qc_gate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// The browser build screens spectra exactly as the server does, so no
+// product and sum here may be fused into an FMA.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace probionis {
+
+namespace {
+
+// Running sums for one pass. Float lane sums are flushed into the doubles
+// every kFlushChannels so long spectra do not lose precision.
+struct QcAccumulator {
+    double sum = 0.0;
+    double sum_ix = 0.0;
+    double sum_d2sq = 0.0;
+    std::size_t saturated = 0;
+    std::size_t spikes = 0;
+    std::size_t non_finite = 0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+};
+
+constexpr std::size_t kFlushChannels = 512;
+
+void accumulate_scalar(const float* x, std::size_t n, std::size_t lo,
+                       std::size_t hi, const QcThresholds& t,
+                       QcAccumulator& acc) {
+    for (std::size_t i = lo; i < hi; ++i) {
+        const float v = x[i];
+        if (!std::isfinite(v)) {
+            ++acc.non_finite;
+            continue;
+        }
+        acc.sum += v;
+        acc.sum_ix += static_cast<double>(i) * v;
+        acc.min = std::min(acc.min, v);
+        acc.max = std::max(acc.max, v);
+        acc.saturated += v >= t.saturation_level ? 1 : 0;
+        if (i == 0 || i + 1 >= n || !std::isfinite(x[i - 1]) ||
+            !std::isfinite(x[i + 1])) {
+            continue;
+        }
+        const float d2 = x[i - 1] - 2.0f * v + x[i + 1];
+        acc.sum_d2sq += static_cast<double>(d2) * d2;
+        const float mid = 0.5f * (x[i - 1] + x[i + 1]);
+        acc.spikes += (v - mid) > t.spike_ratio * std::fabs(mid) + t.spike_floor ? 1 : 0;
+    }
+}
+
+#if defined(__AVX2__)
+inline float hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+inline float hmin(__m256 v) {
+    __m128 s = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_min_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_min_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+inline float hmax(__m256 v) {
+    __m128 s = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// Interior channels [lo, hi), all of which have both neighbours. Returns the
+// first channel not processed.
+std::size_t accumulate_avx2(const float* x, std::size_t lo, std::size_t hi,
+                            const QcThresholds& t, QcAccumulator& acc) {
+    const __m256 sat_level = _mm256_set1_ps(t.saturation_level);
+    const __m256 ratio = _mm256_set1_ps(t.spike_ratio);
+    const __m256 floor = _mm256_set1_ps(t.spike_floor);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 all_ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    const __m256 lane_index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256 vmin = inf;
+    __m256 vmax = _mm256_sub_ps(_mm256_setzero_ps(), inf);
+    __m256i counts_sat = _mm256_setzero_si256();
+    __m256i counts_spike = _mm256_setzero_si256();
+    __m256i counts_bad = _mm256_setzero_si256();
+
+    std::size_t i = lo;
+    while (i + 8 <= hi) {
+        const std::size_t block_end = i + std::min(kFlushChannels, (hi - i) / 8 * 8);
+        // Index terms are taken relative to the block start to keep the
+        // float products small; the base is added back when flushing.
+        const float base = static_cast<float>(i);
+        __m256 vsum = _mm256_setzero_ps();
+        __m256 vsum_ix = _mm256_setzero_ps();
+        __m256 vsum_d2 = _mm256_setzero_ps();
+        __m256 offset = lane_index;
+        for (; i < block_end; i += 8) {
+            const __m256 prev = _mm256_loadu_ps(x + i - 1);
+            const __m256 cur = _mm256_loadu_ps(x + i);
+            const __m256 next = _mm256_loadu_ps(x + i + 1);
+
+            // |v| < inf is false for NaN and +/-inf alike.
+            const __m256 finite =
+                _mm256_cmp_ps(_mm256_and_ps(cur, abs_mask), inf, _CMP_LT_OQ);
+            const __m256 neighbours_finite = _mm256_and_ps(
+                _mm256_cmp_ps(_mm256_and_ps(prev, abs_mask), inf, _CMP_LT_OQ),
+                _mm256_cmp_ps(_mm256_and_ps(next, abs_mask), inf, _CMP_LT_OQ));
+            const __m256 v = _mm256_and_ps(cur, finite);
+            counts_bad = _mm256_sub_epi32(
+                counts_bad, _mm256_castps_si256(_mm256_andnot_ps(finite, all_ones)));
+
+            vsum = _mm256_add_ps(vsum, v);
+            vsum_ix = _mm256_add_ps(vsum_ix, _mm256_mul_ps(offset, v));
+            offset = _mm256_add_ps(offset, _mm256_set1_ps(8.0f));
+            vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(inf, cur, finite));
+            vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(_mm256_sub_ps(_mm256_setzero_ps(), inf),
+                                                        cur, finite));
+            counts_sat = _mm256_sub_epi32(
+                counts_sat,
+                _mm256_castps_si256(_mm256_and_ps(
+                    finite, _mm256_cmp_ps(cur, sat_level, _CMP_GE_OQ))));
+
+            const __m256 all_finite = _mm256_and_ps(finite, neighbours_finite);
+            const __m256 d2 = _mm256_and_ps(
+                _mm256_add_ps(_mm256_sub_ps(prev, _mm256_mul_ps(two, cur)), next),
+                all_finite);
+            vsum_d2 = _mm256_add_ps(vsum_d2, _mm256_mul_ps(d2, d2));
+
+            const __m256 mid = _mm256_mul_ps(half, _mm256_add_ps(prev, next));
+            const __m256 limit = _mm256_add_ps(
+                _mm256_mul_ps(ratio, _mm256_and_ps(mid, abs_mask)), floor);
+            const __m256 spike = _mm256_and_ps(
+                all_finite, _mm256_cmp_ps(_mm256_sub_ps(cur, mid), limit, _CMP_GT_OQ));
+            counts_spike = _mm256_sub_epi32(counts_spike, _mm256_castps_si256(spike));
+        }
+        const double block_sum = hsum(vsum);
+        acc.sum += block_sum;
+        acc.sum_ix += hsum(vsum_ix) + static_cast<double>(base) * block_sum;
+        acc.sum_d2sq += hsum(vsum_d2);
+    }
+
+    acc.min = std::min(acc.min, hmin(vmin));
+    acc.max = std::max(acc.max, hmax(vmax));
+    alignas(32) std::int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), counts_sat);
+    for (std::int32_t c : lanes) acc.saturated += static_cast<std::size_t>(c);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), counts_spike);
+    for (std::int32_t c : lanes) acc.spikes += static_cast<std::size_t>(c);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), counts_bad);
+    for (std::int32_t c : lanes) acc.non_finite += static_cast<std::size_t>(c);
+    return i;
+}
+#elif defined(__wasm_simd128__)
+// The AVX2 pass on SIMD128: each 8-channel step is two 4-lane halves, and
+// lanes are accumulated, flushed and reduced in the AVX2 order, so a
+// browser reaches the same verdict and statistics as an AVX2 server.
+struct QcHalf {
+    v128_t vmin = wasm_f32x4_splat(std::numeric_limits<float>::infinity());
+    v128_t vmax = wasm_f32x4_splat(-std::numeric_limits<float>::infinity());
+    v128_t counts_sat = wasm_i32x4_splat(0);
+    v128_t counts_spike = wasm_i32x4_splat(0);
+    v128_t counts_bad = wasm_i32x4_splat(0);
+    v128_t vsum = wasm_f32x4_splat(0.0f);
+    v128_t vsum_ix = wasm_f32x4_splat(0.0f);
+    v128_t vsum_d2 = wasm_f32x4_splat(0.0f);
+    v128_t offset = wasm_f32x4_splat(0.0f);
+};
+
+inline v128_t is_finite(v128_t v) {
+    return wasm_f32x4_lt(wasm_f32x4_abs(v),
+                         wasm_f32x4_splat(std::numeric_limits<float>::infinity()));
+}
+
+void step_simd128(const float* p, const QcThresholds& t, QcHalf& h) {
+    const v128_t inf = wasm_f32x4_splat(std::numeric_limits<float>::infinity());
+    const v128_t prev = wasm_v128_load(p - 1);
+    const v128_t cur = wasm_v128_load(p);
+    const v128_t next = wasm_v128_load(p + 1);
+
+    const v128_t finite = is_finite(cur);
+    const v128_t neighbours_finite = wasm_v128_and(is_finite(prev), is_finite(next));
+    const v128_t v = wasm_v128_and(cur, finite);
+    h.counts_bad = wasm_i32x4_sub(h.counts_bad, wasm_v128_not(finite));
+
+    h.vsum = wasm_f32x4_add(h.vsum, v);
+    h.vsum_ix = wasm_f32x4_add(h.vsum_ix, wasm_f32x4_mul(h.offset, v));
+    h.offset = wasm_f32x4_add(h.offset, wasm_f32x4_splat(8.0f));
+    // pmin/pmax with swapped operands follow the x86 min/max rule.
+    h.vmin = wasm_f32x4_pmin(wasm_v128_bitselect(cur, inf, finite), h.vmin);
+    h.vmax = wasm_f32x4_pmax(wasm_v128_bitselect(cur, wasm_f32x4_neg(inf), finite), h.vmax);
+    h.counts_sat = wasm_i32x4_sub(
+        h.counts_sat,
+        wasm_v128_and(finite, wasm_f32x4_ge(cur, wasm_f32x4_splat(t.saturation_level))));
+
+    const v128_t all_finite = wasm_v128_and(finite, neighbours_finite);
+    const v128_t d2 = wasm_v128_and(
+        wasm_f32x4_add(wasm_f32x4_sub(prev, wasm_f32x4_mul(wasm_f32x4_splat(2.0f), cur)), next),
+        all_finite);
+    h.vsum_d2 = wasm_f32x4_add(h.vsum_d2, wasm_f32x4_mul(d2, d2));
+
+    const v128_t mid = wasm_f32x4_mul(wasm_f32x4_splat(0.5f), wasm_f32x4_add(prev, next));
+    const v128_t limit = wasm_f32x4_add(
+        wasm_f32x4_mul(wasm_f32x4_splat(t.spike_ratio), wasm_f32x4_abs(mid)),
+        wasm_f32x4_splat(t.spike_floor));
+    const v128_t spike = wasm_v128_and(all_finite, wasm_f32x4_gt(wasm_f32x4_sub(cur, mid), limit));
+    h.counts_spike = wasm_i32x4_sub(h.counts_spike, spike);
+}
+
+// hsum/hmin/hmax of the AVX2 pass over lanes lo = 0..3, hi = 4..7.
+inline float hsum(v128_t lo, v128_t hi) {
+    const v128_t s = wasm_f32x4_add(lo, hi);
+    const float a = wasm_f32x4_extract_lane(s, 0) + wasm_f32x4_extract_lane(s, 2);
+    const float b = wasm_f32x4_extract_lane(s, 1) + wasm_f32x4_extract_lane(s, 3);
+    return a + b;
+}
+
+inline float min_x86(float a, float b) { return a < b ? a : b; }
+inline float max_x86(float a, float b) { return a > b ? a : b; }
+
+inline float hmin(v128_t lo, v128_t hi) {
+    const v128_t s = wasm_f32x4_pmin(hi, lo);
+    return min_x86(min_x86(wasm_f32x4_extract_lane(s, 0), wasm_f32x4_extract_lane(s, 2)),
+                   min_x86(wasm_f32x4_extract_lane(s, 1), wasm_f32x4_extract_lane(s, 3)));
+}
+
+inline float hmax(v128_t lo, v128_t hi) {
+    const v128_t s = wasm_f32x4_pmax(hi, lo);
+    return max_x86(max_x86(wasm_f32x4_extract_lane(s, 0), wasm_f32x4_extract_lane(s, 2)),
+                   max_x86(wasm_f32x4_extract_lane(s, 1), wasm_f32x4_extract_lane(s, 3)));
+}
+
+inline std::size_t lane_total(v128_t lo, v128_t hi) {
+    alignas(16) std::int32_t lanes[8];
+    wasm_v128_store(lanes, lo);
+    wasm_v128_store(lanes + 4, hi);
+    std::size_t total = 0;
+    for (std::int32_t c : lanes) total += static_cast<std::size_t>(c);
+    return total;
+}
+
+std::size_t accumulate_simd128(const float* x, std::size_t lo, std::size_t hi,
+                               const QcThresholds& t, QcAccumulator& acc) {
+    QcHalf low;
+    QcHalf high;
+    std::size_t i = lo;
+    while (i + 8 <= hi) {
+        const std::size_t block_end = i + std::min(kFlushChannels, (hi - i) / 8 * 8);
+        const float base = static_cast<float>(i);
+        for (QcHalf* h : {&low, &high}) {
+            h->vsum = h->vsum_ix = h->vsum_d2 = wasm_f32x4_splat(0.0f);
+        }
+        low.offset = wasm_f32x4_make(0, 1, 2, 3);
+        high.offset = wasm_f32x4_make(4, 5, 6, 7);
+        for (; i < block_end; i += 8) {
+            step_simd128(x + i, t, low);
+            step_simd128(x + i + 4, t, high);
+        }
+        const double block_sum = hsum(low.vsum, high.vsum);
+        acc.sum += block_sum;
+        acc.sum_ix += hsum(low.vsum_ix, high.vsum_ix) + static_cast<double>(base) * block_sum;
+        acc.sum_d2sq += hsum(low.vsum_d2, high.vsum_d2);
+    }
+
+    acc.min = std::min(acc.min, hmin(low.vmin, high.vmin));
+    acc.max = std::max(acc.max, hmax(low.vmax, high.vmax));
+    acc.saturated += lane_total(low.counts_sat, high.counts_sat);
+    acc.spikes += lane_total(low.counts_spike, high.counts_spike);
+    acc.non_finite += lane_total(low.counts_bad, high.counts_bad);
+    return i;
+}
+#endif
+
+}  // namespace
+
+const char* qc_reason_name(QcReason reason) {
+    switch (reason) {
+        case QcReason::kOk: return "ok";
+        case QcReason::kEmpty: return "empty";
+        case QcReason::kNonFinite: return "non_finite";
+        case QcReason::kSaturated: return "saturated";
+        case QcReason::kDark: return "dark";
+        case QcReason::kLowSnr: return "low_snr";
+        case QcReason::kFluorescence: return "fluorescence";
+        case QcReason::kSpikes: return "spikes";
+    }
+    return "unknown";
+}
+
+QcStats compute_qc_stats(const float* intensity, std::size_t count,
+                         const QcThresholds& thresholds) {
+    QcStats stats;
+    stats.channels = count;
+    if (count == 0) {
+        return stats;
+    }
+
+    QcAccumulator acc;
+    accumulate_scalar(intensity, count, 0, 1, thresholds, acc);
+    std::size_t i = 1;
+#if defined(__AVX2__)
+    if (count > 2) {
+        i = accumulate_avx2(intensity, 1, count - 1, thresholds, acc);
+    }
+#elif defined(__wasm_simd128__)
+    if (count > 2) {
+        i = accumulate_simd128(intensity, 1, count - 1, thresholds, acc);
+    }
+#endif
+    accumulate_scalar(intensity, count, i, count, thresholds, acc);
+
+    stats.non_finite = acc.non_finite;
+    stats.saturated = acc.saturated;
+    stats.spikes = acc.spikes;
+    stats.total_intensity = acc.sum;
+    stats.min_intensity = acc.min;
+    stats.max_intensity = acc.max;
+
+    const double n = static_cast<double>(count - acc.non_finite);
+    if (n > 0) {
+        stats.mean_intensity = acc.sum / n;
+    }
+    if (count > 2) {
+        stats.noise = std::sqrt(acc.sum_d2sq / static_cast<double>(count - 2) / 6.0);
+    }
+    const double range = static_cast<double>(acc.max) - acc.min;
+    stats.snr = stats.noise > 0.0 ? range / stats.noise
+                                  : (range > 0.0 ? std::numeric_limits<double>::infinity() : 0.0);
+
+    // Slope of the least-squares line through (i, x_i), i = 0..count-1.
+    const double m = static_cast<double>(count);
+    const double sum_i = m * (m - 1.0) / 2.0;
+    const double sum_ii = (m - 1.0) * m * (2.0 * m - 1.0) / 6.0;
+    const double denominator = m * sum_ii - sum_i * sum_i;
+    if (denominator > 0.0) {
+        stats.baseline_slope = (m * acc.sum_ix - sum_i * acc.sum) / denominator;
+    }
+    return stats;
+}
+
+QcResult QcGate::screen(const Spectrum& spectrum) const {
+    return screen(spectrum.intensity.data(), spectrum.size());
+}
+
+QcResult QcGate::screen(const float* intensity, std::size_t count) const {
+    QcResult result;
+    if (count == 0) {
+        result.reason = QcReason::kEmpty;
+        return result;
+    }
+    result.stats = compute_qc_stats(intensity, count, thresholds_);
+    const QcStats& s = result.stats;
+    const QcThresholds& t = thresholds_;
+
+    if (s.non_finite > 0) {
+        result.reason = QcReason::kNonFinite;
+    } else if (s.saturated > t.max_saturated) {
+        result.reason = QcReason::kSaturated;
+    } else if (s.mean_intensity < t.min_mean_intensity) {
+        result.reason = QcReason::kDark;
+    } else if (s.spikes > t.max_spikes) {
+        result.reason = QcReason::kSpikes;
+    } else if (std::fabs(s.baseline_slope) * static_cast<double>(s.channels) >
+               t.max_baseline_rise * std::fabs(s.mean_intensity)) {
+        result.reason = QcReason::kFluorescence;
+    } else if (s.snr < t.min_snr) {
+        result.reason = QcReason::kLowSnr;
+    }
+    return result;
+}
+
+}  // namespace probionis
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// Why a spectrum was rejected. Values are stable: they are returned to
+// clients and recorded with the sample.
+enum class QcReason : std::uint8_t {
+    kOk = 0,
+    kEmpty = 1,
+    kNonFinite = 2,
+    kSaturated = 3,
+    kDark = 4,
+    kLowSnr = 5,
+    kFluorescence = 6,
+    kSpikes = 7,
+};
+
+const char* qc_reason_name(QcReason reason);
+
+// Cheap statistics gathered in a single pass over the intensities.
+struct QcStats {
+    std::size_t channels = 0;
+    std::size_t non_finite = 0;
+    std::size_t saturated = 0;
+    std::size_t spikes = 0;
+    double total_intensity = 0.0;
+    double mean_intensity = 0.0;
+    float min_intensity = 0.0f;
+    float max_intensity = 0.0f;
+    // Noise from the RMS second difference, which ignores smooth baselines
+    // and broad peaks; signal is the peak-to-trough range.
+    double noise = 0.0;
+    double snr = 0.0;
+    // Least-squares slope across the whole spectrum, in intensity units per
+    // channel.
+    double baseline_slope = 0.0;
+};
+
+struct QcThresholds {
+    float saturation_level = 65000.0f;
+    std::size_t max_saturated = 3;
+    double min_mean_intensity = 50.0;
+    double min_snr = 10.0;
+    // Rise of the fitted baseline over the spectrum, relative to the mean
+    // intensity. Fluorescence shows up as a steep broad background.
+    double max_baseline_rise = 4.0;
+    // A channel is a spike when it exceeds the mean of its neighbours by
+    // this factor of their magnitude (plus `spike_floor`).
+    float spike_ratio = 1.5f;
+    float spike_floor = 10.0f;
+    std::size_t max_spikes = 8;
+};
+
+struct QcResult {
+    QcReason reason = QcReason::kOk;
+    QcStats stats;
+
+    bool ok() const { return reason == QcReason::kOk; }
+};
+
+QcStats compute_qc_stats(const float* intensity, std::size_t count,
+                         const QcThresholds& thresholds);
+
+// Screens raw spectra before preprocessing. Checks run from the cheapest,
+// most definitive reason to the most heuristic one, and the first failure
+// is reported.
+class QcGate {
+public:
+    QcGate() = default;
+    explicit QcGate(const QcThresholds& thresholds) : thresholds_(thresholds) {}
+
+    QcResult screen(const Spectrum& spectrum) const;
+    // The same for `count` raw intensities, e.g. a row of a batch slab.
+    QcResult screen(const float* intensity, std::size_t count) const;
+
+    const QcThresholds& thresholds() const { return thresholds_; }
+
+private:
+    QcThresholds thresholds_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,343 @@
+#include "preprocess/tensor_cache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "runtime/futex.h"
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr std::uint32_t kSegmentMagic = 0x50425443;  // "PBTC"
+constexpr std::uint32_t kSegmentVersion = 2;
+constexpr std::size_t kHeaderBytes = 4096;
+
+static_assert(sizeof(pthread_mutex_t) <= kCacheLineSize, "a set lock must fit its cache line");
+
+std::size_t round_up(std::size_t value, std::size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Millisecond timestamp for LRU ordering; the coarse clock is a vDSO read
+// and is the same across processes.
+std::uint64_t now_ms() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000 +
+           static_cast<std::uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+void init_set_lock(pthread_mutex_t* mutex) {
+    pthread_mutexattr_t attr;
+    ::pthread_mutexattr_init(&attr);
+    ::pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    ::pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    ::pthread_mutex_init(mutex, &attr);
+    ::pthread_mutexattr_destroy(&attr);
+}
+
+// Holds flock(LOCK_EX) on the segment while it is created or checked.
+class SegmentInitLock {
+public:
+    explicit SegmentInitLock(int fd) : fd_(fd) {
+        while (::flock(fd_, LOCK_EX) != 0 && errno == EINTR) {
+        }
+    }
+    ~SegmentInitLock() { ::flock(fd_, LOCK_UN); }
+
+    SegmentInitLock(const SegmentInitLock&) = delete;
+    SegmentInitLock& operator=(const SegmentInitLock&) = delete;
+
+private:
+    int fd_;
+};
+
+}  // namespace
+
+struct SharedTensorCache::Header {
+    std::atomic<std::uint32_t> ready;
+    std::uint32_t version;
+    std::uint64_t ways;
+    std::uint64_t max_floats;
+    std::uint64_t slot_bytes;
+    std::uint64_t sets;
+};
+
+// Slot header, one cache line; the tensor follows it. Key fields are
+// atomics only so that readers racing a writer are well defined; the
+// sequence counter is what makes a copy trustworthy.
+struct alignas(kCacheLineSize) SharedTensorCache::Slot {
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> last_used_ms;
+    std::atomic<std::uint64_t> raw_hash;
+    std::atomic<std::uint64_t> state;
+    std::atomic<std::uint32_t> recipe_version;
+    std::atomic<std::uint32_t> count;  // 0 while empty
+
+    bool holds(const TensorKey& key) const {
+        return raw_hash.load(std::memory_order_relaxed) == key.raw_hash &&
+               state.load(std::memory_order_relaxed) == key.state &&
+               recipe_version.load(std::memory_order_relaxed) == key.recipe_version;
+    }
+
+    float* data() {
+        return reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(this) + kCacheLineSize);
+    }
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+                  std::atomic<std::uint32_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free to work across processes");
+
+std::uint64_t raw_spectrum_hash(const Spectrum& spectrum) {
+    // The instrument picks the calibration, so equal readings from two
+    // instruments are different inputs; the length keeps the ID and the
+    // axis from running into each other.
+    const std::uint64_t id_length = spectrum.instrument_id.size();
+    std::uint64_t hash = fnv1a64(&id_length, sizeof(id_length));
+    hash = fnv1a64(spectrum.instrument_id.data(), spectrum.instrument_id.size(), hash);
+    hash = fnv1a64(spectrum.axis.data(), spectrum.axis.size() * sizeof(float), hash);
+    return fnv1a64(spectrum.intensity.data(), spectrum.intensity.size() * sizeof(float), hash);
+}
+
+SharedTensorCache::SharedTensorCache(const TensorCacheOptions& options)
+    : ways_(options.ways),
+      max_floats_(options.max_floats),
+      slot_bytes_(kCacheLineSize + round_up(options.max_floats * sizeof(float), kCacheLineSize)) {
+    if (ways_ == 0 || max_floats_ == 0) {
+        throw std::invalid_argument("SharedTensorCache: ways and max_floats must be positive");
+    }
+    // Each set costs its lock line plus its slots.
+    const std::size_t set_bytes = kCacheLineSize + ways_ * slot_bytes_;
+    sets_ = options.capacity_bytes > kHeaderBytes
+                ? (options.capacity_bytes - kHeaderBytes) / set_bytes
+                : 0;
+    if (sets_ == 0) {
+        throw std::invalid_argument("SharedTensorCache: capacity too small for one set");
+    }
+    mapped_bytes_ = kHeaderBytes + sets_ * set_bytes;
+
+    const int fd = ::shm_open(options.name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("SharedTensorCache: shm_open " + options.name + ": " +
+                                 std::strerror(errno));
+    }
+    // Creating and attaching both happen under the flock, so an attacher
+    // never sees a half-initialised segment, and one whose creator died
+    // (ready never set) is simply initialised again.
+    std::string error;
+    {
+        SegmentInitLock init(fd);
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            error = std::string("fstat failed: ") + std::strerror(errno);
+        } else if (st.st_size == 0 && ::ftruncate(fd, static_cast<off_t>(mapped_bytes_)) != 0) {
+            error = std::string("cannot size segment: ") + std::strerror(errno);
+        } else if (st.st_size != 0 && static_cast<std::size_t>(st.st_size) != mapped_bytes_) {
+            error = "segment " + options.name + " exists with a different size";
+        } else {
+            void* base = ::mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                error = std::string("mmap failed: ") + std::strerror(errno);
+            } else {
+                base_ = static_cast<unsigned char*>(base);
+                header_ = reinterpret_cast<Header*>(base_);
+                locks_ = base_ + kHeaderBytes;
+                slots_ = base_ + kHeaderBytes + sets_ * kCacheLineSize;
+                if (header_->ready.load(std::memory_order_acquire) != kSegmentMagic) {
+                    // Slots are zero (empty) from ftruncate; an earlier
+                    // creator got at most this far before dying.
+                    for (std::size_t set = 0; set < sets_; ++set) {
+                        init_set_lock(set_lock(set));
+                    }
+                    header_->version = kSegmentVersion;
+                    header_->ways = ways_;
+                    header_->max_floats = max_floats_;
+                    header_->slot_bytes = slot_bytes_;
+                    header_->sets = sets_;
+                    header_->ready.store(kSegmentMagic, std::memory_order_release);
+                } else if (header_->version != kSegmentVersion || header_->ways != ways_ ||
+                           header_->max_floats != max_floats_ || header_->sets != sets_) {
+                    error = "segment " + options.name + " has a different layout";
+                }
+            }
+        }
+    }
+    ::close(fd);
+    if (!error.empty()) {
+        if (base_) {
+            ::munmap(base_, mapped_bytes_);
+            base_ = nullptr;
+        }
+        throw std::runtime_error("SharedTensorCache: " + error);
+    }
+}
+
+SharedTensorCache::~SharedTensorCache() {
+    if (base_) {
+        ::munmap(base_, mapped_bytes_);
+    }
+}
+
+void SharedTensorCache::unlink(const std::string& name) {
+    ::shm_unlink(name.c_str());
+}
+
+SharedTensorCache::Slot* SharedTensorCache::slot(std::size_t set, std::size_t way) const {
+    return reinterpret_cast<Slot*>(slots_ + (set * ways_ + way) * slot_bytes_);
+}
+
+pthread_mutex_t* SharedTensorCache::set_lock(std::size_t set) const {
+    return reinterpret_cast<pthread_mutex_t*>(locks_ + set * kCacheLineSize);
+}
+
+void SharedTensorCache::lock_set(std::size_t set) {
+    const int result = ::pthread_mutex_lock(set_lock(set));
+    if (result == EOWNERDEAD) {
+        // The holder died mid-insert. Its half-written slot still has an
+        // odd sequence, which readers skip and the next write repairs.
+        ::pthread_mutex_consistent(set_lock(set));
+    } else if (result != 0) {
+        throw std::runtime_error("SharedTensorCache: set lock failed: " +
+                                 std::string(std::strerror(result)));
+    }
+}
+
+void SharedTensorCache::unlock_set(std::size_t set) {
+    ::pthread_mutex_unlock(set_lock(set));
+}
+
+std::size_t SharedTensorCache::set_of(const TensorKey& key) const {
+    return static_cast<std::size_t>(mix(key.raw_hash ^ mix(key.state) ^
+                                        (std::uint64_t{key.recipe_version} << 32 |
+                                         key.recipe_version)) %
+                                    sets_);
+}
+
+bool SharedTensorCache::lookup(const TensorKey& key, std::vector<float>& out) {
+    const std::size_t set = set_of(key);
+    for (std::size_t way = 0; way < ways_; ++way) {
+        Slot* s = slot(set, way);
+        // A copy that raced a writer is retried; a slot rewritten with a
+        // different key simply stops matching.
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            const std::uint64_t before = s->sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                cpu_relax();
+                continue;
+            }
+            const std::uint32_t count = s->count.load(std::memory_order_relaxed);
+            if (count == 0 || count > max_floats_ || !s->holds(key)) {
+                break;
+            }
+            out.resize(count);
+            std::memcpy(out.data(), s->data(), count * sizeof(float));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s->sequence.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            // Skip the store when the stamp is current to keep hot slots'
+            // cache lines shared between readers.
+            const std::uint64_t now = now_ms();
+            if (s->last_used_ms.load(std::memory_order_relaxed) != now) {
+                s->last_used_ms.store(now, std::memory_order_relaxed);
+            }
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void SharedTensorCache::insert(const TensorKey& key, const float* data, std::size_t count) {
+    if (count == 0 || count > max_floats_) {
+        return;
+    }
+    const std::size_t set = set_of(key);
+    lock_set(set);
+    Slot* target = nullptr;
+    Slot* oldest = nullptr;
+    for (std::size_t way = 0; way < ways_ && !target; ++way) {
+        Slot* s = slot(set, way);
+        const std::uint32_t occupied = s->count.load(std::memory_order_relaxed);
+        if (occupied == 0 || s->holds(key)) {
+            target = s;
+        } else if (!oldest || s->last_used_ms.load(std::memory_order_relaxed) <
+                                  oldest->last_used_ms.load(std::memory_order_relaxed)) {
+            oldest = s;
+        }
+    }
+    if (!target) {
+        target = oldest;
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Odd while writing; `| 1` also covers a slot left odd by a writer that died.
+    const std::uint64_t writing = target->sequence.load(std::memory_order_relaxed) | 1;
+    target->sequence.store(writing, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    target->raw_hash.store(key.raw_hash, std::memory_order_relaxed);
+    target->state.store(key.state, std::memory_order_relaxed);
+    target->recipe_version.store(key.recipe_version, std::memory_order_relaxed);
+    target->count.store(static_cast<std::uint32_t>(count), std::memory_order_relaxed);
+    std::memcpy(target->data(), data, count * sizeof(float));
+    target->last_used_ms.store(now_ms(), std::memory_order_relaxed);
+    target->sequence.store(writing + 1, std::memory_order_release);
+    unlock_set(set);
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TensorCacheStats SharedTensorCache::stats() const {
+    TensorCacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.inserts = inserts_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+QcResult preprocess_cached(SharedTensorCache& cache, const Pipeline& pipeline,
+                           std::uint32_t recipe_version, Spectrum& spectrum) {
+    // Steps may change the axis (calibration transfer, resampling), so the
+    // cached tensor holds the output axis followed by the intensities.
+    const TensorKey key{raw_spectrum_hash(spectrum), recipe_version,
+                        pipeline.state_fingerprint(spectrum)};
+    thread_local std::vector<float> packed;
+    if (cache.lookup(key, packed) && packed.size() % 2 == 0) {
+        const std::size_t channels = packed.size() / 2;
+        spectrum.axis.assign(packed.begin(), packed.begin() + channels);
+        spectrum.intensity.assign(packed.begin() + channels, packed.end());
+        return QcResult{};
+    }
+    // The state is read again after the run (steps keep the instrument ID):
+    // if a calibration was replaced meanwhile, this output may come from
+    // either operator and is not kept.
+    const QcResult result = pipeline.run(spectrum);
+    if (result.ok() && spectrum.axis.size() == spectrum.intensity.size() &&
+        pipeline.state_fingerprint(spectrum) == key.state) {
+        packed.assign(spectrum.axis.begin(), spectrum.axis.end());
+        packed.insert(packed.end(), spectrum.intensity.begin(), spectrum.intensity.end());
+        cache.insert(key, packed.data(), packed.size());
+    }
+    return result;
+}
+
+}  // namespace probionis
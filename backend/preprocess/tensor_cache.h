@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "preprocess/pipeline.h"
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// Identity of a preprocessed tensor: the raw input, the exact recipe
+// (pipeline steps and their parameters) that transformed it, and the
+// state the steps resolved for it (Pipeline::state_fingerprint), so that
+// replacing an instrument's calibration stops serving the old output.
+struct TensorKey {
+    std::uint64_t raw_hash = 0;
+    std::uint32_t recipe_version = 0;
+    std::uint64_t state = 0;
+};
+
+// Hash of a raw spectrum's instrument ID, axis and intensities, for
+// TensorKey::raw_hash.
+std::uint64_t raw_spectrum_hash(const Spectrum& spectrum);
+
+struct TensorCacheOptions {
+    // POSIX shared-memory object name; every process on the host that
+    // opens the same name shares the cache.
+    std::string name = "/probionis-tensors";
+    std::size_t capacity_bytes = std::size_t{512} << 20;
+    // Largest tensor stored, in floats; longer ones are not cached.
+    // preprocess_cached() stores axis and intensities, two floats per channel.
+    std::size_t max_floats = 8192;
+    // Slots per set. A key can live only in its set, so this bounds both
+    // the probe length of a lookup and the scope of an eviction.
+    std::size_t ways = 8;
+};
+
+struct TensorCacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t inserts = 0;
+    std::uint64_t evictions = 0;
+};
+
+// Host-wide LRU cache of preprocessed input tensors in POSIX shared
+// memory, so re-scoring a sample under another model version (or by every
+// member of an ensemble, in any worker process) reuses the preprocessing.
+//
+// The segment is a set-associative array: a key hashes to one set of
+// `ways` fixed-size slots. Lookups take no lock; each slot carries a
+// sequence counter (odd while a write is in progress), and a reader
+// copies the tensor and retries if the counter moved. Inserts lock only
+// their set and replace its least recently used slot, so eviction is
+// sharded as finely as the sets are. Set locks are robust process-shared
+// mutexes, so a writer that dies holding one hands it to the next locker,
+// and the segment is initialised under flock() on its descriptor, so a
+// creator that dies half way is finished by the next process to attach.
+class SharedTensorCache {
+public:
+    // Creates the segment or attaches to an existing one with the same
+    // geometry; throws std::runtime_error otherwise.
+    explicit SharedTensorCache(const TensorCacheOptions& options = {});
+    ~SharedTensorCache();
+
+    SharedTensorCache(const SharedTensorCache&) = delete;
+    SharedTensorCache& operator=(const SharedTensorCache&) = delete;
+
+    // Copies the cached tensor into `out`; false on a miss.
+    bool lookup(const TensorKey& key, std::vector<float>& out);
+    void insert(const TensorKey& key, const float* data, std::size_t count);
+
+    TensorCacheStats stats() const;
+    std::size_t set_count() const { return sets_; }
+    std::size_t ways() const { return ways_; }
+    std::size_t max_floats() const { return max_floats_; }
+
+    // Removes the named segment; attached processes keep their mapping.
+    static void unlink(const std::string& name);
+
+private:
+    struct Header;
+    struct Slot;
+
+    Slot* slot(std::size_t set, std::size_t way) const;
+    std::size_t set_of(const TensorKey& key) const;
+    pthread_mutex_t* set_lock(std::size_t set) const;
+    void lock_set(std::size_t set);
+    void unlock_set(std::size_t set);
+
+    std::size_t ways_ = 0;
+    std::size_t max_floats_ = 0;
+    std::size_t slot_bytes_ = 0;
+    std::size_t sets_ = 0;
+    std::size_t mapped_bytes_ = 0;
+    unsigned char* base_ = nullptr;
+    Header* header_ = nullptr;
+    // One cache line per set, holding the mutex of the process writing it.
+    unsigned char* locks_ = nullptr;
+    unsigned char* slots_ = nullptr;
+
+    // Counted per process; each worker reports its own hit rate.
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> inserts_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+};
+
+// Runs `pipeline` through the cache: the preprocessed intensities for
+// (raw spectrum, recipe_version, pipeline state) come from the cache when
+// present and are computed and inserted otherwise. `recipe_version` must change whenever
+// the pipeline's steps or their parameters do. Returns the QC verdict of
+// a computed run (cached tensors only exist for spectra that passed).
+QcResult preprocess_cached(SharedTensorCache& cache, const Pipeline& pipeline,
+                           std::uint32_t recipe_version, Spectrum& spectrum);
+
+}  // namespace probionis
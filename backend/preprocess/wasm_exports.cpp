@@ -0,0 +1,182 @@
+// C entry points of the browser build (Emscripten), so a web page can
+// extract features on the client with the server's own kernels. The page
+// builds one pipeline with the pb_add_* calls, then runs it per spectrum:
+//
+//   float* x = pb_alloc(n);       // copy the raw intensities into x
+//   int verdict = pb_run(x, n);   // 0: x now holds the preprocessed values
+//
+// Output is bit-identical to the server's preprocessing of the same input
+// (see runtime/vector_math.h and the QC SIMD128 path). Not part of the
+// native server build.
+
+#if defined(__EMSCRIPTEN__)
+
+#include <emscripten/emscripten.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "io/repeat_codec.h"
+#include "preprocess/absorbance.h"
+#include "preprocess/calibration_transfer.h"
+#include "preprocess/pipeline.h"
+
+namespace {
+
+using namespace probionis;
+
+// A page runs one pipeline on the main thread or in one worker, so plain
+// globals are enough.
+struct BrowserPipeline {
+    std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>();
+    std::shared_ptr<CalibrationRegistry> registry = std::make_shared<CalibrationRegistry>();
+    // Set once pb_add_calibration added its step; later calls only swap the
+    // operator.
+    bool calibrated = false;
+    std::string instrument_id;
+    Spectrum last;
+    std::unique_ptr<RepeatEncoder> repeats;
+    std::string repeat_bytes;
+    std::string error;
+};
+
+BrowserPipeline& state() {
+    static BrowserPipeline browser;
+    return browser;
+}
+
+// Runs `body`, turning an exception into pb_last_error() and -1.
+template <class Body>
+int guarded(Body body) {
+    try {
+        return body();
+    } catch (const std::exception& e) {
+        state().error = e.what();
+        return -1;
+    }
+}
+
+}  // namespace
+
+extern "C" {
+
+EMSCRIPTEN_KEEPALIVE float* pb_alloc(std::size_t floats) {
+    return static_cast<float*>(std::malloc(floats * sizeof(float)));
+}
+
+EMSCRIPTEN_KEEPALIVE void pb_free(float* p) { std::free(p); }
+
+// Drops every step, the QC gate and the calibration.
+EMSCRIPTEN_KEEPALIVE void pb_reset() { state() = BrowserPipeline(); }
+
+EMSCRIPTEN_KEEPALIVE int pb_add_absorbance(float floor) {
+    return guarded([&] {
+        state().pipeline->add(std::make_shared<AbsorbanceStep>(floor));
+        return 0;
+    });
+}
+
+// Adds calibration transfer with the operator in `bytes`, the contents of
+// a .pbcal file; every spectrum run is taken to come from its instrument.
+// Calling it again replaces the operator (e.g. after switching
+// instruments); the step keeps its place in the pipeline.
+EMSCRIPTEN_KEEPALIVE int pb_add_calibration(const char* bytes, std::size_t size) {
+    return guarded([&] {
+        BrowserPipeline& s = state();
+        std::istringstream in(std::string(bytes, size));
+        std::string instrument_id;
+        auto op = std::make_shared<BandedOperator>(
+            read_calibration(in, "calibration bytes", &instrument_id));
+        if (s.calibrated && instrument_id != s.instrument_id) {
+            s.registry->remove(s.instrument_id);
+        }
+        s.registry->put(instrument_id, std::move(op));
+        s.instrument_id = instrument_id;
+        if (!s.calibrated) {
+            s.pipeline->add(std::make_shared<CalibrationTransferStep>(s.registry, true));
+            s.calibrated = true;
+        }
+        return 0;
+    });
+}
+
+// Screens spectra with the default QC thresholds before any step.
+EMSCRIPTEN_KEEPALIVE void pb_enable_qc() {
+    state().pipeline->set_qc_gate(std::make_shared<QcGate>());
+}
+
+// Preprocesses `channels` intensities in place. Returns 0 on success, the
+// QcReason code when the gate rejects the spectrum (x is then unchanged),
+// or -1 with the message in pb_last_error().
+EMSCRIPTEN_KEEPALIVE int pb_run(float* x, std::size_t channels) {
+    return guarded([&] {
+        BrowserPipeline& s = state();
+        s.last.instrument_id = s.instrument_id;
+        s.last.axis.clear();
+        s.last.intensity.assign(x, x + channels);
+        const QcResult verdict = s.pipeline->run(s.last);
+        if (!verdict.ok()) {
+            return static_cast<int>(verdict.reason);
+        }
+        std::copy(s.last.intensity.begin(), s.last.intensity.end(), x);
+        return 0;
+    });
+}
+
+// Axis of the last successful run's output, or null if no step moved it
+// (calibration transfer resamples onto the reference instrument's axis).
+EMSCRIPTEN_KEEPALIVE const float* pb_output_axis() {
+    const Spectrum& last = state().last;
+    return last.axis.empty() ? nullptr : last.axis.data();
+}
+
+EMSCRIPTEN_KEEPALIVE const char* pb_qc_reason_name(int reason) {
+    return qc_reason_name(static_cast<QcReason>(reason));
+}
+
+// Repeated acquisitions of one sample, encoded for upload with
+// Content-Type application/x-probionis-repeats: pb_repeats_begin, then
+// pb_repeats_add per acquisition, then pb_repeats_finish, whose bytes stay
+// valid until the next pb_repeats_begin.
+EMSCRIPTEN_KEEPALIVE int pb_repeats_begin(std::size_t channels) {
+    return guarded([&] {
+        state().repeats = std::make_unique<RepeatEncoder>(channels);
+        return 0;
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE int pb_repeats_add(const float* acquisition) {
+    return guarded([&] {
+        if (!state().repeats) {
+            throw std::logic_error("pb_repeats_begin was not called");
+        }
+        state().repeats->add(acquisition);
+        return 0;
+    });
+}
+
+// Returns the encoded size, or -1; the bytes are at pb_repeats_data().
+EMSCRIPTEN_KEEPALIVE int pb_repeats_finish() {
+    return guarded([&] {
+        BrowserPipeline& s = state();
+        if (!s.repeats) {
+            throw std::logic_error("pb_repeats_begin was not called");
+        }
+        s.repeat_bytes = s.repeats->bytes();
+        return static_cast<int>(s.repeat_bytes.size());
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE const char* pb_repeats_data() { return state().repeat_bytes.data(); }
+
+EMSCRIPTEN_KEEPALIVE const char* pb_last_error() { return state().error.c_str(); }
+
+}  // extern "C"
+
+#endif  // __EMSCRIPTEN__
@@ -0,0 +1,237 @@
+#include "replay/capture_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <strings.h>
+
+#include "runtime/varint.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr char kCaptureMagic[4] = {'P', 'B', 'R', 'C'};
+constexpr std::uint32_t kCaptureVersion = 1;
+// Records popped per write() call on the writer thread.
+constexpr std::size_t kWriterBatch = 64;
+
+std::uint64_t splitmix64(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+}  // namespace
+
+bool is_credential_header(const std::string& name) {
+    static const char* const kCredentialHeaders[] = {
+        "authorization", "proxy-authorization", "cookie", "set-cookie", "x-api-key",
+        "x-auth-token", "x-csrf-token",
+    };
+    for (const char* credential : kCredentialHeaders) {
+        if (strcasecmp(name.c_str(), credential) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string encode_captured_request(const CapturedRequest& request) {
+    std::string out;
+    out.reserve(32 + request.method.size() + request.target.size() + request.body.size());
+    put_varint(out, request.offset_ns);
+    put_string(out, request.method);
+    put_string(out, request.target);
+    put_varint(out, request.headers.size());
+    for (const auto& [name, value] : request.headers) {
+        put_string(out, name);
+        put_string(out, value);
+    }
+    put_string(out, request.body);
+    put_varint(out, request.status);
+    put_varint(out, request.response_hash);
+    return out;
+}
+
+bool decode_captured_request(const char* data, std::size_t size, CapturedRequest& request) {
+    std::size_t offset = 0;
+    std::uint64_t value = 0;
+    std::uint64_t header_count = 0;
+    if (!get_varint(data, size, offset, request.offset_ns) ||
+        !get_string(data, size, offset, request.method) ||
+        !get_string(data, size, offset, request.target) ||
+        !get_varint(data, size, offset, header_count) || header_count > size) {
+        return false;
+    }
+    request.headers.resize(static_cast<std::size_t>(header_count));
+    for (auto& [name, header_value] : request.headers) {
+        if (!get_string(data, size, offset, name) ||
+            !get_string(data, size, offset, header_value)) {
+            return false;
+        }
+    }
+    if (!get_string(data, size, offset, request.body) ||
+        !get_varint(data, size, offset, value) ||
+        !get_varint(data, size, offset, request.response_hash)) {
+        return false;
+    }
+    request.status = static_cast<std::uint16_t>(value);
+    return offset == size;
+}
+
+CaptureWriter::CaptureWriter(const std::string& path, const CaptureOptions& options)
+    : file_(std::fopen(path.c_str(), "wb")),
+      options_(options),
+      start_(std::chrono::steady_clock::now()),
+      queue_(options.queue_capacity),
+      sample_state_(static_cast<std::uint64_t>(start_.time_since_epoch().count())) {
+    if (!file_) {
+        throw std::runtime_error("CaptureWriter: cannot open " + path + ": " +
+                                 std::strerror(errno));
+    }
+    if (std::fwrite(kCaptureMagic, 1, sizeof(kCaptureMagic), file_) != sizeof(kCaptureMagic) ||
+        std::fwrite(&kCaptureVersion, sizeof(kCaptureVersion), 1, file_) != 1) {
+        std::fclose(file_);
+        throw std::runtime_error("CaptureWriter: cannot write " + path);
+    }
+    writer_ = std::thread([this] { run_writer(); });
+}
+
+CaptureWriter::~CaptureWriter() { close(); }
+
+std::uint64_t CaptureWriter::now_offset_ns() const {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count());
+}
+
+void CaptureWriter::record(const CapturedRequest& request) {
+    if (options_.sample_rate < 1.0) {
+        const std::uint64_t draw =
+            splitmix64(sample_state_.fetch_add(1, std::memory_order_relaxed));
+        if (static_cast<double>(draw >> 11) * 0x1.0p-53 >= options_.sample_rate) {
+            sampled_out_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    std::string payload = encode_captured_request(request);
+    std::string framed;
+    framed.reserve(payload.size() + 5);
+    put_varint(framed, payload.size());
+    framed.append(payload);
+    std::shared_lock<std::shared_mutex> lock(close_mutex_);
+    if (queue_.closed() || !queue_.try_push(std::move(framed))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    recorded_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CaptureWriter::close() {
+    std::unique_lock<std::shared_mutex> lock(close_mutex_);
+    if (!writer_.joinable()) {
+        return;
+    }
+    queue_.close();
+    writer_.join();
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+CaptureStats CaptureWriter::stats() const {
+    CaptureStats stats;
+    stats.recorded = recorded_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.sampled_out = sampled_out_.load(std::memory_order_relaxed);
+    stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+    stats.write_failed = write_failed_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void CaptureWriter::run_writer() {
+    std::string batch[kWriterBatch];
+    bool failed = false;
+    while (true) {
+        const std::size_t count = queue_.pop_bulk(batch, kWriterBatch);
+        if (count == 0) {
+            break;
+        }
+        std::uint64_t bytes = 0;
+        std::size_t written = 0;
+        while (!failed && written < count &&
+               std::fwrite(batch[written].data(), 1, batch[written].size(), file_) ==
+                   batch[written].size()) {
+            bytes += batch[written++].size();
+        }
+        // Flushed per batch, so a failure is seen while its records are
+        // still known. The writer then stops, and stats().write_failed counts
+        // everything from the failing batch on: a torn record would make
+        // every later one unreadable, while a torn tail is skipped by readers.
+        if (!failed && (written < count || std::fflush(file_) != 0)) {
+            failed = true;
+        }
+        if (failed) {
+            write_failed_.fetch_add(count, std::memory_order_relaxed);
+        } else {
+            bytes_written_.fetch_add(bytes, std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            batch[i].clear();
+        }
+    }
+}
+
+CaptureReader::CaptureReader(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("CaptureReader: cannot open " + path);
+    }
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    data_ = contents.str();
+
+    std::uint32_t version = 0;
+    if (data_.size() < sizeof(kCaptureMagic) + sizeof(version) ||
+        std::memcmp(data_.data(), kCaptureMagic, sizeof(kCaptureMagic)) != 0) {
+        throw std::runtime_error("CaptureReader: " + path + " is not a capture log");
+    }
+    std::memcpy(&version, data_.data() + sizeof(kCaptureMagic), sizeof(version));
+    if (version != kCaptureVersion) {
+        throw std::runtime_error("CaptureReader: unsupported capture version");
+    }
+    offset_ = sizeof(kCaptureMagic) + sizeof(version);
+}
+
+bool CaptureReader::next(CapturedRequest& request) {
+    std::uint64_t length = 0;
+    std::size_t offset = offset_;
+    if (!get_varint(data_.data(), data_.size(), offset, length) ||
+        length > data_.size() - offset) {
+        return false;
+    }
+    if (!decode_captured_request(data_.data() + offset, static_cast<std::size_t>(length),
+                                 request)) {
+        throw std::runtime_error("CaptureReader: corrupt record");
+    }
+    offset_ = offset + static_cast<std::size_t>(length);
+    return true;
+}
+
+std::vector<CapturedRequest> CaptureReader::read_all(const std::string& path) {
+    CaptureReader reader(path);
+    std::vector<CapturedRequest> requests;
+    CapturedRequest request;
+    while (reader.next(request)) {
+        requests.push_back(std::move(request));
+        request = CapturedRequest();
+    }
+    return requests;
+}
+
+}  // namespace probionis
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "runtime/mpmc_queue.h"
+
+namespace probionis {
+
+// One production request as seen by the server, plus a fingerprint of the
+// reply so a replay can check that results did not change.
+struct CapturedRequest {
+    // Arrival time relative to the start of the capture.
+    std::uint64_t offset_ns = 0;
+    std::string method;
+    std::string target;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::uint16_t status = 0;
+    // fnv1a64 of the response body; 0 when unknown.
+    std::uint64_t response_hash = 0;
+};
+
+struct CaptureOptions {
+    // Records waiting for the writer thread. When full, new records are
+    // dropped (and counted) rather than slowing the request path.
+    std::size_t queue_capacity = 8192;
+    // Fraction of requests kept, decided per request.
+    double sample_rate = 1.0;
+};
+
+struct CaptureStats {
+    std::uint64_t recorded = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t sampled_out = 0;
+    std::uint64_t bytes_written = 0;
+    // Records that may not have reached the log because a write failed
+    // (e.g. a full disk). The writer stops at the first failure.
+    std::uint64_t write_failed = 0;
+};
+
+// Appends requests to a compact binary log. Request threads only format
+// the record and hand it to a bounded queue; a dedicated thread does the
+// file I/O, so capture overhead per request is one allocation and one
+// queue push.
+//
+// Layout: "PBRC" magic, u32 version, then records each prefixed by their
+// varint length so a truncated tail is detected and skipped on read.
+class CaptureWriter {
+public:
+    CaptureWriter(const std::string& path, const CaptureOptions& options = {});
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Nanoseconds since the writer was created, for CapturedRequest::offset_ns.
+    std::uint64_t now_offset_ns() const;
+
+    void record(const CapturedRequest& request);
+
+    // Drains the queue and closes the file; further records are dropped.
+    // Safe to call while other threads record.
+    void close();
+
+    CaptureStats stats() const;
+
+private:
+    void run_writer();
+
+    std::FILE* file_;
+    CaptureOptions options_;
+    // Held shared by record() around its push, and exclusively by close(),
+    // so no record lands in the queue after the writer has drained it.
+    std::shared_mutex close_mutex_;
+    std::chrono::steady_clock::time_point start_;
+    MpmcQueue<std::string> queue_;
+    std::thread writer_;
+    std::atomic<std::uint64_t> sample_state_;
+    std::atomic<std::uint64_t> recorded_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> sampled_out_{0};
+    std::atomic<std::uint64_t> bytes_written_{0};
+    std::atomic<std::uint64_t> write_failed_{0};
+};
+
+// Reads a capture log in file order. Records are ordered by completion,
+// not arrival; callers that care about arrival order sort by offset_ns.
+class CaptureReader {
+public:
+    explicit CaptureReader(const std::string& path);
+
+    // False at end of log. A truncated final record is treated as the end.
+    bool next(CapturedRequest& request);
+
+    static std::vector<CapturedRequest> read_all(const std::string& path);
+
+private:
+    std::string data_;
+    std::size_t offset_ = 0;
+};
+
+// True for headers that carry credentials (Authorization, Cookie, API keys
+// and the like). The server leaves these out of captured requests, so a
+// capture log never holds a secret; replays against a server that checks
+// them must supply their own.
+bool is_credential_header(const std::string& name);
+
+std::string encode_captured_request(const CapturedRequest& request);
+bool decode_captured_request(const char* data, std::size_t size, CapturedRequest& request);
+
+}  // namespace probionis
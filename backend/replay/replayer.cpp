@@ -0,0 +1,105 @@
+#include "replay/replayer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "net/http.h"
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+}  // namespace
+
+double ReplayReport::percentile_us(double p) const {
+    if (latencies_us.empty()) {
+        return 0.0;
+    }
+    const double rank = std::clamp(p, 0.0, 1.0) * static_cast<double>(latencies_us.size() - 1);
+    return latencies_us[static_cast<std::size_t>(std::llround(rank))];
+}
+
+ReplayReport replay(std::vector<CapturedRequest> requests, const ReplayOptions& options) {
+    std::stable_sort(requests.begin(), requests.end(),
+                     [](const CapturedRequest& a, const CapturedRequest& b) {
+                         return a.offset_ns < b.offset_ns;
+                     });
+
+    ReplayReport report;
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::uint64_t> transport_errors{0};
+    std::atomic<std::uint64_t> status_mismatches{0};
+    std::atomic<std::uint64_t> body_mismatches{0};
+    std::mutex latency_mutex;
+    const std::uint64_t first_offset = requests.empty() ? 0 : requests.front().offset_ns;
+    const Clock::time_point start = Clock::now();
+
+    auto drive = [&] {
+        HttpConnection connection(options.host, options.port);
+        std::vector<double> latencies;
+        HttpResponse response;
+        while (true) {
+            const std::size_t index = next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= requests.size()) {
+                break;
+            }
+            const CapturedRequest& request = requests[index];
+            // Latency counts from when the request was due, not when a
+            // connection got round to sending it, so a stalled server is
+            // charged for the queue it causes (coordinated omission).
+            Clock::time_point due = Clock::now();
+            if (options.speed > 0.0) {
+                const double due_ns =
+                    static_cast<double>(request.offset_ns - first_offset) / options.speed;
+                due = start + std::chrono::nanoseconds(static_cast<std::int64_t>(due_ns));
+                std::this_thread::sleep_until(due);
+            }
+            if (!connection.exchange(request.method, request.target, request.headers,
+                                     request.body, response)) {
+                transport_errors.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            latencies.push_back(
+                std::chrono::duration<double, std::micro>(Clock::now() - due).count());
+            if (!options.verify) {
+                continue;
+            }
+            if (request.status != 0 && response.status != request.status) {
+                status_mismatches.fetch_add(1, std::memory_order_relaxed);
+            } else if (request.response_hash != 0 &&
+                       fnv1a64(response.body.data(), response.body.size()) !=
+                           request.response_hash) {
+                body_mismatches.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        report.latencies_us.insert(report.latencies_us.end(), latencies.begin(), latencies.end());
+    };
+
+    std::vector<std::thread> threads;
+    const std::size_t connections = std::max<std::size_t>(1, options.connections);
+    threads.reserve(connections);
+    for (std::size_t i = 0; i < connections; ++i) {
+        threads.emplace_back(drive);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    report.wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.sent = requests.size();
+    report.transport_errors = transport_errors.load();
+    report.status_mismatches = status_mismatches.load();
+    report.body_mismatches = body_mismatches.load();
+    std::sort(report.latencies_us.begin(), report.latencies_us.end());
+    return report;
+}
+
+}  // namespace probionis
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "replay/capture_log.h"
+
+namespace probionis {
+
+struct ReplayOptions {
+    std::string host = "127.0.0.1";
+    std::uint16_t port = 8080;
+    // 1.0 replays with the captured inter-arrival times, 2.0 twice as fast,
+    // 0 sends as fast as the connections allow.
+    double speed = 1.0;
+    std::size_t connections = 8;
+    // Compare status and response-body hash with the captured ones.
+    bool verify = true;
+};
+
+struct ReplayReport {
+    std::uint64_t sent = 0;
+    std::uint64_t transport_errors = 0;
+    std::uint64_t status_mismatches = 0;
+    std::uint64_t body_mismatches = 0;
+    double wall_seconds = 0.0;
+    // Per-request latency in microseconds, sorted ascending. When paced,
+    // each is measured from the request's scheduled send time.
+    std::vector<double> latencies_us;
+
+    double percentile_us(double p) const;
+};
+
+// Re-drives captured requests against a server over HTTP/1.1 keep-alive
+// connections, preserving arrival order and (optionally scaled) timing.
+ReplayReport replay(std::vector<CapturedRequest> requests, const ReplayOptions& options);
+
+}  // namespace probionis
@@ -0,0 +1,246 @@
+#include "report/report_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include "storage/spectrum_pyramid.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr double kPlotWidth = 760.0;
+constexpr double kPlotHeight = 280.0;
+constexpr double kMarginLeft = 60.0;
+constexpr double kMarginBottom = 30.0;
+constexpr double kMarginTop = 10.0;
+// Envelope points drawn; the pyramid picks the level that fits.
+constexpr std::size_t kPlotPoints = 600;
+constexpr std::size_t kTopChannels = 10;
+constexpr int kAxisTicks = 5;
+
+void append_escaped(std::string& out, const std::string& s) {
+    for (const char c : s) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out.push_back(c);
+        }
+    }
+}
+
+void append_number(std::string& out, double value, const char* format = "%.4g") {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), format, value);
+    out += buffer;
+}
+
+void append_row(std::string& out, const char* name, double value,
+                const char* format = "%.4g") {
+    out += "<tr><th>";
+    out += name;
+    out += "</th><td>";
+    append_number(out, value, format);
+    out += "</td></tr>\n";
+}
+
+// Maps data coordinates onto the plot area.
+struct PlotScale {
+    double x0, x1, y0, y1;
+
+    double x(double v) const {
+        return kMarginLeft + (x1 > x0 ? (v - x0) / (x1 - x0) : 0.5) * (kPlotWidth - kMarginLeft);
+    }
+    double y(double v) const {
+        const double t = y1 > y0 ? (v - y0) / (y1 - y0) : 0.5;
+        return kMarginTop + (1.0 - t) * (kPlotHeight - kMarginTop - kMarginBottom);
+    }
+};
+
+std::vector<std::size_t> top_attributed(const std::vector<float>& attribution) {
+    std::vector<std::size_t> order(attribution.size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    const std::size_t keep = std::min(kTopChannels, order.size());
+    std::partial_sort(order.begin(), order.begin() + keep, order.end(),
+                      [&](std::size_t a, std::size_t b) {
+                          return std::fabs(attribution[a]) > std::fabs(attribution[b]);
+                      });
+    order.resize(keep);
+    return order;
+}
+
+void append_plot(std::string& out, const ReportInput& input,
+                 const std::vector<std::size_t>& top) {
+    const Spectrum& spectrum = input.spectrum;
+    out += "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+    append_number(out, kPlotWidth, "%.0f");
+    out += "\" height=\"";
+    append_number(out, kPlotHeight, "%.0f");
+    out += "\" role=\"img\">\n";
+    if (spectrum.size() < 2 || spectrum.axis.size() != spectrum.size()) {
+        out += "<text x=\"50%\" y=\"50%\" text-anchor=\"middle\">No spectrum</text>\n</svg>\n";
+        return;
+    }
+
+    std::shared_ptr<const SpectrumPyramid> pyramid = input.pyramid;
+    if (!pyramid) {
+        pyramid = std::make_shared<const SpectrumPyramid>(SpectrumPyramid::build(spectrum));
+    }
+    const PyramidSlice slice =
+        pyramid->query(spectrum.axis.front(), spectrum.axis.back(), kPlotPoints);
+    PlotScale scale{spectrum.axis.front(), spectrum.axis.back(), slice.bins[0].min,
+                    slice.bins[0].max};
+    for (std::size_t i = 0; i < slice.count; ++i) {
+        scale.y0 = std::min<double>(scale.y0, slice.bins[i].min);
+        scale.y1 = std::max<double>(scale.y1, slice.bins[i].max);
+    }
+
+    // Most attributed channels as bands behind the trace: red pushes the
+    // top prediction up, blue down.
+    const double peak = top.empty() ? 0.0 : std::fabs(input.attribution[top.front()]);
+    const double band = (kPlotWidth - kMarginLeft) / static_cast<double>(spectrum.size());
+    for (const std::size_t channel : top) {
+        const double weight = peak > 0.0 ? std::fabs(input.attribution[channel]) / peak : 0.0;
+        out += "<rect x=\"";
+        append_number(out, scale.x(spectrum.axis[channel]) - std::max(band, 2.0) / 2, "%.1f");
+        out += "\" y=\"";
+        append_number(out, kMarginTop, "%.0f");
+        out += "\" width=\"";
+        append_number(out, std::max(band, 2.0), "%.1f");
+        out += "\" height=\"";
+        append_number(out, kPlotHeight - kMarginTop - kMarginBottom, "%.0f");
+        out += input.attribution[channel] >= 0.0f ? "\" fill=\"#d62728\"" : "\" fill=\"#1f77b4\"";
+        out += " fill-opacity=\"";
+        append_number(out, 0.15 + 0.35 * weight, "%.2f");
+        out += "\"/>\n";
+    }
+
+    // Min/max envelope, then the mean trace over it.
+    out += "<polygon fill=\"#c7d7ea\" stroke=\"none\" points=\"";
+    for (std::size_t i = 0; i < slice.count; ++i) {
+        append_number(out, scale.x(slice.bins[i].x), "%.1f");
+        out += ',';
+        append_number(out, scale.y(slice.bins[i].max), "%.1f");
+        out += ' ';
+    }
+    for (std::size_t i = slice.count; i-- > 0;) {
+        append_number(out, scale.x(slice.bins[i].x), "%.1f");
+        out += ',';
+        append_number(out, scale.y(slice.bins[i].min), "%.1f");
+        out += ' ';
+    }
+    out += "\"/>\n<polyline fill=\"none\" stroke=\"#1a4f8b\" stroke-width=\"1\" points=\"";
+    for (std::size_t i = 0; i < slice.count; ++i) {
+        append_number(out, scale.x(slice.bins[i].x), "%.1f");
+        out += ',';
+        append_number(out, scale.y(slice.bins[i].mean), "%.1f");
+        out += ' ';
+    }
+    out += "\"/>\n";
+
+    const double baseline = kPlotHeight - kMarginBottom;
+    for (int t = 0; t <= kAxisTicks; ++t) {
+        const double v = scale.x0 + (scale.x1 - scale.x0) * t / kAxisTicks;
+        out += "<text font-size=\"11\" text-anchor=\"middle\" x=\"";
+        append_number(out, scale.x(v), "%.1f");
+        out += "\" y=\"";
+        append_number(out, baseline + 16, "%.0f");
+        out += "\">";
+        append_number(out, v, "%.0f");
+        out += "</text>\n";
+    }
+    for (const double v : {scale.y0, scale.y1}) {
+        out += "<text font-size=\"11\" text-anchor=\"end\" x=\"";
+        append_number(out, kMarginLeft - 4, "%.0f");
+        out += "\" y=\"";
+        append_number(out, scale.y(v) + 4, "%.1f");
+        out += "\">";
+        append_number(out, v);
+        out += "</text>\n";
+    }
+    out += "</svg>\n";
+}
+
+}  // namespace
+
+std::string render_report_html(const ReportInput& input) {
+    std::string out;
+    out.reserve(64 << 10);
+    out += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">\n<title>Sample ";
+    append_escaped(out, input.sample_id);
+    out += "</title>\n<style>\n"
+           "body{font-family:sans-serif;margin:24px;color:#222}\n"
+           "table{border-collapse:collapse;margin:8px 0 16px}\n"
+           "th,td{border:1px solid #ccc;padding:3px 8px;text-align:left}\n"
+           "tr.top td{font-weight:bold}\n.fail{color:#b00}\n"
+           "@media print{body{margin:0}}\n"
+           "</style></head><body>\n<h1>Sample ";
+    append_escaped(out, input.sample_id);
+    out += "</h1>\n<p>Tenant ";
+    append_escaped(out, input.tenant);
+    out += " &middot; instrument ";
+    append_escaped(out, input.spectrum.instrument_id);
+    out += " &middot; model ";
+    append_escaped(out, input.model_version);
+    out += "</p>\n";
+
+    const std::vector<std::size_t> top =
+        input.attribution.size() == input.spectrum.size() ? top_attributed(input.attribution)
+                                                           : std::vector<std::size_t>{};
+    out += "<h2>Spectrum</h2>\n";
+    append_plot(out, input, top);
+
+    out += "<h2>Prediction</h2>\n<table>\n<tr><th>Label</th><th>Score</th></tr>\n";
+    std::vector<std::pair<std::string, float>> predictions = input.predictions;
+    std::stable_sort(predictions.begin(), predictions.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    for (std::size_t i = 0; i < predictions.size(); ++i) {
+        out += i == 0 ? "<tr class=\"top\"><td>" : "<tr><td>";
+        append_escaped(out, predictions[i].first);
+        out += "</td><td>";
+        append_number(out, predictions[i].second, "%.4f");
+        out += "</td></tr>\n";
+    }
+    out += "</table>\n";
+
+    if (!top.empty()) {
+        out += "<h2>Explanation</h2>\n<table>\n"
+               "<tr><th>Position</th><th>Intensity</th><th>Attribution</th></tr>\n";
+        for (const std::size_t channel : top) {
+            out += "<tr><td>";
+            append_number(out, input.spectrum.axis[channel], "%.1f");
+            out += "</td><td>";
+            append_number(out, input.spectrum.intensity[channel]);
+            out += "</td><td>";
+            append_number(out, input.attribution[channel], "%+.4g");
+            out += "</td></tr>\n";
+        }
+        out += "</table>\n";
+    }
+
+    const QcStats& qc = input.qc.stats;
+    out += "<h2>Quality control</h2>\n<p";
+    out += input.qc.ok() ? ">Passed" : " class=\"fail\">Rejected: ";
+    if (!input.qc.ok()) {
+        out += qc_reason_name(input.qc.reason);
+    }
+    out += "</p>\n<table>\n";
+    append_row(out, "Channels", static_cast<double>(qc.channels), "%.0f");
+    append_row(out, "Mean intensity", qc.mean_intensity);
+    append_row(out, "Intensity range", qc.max_intensity - qc.min_intensity);
+    append_row(out, "Signal-to-noise", qc.snr, "%.1f");
+    append_row(out, "Saturated channels", static_cast<double>(qc.saturated), "%.0f");
+    append_row(out, "Spikes", static_cast<double>(qc.spikes), "%.0f");
+    append_row(out, "Baseline slope", qc.baseline_slope);
+    out += "</table>\n<p><small>Report template ";
+    append_number(out, kReportTemplateVersion, "%.0f");
+    out += "</small></p>\n</body></html>\n";
+    return out;
+}
+
+}  // namespace probionis
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "preprocess/qc_gate.h"
+#include "spectrum/spectrum.h"
+#include "storage/spectrum_pyramid.h"
+
+namespace probionis {
+
+// Bumped whenever render_report_html() changes what it draws, so cached
+// reports from an older layout are not served.
+constexpr std::uint32_t kReportTemplateVersion = 1;
+
+// Everything a per-sample report shows.
+struct ReportInput {
+    std::string sample_id;
+    std::string tenant;
+    std::string model_version;
+    // The spectrum as acquired, before preprocessing.
+    Spectrum spectrum;
+    // The spectrum's stored pyramid; when null the renderer builds one.
+    std::shared_ptr<const SpectrumPyramid> pyramid;
+    // Label and score per model output, in output order.
+    std::vector<std::pair<std::string, float>> predictions;
+    // Per-channel contribution to the top prediction, parallel to
+    // spectrum.axis; empty when the model has no explanation.
+    std::vector<float> attribution;
+    QcResult qc;
+};
+
+// Self-contained HTML page: inline SVG plot of the spectrum's intensity
+// envelope with the most influential regions shaded, the prediction
+// table, the top attributed channels and the QC statistics. No scripts or
+// external assets, so the page can be stored and served as a static blob
+// or printed to PDF by the browser.
+std::string render_report_html(const ReportInput& input);
+
+}  // namespace probionis
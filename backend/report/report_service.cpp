@@ -0,0 +1,463 @@
+#include "report/report_service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string path_of(const std::string& target) {
+    return target.substr(0, target.find('?'));
+}
+
+// The full (sample, model version, template version) triple, for exact
+// matching where report_key() only hashes it.
+std::string report_identity(const std::string& sample_id, const std::string& model_version) {
+    std::string identity = sample_id;
+    identity += '\0';
+    identity += model_version;
+    identity += '\0';
+    identity += std::to_string(kReportTemplateVersion);
+    return identity;
+}
+
+std::string hex_encode(const std::string& text) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string hex;
+    for (const char c : text) {
+        const auto byte = static_cast<unsigned char>(c);
+        hex += kHex[byte >> 4];
+        hex += kHex[byte & 15];
+    }
+    return hex;
+}
+
+// First line of every stored report. The triple is hex-encoded so no
+// sample ID can end the comment early.
+std::string report_marker(const std::string& identity) {
+    return "<!-- probionis-report " + hex_encode(identity) + " -->\n";
+}
+
+// Precedes the serialized pyramid in its file. The viewport endpoint has
+// no spectrum to check describes() against, so the file says whose it is.
+std::string pyramid_marker(const std::string& sample_id) {
+    return "probionis-pyramid " + hex_encode(sample_id) + "\n";
+}
+
+// Bins a viewport request may ask for; the default suits a plot a few
+// thousand pixels wide.
+constexpr std::size_t kDefaultViewportPoints = 2048;
+constexpr std::size_t kMaxViewportPoints = 65536;
+
+// Writes `size` bytes to `path` through a temporary name, so readers never
+// see a partial file. The temporary is unique to this write, as two
+// renders may store the same sample's pyramid at once.
+void write_file(const std::string& path, const void* data, std::size_t size) {
+    static std::atomic<std::uint64_t> sequence{0};
+    const std::string partial = path + ".partial." + std::to_string(::getpid()) + "." +
+                                std::to_string(sequence.fetch_add(1));
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!out) {
+            out.close();
+            std::remove(partial.c_str());
+            throw std::runtime_error("ReportService: cannot write " + partial);
+        }
+    }
+    if (std::rename(partial.c_str(), path.c_str()) != 0) {
+        std::remove(partial.c_str());
+        throw std::runtime_error("ReportService: cannot rename " + partial);
+    }
+}
+
+}  // namespace
+
+std::string report_key(const std::string& sample_id, const std::string& model_version,
+                       std::uint32_t template_version) {
+    std::uint64_t hash = fnv1a64(sample_id.data(), sample_id.size());
+    hash = fnv1a64("\0", 1, hash);
+    hash = fnv1a64(model_version.data(), model_version.size(), hash);
+    hash = fnv1a64(&template_version, sizeof(template_version), hash);
+    char key[24];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return key;
+}
+
+std::string pyramid_key(const std::string& sample_id) {
+    const std::uint64_t hash = fnv1a64(sample_id.data(), sample_id.size());
+    char key[24];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return key;
+}
+
+ReportService::ReportService(ReportServiceOptions options, ReportLoader loader,
+                             Executor& executor)
+    : options_(std::move(options)),
+      loader_(std::move(loader)),
+      executor_(executor),
+      hits_(global_metrics().counter("probionis_report_cache_hits_total",
+                                     "Report lookups answered from the cache")),
+      misses_(global_metrics().counter("probionis_report_cache_misses_total",
+                                       "Report lookups that had to queue a render")),
+      rendered_(global_metrics().counter("probionis_reports_rendered_total",
+                                         "Sample reports rendered")),
+      failures_(global_metrics().counter("probionis_report_render_failures_total",
+                                         "Report renders whose input could not be built")),
+      pyramids_loaded_(global_metrics().counter(
+          "probionis_report_pyramids_loaded_total",
+          "Report renders that reused the sample's stored spectrum pyramid")),
+      render_us_(global_metrics().histogram("probionis_report_render_us", latency_buckets_us(),
+                                            "Time to render and store one report")) {}
+
+ReportService::~ReportService() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+}
+
+bool ReportService::begin_locked(const std::string& identity, const std::string& key) {
+    Entry& entry = entries_[identity];
+    entry.key = key;
+    if (entry.state == ReportState::kRendering || entry.state == ReportState::kReady) {
+        return false;
+    }
+    entry.state = ReportState::kRendering;
+    entry.error.clear();
+    ++in_flight_;
+    return true;
+}
+
+void ReportService::prepare(ReportInput input) {
+    std::string identity = report_identity(input.sample_id, input.model_version);
+    std::string key = report_key(input.sample_id, input.model_version);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!begin_locked(identity, key)) {
+            return;
+        }
+    }
+    executor_.submit(
+        [this, identity = std::move(identity), key = std::move(key),
+         input = std::move(input)]() mutable { render(identity, key, std::move(input)); },
+        TaskPriority::kBackground);
+}
+
+ReportLookup ReportService::lookup(const std::string& sample_id,
+                                   const std::string& model_version) {
+    ReportLookup result;
+    result.key = report_key(sample_id, model_version);
+    const std::string identity = report_identity(sample_id, model_version);
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = entries_.find(identity);
+    if (it != entries_.end() && it->second.state != ReportState::kMissing) {
+        Entry& entry = it->second;
+        result.state = entry.state;
+        if (entry.state == ReportState::kReady) {
+            entry.last_used = ++clock_;
+            result.html = entry.html;
+            hits_.add();
+            return result;
+        }
+        if (entry.state == ReportState::kFailed) {
+            result.error = std::move(entry.error);
+            entries_.erase(it);
+        }
+        return result;
+    }
+
+    // Rendered earlier but trimmed from memory, or by a previous process.
+    lock.unlock();
+    std::shared_ptr<const std::string> html = read_from_disk(identity, result.key);
+    lock.lock();
+    if (html) {
+        Entry& entry = entries_[identity];
+        entry.key = result.key;
+        entry.last_used = ++clock_;
+        if (entry.state != ReportState::kReady) {
+            entry.state = ReportState::kReady;
+            entry.html = html;
+            cached_bytes_ += html->size();
+            trim_locked(identity);
+        }
+        hits_.add();
+        result.state = ReportState::kReady;
+        result.html = std::move(html);
+        return result;
+    }
+
+    misses_.add();
+    result.state = ReportState::kRendering;
+    if (!begin_locked(identity, result.key)) {
+        return result;
+    }
+    lock.unlock();
+    // Loading may block on storage; render on a compute worker afterwards.
+    executor_.submit_blocking([this, identity, key = result.key, sample_id, model_version] {
+        ReportInput input;
+        try {
+            if (!loader_) {
+                throw std::runtime_error("no report loader configured");
+            }
+            input = loader_(sample_id, model_version);
+        } catch (const std::exception& e) {
+            finish(identity, nullptr, e.what());
+            return;
+        }
+        executor_.submit(
+            [this, identity, key, input = std::move(input)]() mutable {
+                render(identity, key, std::move(input));
+            },
+            TaskPriority::kBackground);
+    });
+    return result;
+}
+
+void ReportService::render(const std::string& identity, const std::string& key,
+                           ReportInput input) {
+    const Clock::time_point start = Clock::now();
+    std::shared_ptr<const std::string> html;
+    try {
+        if (!input.pyramid) {
+            input.pyramid = pyramid_for(input);
+        }
+        html = std::make_shared<const std::string>(report_marker(identity) +
+                                                   render_report_html(input));
+        write_to_disk(key, *html);
+    } catch (const std::exception& e) {
+        finish(identity, nullptr, e.what());
+        return;
+    }
+    render_us_.record(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    finish(identity, std::move(html), std::string());
+}
+
+void ReportService::finish(const std::string& identity,
+                           std::shared_ptr<const std::string> html, std::string error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[identity];
+    if (html) {
+        // A lookup may have found the file on disk while this render ran.
+        if (entry.html) {
+            cached_bytes_ -= entry.html->size();
+        }
+        cached_bytes_ += html->size();
+        entry.state = ReportState::kReady;
+        entry.html = std::move(html);
+        entry.last_used = ++clock_;
+        rendered_.add();
+        trim_locked(identity);
+    } else if (entry.state != ReportState::kReady) {
+        entry.state = ReportState::kFailed;
+        entry.error = std::move(error);
+        failures_.add();
+    }
+    if (--in_flight_ == 0) {
+        idle_.notify_all();
+    }
+}
+
+void ReportService::trim_locked(const std::string& keep) {
+    while (cached_bytes_ > options_.memory_bytes) {
+        auto victim = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.state == ReportState::kReady && it->first != keep &&
+                (victim == entries_.end() || it->second.last_used < victim->second.last_used)) {
+                victim = it;
+            }
+        }
+        if (victim == entries_.end()) {
+            return;
+        }
+        cached_bytes_ -= victim->second.html->size();
+        entries_.erase(victim);
+    }
+}
+
+std::shared_ptr<const std::string> ReportService::read_from_disk(const std::string& identity,
+                                                                 const std::string& key) const {
+    if (options_.directory.empty()) {
+        return nullptr;
+    }
+    std::ifstream in(options_.directory + "/" + key + ".html", std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    auto html = std::make_shared<const std::string>(std::istreambuf_iterator<char>(in),
+                                                    std::istreambuf_iterator<char>());
+    // Another triple with the same report_key() may own the file.
+    const std::string marker = report_marker(identity);
+    if (html->compare(0, marker.size(), marker) != 0) {
+        return nullptr;
+    }
+    return html;
+}
+
+void ReportService::write_to_disk(const std::string& key, const std::string& html) const {
+    if (options_.directory.empty()) {
+        return;
+    }
+    write_file(options_.directory + "/" + key + ".html", html.data(), html.size());
+}
+
+std::shared_ptr<const SpectrumPyramid> ReportService::read_pyramid(
+    const std::string& sample_id) const {
+    if (options_.directory.empty()) {
+        return nullptr;
+    }
+    std::ifstream in(options_.directory + "/" + pyramid_key(sample_id) + ".pyramid",
+                     std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    const std::string bytes((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+    // Another sample with the same pyramid_key() may own the file.
+    const std::string marker = pyramid_marker(sample_id);
+    if (bytes.compare(0, marker.size(), marker) != 0) {
+        return nullptr;
+    }
+    try {
+        return std::make_shared<const SpectrumPyramid>(SpectrumPyramid::deserialize(
+            reinterpret_cast<const std::uint8_t*>(bytes.data()) + marker.size(),
+            bytes.size() - marker.size()));
+    } catch (const std::runtime_error&) {
+        return nullptr;  // corrupt or from an older format
+    }
+}
+
+std::shared_ptr<const SpectrumPyramid> ReportService::pyramid_for(
+    const ReportInput& input) const {
+    const Spectrum& spectrum = input.spectrum;
+    if (spectrum.axis.size() != spectrum.size()) {
+        return nullptr;  // the renderer draws no plot
+    }
+    if (options_.directory.empty()) {
+        return std::make_shared<const SpectrumPyramid>(SpectrumPyramid::build(spectrum));
+    }
+    if (auto stored = read_pyramid(input.sample_id); stored && stored->describes(spectrum)) {
+        pyramids_loaded_.add();
+        return stored;
+    }
+    // Missing or stale: rebuild and replace it.
+    auto built = std::make_shared<const SpectrumPyramid>(SpectrumPyramid::build(spectrum));
+    const std::vector<std::uint8_t> serialized = built->serialize();
+    std::string bytes = pyramid_marker(input.sample_id);
+    bytes.append(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    try {
+        write_file(options_.directory + "/" + pyramid_key(input.sample_id) + ".pyramid",
+                   bytes.data(), bytes.size());
+    } catch (const std::runtime_error&) {
+        // The report does not depend on it; the next render rebuilds it.
+    }
+    return built;
+}
+
+void ReportService::handle_viewport(const HttpRequest& request, HttpResponse& response) const {
+    const std::string sample_id = query_parameter(request.target, "sample_id");
+    if (sample_id.empty()) {
+        response.status = 400;
+        response.body = "sample_id is required\n";
+        return;
+    }
+    float bounds[2] = {-HUGE_VALF, HUGE_VALF};
+    const char* names[2] = {"x_lo", "x_hi"};
+    for (int i = 0; i < 2; ++i) {
+        const std::string value = query_parameter(request.target, names[i]);
+        char* end = nullptr;
+        if (!value.empty()) {
+            bounds[i] = std::strtof(value.c_str(), &end);
+        }
+        if (!value.empty() && (*end != '\0' || std::isnan(bounds[i]))) {
+            response.status = 400;
+            response.body = std::string(names[i]) + " must be a number\n";
+            return;
+        }
+    }
+    const std::string points = query_parameter(request.target, "points");
+    const std::size_t max_points =
+        points.empty() ? kDefaultViewportPoints
+                       : std::min<std::size_t>(std::strtoul(points.c_str(), nullptr, 10),
+                                               kMaxViewportPoints);
+    if (max_points == 0) {
+        response.status = 400;
+        response.body = "points must be a positive number\n";
+        return;
+    }
+
+    const std::shared_ptr<const SpectrumPyramid> pyramid = read_pyramid(sample_id);
+    if (!pyramid) {
+        response.status = 404;
+        response.body = "no stored spectrum pyramid for this sample; it is stored when the "
+                        "sample's first report renders\n";
+        return;
+    }
+    const PyramidSlice slice = pyramid->query(bounds[0], bounds[1], max_points);
+    response.status = 200;
+    response.headers.emplace_back("Content-Type", "application/octet-stream");
+    response.headers.emplace_back("Cache-Control", "private, no-cache");
+    response.headers.emplace_back("X-Probionis-Pyramid-Level", std::to_string(slice.level));
+    response.body.assign(reinterpret_cast<const char*>(slice.bins),
+                         slice.count * sizeof(PyramidBin));
+}
+
+bool ReportService::handle(const HttpRequest& request, HttpResponse& response) {
+    const std::string path = path_of(request.target);
+    if (path == "/reports/spectrum") {
+        handle_viewport(request, response);
+        return true;
+    }
+    if (path != "/reports") {
+        return false;
+    }
+    const std::string sample_id = query_parameter(request.target, "sample_id");
+    const std::string model_version = query_parameter(request.target, "model_version");
+    if (sample_id.empty() || model_version.empty()) {
+        response.status = 400;
+        response.body = "sample_id and model_version are required\n";
+        return true;
+    }
+
+    ReportLookup report = lookup(sample_id, model_version);
+    switch (report.state) {
+        case ReportState::kReady: {
+            const std::string etag = "\"" + report.key + "\"";
+            const std::string* match = find_header(request.headers, "If-None-Match");
+            response.status = match && *match == etag ? 304 : 200;
+            response.headers.emplace_back("ETag", etag);
+            response.headers.emplace_back("Cache-Control", "private, max-age=31536000, immutable");
+            if (response.status == 200) {
+                response.headers.emplace_back("Content-Type", "text/html; charset=utf-8");
+                response.body = *report.html;
+            }
+            break;
+        }
+        case ReportState::kFailed:
+            response.status = 500;
+            response.body = "report failed: " + report.error + "\n";
+            break;
+        default:
+            response.status = 202;
+            response.headers.emplace_back("Retry-After", "1");
+            response.body = "rendering\n";
+            break;
+    }
+    return true;
+}
+
+}  // namespace probionis
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "net/http.h"
+#include "report/report_renderer.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+// Gathers a stored sample's report input (spectrum, prediction, QC) for
+// a model version. May block on storage; runs on the blocking pool.
+using ReportLoader =
+    std::function<ReportInput(const std::string& sample_id, const std::string& model_version)>;
+
+struct ReportServiceOptions {
+    // Rendered reports are written here as <key>.html, where key is
+    // report_key(); the directory can be served as-is by a static file
+    // server. Each sample's spectrum pyramid is kept beside them as
+    // <pyramid_key()>.pyramid, built on its first render and read back by
+    // every later one and by the viewport endpoint. Empty keeps reports in
+    // memory only and builds pyramids per render.
+    std::string directory;
+    // Rendered reports kept in memory; older ones are re-read from disk.
+    std::size_t memory_bytes = std::size_t{64} << 20;
+};
+
+enum class ReportState : std::uint8_t { kMissing, kRendering, kReady, kFailed };
+
+struct ReportLookup {
+    ReportState state = ReportState::kMissing;
+    std::shared_ptr<const std::string> html;
+    // report_key() of the report; doubles as its ETag.
+    std::string key;
+    std::string error;
+};
+
+// Hex name of the report for (sample, model version, template version).
+// The triple fixes the content, so a report never changes once rendered.
+// The name is a hash, so each report file opens with a comment naming its
+// triple, and a file read back for a different triple counts as a miss.
+std::string report_key(const std::string& sample_id, const std::string& model_version,
+                       std::uint32_t template_version = kReportTemplateVersion);
+
+// Hex name of a sample's stored pyramid. A pyramid is only used for a
+// spectrum it describes(), so a name shared by two samples costs a rebuild.
+std::string pyramid_key(const std::string& sample_id);
+
+// Renders per-sample reports on background tasks and serves them from a
+// cache keyed by (sample, model version, template version). Scoring calls
+// prepare() after replying, so by the time the UI asks, the report is a
+// cached blob; a report nobody prepared is rendered on its first request,
+// which is answered 202 until it is ready. Request threads never render.
+class ReportService {
+public:
+    ReportService(ReportServiceOptions options, ReportLoader loader,
+                  Executor& executor = shared_executor());
+    // Waits for renders in flight.
+    ~ReportService();
+
+    ReportService(const ReportService&) = delete;
+    ReportService& operator=(const ReportService&) = delete;
+
+    // Queues rendering of a report whose input is already at hand.
+    void prepare(ReportInput input);
+
+    // The cached report, or its state; a miss queues rendering through the
+    // loader and returns kRendering. A failed render is reported once and
+    // retried on the next lookup.
+    ReportLookup lookup(const std::string& sample_id, const std::string& model_version);
+
+    // GET /reports?sample_id=ID&model_version=V: 200 with the report and
+    // private immutable cache headers (reports hold patient data, so shared
+    // caches must not keep them), 304 on a matching If-None-Match, 202 with
+    // Retry-After while rendering.
+    //
+    // GET /reports/spectrum?sample_id=ID[&x_lo=X][&x_hi=X][&points=N]: the
+    // stored pyramid's bins covering [x_lo, x_hi] (default: everything)
+    // from the finest level needing at most N of them (default 2048), as
+    // raw PyramidBin structs with the level in X-Probionis-Pyramid-Level,
+    // for zooming the report's plot without re-reading the spectrum. 404
+    // until the sample's first report has rendered.
+    //
+    // Returns false for any other target.
+    bool handle(const HttpRequest& request, HttpResponse& response);
+
+private:
+    // Keyed by the full triple rather than report_key(), which can collide.
+    struct Entry {
+        std::string key;
+        ReportState state = ReportState::kMissing;
+        std::shared_ptr<const std::string> html;
+        std::string error;
+        std::uint64_t last_used = 0;
+    };
+
+    // Starts a render unless one is in flight or done; true if it did.
+    bool begin_locked(const std::string& identity, const std::string& key);
+    void render(const std::string& identity, const std::string& key, ReportInput input);
+    // The sample's stored pyramid, or a new one, stored for next time.
+    std::shared_ptr<const SpectrumPyramid> pyramid_for(const ReportInput& input) const;
+    // The stored pyramid if there is one for `sample_id`, unchecked against
+    // its spectrum.
+    std::shared_ptr<const SpectrumPyramid> read_pyramid(const std::string& sample_id) const;
+    void handle_viewport(const HttpRequest& request, HttpResponse& response) const;
+    void finish(const std::string& identity, std::shared_ptr<const std::string> html,
+                std::string error);
+    // The stored report if it exists and was rendered for `identity`.
+    std::shared_ptr<const std::string> read_from_disk(const std::string& identity,
+                                                      const std::string& key) const;
+    void write_to_disk(const std::string& key, const std::string& html) const;
+    // Evicts least recently used reports, never the one under `keep`.
+    void trim_locked(const std::string& keep);
+
+    ReportServiceOptions options_;
+    ReportLoader loader_;
+    Executor& executor_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::size_t cached_bytes_ = 0;
+    std::size_t in_flight_ = 0;
+    std::uint64_t clock_ = 0;
+
+    Counter& hits_;
+    Counter& misses_;
+    Counter& rendered_;
+    Counter& failures_;
+    Counter& pyramids_loaded_;
+    Histogram& render_us_;
+};
+
+}  // namespace probionis
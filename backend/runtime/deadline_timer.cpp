@@ -0,0 +1,78 @@
+#include "runtime/deadline_timer.h"
+
+namespace probionis {
+
+DeadlineTimer::DeadlineTimer() : thread_([this] { run(); }) {}
+
+DeadlineTimer::~DeadlineTimer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+DeadlineTimer::Id DeadlineTimer::schedule(Clock::time_point when,
+                                          std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Id id = next_id_++;
+    const auto it = queue_.emplace(when, std::make_pair(id, std::move(callback)));
+    by_id_.emplace(id, it);
+    // Only a new earliest deadline changes how long the thread sleeps.
+    if (it == queue_.begin()) {
+        changed_.notify_one();
+    }
+    return id;
+}
+
+bool DeadlineTimer::cancel(Id id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto found = by_id_.find(id);
+    if (found == by_id_.end()) {
+        return false;
+    }
+    queue_.erase(found->second);
+    by_id_.erase(found);
+    return true;
+}
+
+std::size_t DeadlineTimer::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void DeadlineTimer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (queue_.empty()) {
+            changed_.wait(lock);
+            continue;
+        }
+        const auto first = queue_.begin();
+        if (Clock::now() < first->first) {
+            changed_.wait_until(lock, first->first);
+            continue;
+        }
+        std::function<void()> callback = std::move(first->second.second);
+        by_id_.erase(first->second.first);
+        queue_.erase(first);
+        // Callbacks may schedule or cancel, so they run unlocked.
+        lock.unlock();
+        try {
+            callback();
+        } catch (...) {
+            // One component's failing callback must not stop everyone's.
+        }
+        lock.lock();
+    }
+}
+
+DeadlineTimer& shared_timer() {
+    // Never destroyed, like shared_executor(): components scheduled on it
+    // may outlive static destruction order.
+    static DeadlineTimer* timer = new DeadlineTimer();
+    return *timer;
+}
+
+}  // namespace probionis
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace probionis {
+
+// One thread that runs callbacks at their deadlines, so components that
+// only need to wake up now and then (batch sealing deadlines) share it
+// instead of each parking a thread of its own. Callbacks run on the timer
+// thread one at a time and must be short: anything heavier goes to the
+// executor. An exception from a callback is dropped.
+class DeadlineTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Id = std::uint64_t;
+
+    DeadlineTimer();
+    // Pending callbacks are dropped, not run.
+    ~DeadlineTimer();
+
+    DeadlineTimer(const DeadlineTimer&) = delete;
+    DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+
+    // Runs `callback` at `when`, or at once if that has passed. Never 0.
+    Id schedule(Clock::time_point when, std::function<void()> callback);
+
+    // Drops a pending callback. False if it has already started (or ran),
+    // in which case the caller must not assume it is done.
+    bool cancel(Id id);
+
+    std::size_t pending() const;
+
+private:
+    using Queue = std::multimap<Clock::time_point, std::pair<Id, std::function<void()>>>;
+
+    void run();
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    Queue queue_;
+    std::unordered_map<Id, Queue::iterator> by_id_;
+    Id next_id_ = 1;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+// Process-wide timer, started on first use and alive until exit.
+DeadlineTimer& shared_timer();
+
+}  // namespace probionis
@@ -0,0 +1,488 @@
+#include "runtime/executor.h"
+
+#include <algorithm>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <time.h>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+// Guards one worker's deques. Critical sections are a handful of
+// instructions, so spinning beats parking.
+class SpinLock {
+public:
+    void lock() {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            cpu_relax();
+        }
+    }
+    bool try_lock() { return !flag_.test_and_set(std::memory_order_acquire); }
+    void unlock() { flag_.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+thread_local const Executor* tl_executor = nullptr;
+thread_local int tl_worker = -1;
+// Lane of the task the worker is running, which may be the other lane's.
+thread_local ExecutionLane tl_lane = ExecutionLane::kThroughput;
+thread_local TaskPriority tl_priority = TaskPriority::kNormal;
+thread_local CpuAccount* tl_cpu_account = nullptr;
+
+constexpr std::size_t lane_index(ExecutionLane lane) { return static_cast<std::size_t>(lane); }
+
+void check_cpus(const std::vector<int>& cpus) {
+    for (const int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            throw std::invalid_argument("Executor: bad CPU " + std::to_string(cpu));
+        }
+    }
+}
+
+// Blocking pool size out of `total` threads; one compute worker remains.
+std::size_t blocking_share(const ExecutorOptions& options, std::size_t total) {
+    const std::size_t blocking = options.blocking_threads != 0
+                                     ? options.blocking_threads
+                                     : std::max<std::size_t>(1, total / 8);
+    return std::min(blocking, total - 1);
+}
+
+// 0 or the pthread_setaffinity_np error.
+int pin_thread(std::thread& thread, const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return 0;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+std::mutex g_shared_mutex;
+std::atomic<Executor*> g_shared_executor{nullptr};
+ExecutorOptions g_shared_options;
+
+}  // namespace
+
+struct alignas(kCacheLineSize) Executor::Worker {
+    SpinLock lock;
+    std::deque<Task> queues[kTaskPriorityCount];
+    std::thread thread;
+    std::atomic<std::uint64_t> executed{0};
+    std::atomic<std::uint64_t> stolen{0};
+    std::atomic<std::uint64_t> failed{0};
+    std::atomic<std::uint64_t> lent{0};
+    std::atomic<std::uint64_t> borrowed{0};
+};
+
+Executor::Executor(const ExecutorOptions& options)
+    : blocking_queue_(options.blocking_queue_capacity),
+      lend_after_(std::chrono::duration_cast<Clock::duration>(options.lend_after)) {
+    const std::size_t total = resolved_thread_count(options);
+    const std::size_t blocking = blocking_share(options, total);
+    const std::size_t compute = total - blocking;
+    if (options.latency_threads < compute) {
+        latency_workers_ = options.latency_threads;
+    }
+    latency_active_at_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    check_cpus(options.latency_cpus);
+    check_cpus(options.throughput_cpus);
+
+    workers_.reserve(compute);
+    for (std::size_t i = 0; i < compute; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < compute; ++i) {
+        workers_[i]->thread = std::thread([this, i] { run_worker(i); });
+    }
+    for (std::size_t i = 0; i < compute; ++i) {
+        const int error = pin_thread(workers_[i]->thread, lane_of(i) == ExecutionLane::kLatency
+                                                               ? options.latency_cpus
+                                                               : options.throughput_cpus);
+        if (error != 0) {
+            // E.g. a CPU outside the process's allowed set.
+            stopping_.store(true, std::memory_order_release);
+            for (Lane& lane : lanes_) {
+                lane.work_available.notify_all();
+            }
+            for (auto& worker : workers_) {
+                worker->thread.join();
+            }
+            throw std::system_error(error, std::generic_category(),
+                                    "Executor: cannot pin worker");
+        }
+    }
+    blocking_threads_.reserve(blocking);
+    for (std::size_t i = 0; i < blocking; ++i) {
+        blocking_threads_.emplace_back([this] { run_blocking_worker(); });
+    }
+}
+
+Executor::~Executor() {
+    // Workers drain what is queued before exiting.
+    stopping_.store(true, std::memory_order_release);
+    for (Lane& lane : lanes_) {
+        lane.work_available.notify_all();
+    }
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+    blocking_queue_.close();
+    for (auto& thread : blocking_threads_) {
+        thread.join();
+    }
+}
+
+void Executor::submit(Task task, TaskPriority priority, int affinity) {
+    const bool on_worker = tl_executor == this;
+    ExecutionLane lane = ExecutionLane::kThroughput;
+    if (priority == TaskPriority::kInteractive && partitioned() &&
+        !(on_worker && tl_lane == ExecutionLane::kThroughput)) {
+        lane = ExecutionLane::kLatency;
+    }
+    Lane& target = lanes_[lane_index(lane)];
+    const std::size_t first = lane == ExecutionLane::kLatency ? 0 : latency_workers_;
+    const std::size_t count = lane_worker_count(lane);
+    std::size_t index;
+    if (affinity >= 0) {
+        index = first + static_cast<std::size_t>(affinity) % count;
+    } else if (on_worker && lane_of(static_cast<std::size_t>(tl_worker)) == lane) {
+        index = static_cast<std::size_t>(tl_worker);
+    } else {
+        index = first + target.next_worker.fetch_add(1, std::memory_order_relaxed) % count;
+    }
+
+    if (lane == ExecutionLane::kLatency) {
+        latency_active_at_.store(Clock::now().time_since_epoch().count(),
+                                 std::memory_order_relaxed);
+    }
+    // Counted before it is published: a worker may pop the task and
+    // decrement as soon as the lock is released, and the count must never
+    // wrap below zero. A worker that sees the count first just retries
+    // until the push lands.
+    const std::size_t queued = target.pending.fetch_add(1, std::memory_order_acq_rel) + 1;
+    Worker& worker = *workers_[index];
+    {
+        std::lock_guard<SpinLock> guard(worker.lock);
+        worker.queues[static_cast<std::size_t>(priority)].push_back(std::move(task));
+    }
+    // With the lane's own workers all busy, or more latency tasks queued
+    // than latency workers, wake one from the other lane if it may help.
+    const bool idle_worker = target.work_available.has_waiters();
+    target.work_available.notify_one();
+    if (partitioned() && (!idle_worker || (lane == ExecutionLane::kLatency &&
+                                           queued > latency_workers_))) {
+        if (lane == ExecutionLane::kLatency) {
+            lanes_[lane_index(ExecutionLane::kThroughput)].work_available.notify_one();
+        } else if (may_lend()) {
+            lanes_[lane_index(ExecutionLane::kLatency)].work_available.notify_one();
+        }
+    }
+}
+
+void Executor::submit_blocking(Task task) {
+    if (!blocking_queue_.push(std::move(task))) {
+        throw std::runtime_error("Executor: submit_blocking after shutdown");
+    }
+}
+
+int Executor::current_worker() const { return tl_executor == this ? tl_worker : -1; }
+
+TaskPriority Executor::current_priority() const {
+    return tl_executor == this ? tl_priority : TaskPriority::kNormal;
+}
+
+std::size_t Executor::lane_worker_count(ExecutionLane lane) const {
+    return lane == ExecutionLane::kLatency ? latency_workers_
+                                           : workers_.size() - latency_workers_;
+}
+
+ExecutionLane Executor::lane_of(std::size_t worker) const {
+    return worker < latency_workers_ ? ExecutionLane::kLatency : ExecutionLane::kThroughput;
+}
+
+ExecutorStats Executor::stats() const {
+    ExecutorStats stats;
+    for (const auto& worker : workers_) {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+        stats.failed += worker->failed.load(std::memory_order_relaxed);
+        stats.lent += worker->lent.load(std::memory_order_relaxed);
+        stats.borrowed += worker->borrowed.load(std::memory_order_relaxed);
+    }
+    stats.failed += blocking_failed_.load(std::memory_order_relaxed);
+    stats.blocking_executed = blocking_executed_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool Executor::take_from_lane(std::size_t self, ExecutionLane lane, Task& task,
+                              TaskPriority& priority) {
+    const std::size_t first = lane == ExecutionLane::kLatency ? 0 : latency_workers_;
+    const std::size_t count = lane_worker_count(lane);
+    const bool member = lane_of(self) == lane;
+    Worker& own = *workers_[self];
+    for (std::size_t p = 0; p < kTaskPriorityCount; ++p) {
+        if (member) {
+            std::lock_guard<SpinLock> guard(own.lock);
+            auto& queue = own.queues[p];
+            if (!queue.empty()) {
+                task = std::move(queue.back());
+                queue.pop_back();
+                priority = static_cast<TaskPriority>(p);
+                return true;
+            }
+        }
+        // Members start after themselves, so they spread over victims.
+        const std::size_t start = member ? self - first + 1 : 0;
+        for (std::size_t k = 0; k < count; ++k) {
+            const std::size_t victim_index = first + (start + k) % count;
+            if (victim_index == self) {
+                continue;
+            }
+            Worker& victim = *workers_[victim_index];
+            // A busy victim is skipped rather than waited on; the outer loop
+            // in run_worker() comes back if work is still pending.
+            if (!victim.lock.try_lock()) {
+                continue;
+            }
+            auto& queue = victim.queues[p];
+            if (!queue.empty()) {
+                task = std::move(queue.front());
+                queue.pop_front();
+                victim.lock.unlock();
+                own.stolen.fetch_add(1, std::memory_order_relaxed);
+                priority = static_cast<TaskPriority>(p);
+                return true;
+            }
+            victim.lock.unlock();
+        }
+    }
+    return false;
+}
+
+bool Executor::find_task(std::size_t self, Task& task, ExecutionLane& lane,
+                         TaskPriority& priority) {
+    lane = lane_of(self);
+    if (take_from_lane(self, lane, task, priority)) {
+        return true;
+    }
+    if (!partitioned()) {
+        return false;
+    }
+    Worker& own = *workers_[self];
+    if (lane == ExecutionLane::kThroughput) {
+        if (lanes_[lane_index(ExecutionLane::kLatency)].pending.load(std::memory_order_acquire) >
+                0 &&
+            take_from_lane(self, ExecutionLane::kLatency, task, priority)) {
+            own.borrowed.fetch_add(1, std::memory_order_relaxed);
+            lane = ExecutionLane::kLatency;
+            return true;
+        }
+        return false;
+    }
+    if (lanes_[lane_index(ExecutionLane::kThroughput)].pending.load(std::memory_order_acquire) ==
+            0 ||
+        !may_lend()) {
+        return false;
+    }
+    // Reserve the loan first so concurrent lenders cannot take the last
+    // free latency worker.
+    if (lent_.fetch_add(1, std::memory_order_acq_rel) + 1 >= latency_workers_) {
+        lent_.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    if (take_from_lane(self, ExecutionLane::kThroughput, task, priority)) {
+        own.lent.fetch_add(1, std::memory_order_relaxed);
+        lane = ExecutionLane::kThroughput;
+        // Pass the loan on: sleeping latency workers are not woken by
+        // throughput submissions while throughput workers are idle.
+        if (may_lend()) {
+            lanes_[lane_index(ExecutionLane::kLatency)].work_available.notify_one();
+        }
+        return true;
+    }
+    lent_.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+}
+
+bool Executor::may_lend() const {
+    const Lane& latency = lanes_[lane_index(ExecutionLane::kLatency)];
+    if (latency_workers_ < 2 || lent_.load(std::memory_order_acquire) + 1 >= latency_workers_ ||
+        latency.pending.load(std::memory_order_acquire) > 0 ||
+        latency.running.load(std::memory_order_acquire) > 0) {
+        return false;
+    }
+    const Clock::rep idle_since = latency_active_at_.load(std::memory_order_relaxed);
+    return Clock::now().time_since_epoch().count() - idle_since >= lend_after_.count();
+}
+
+bool Executor::has_work_for(std::size_t index) const {
+    const std::size_t latency =
+        lanes_[lane_index(ExecutionLane::kLatency)].pending.load(std::memory_order_acquire);
+    const std::size_t throughput =
+        lanes_[lane_index(ExecutionLane::kThroughput)].pending.load(std::memory_order_acquire);
+    if (lane_of(index) == ExecutionLane::kThroughput) {
+        return throughput > 0 || latency > 0;
+    }
+    return latency > 0 || (throughput > 0 && may_lend());
+}
+
+void Executor::run_worker(std::size_t index) {
+    tl_executor = this;
+    tl_worker = static_cast<int>(index);
+    Worker& self = *workers_[index];
+    const ExecutionLane home = lane_of(index);
+    Lane& home_lane = lanes_[lane_index(home)];
+    Lane& latency = lanes_[lane_index(ExecutionLane::kLatency)];
+    Task task;
+    ExecutionLane lane;
+    TaskPriority priority;
+    while (true) {
+        if (find_task(index, task, lane, priority)) {
+            lanes_[lane_index(lane)].pending.fetch_sub(1, std::memory_order_acq_rel);
+            const bool latency_task = lane == ExecutionLane::kLatency;
+            if (latency_task) {
+                latency.running.fetch_add(1, std::memory_order_acq_rel);
+            }
+            tl_lane = lane;
+            tl_priority = priority;
+            try {
+                task();
+            } catch (...) {
+                self.failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            task = nullptr;
+            self.executed.fetch_add(1, std::memory_order_relaxed);
+            if (latency_task) {
+                latency_active_at_.store(Clock::now().time_since_epoch().count(),
+                                         std::memory_order_relaxed);
+                latency.running.fetch_sub(1, std::memory_order_acq_rel);
+            } else if (home == ExecutionLane::kLatency) {
+                lent_.fetch_sub(1, std::memory_order_acq_rel);
+            }
+            continue;
+        }
+        if (has_work_for(index)) {
+            // Work exists but every victim was locked; retry.
+            cpu_relax();
+            continue;
+        }
+        if (stopping_.load(std::memory_order_acquire)) {
+            break;
+        }
+        const auto ready = [this, index] {
+            return has_work_for(index) || stopping_.load(std::memory_order_acquire);
+        };
+        // A latency worker with throughput work waiting wakes when the
+        // lane's idle period would allow a loan. Once that time has passed
+        // and it still may not lend, the lane is busy or lent out, and the
+        // next latency task or loan wakes it instead.
+        const Clock::time_point lend_at =
+            Clock::time_point(Clock::duration(latency_active_at_.load(std::memory_order_relaxed))) +
+            lend_after_;
+        if (home == ExecutionLane::kLatency && latency_workers_ > 1 &&
+            lanes_[lane_index(ExecutionLane::kThroughput)].pending.load(
+                std::memory_order_acquire) > 0 &&
+            lend_at > Clock::now()) {
+            home_lane.work_available.wait_until(ready, lend_at);
+        } else {
+            home_lane.work_available.wait_until(ready);
+        }
+    }
+    tl_executor = nullptr;
+    tl_worker = -1;
+}
+
+void Executor::run_blocking_worker() {
+    Task task;
+    while (blocking_queue_.pop(task)) {
+        try {
+            task();
+        } catch (...) {
+            blocking_failed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        task = nullptr;
+        blocking_executed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::uint64_t thread_cpu_ns() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+CpuAccount* current_cpu_account() { return tl_cpu_account; }
+
+ScopedCpuAccount::ScopedCpuAccount(CpuAccount* account)
+    : previous_(std::exchange(tl_cpu_account, account)) {}
+
+ScopedCpuAccount::~ScopedCpuAccount() { tl_cpu_account = previous_; }
+
+std::size_t resolved_thread_count(const ExecutorOptions& options) {
+    // One compute worker and one blocking thread, so neither kind of task
+    // can starve the other.
+    if (options.threads != 0) {
+        return std::max<std::size_t>(2, options.threads);
+    }
+    return std::max<unsigned>(2, std::thread::hardware_concurrency());
+}
+
+ThreadBudget split_thread_budget(const ExecutorOptions& options) {
+    const std::size_t total = resolved_thread_count(options);
+    ThreadBudget budget;
+    budget.blocking = blocking_share(options, total);
+    budget.connections = options.connection_threads != 0
+                             ? options.connection_threads
+                             : std::max<std::size_t>(1, total / 4);
+    budget.connections = std::min(budget.connections, total - budget.blocking - 1);
+    budget.compute = total - budget.blocking - budget.connections;
+    return budget;
+}
+
+void configure_shared_executor(const ExecutorOptions& options) {
+    std::lock_guard<std::mutex> lock(g_shared_mutex);
+    if (g_shared_executor.load(std::memory_order_acquire)) {
+        throw std::logic_error("configure_shared_executor: executor already running");
+    }
+    g_shared_options = options;
+}
+
+Executor& shared_executor() {
+    // Called on every submit from subsystems, so the common case is a
+    // single acquire load. The executor lives until process exit.
+    if (Executor* executor = g_shared_executor.load(std::memory_order_acquire)) {
+        return *executor;
+    }
+    std::lock_guard<std::mutex> lock(g_shared_mutex);
+    Executor* executor = g_shared_executor.load(std::memory_order_relaxed);
+    if (!executor) {
+        // HttpServer connections take their share of the budget outside
+        // the executor.
+        const ThreadBudget budget = split_thread_budget(g_shared_options);
+        ExecutorOptions options = g_shared_options;
+        options.threads = budget.compute + budget.blocking;
+        options.blocking_threads = budget.blocking;
+        executor = new Executor(options);
+        g_shared_executor.store(executor, std::memory_order_release);
+    }
+    return *executor;
+}
+
+ExecutorOptions shared_executor_options() {
+    std::lock_guard<std::mutex> lock(g_shared_mutex);
+    return g_shared_options;
+}
+
+}  // namespace probionis
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "runtime/futex.h"
+#include "runtime/mpmc_queue.h"
+
+namespace probionis {
+
+using Task = std::function<void()>;
+
+// Scheduling class of a compute task. Workers drain every queue of a higher
+// class (their own first, then by stealing) before touching a lower one.
+enum class TaskPriority : std::uint8_t {
+    kInteractive = 0,  // single-sample requests waiting on a reply
+    kNormal = 1,       // batching, inference, storage writes
+    kBackground = 2,   // bulk rescoring, shadow models, report rendering
+};
+
+constexpr std::size_t kTaskPriorityCount = 3;
+
+// Partition of the compute workers (see ExecutorOptions::latency_threads).
+enum class ExecutionLane : std::uint8_t {
+    kLatency = 0,     // reserved for kInteractive tasks
+    kThroughput = 1,  // everything else
+};
+
+constexpr std::size_t kExecutionLaneCount = 2;
+
+struct ExecutorOptions {
+    // The one knob: total threads the backend may keep busy, compute
+    // workers and blocking pool together. 0 means one per hardware thread.
+    // At least 2 are used: one compute worker and one blocking thread.
+    std::size_t threads = 0;
+    // Threads reserved for tasks that block on I/O, carved out of `threads`
+    // and capped so one compute worker remains. 0 picks max(1, threads / 8).
+    std::size_t blocking_threads = 0;
+    // Capacity of the blocking-task queue; submitters wait when it is full.
+    std::size_t blocking_queue_capacity = 4096;
+    // Shared executor only: threads set aside for HttpServer connections,
+    // which live outside the executor but count against `threads` all the
+    // same. Carved out after the blocking pool and capped so one compute
+    // worker remains. 0 picks max(1, threads / 4).
+    std::size_t connection_threads = 0;
+    // Compute workers reserved for kInteractive tasks, so single-sample
+    // requests never queue behind bulk batches on a busy core. 0 keeps one
+    // lane for every priority. Ignored unless both lanes get a worker.
+    std::size_t latency_threads = 0;
+    // Once the latency lane has had no work for this long, all but one of
+    // its workers may run throughput tasks until interactive work returns.
+    std::chrono::microseconds lend_after{2000};
+    // CPUs each lane's workers are pinned to, e.g. whole cores for the
+    // latency lane so bulk work never shares their caches. Empty leaves
+    // placement to the OS. With one lane every worker is a throughput
+    // worker. Lent workers stay on their own lane's CPUs.
+    std::vector<int> latency_cpus;
+    std::vector<int> throughput_cpus;
+};
+
+struct ExecutorStats {
+    std::uint64_t executed = 0;
+    std::uint64_t stolen = 0;
+    std::uint64_t failed = 0;
+    std::uint64_t blocking_executed = 0;
+    // Throughput tasks run by latency workers, and latency tasks run by
+    // throughput workers.
+    std::uint64_t lent = 0;
+    std::uint64_t borrowed = 0;
+};
+
+// Work-stealing executor shared by the network server, preprocessing,
+// inference and storage so the process never runs more threads than cores.
+//
+// Compute workers each own one deque per priority: the owner pushes and
+// pops at the back (LIFO, cache-warm), idle workers steal from the front of
+// other workers' deques (FIFO, oldest first). Idle workers sleep on a
+// futex and are woken per submitted task.
+//
+// Tasks that may block (disk, sockets, DNS) must go through
+// submit_blocking(): they run on a small separate pool so a stalled read
+// never occupies a compute worker.
+//
+// With latency_threads set, the workers split into two lanes that steal
+// only among themselves: kInteractive tasks go to the latency lane, the
+// rest to the throughput lane. The split bends when a lane idles:
+// throughput workers with nothing of their own take latency tasks, and an
+// idle latency lane lends all but one worker to the throughput lane. A
+// kInteractive task submitted from a throughput worker stays in its lane,
+// since it serves work that lane already holds rather than a new request.
+class Executor {
+public:
+    explicit Executor(const ExecutorOptions& options = {});
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // `affinity` is a hint naming the preferred worker (taken modulo the
+    // worker count), e.g. a hash of the tenant so related tasks share a
+    // cache. -1 keeps the task on the submitting worker if there is one.
+    void submit(Task task, TaskPriority priority = TaskPriority::kNormal,
+                int affinity = -1);
+
+    // Runs `task` on the blocking-I/O pool.
+    void submit_blocking(Task task);
+
+    std::size_t worker_count() const { return workers_.size(); }
+    // Workers owned by `lane`; with one lane, every worker is a throughput
+    // worker.
+    std::size_t lane_worker_count(ExecutionLane lane) const;
+    std::size_t blocking_thread_count() const { return blocking_threads_.size(); }
+
+    // Index of the compute worker running the caller, or -1.
+    int current_worker() const;
+    // Priority of the task the calling worker is running; kNormal off the
+    // compute workers. Work fanned out on a task's behalf is submitted at
+    // it, so helpers neither jump ahead of queued work nor fall behind it.
+    TaskPriority current_priority() const;
+    bool partitioned() const { return latency_workers_ > 0; }
+
+    ExecutorStats stats() const;
+
+private:
+    struct Worker;
+
+    using Clock = std::chrono::steady_clock;
+
+    void run_worker(std::size_t index);
+    void run_blocking_worker();
+    bool find_task(std::size_t self, Task& task, ExecutionLane& lane, TaskPriority& priority);
+    bool take_from_lane(std::size_t self, ExecutionLane lane, Task& task,
+                        TaskPriority& priority);
+    ExecutionLane lane_of(std::size_t worker) const;
+    // Whether a latency worker may take throughput work now: its lane has
+    // been idle for lend_after and one of its workers would stay free.
+    bool may_lend() const;
+    // Whether worker `index` has anything it may run.
+    bool has_work_for(std::size_t index) const;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> blocking_threads_;
+    MpmcQueue<Task> blocking_queue_;
+    // Workers [0, latency_workers_) form the latency lane.
+    std::size_t latency_workers_ = 0;
+    Clock::duration lend_after_;
+
+    struct alignas(kCacheLineSize) Lane {
+        std::atomic<std::size_t> pending{0};
+        std::atomic<std::size_t> next_worker{0};
+        // Tasks of the lane being run; only tracked for the latency lane.
+        std::atomic<std::size_t> running{0};
+        WaitEvent work_available;
+    };
+    Lane lanes_[kExecutionLaneCount];
+    // Last time the latency lane had a task queued or finishing, in Clock
+    // ticks, and how many of its workers are running throughput work.
+    alignas(kCacheLineSize) std::atomic<Clock::rep> latency_active_at_{0};
+    std::atomic<std::size_t> lent_{0};
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::uint64_t> blocking_executed_{0};
+    std::atomic<std::uint64_t> blocking_failed_{0};
+};
+
+// CPU time of the calling thread so far (CLOCK_THREAD_CPUTIME_ID).
+std::uint64_t thread_cpu_ns();
+
+// Collects CPU time spent on other threads on behalf of a task, e.g. by
+// the helper chunks of a split GEMM. Code that fans work out charges each
+// helper's thread CPU to the account current on the submitting thread, so
+// whoever measures the task can bill the whole of it.
+class CpuAccount {
+public:
+    void charge(std::uint64_t ns) { ns_.fetch_add(ns, std::memory_order_relaxed); }
+    std::uint64_t charged() const { return ns_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> ns_{0};
+};
+
+// The account installed on the calling thread, or nullptr.
+CpuAccount* current_cpu_account();
+
+// Installs `account` on the calling thread for its lifetime.
+class ScopedCpuAccount {
+public:
+    explicit ScopedCpuAccount(CpuAccount* account);
+    ~ScopedCpuAccount();
+
+    ScopedCpuAccount(const ScopedCpuAccount&) = delete;
+    ScopedCpuAccount& operator=(const ScopedCpuAccount&) = delete;
+
+private:
+    CpuAccount* previous_;
+};
+
+// Total threads `options` resolves to (ExecutorOptions::threads, or one
+// per hardware thread, and at least 2).
+std::size_t resolved_thread_count(const ExecutorOptions& options);
+
+// How the shared executor splits resolved_thread_count() of `options`
+// between compute workers, the blocking pool and HttpServer connections.
+// Only the connection share can be 0, when the budget is too small to
+// spare it. An Executor built directly has no connection share.
+struct ThreadBudget {
+    std::size_t compute = 0;
+    std::size_t blocking = 0;
+    std::size_t connections = 0;
+};
+ThreadBudget split_thread_budget(const ExecutorOptions& options);
+
+// Process-wide executor. configure_shared_executor() must run before the
+// first shared_executor() call to take effect; later calls throw.
+void configure_shared_executor(const ExecutorOptions& options);
+Executor& shared_executor();
+// Options the shared executor runs (or will run) with, without starting it.
+ExecutorOptions shared_executor_options();
+
+}  // namespace probionis
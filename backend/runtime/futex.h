@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace probionis {
+
+constexpr std::size_t kCacheLineSize = 64;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Process-private futex on a 32-bit atomic. Sleeps only while *word still
+// equals `expected`, and at most `timeout` (relative) if given; spurious
+// wake-ups are possible, so callers re-check.
+inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected,
+                       const timespec* timeout = nullptr) {
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                  "futex word must be a plain 32-bit integer");
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE,
+            expected, timeout, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<std::uint32_t>& word, int count) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+            count, nullptr, nullptr, 0);
+}
+
+// Spin-then-futex wait point. Waiters announce themselves so the notify
+// side costs one relaxed load when nobody is sleeping, which is the normal
+// case on a busy pipeline.
+class WaitEvent {
+public:
+    static constexpr int kSpinIterations = 256;
+
+    // Blocks until `ready()` returns true, spinning briefly before sleeping.
+    template <typename Ready>
+    void wait_until(Ready&& ready) {
+        for (int i = 0; i < kSpinIterations; ++i) {
+            if (ready()) {
+                return;
+            }
+            cpu_relax();
+        }
+        while (true) {
+            const std::uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Re-check after registering so a notify between the check and
+            // the registration is not lost.
+            if (ready()) {
+                waiters_.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+            futex_wait(epoch_, epoch);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+            if (ready()) {
+                return;
+            }
+        }
+    }
+
+    // As above, but gives up at `deadline`; returns what `ready()` last
+    // returned.
+    template <typename Ready>
+    bool wait_until(Ready&& ready, std::chrono::steady_clock::time_point deadline) {
+        for (int i = 0; i < kSpinIterations; ++i) {
+            if (ready()) {
+                return true;
+            }
+            cpu_relax();
+        }
+        while (true) {
+            const auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero()) {
+                return ready();
+            }
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            const timespec timeout{static_cast<time_t>(ns / 1000000000),
+                                   static_cast<long>(ns % 1000000000)};
+            const std::uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                waiters_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            futex_wait(epoch_, epoch, &timeout);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+            if (ready()) {
+                return true;
+            }
+        }
+    }
+
+    // Whether a thread is asleep in wait_until(); threads still spinning
+    // are not counted.
+    bool has_waiters() const { return waiters_.load(std::memory_order_relaxed) != 0; }
+
+    void notify_one() { notify(1); }
+    void notify_all() { notify(INT32_MAX); }
+
+private:
+    void notify(int count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        epoch_.fetch_add(1, std::memory_order_release);
+        futex_wake(epoch_, count);
+    }
+
+    alignas(kCacheLineSize) std::atomic<std::uint32_t> epoch_{0};
+    std::atomic<std::uint32_t> waiters_{0};
+};
+
+}  // namespace probionis
@@ -0,0 +1,286 @@
+#include "runtime/huge_page_allocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+namespace probionis {
+
+namespace {
+
+constexpr const char* kKindNames[kMemoryKindCount] = {"weights", "activations", "batch"};
+
+std::size_t round_up(std::size_t value, std::size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+void* map_explicit(std::size_t bytes) {
+#ifdef MAP_HUGETLB
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+#else
+    // No hugetlbfs (e.g. WebAssembly); the transparent path takes over.
+    (void)bytes;
+    return nullptr;
+#endif
+}
+
+// Maps `bytes` (a multiple of 2 MB) at a 2 MB boundary so every page of the
+// region is eligible for THP promotion, then trims the slack.
+void* map_transparent(std::size_t bytes) {
+    const std::size_t padded = bytes + kHugePageSize;
+    void* raw = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    const auto base = reinterpret_cast<std::uintptr_t>(raw);
+    const std::uintptr_t aligned = round_up(base, kHugePageSize);
+    if (aligned > base) {
+        ::munmap(raw, aligned - base);
+    }
+    const std::uintptr_t tail = aligned + bytes;
+    const std::uintptr_t end = base + padded;
+    if (end > tail) {
+        ::munmap(reinterpret_cast<void*>(tail), end - tail);
+    }
+    void* p = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+// Sums AnonHugePages of the smaps entries that start inside one of the
+// given [begin, end) ranges.
+std::vector<std::size_t> measure_anon_huge(
+    const std::vector<std::pair<std::uintptr_t, std::uintptr_t>>& ranges) {
+    std::vector<std::size_t> backed(ranges.size(), 0);
+    std::FILE* smaps = std::fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        return backed;
+    }
+    char line[512];
+    long current = -1;
+    while (std::fgets(line, sizeof(line), smaps)) {
+        unsigned long start = 0;
+        unsigned long end = 0;
+        if (std::sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            current = -1;
+            for (std::size_t i = 0; i < ranges.size(); ++i) {
+                if (start >= ranges[i].first && start < ranges[i].second) {
+                    current = static_cast<long>(i);
+                    break;
+                }
+            }
+            continue;
+        }
+        unsigned long kb = 0;
+        if (current >= 0 && std::sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            backed[static_cast<std::size_t>(current)] += kb * 1024;
+        }
+    }
+    std::fclose(smaps);
+    return backed;
+}
+
+}  // namespace
+
+double HugePageKindStats::coverage() const {
+    if (requested_bytes == 0) {
+        return 0.0;
+    }
+    const double huge = static_cast<double>(explicit_bytes + transparent_backed_bytes);
+    const double total = static_cast<double>(explicit_bytes + transparent_bytes + small_bytes);
+    return total > 0.0 ? std::min(1.0, huge / total) : 0.0;
+}
+
+HugePageAllocator::HugePageAllocator(const HugePagePolicy& policy) : policy_(policy) {}
+
+HugePageAllocator::~HugePageAllocator() {
+    for (auto& [pointer, region] : regions_) {
+        if (region.backing == PageBacking::kSmall) {
+            std::free(pointer);
+        } else {
+            ::munmap(pointer, region.mapped);
+        }
+    }
+}
+
+void* HugePageAllocator::allocate(std::size_t bytes, MemoryKind kind) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    Region region{bytes, 0, kind, PageBacking::kSmall};
+    void* p = nullptr;
+
+    if (bytes >= policy_.min_huge_bytes) {
+        const std::size_t mapped = round_up(bytes, kHugePageSize);
+        if (policy_.allow_explicit) {
+            p = map_explicit(mapped);
+            region.backing = PageBacking::kExplicit;
+        }
+        if (!p && policy_.allow_transparent) {
+            p = map_transparent(mapped);
+            region.backing = PageBacking::kTransparent;
+        }
+        region.mapped = mapped;
+    }
+    if (!p) {
+        region.backing = PageBacking::kSmall;
+        region.mapped = round_up(bytes, kSimdAlignment);
+        p = std::aligned_alloc(kSimdAlignment, region.mapped);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    regions_.emplace(p, region);
+    return p;
+}
+
+void HugePageAllocator::deallocate(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    Region region{};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = regions_.find(pointer);
+        if (it == regions_.end()) {
+            return;
+        }
+        region = it->second;
+        regions_.erase(it);
+    }
+    if (region.backing == PageBacking::kSmall) {
+        std::free(pointer);
+    } else {
+        ::munmap(pointer, region.mapped);
+    }
+}
+
+PageBacking HugePageAllocator::backing(const void* pointer) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = regions_.find(const_cast<void*>(pointer));
+    return it == regions_.end() ? PageBacking::kSmall : it->second.backing;
+}
+
+HugePageStats HugePageAllocator::stats(bool measure_transparent) const {
+    HugePageStats stats;
+    std::vector<std::pair<std::uintptr_t, std::uintptr_t>> thp_ranges;
+    std::vector<MemoryKind> thp_kinds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [pointer, region] : regions_) {
+            HugePageKindStats& s = stats.kinds[static_cast<std::size_t>(region.kind)];
+            s.requested_bytes += region.requested;
+            switch (region.backing) {
+                case PageBacking::kExplicit:
+                    s.explicit_bytes += region.mapped;
+                    break;
+                case PageBacking::kTransparent:
+                    s.transparent_bytes += region.mapped;
+                    if (measure_transparent) {
+                        const auto begin = reinterpret_cast<std::uintptr_t>(pointer);
+                        thp_ranges.emplace_back(begin, begin + region.mapped);
+                        thp_kinds.push_back(region.kind);
+                    }
+                    break;
+                case PageBacking::kSmall:
+                    s.small_bytes += region.mapped;
+                    break;
+            }
+        }
+    }
+    if (!thp_ranges.empty()) {
+        const std::vector<std::size_t> backed = measure_anon_huge(thp_ranges);
+        for (std::size_t i = 0; i < backed.size(); ++i) {
+            stats.kinds[static_cast<std::size_t>(thp_kinds[i])].transparent_backed_bytes +=
+                backed[i];
+        }
+    }
+    return stats;
+}
+
+void HugePageAllocator::publish_metrics(MetricsRegistry& registry) const {
+    HugePageStats s;
+    {
+        std::lock_guard<std::mutex> lock(measured_mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        const bool rescan = !measured_ || now - measured_at_ >= policy_.smaps_interval;
+        s = stats(rescan);
+        for (std::size_t k = 0; k < kMemoryKindCount; ++k) {
+            HugePageKindStats& kind = s.kinds[k];
+            if (rescan) {
+                measured_backed_[k] = kind.transparent_backed_bytes;
+            } else {
+                // Regions freed since the scan take their backing with them.
+                kind.transparent_backed_bytes =
+                    std::min(measured_backed_[k], kind.transparent_bytes);
+            }
+        }
+        if (rescan) {
+            measured_ = true;
+            measured_at_ = now;
+        }
+    }
+    for (std::size_t k = 0; k < kMemoryKindCount; ++k) {
+        const std::string label = std::string("{kind=\"") + kKindNames[k] + "\"";
+        const HugePageKindStats& kind = s.kinds[k];
+        registry.gauge("probionis_hugepage_explicit_bytes" + label + "}",
+                       "Bytes on explicit 2 MB pages")
+            .set(static_cast<double>(kind.explicit_bytes));
+        registry.gauge("probionis_hugepage_transparent_bytes" + label + "}",
+                       "Bytes in THP-advised mappings")
+            .set(static_cast<double>(kind.transparent_bytes));
+        registry.gauge("probionis_hugepage_transparent_backed_bytes" + label + "}",
+                       "THP-advised bytes the kernel backs with huge pages")
+            .set(static_cast<double>(kind.transparent_backed_bytes));
+        registry.gauge("probionis_hugepage_small_bytes" + label + "}",
+                       "Bytes on regular 4 KB pages")
+            .set(static_cast<double>(kind.small_bytes));
+        registry.gauge("probionis_hugepage_coverage_ratio" + label + "}",
+                       "Fraction of mapped bytes on huge pages")
+            .set(kind.coverage());
+    }
+}
+
+HugePageAllocator& HugePageAllocator::instance() {
+    static HugePageAllocator allocator;
+    return allocator;
+}
+
+HugePageBuffer::HugePageBuffer(std::size_t bytes, MemoryKind kind)
+    : data_(HugePageAllocator::instance().allocate(bytes, kind)), size_(bytes) {}
+
+HugePageBuffer::~HugePageBuffer() { HugePageAllocator::instance().deallocate(data_); }
+
+HugePageBuffer::HugePageBuffer(HugePageBuffer&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+HugePageBuffer& HugePageBuffer::operator=(HugePageBuffer&& other) noexcept {
+    if (this != &other) {
+        HugePageAllocator::instance().deallocate(data_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+}  // namespace probionis
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "runtime/metrics.h"
+
+namespace probionis {
+
+constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+// Widest vector load the kernels issue (AVX-512).
+constexpr std::size_t kSimdAlignment = 64;
+
+// What a buffer holds; coverage is reported per kind.
+enum class MemoryKind : std::uint8_t { kWeights = 0, kActivations = 1, kBatch = 2 };
+constexpr std::size_t kMemoryKindCount = 3;
+
+// How a region ended up backed.
+enum class PageBacking : std::uint8_t {
+    kExplicit,     // MAP_HUGETLB from the reserved 2 MB pool
+    kTransparent,  // 2 MB-aligned anonymous mapping with MADV_HUGEPAGE
+    kSmall,        // below the huge-page threshold; plain aligned allocation
+};
+
+struct HugePagePolicy {
+    bool allow_explicit = true;
+    bool allow_transparent = true;
+    // Requests smaller than this are not worth a huge page.
+    std::size_t min_huge_bytes = std::size_t{1} << 20;
+    // publish_metrics() rescans /proc/self/smaps at most this often and
+    // reports the last measurement in between; the scan walks every
+    // mapping of the process, too much for each metrics scrape.
+    std::chrono::milliseconds smaps_interval{10000};
+};
+
+struct HugePageKindStats {
+    std::size_t requested_bytes = 0;
+    std::size_t explicit_bytes = 0;
+    std::size_t transparent_bytes = 0;
+    // Part of transparent_bytes the kernel actually backs with huge pages;
+    // only filled in by stats(true).
+    std::size_t transparent_backed_bytes = 0;
+    std::size_t small_bytes = 0;
+
+    // Fraction of the bytes mapped for this kind (requests rounded up to
+    // the page or alignment granule) known to sit on huge pages.
+    double coverage() const;
+};
+
+struct HugePageStats {
+    HugePageKindStats kinds[kMemoryKindCount];
+};
+
+// Allocator for model weights, activation slabs and batch tensors, where
+// TLB misses on 4 KB pages are measurable. Large requests first try
+// explicit 2 MB pages and fall back to a 2 MB-aligned mapping advised for
+// transparent huge pages. Every buffer is at least 64-byte aligned.
+//
+// Allocations are expected to be few and long-lived (loaded once, reused
+// across batches), so bookkeeping uses a mutex-protected map.
+class HugePageAllocator {
+public:
+    explicit HugePageAllocator(const HugePagePolicy& policy = {});
+    ~HugePageAllocator();
+
+    HugePageAllocator(const HugePageAllocator&) = delete;
+    HugePageAllocator& operator=(const HugePageAllocator&) = delete;
+
+    void* allocate(std::size_t bytes, MemoryKind kind);
+    void deallocate(void* pointer);
+
+    PageBacking backing(const void* pointer) const;
+
+    // With `measure_transparent`, /proc/self/smaps is scanned to see how
+    // much of the THP fallback memory the kernel has actually promoted.
+    HugePageStats stats(bool measure_transparent = false) const;
+
+    // Publishes byte counts and coverage per kind as gauges, measuring THP
+    // backing at most once per HugePagePolicy::smaps_interval.
+    void publish_metrics(MetricsRegistry& registry) const;
+
+    static HugePageAllocator& instance();
+
+private:
+    struct Region {
+        std::size_t requested;
+        std::size_t mapped;
+        MemoryKind kind;
+        PageBacking backing;
+    };
+
+    HugePagePolicy policy_;
+    mutable std::mutex mutex_;
+    std::unordered_map<void*, Region> regions_;
+
+    // publish_metrics()' last smaps measurement, per kind.
+    mutable std::mutex measured_mutex_;
+    mutable std::chrono::steady_clock::time_point measured_at_;
+    mutable bool measured_ = false;
+    mutable std::size_t measured_backed_[kMemoryKindCount] = {};
+};
+
+// Owning handle for an allocation from HugePageAllocator::instance().
+class HugePageBuffer {
+public:
+    HugePageBuffer() = default;
+    HugePageBuffer(std::size_t bytes, MemoryKind kind);
+    ~HugePageBuffer();
+
+    HugePageBuffer(HugePageBuffer&& other) noexcept;
+    HugePageBuffer& operator=(HugePageBuffer&& other) noexcept;
+    HugePageBuffer(const HugePageBuffer&) = delete;
+    HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+
+    void* data() const { return data_; }
+    template <typename T>
+    T* as() const { return static_cast<T*>(data_); }
+    std::size_t size() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+}  // namespace probionis
@@ -0,0 +1,197 @@
+#include "runtime/metrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+// "name{labels}" -> "name", used for the HELP/TYPE header lines.
+std::string base_name(const std::string& name) {
+    const std::size_t brace = name.find('{');
+    return brace == std::string::npos ? name : name.substr(0, brace);
+}
+
+// "name{labels}" + suffix and an extra label, e.g. the `le` of a bucket.
+std::string series_name(const std::string& name, const std::string& suffix,
+                        const std::string& extra_label = "") {
+    const std::size_t brace = name.find('{');
+    const std::string base = brace == std::string::npos ? name : name.substr(0, brace);
+    std::string labels = brace == std::string::npos
+                             ? std::string()
+                             : name.substr(brace + 1, name.size() - brace - 2);
+    if (!extra_label.empty()) {
+        labels += labels.empty() ? extra_label : "," + extra_label;
+    }
+    return base + suffix + (labels.empty() ? "" : "{" + labels + "}");
+}
+
+const char* type_name(bool counter, bool gauge) {
+    return counter ? "counter" : gauge ? "gauge" : "histogram";
+}
+
+}  // namespace
+
+std::string labeled_name(const std::string& name, const std::string& label,
+                         const std::string& value) {
+    std::string out = name + "{" + label + "=\"";
+    for (const char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"}";
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)),
+      buckets_(new std::atomic<std::uint64_t>[bounds_.size() + 1]) {
+    if (!std::is_sorted(bounds_.begin(), bounds_.end())) {
+        throw std::invalid_argument("Histogram: bounds must be ascending");
+    }
+    for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(double value) {
+    const std::size_t i = static_cast<std::size_t>(
+        std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    double sum = sum_.load(std::memory_order_relaxed);
+    while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+    }
+}
+
+std::uint64_t Histogram::count() const {
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+        total += bucket(i);
+    }
+    return total;
+}
+
+double Histogram::sum() const { return sum_.load(std::memory_order_relaxed); }
+
+double Histogram::quantile(double p) const {
+    const std::uint64_t total = count();
+    if (total == 0 || bounds_.empty()) {
+        return 0.0;
+    }
+    const double rank = std::clamp(p, 0.0, 1.0) * static_cast<double>(total);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bounds_.size(); ++i) {
+        seen += bucket(i);
+        if (static_cast<double>(seen) >= rank) {
+            return bounds_[i];
+        }
+    }
+    return bounds_.back();
+}
+
+std::vector<double> latency_buckets_us() {
+    return {50,     100,    250,    500,     1000,    2500,    5000,   10000,
+            25000,  50000,  100000, 250000,  500000,  1000000, 2500000, 10000000};
+}
+
+MetricsRegistry::Entry& MetricsRegistry::entry(const std::string& name,
+                                               const std::string& help) {
+    Entry& e = entries_[name];
+    if (e.help.empty()) {
+        e.help = help;
+    }
+    return e;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& e = entry(name, help);
+    if (e.gauge || e.histogram) {
+        throw std::logic_error("metric " + name + " is already a " +
+                               type_name(false, e.gauge != nullptr));
+    }
+    if (!e.counter) {
+        e.counter = std::make_unique<Counter>();
+    }
+    return *e.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& e = entry(name, help);
+    if (e.counter || e.histogram) {
+        throw std::logic_error("metric " + name + " is already a " +
+                               type_name(e.counter != nullptr, false));
+    }
+    if (!e.gauge) {
+        e.gauge = std::make_unique<Gauge>();
+    }
+    return *e.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, std::vector<double> bounds,
+                                      const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& e = entry(name, help);
+    if (e.counter || e.gauge) {
+        throw std::logic_error("metric " + name + " is already a " +
+                               type_name(e.counter != nullptr, e.gauge != nullptr));
+    }
+    if (!e.histogram) {
+        e.histogram = std::make_unique<Histogram>(std::move(bounds));
+    }
+    return *e.histogram;
+}
+
+std::string MetricsRegistry::render_prometheus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    std::string last_base;
+    // std::map keeps all label sets of one metric adjacent, so each family
+    // gets a single HELP/TYPE header.
+    for (const auto& [name, e] : entries_) {
+        const std::string base = base_name(name);
+        if (base != last_base) {
+            if (!e.help.empty()) {
+                out << "# HELP " << base << ' ' << e.help << '\n';
+            }
+            out << "# TYPE " << base << ' '
+                << type_name(e.counter != nullptr, e.gauge != nullptr) << '\n';
+            last_base = base;
+        }
+        if (e.counter) {
+            out << name << ' ' << e.counter->value() << '\n';
+        } else if (e.gauge) {
+            out << name << ' ' << e.gauge->value() << '\n';
+        } else if (e.histogram) {
+            const Histogram& h = *e.histogram;
+            std::uint64_t cumulative = 0;
+            for (std::size_t i = 0; i < h.bounds().size(); ++i) {
+                cumulative += h.bucket(i);
+                std::ostringstream le;
+                le << "le=\"" << h.bounds()[i] << '"';
+                out << series_name(name, "_bucket", le.str()) << ' ' << cumulative << '\n';
+            }
+            cumulative += h.bucket(h.bounds().size());
+            out << series_name(name, "_bucket", "le=\"+Inf\"") << ' ' << cumulative << '\n';
+            out << series_name(name, "_sum") << ' ' << h.sum() << '\n';
+            out << series_name(name, "_count") << ' ' << cumulative << '\n';
+        }
+    }
+    return out.str();
+}
+
+MetricsRegistry& global_metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+}  // namespace probionis
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace probionis {
+
+// Monotonic event count.
+class Counter {
+public:
+    void add(std::uint64_t delta = 1) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    std::uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+// Point-in-time value that may go up or down.
+class Gauge {
+public:
+    void set(double value) { value_.store(value, std::memory_order_relaxed); }
+    double value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value_{0.0};
+};
+
+// Distribution over fixed bucket upper bounds, exported as a Prometheus
+// histogram. record() is two relaxed atomic updates.
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> bounds);
+
+    void record(double value);
+
+    std::uint64_t count() const;
+    double sum() const;
+    // Upper bound of the bucket holding the p-quantile; the last finite
+    // bound if it falls in the overflow bucket, 0 with no samples.
+    double quantile(double p) const;
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    // Samples in bucket i alone (not cumulative); i == bounds().size() is
+    // the overflow bucket.
+    std::uint64_t bucket(std::size_t i) const {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+    std::atomic<double> sum_{0.0};
+};
+
+// 50 us to 10 s, roughly three buckets per decade, for request and batch
+// latencies recorded in microseconds.
+std::vector<double> latency_buckets_us();
+
+// Named counters, gauges and histograms exported in Prometheus text format. Metric
+// objects are created once and never move, so hot paths keep a reference
+// and update it without touching the registry again. Names may carry a
+// label set, e.g. `probionis_hugepage_bytes{kind="weights"}`.
+class MetricsRegistry {
+public:
+    Counter& counter(const std::string& name, const std::string& help = "");
+    Gauge& gauge(const std::string& name, const std::string& help = "");
+    // `bounds` only matter on first registration of `name`.
+    Histogram& histogram(const std::string& name, std::vector<double> bounds,
+                         const std::string& help = "");
+
+    std::string render_prometheus() const;
+
+private:
+    struct Entry {
+        std::string help;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    Entry& entry(const std::string& name, const std::string& help);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+};
+
+// `name{label="value"}`, with `value` escaped for the text format so any
+// string, e.g. a client-chosen tenant name, is safe as a label value.
+std::string labeled_name(const std::string& name, const std::string& label,
+                         const std::string& value);
+
+// Registry the server tools serve at GET /metrics (handle_metrics() in
+// net/http_server.h).
+MetricsRegistry& global_metrics();
+
+}  // namespace probionis
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "runtime/futex.h"
+
+namespace probionis {
+
+// Bounded multi-producer multi-consumer ring for plain FIFO hand-offs: the
+// executor's blocking-task pool, the capture log writer, and results
+// writes on their way to the primary's WAL committer. Scoring itself does
+// not go through it. Requests claim rows of a batch slab in
+// place (BatchScheduler), since a queue of samples would copy each one.
+// Sealed batches go to the executor, whose per-worker deques need LIFO
+// pops, stealing and priorities. Fair-share dispatch picks tasks by
+// per-tenant virtual time under one lock.
+//
+// Each cell carries a sequence number (Vyukov's scheme): a producer owns
+// cell `pos` once its sequence equals `pos`, a consumer once it equals
+// `pos + 1`. The fast path is one CAS on the shared position plus one
+// release store, with no locks. Head, tail and the wait events live on
+// separate cache lines so producers and consumers do not false-share.
+//
+// Bulk operations claim a whole range of positions with a single CAS and
+// then fill or drain it. A claimed cell still being released by the other
+// side (a few instructions away) is waited on with a short spin.
+//
+// The blocking push()/pop() spin briefly and then sleep on a futex; close()
+// wakes every waiter so stages can drain and shut down.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(std::size_t capacity)
+        : mask_(checked_capacity(capacity) - 1), cells_(new Cell[capacity]) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    // Racy by nature; for metrics and heuristics only.
+    std::size_t size_approx() const {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    // Takes `value` only on success, so a failed attempt can be retried.
+    template <typename U>
+    bool try_push(U&& value) {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff =
+                static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::forward<U>(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    not_empty_.notify_one();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& out) {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff =
+                static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    not_full_.notify_one();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Moves up to `count` items from `items`; returns how many were taken.
+    std::size_t try_push_bulk(T* items, std::size_t count) {
+        if (count == 0) {
+            return 0;
+        }
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        std::size_t claimed = 0;
+        while (true) {
+            const std::size_t head = head_.load(std::memory_order_acquire);
+            const std::size_t free_slots = head + capacity() > pos ? head + capacity() - pos : 0;
+            claimed = free_slots < count ? free_slots : count;
+            if (claimed == 0) {
+                return 0;
+            }
+            if (tail_.compare_exchange_weak(pos, pos + claimed, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (std::size_t i = 0; i < claimed; ++i) {
+            Cell& cell = cells_[(pos + i) & mask_];
+            while (cell.sequence.load(std::memory_order_acquire) != pos + i) {
+                cpu_relax();
+            }
+            cell.value = std::move(items[i]);
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        if (claimed == 1) {
+            not_empty_.notify_one();
+        } else {
+            not_empty_.notify_all();
+        }
+        return claimed;
+    }
+
+    // Moves up to `max` items into `out`; returns how many were taken.
+    std::size_t try_pop_bulk(T* out, std::size_t max) {
+        if (max == 0) {
+            return 0;
+        }
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        std::size_t claimed = 0;
+        while (true) {
+            const std::size_t tail = tail_.load(std::memory_order_acquire);
+            const std::size_t available = tail > pos ? tail - pos : 0;
+            claimed = available < max ? available : max;
+            if (claimed == 0) {
+                return 0;
+            }
+            if (head_.compare_exchange_weak(pos, pos + claimed, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (std::size_t i = 0; i < claimed; ++i) {
+            Cell& cell = cells_[(pos + i) & mask_];
+            while (cell.sequence.load(std::memory_order_acquire) != pos + i + 1) {
+                cpu_relax();
+            }
+            out[i] = std::move(cell.value);
+            cell.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+        }
+        if (claimed == 1) {
+            not_full_.notify_one();
+        } else {
+            not_full_.notify_all();
+        }
+        return claimed;
+    }
+
+    // Blocks while full. Returns false (and drops nothing) once closed.
+    bool push(T value) {
+        while (true) {
+            if (closed()) {
+                return false;
+            }
+            if (try_push(std::move(value))) {
+                return true;
+            }
+            not_full_.wait_until([this] { return closed() || !full(); });
+        }
+    }
+
+    // Blocks while empty. Returns false once closed and drained.
+    bool pop(T& out) {
+        while (true) {
+            if (try_pop(out)) {
+                return true;
+            }
+            if (closed() && empty()) {
+                return false;
+            }
+            not_empty_.wait_until([this] { return closed() || !empty(); });
+        }
+    }
+
+    // Blocks until at least one item is available, then takes up to `max`.
+    // Returns 0 only once closed and drained.
+    std::size_t pop_bulk(T* out, std::size_t max) {
+        while (true) {
+            const std::size_t taken = try_pop_bulk(out, max);
+            if (taken > 0) {
+                return taken;
+            }
+            if (closed() && empty()) {
+                return 0;
+            }
+            not_empty_.wait_until([this] { return closed() || !empty(); });
+        }
+    }
+
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    // Runs before the cells are allocated, so a bad capacity never reaches
+    // new[] or the mask.
+    static std::size_t checked_capacity(std::size_t capacity) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("MpmcQueue: capacity must be a power of two >= 2");
+        }
+        return capacity;
+    }
+
+    bool empty() const {
+        const std::size_t pos = head_.load(std::memory_order_acquire);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    bool full() const {
+        const std::size_t pos = tail_.load(std::memory_order_acquire);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire) != pos;
+    }
+
+    const std::size_t mask_;
+    const std::unique_ptr<Cell[]> cells_;
+    alignas(kCacheLineSize) std::atomic<std::size_t> tail_{0};
+    alignas(kCacheLineSize) std::atomic<std::size_t> head_{0};
+    alignas(kCacheLineSize) std::atomic<bool> closed_{false};
+    WaitEvent not_empty_;
+    WaitEvent not_full_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace probionis {
+
+// LEB128 varints and length-prefixed strings shared by the binary log
+// formats (capture logs, the results WAL).
+
+inline void put_varint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool get_varint(const char* data, std::size_t size, std::size_t& offset,
+                       std::uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (offset >= size) {
+            return false;
+        }
+        const auto byte = static_cast<std::uint8_t>(data[offset++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void put_string(std::string& out, const std::string& s) {
+    put_varint(out, s.size());
+    out.append(s);
+}
+
+inline bool get_string(const char* data, std::size_t size, std::size_t& offset, std::string& s) {
+    std::uint64_t length = 0;
+    if (!get_varint(data, size, offset, length) || length > size - offset) {
+        return false;
+    }
+    s.assign(data + offset, static_cast<std::size_t>(length));
+    offset += static_cast<std::size_t>(length);
+    return true;
+}
+
+}  // namespace probionis
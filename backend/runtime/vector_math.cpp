@@ -0,0 +1,732 @@
+// Results must not depend on whether the target has FMA, so mul + add
+// pairs are never fused, including those written with intrinsics.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "runtime/vector_math.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace probionis {
+
+namespace {
+
+// Lane operations the kernels are written against. Every implementation
+// must round identically: min/max follow the x86 rule of returning the
+// second operand when either is NaN, and select(m, a, b) picks a where m.
+
+struct ScalarF {
+    using F = float;
+    using M = bool;
+    static constexpr std::size_t kWidth = 1;
+
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F v) { *p = v; }
+    static F set(float v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F min(F a, F b) { return a < b ? a : b; }
+    static F max(F a, F b) { return a > b ? a : b; }
+    static F floor(F a) { return std::floor(a); }
+    static F abs(F a) { return from_bits(bits(a) & 0x7fffffffu); }
+    static F copysign(F magnitude, F sign) {
+        return from_bits((bits(magnitude) & 0x7fffffffu) | (bits(sign) & 0x80000000u));
+    }
+    static M lt(F a, F b) { return a < b; }
+    static M gt(F a, F b) { return a > b; }
+    static M eq(F a, F b) { return a == b; }
+    static M is_nan(F a) { return a != a; }
+    static M either(M a, M b) { return a || b; }
+    static M both(M a, M b) { return a && b; }
+    static F select(M m, F a, F b) { return m ? a : b; }
+    // 2^n for integral n in [-126, 127].
+    static F pow2i(F n) {
+        return from_bits(static_cast<std::uint32_t>(static_cast<std::int32_t>(n) + 127) << 23);
+    }
+    // frexp for positive normal x: x = mantissa * 2^exponent, mantissa in [0.5, 1).
+    static F exponent(F x) {
+        return static_cast<float>(static_cast<std::int32_t>(bits(x) >> 23) - 126);
+    }
+    static F mantissa(F x) { return from_bits((bits(x) & 0x007fffffu) | 0x3f000000u); }
+
+    static std::uint32_t bits(float v) {
+        std::uint32_t b;
+        std::memcpy(&b, &v, sizeof(b));
+        return b;
+    }
+    static float from_bits(std::uint32_t b) {
+        float v;
+        std::memcpy(&v, &b, sizeof(v));
+        return v;
+    }
+};
+
+struct ScalarD {
+    using F = double;
+    using M = bool;
+    static constexpr std::size_t kWidth = 1;
+
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F v) { *p = static_cast<float>(v); }
+    static F set(double v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F min(F a, F b) { return a < b ? a : b; }
+    static F max(F a, F b) { return a > b ? a : b; }
+    static F floor(F a) { return std::floor(a); }
+    static F abs(F a) { return from_bits(bits(a) & 0x7fffffffffffffffull); }
+    static F neg(F a) { return from_bits(bits(a) ^ 0x8000000000000000ull); }
+    static M lt(F a, F b) { return a < b; }
+    static M eq(F a, F b) { return a == b; }
+    static M neq(F a, F b) { return a != b; }
+    static M is_nan(F a) { return a != a; }
+    static M either(M a, M b) { return a || b; }
+    static M both(M a, M b) { return a && b; }
+    static F select(M m, F a, F b) { return m ? a : b; }
+    // 2^n for integral n in [-1022, 1023].
+    static F pow2i(F n) {
+        return from_bits(static_cast<std::uint64_t>(static_cast<std::int64_t>(n) + 1023) << 52);
+    }
+    static F exponent(F x) {
+        return static_cast<double>(static_cast<std::int64_t>(bits(x) >> 52) - 1022);
+    }
+    static F mantissa(F x) {
+        return from_bits((bits(x) & 0x000fffffffffffffull) | 0x3fe0000000000000ull);
+    }
+
+    static std::uint64_t bits(double v) {
+        std::uint64_t b;
+        std::memcpy(&b, &v, sizeof(b));
+        return b;
+    }
+    static double from_bits(std::uint64_t b) {
+        double v;
+        std::memcpy(&v, &b, sizeof(v));
+        return v;
+    }
+};
+
+#if defined(__AVX512F__)
+struct Avx512F {
+    using F = __m512;
+    using M = __mmask16;
+    static constexpr std::size_t kWidth = 16;
+
+    static F load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+    static F set(float v) { return _mm512_set1_ps(v); }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static F floor(F a) {
+        return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+    static F abs(F a) {
+        return _mm512_castsi512_ps(
+            _mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+    }
+    static F copysign(F magnitude, F sign) {
+        const __m512i m = _mm512_and_si512(_mm512_castps_si512(magnitude),
+                                           _mm512_set1_epi32(0x7fffffff));
+        const __m512i s = _mm512_and_si512(_mm512_castps_si512(sign),
+                                           _mm512_set1_epi32(static_cast<int>(0x80000000u)));
+        return _mm512_castsi512_ps(_mm512_or_si512(m, s));
+    }
+    static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M eq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static M is_nan(F a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+    static M either(M a, M b) { return static_cast<M>(a | b); }
+    static M both(M a, M b) { return static_cast<M>(a & b); }
+    static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+    static F pow2i(F n) {
+        const __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+    }
+    static F exponent(F x) {
+        const __m512i e = _mm512_srli_epi32(_mm512_castps_si512(x), 23);
+        return _mm512_cvtepi32_ps(_mm512_sub_epi32(e, _mm512_set1_epi32(126)));
+    }
+    static F mantissa(F x) {
+        const __m512i m = _mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(0x007fffff));
+        return _mm512_castsi512_ps(_mm512_or_si512(m, _mm512_set1_epi32(0x3f000000)));
+    }
+};
+
+// Eight floats widened to doubles.
+struct Avx512D {
+    using F = __m512d;
+    using M = __mmask8;
+    static constexpr std::size_t kWidth = 8;
+
+    static F load(const float* p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, _mm512_cvtpd_ps(v)); }
+    static F set(double v) { return _mm512_set1_pd(v); }
+    static F add(F a, F b) { return _mm512_add_pd(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_pd(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_pd(a, b); }
+    static F div(F a, F b) { return _mm512_div_pd(a, b); }
+    static F min(F a, F b) { return _mm512_min_pd(a, b); }
+    static F max(F a, F b) { return _mm512_max_pd(a, b); }
+    static F floor(F a) {
+        return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+    static F abs(F a) {
+        return _mm512_castsi512_pd(_mm512_and_si512(
+            _mm512_castpd_si512(a), _mm512_set1_epi64(0x7fffffffffffffffll)));
+    }
+    static F neg(F a) {
+        return _mm512_castsi512_pd(_mm512_xor_si512(
+            _mm512_castpd_si512(a),
+            _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull))));
+    }
+    static M lt(F a, F b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static M eq(F a, F b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static M neq(F a, F b) { return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ); }
+    static M is_nan(F a) { return _mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q); }
+    static M either(M a, M b) { return static_cast<M>(a | b); }
+    static M both(M a, M b) { return static_cast<M>(a & b); }
+    static F select(M m, F a, F b) { return _mm512_mask_blend_pd(m, b, a); }
+    static F pow2i(F n) {
+        const __m512i e = _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(n)),
+                                           _mm512_set1_epi64(1023));
+        return _mm512_castsi512_pd(_mm512_slli_epi64(e, 52));
+    }
+    static F exponent(F x) {
+        return int_to_double(_mm512_srli_epi64(_mm512_castpd_si512(x), 52), 1022);
+    }
+    static F mantissa(F x) {
+        const __m512i m = _mm512_and_si512(_mm512_castpd_si512(x),
+                                           _mm512_set1_epi64(0x000fffffffffffffll));
+        return _mm512_castsi512_pd(_mm512_or_si512(m, _mm512_set1_epi64(0x3fe0000000000000ll)));
+    }
+    // Small non-negative integers to double minus `bias`, via the 2^52 trick
+    // (AVX-512F has no 64-bit integer conversion).
+    static F int_to_double(__m512i v, int bias) {
+        const __m512d magic = _mm512_set1_pd(4503599627370496.0);
+        const __m512d d = _mm512_castsi512_pd(_mm512_or_si512(v, _mm512_castpd_si512(magic)));
+        return _mm512_sub_pd(d, _mm512_set1_pd(4503599627370496.0 + bias));
+    }
+};
+#endif
+
+#if defined(__AVX2__)
+struct Avx2F {
+    using F = __m256;
+    using M = __m256;
+    static constexpr std::size_t kWidth = 8;
+
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F set(float v) { return _mm256_set1_ps(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F floor(F a) { return _mm256_floor_ps(a); }
+    static F abs(F a) {
+        return _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+    }
+    static F copysign(F magnitude, F sign) {
+        const __m256 sign_bit =
+            _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0x80000000u)));
+        return _mm256_or_ps(_mm256_andnot_ps(sign_bit, magnitude), _mm256_and_ps(sign_bit, sign));
+    }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M eq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static M is_nan(F a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+    static M either(M a, M b) { return _mm256_or_ps(a, b); }
+    static M both(M a, M b) { return _mm256_and_ps(a, b); }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static F pow2i(F n) {
+        const __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    static F exponent(F x) {
+        const __m256i e = _mm256_srli_epi32(_mm256_castps_si256(x), 23);
+        return _mm256_cvtepi32_ps(_mm256_sub_epi32(e, _mm256_set1_epi32(126)));
+    }
+    static F mantissa(F x) {
+        const __m256i m = _mm256_and_si256(_mm256_castps_si256(x), _mm256_set1_epi32(0x007fffff));
+        return _mm256_castsi256_ps(_mm256_or_si256(m, _mm256_set1_epi32(0x3f000000)));
+    }
+};
+
+// Four floats widened to doubles.
+struct Avx2D {
+    using F = __m256d;
+    using M = __m256d;
+    static constexpr std::size_t kWidth = 4;
+
+    static F load(const float* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+    static void store(float* p, F v) { _mm_storeu_ps(p, _mm256_cvtpd_ps(v)); }
+    static F set(double v) { return _mm256_set1_pd(v); }
+    static F add(F a, F b) { return _mm256_add_pd(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_pd(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_pd(a, b); }
+    static F div(F a, F b) { return _mm256_div_pd(a, b); }
+    static F min(F a, F b) { return _mm256_min_pd(a, b); }
+    static F max(F a, F b) { return _mm256_max_pd(a, b); }
+    static F floor(F a) { return _mm256_floor_pd(a); }
+    static F abs(F a) {
+        return _mm256_and_pd(a, _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll)));
+    }
+    static F neg(F a) {
+        return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi64x(
+                                    static_cast<long long>(0x8000000000000000ull))));
+    }
+    static M lt(F a, F b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static M eq(F a, F b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static M neq(F a, F b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+    static M is_nan(F a) { return _mm256_cmp_pd(a, a, _CMP_UNORD_Q); }
+    static M either(M a, M b) { return _mm256_or_pd(a, b); }
+    static M both(M a, M b) { return _mm256_and_pd(a, b); }
+    static F select(M m, F a, F b) { return _mm256_blendv_pd(b, a, m); }
+    static F pow2i(F n) {
+        const __m256i e = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n)),
+                                           _mm256_set1_epi64x(1023));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(e, 52));
+    }
+    static F exponent(F x) {
+        return int_to_double(_mm256_srli_epi64(_mm256_castpd_si256(x), 52), 1022);
+    }
+    static F mantissa(F x) {
+        const __m256i m = _mm256_and_si256(_mm256_castpd_si256(x),
+                                           _mm256_set1_epi64x(0x000fffffffffffffll));
+        return _mm256_castsi256_pd(_mm256_or_si256(m, _mm256_set1_epi64x(0x3fe0000000000000ll)));
+    }
+    static F int_to_double(__m256i v, int bias) {
+        const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+        const __m256d d = _mm256_castsi256_pd(_mm256_or_si256(v, _mm256_castpd_si256(magic)));
+        return _mm256_sub_pd(d, _mm256_set1_pd(4503599627370496.0 + bias));
+    }
+};
+#endif
+
+#if defined(__wasm_simd128__)
+// WebAssembly SIMD128, for the browser build. Its min/max propagate NaN;
+// pmin/pmax with swapped operands give the x86 rule instead.
+struct Simd128F {
+    using F = v128_t;
+    using M = v128_t;
+    static constexpr std::size_t kWidth = 4;
+
+    static F load(const float* p) { return wasm_v128_load(p); }
+    static void store(float* p, F v) { wasm_v128_store(p, v); }
+    static F set(float v) { return wasm_f32x4_splat(v); }
+    static F add(F a, F b) { return wasm_f32x4_add(a, b); }
+    static F sub(F a, F b) { return wasm_f32x4_sub(a, b); }
+    static F mul(F a, F b) { return wasm_f32x4_mul(a, b); }
+    static F div(F a, F b) { return wasm_f32x4_div(a, b); }
+    static F min(F a, F b) { return wasm_f32x4_pmin(b, a); }
+    static F max(F a, F b) { return wasm_f32x4_pmax(b, a); }
+    static F floor(F a) { return wasm_f32x4_floor(a); }
+    static F abs(F a) { return wasm_f32x4_abs(a); }
+    static F copysign(F magnitude, F sign) {
+        const v128_t sign_bit = wasm_i32x4_splat(static_cast<int>(0x80000000u));
+        return wasm_v128_or(wasm_v128_andnot(magnitude, sign_bit),
+                            wasm_v128_and(sign, sign_bit));
+    }
+    static M lt(F a, F b) { return wasm_f32x4_lt(a, b); }
+    static M gt(F a, F b) { return wasm_f32x4_gt(a, b); }
+    static M eq(F a, F b) { return wasm_f32x4_eq(a, b); }
+    static M is_nan(F a) { return wasm_f32x4_ne(a, a); }
+    static M either(M a, M b) { return wasm_v128_or(a, b); }
+    static M both(M a, M b) { return wasm_v128_and(a, b); }
+    static F select(M m, F a, F b) { return wasm_v128_bitselect(a, b, m); }
+    static F pow2i(F n) {
+        const v128_t e = wasm_i32x4_add(wasm_i32x4_trunc_sat_f32x4(n), wasm_i32x4_splat(127));
+        return wasm_i32x4_shl(e, 23);
+    }
+    static F exponent(F x) {
+        const v128_t e = wasm_i32x4_sub(wasm_u32x4_shr(x, 23), wasm_i32x4_splat(126));
+        return wasm_f32x4_convert_i32x4(e);
+    }
+    static F mantissa(F x) {
+        return wasm_v128_or(wasm_v128_and(x, wasm_i32x4_splat(0x007fffff)),
+                            wasm_i32x4_splat(0x3f000000));
+    }
+};
+
+// Two floats widened to doubles.
+struct Simd128D {
+    using F = v128_t;
+    using M = v128_t;
+    static constexpr std::size_t kWidth = 2;
+
+    static F load(const float* p) {
+        return wasm_f64x2_promote_low_f32x4(wasm_v128_load64_zero(p));
+    }
+    static void store(float* p, F v) {
+        wasm_v128_store64_lane(p, wasm_f32x4_demote_f64x2_zero(v), 0);
+    }
+    static F set(double v) { return wasm_f64x2_splat(v); }
+    static F add(F a, F b) { return wasm_f64x2_add(a, b); }
+    static F sub(F a, F b) { return wasm_f64x2_sub(a, b); }
+    static F mul(F a, F b) { return wasm_f64x2_mul(a, b); }
+    static F div(F a, F b) { return wasm_f64x2_div(a, b); }
+    static F min(F a, F b) { return wasm_f64x2_pmin(b, a); }
+    static F max(F a, F b) { return wasm_f64x2_pmax(b, a); }
+    static F floor(F a) { return wasm_f64x2_floor(a); }
+    static F abs(F a) { return wasm_f64x2_abs(a); }
+    static F neg(F a) { return wasm_f64x2_neg(a); }
+    static M lt(F a, F b) { return wasm_f64x2_lt(a, b); }
+    static M eq(F a, F b) { return wasm_f64x2_eq(a, b); }
+    static M neq(F a, F b) { return wasm_f64x2_ne(a, b); }
+    static M is_nan(F a) { return wasm_f64x2_ne(a, a); }
+    static M either(M a, M b) { return wasm_v128_or(a, b); }
+    static M both(M a, M b) { return wasm_v128_and(a, b); }
+    static F select(M m, F a, F b) { return wasm_v128_bitselect(a, b, m); }
+    static F pow2i(F n) {
+        const v128_t n32 = wasm_i32x4_trunc_sat_f64x2_zero(n);
+        const v128_t e = wasm_i64x2_add(wasm_i64x2_extend_low_i32x4(n32), wasm_i64x2_splat(1023));
+        return wasm_i64x2_shl(e, 52);
+    }
+    static F exponent(F x) { return int_to_double(wasm_u64x2_shr(x, 52), 1022); }
+    static F mantissa(F x) {
+        return wasm_v128_or(wasm_v128_and(x, wasm_i64x2_splat(0x000fffffffffffffll)),
+                            wasm_i64x2_splat(0x3fe0000000000000ll));
+    }
+    // Same 2^52 trick as the x86 paths; SIMD128 has no 64-bit integer
+    // conversion either.
+    static F int_to_double(v128_t v, int bias) {
+        const v128_t d = wasm_v128_or(v, wasm_f64x2_splat(4503599627370496.0));
+        return wasm_f64x2_sub(d, wasm_f64x2_splat(4503599627370496.0 + bias));
+    }
+};
+#endif
+
+constexpr float kInf = std::numeric_limits<float>::infinity();
+constexpr float kLog2e = 1.44269504088896341f;
+// ln 2 split so that n * kLn2Hi is exact for the n exp() produces.
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kSqrtHalf = 0.707106781186547524f;
+// ln(FLT_MIN): below it exp() would be subnormal.
+constexpr float kExpUnderflow = -87.33654475f;
+// Just past ln(FLT_MAX); larger inputs overflow to inf in the final scale.
+constexpr float kExpOverflow = 88.8f;
+
+// Cephes expf: e^x = 2^n e^r with |r| <= ln2 / 2 and a degree-6 polynomial
+// for e^r. The scale is applied in two steps so n = 128 and n = -126 stay
+// within the normal exponent range.
+template <typename V>
+typename V::F exp_kernel(typename V::F x) {
+    using F = typename V::F;
+    const F clamped = V::max(V::min(x, V::set(kExpOverflow)), V::set(kExpUnderflow));
+    const F n = V::floor(V::add(V::mul(clamped, V::set(kLog2e)), V::set(0.5f)));
+    F r = V::sub(clamped, V::mul(n, V::set(kLn2Hi)));
+    r = V::sub(r, V::mul(n, V::set(kLn2Lo)));
+    const F r2 = V::mul(r, r);
+    F p = V::set(1.9875691500e-4f);
+    p = V::add(V::mul(p, r), V::set(1.3981999507e-3f));
+    p = V::add(V::mul(p, r), V::set(8.3334519073e-3f));
+    p = V::add(V::mul(p, r), V::set(4.1665795894e-2f));
+    p = V::add(V::mul(p, r), V::set(1.6666665459e-1f));
+    p = V::add(V::mul(p, r), V::set(5.0000001201e-1f));
+    p = V::add(V::add(V::mul(p, r2), r), V::set(1.0f));
+    const auto positive = V::gt(n, V::set(0.0f));
+    const F step = V::select(positive, V::set(1.0f), V::set(-1.0f));
+    const F scale = V::select(positive, V::set(2.0f), V::set(0.5f));
+    F y = V::mul(V::mul(p, V::pow2i(V::sub(n, step))), scale);
+    y = V::select(V::lt(x, V::set(kExpUnderflow)), V::set(0.0f), y);
+    return V::select(V::is_nan(x), x, y);
+}
+
+// Cephes logf: x = m 2^e with m in [sqrt(1/2), sqrt(2)), then
+// log(1 + f) = f - f^2/2 + f^3 P(f) with a degree-8 P.
+template <typename V>
+typename V::F log_kernel(typename V::F x) {
+    using F = typename V::F;
+    // Subnormals are scaled into the normal range first.
+    const auto subnormal = V::lt(x, V::set(std::numeric_limits<float>::min()));
+    const F scaled = V::select(subnormal, V::mul(x, V::set(8388608.0f)), x);
+    F e = V::sub(V::exponent(scaled), V::select(subnormal, V::set(23.0f), V::set(0.0f)));
+    F m = V::mantissa(scaled);
+    const auto low = V::lt(m, V::set(kSqrtHalf));
+    e = V::sub(e, V::select(low, V::set(1.0f), V::set(0.0f)));
+    const F f = V::sub(V::add(m, V::select(low, m, V::set(0.0f))), V::set(1.0f));
+    const F f2 = V::mul(f, f);
+    F p = V::set(7.0376836292e-2f);
+    p = V::add(V::mul(p, f), V::set(-1.1514610310e-1f));
+    p = V::add(V::mul(p, f), V::set(1.1676998740e-1f));
+    p = V::add(V::mul(p, f), V::set(-1.2420140846e-1f));
+    p = V::add(V::mul(p, f), V::set(1.4249322787e-1f));
+    p = V::add(V::mul(p, f), V::set(-1.6668057665e-1f));
+    p = V::add(V::mul(p, f), V::set(2.0000714765e-1f));
+    p = V::add(V::mul(p, f), V::set(-2.4999993993e-1f));
+    p = V::add(V::mul(p, f), V::set(3.3333331174e-1f));
+    F y = V::mul(V::mul(p, f), f2);
+    y = V::add(y, V::mul(e, V::set(kLn2Lo)));
+    y = V::sub(y, V::mul(f2, V::set(0.5f)));
+    y = V::add(V::add(f, y), V::mul(e, V::set(kLn2Hi)));
+    y = V::select(V::eq(x, V::set(kInf)), x, y);
+    y = V::select(V::eq(x, V::set(0.0f)), V::set(-kInf), y);
+    const F nan = V::set(std::numeric_limits<float>::quiet_NaN());
+    return V::select(V::either(V::lt(x, V::set(0.0f)), V::is_nan(x)), V::add(x, nan), y);
+}
+
+// Cephes tanhf: odd polynomial below 0.625, 1 - 2 / (e^2|x| + 1) above.
+// Past |x| = 10 the second term is under half an ULP of 1, so the clamp
+// there saturates the result at exactly +-1.
+template <typename V>
+typename V::F tanh_kernel(typename V::F x) {
+    using F = typename V::F;
+    const F z = V::min(V::abs(x), V::set(10.0f));
+    const F s = exp_kernel<V>(V::add(z, z));
+    const F large = V::sub(V::set(1.0f), V::div(V::set(2.0f), V::add(s, V::set(1.0f))));
+    const F x2 = V::mul(x, x);
+    F p = V::set(-5.70498872745e-3f);
+    p = V::add(V::mul(p, x2), V::set(2.06390887954e-2f));
+    p = V::add(V::mul(p, x2), V::set(-5.37397155531e-2f));
+    p = V::add(V::mul(p, x2), V::set(1.33314422036e-1f));
+    p = V::add(V::mul(p, x2), V::set(-3.33332819422e-1f));
+    const F small = V::add(V::mul(V::mul(p, x2), x), x);
+    // The sign is applied last so tanh(-0) stays -0.
+    const F y = V::copysign(V::select(V::lt(V::abs(x), V::set(0.625f)), small, large), x);
+    return V::select(V::is_nan(x), x, y);
+}
+
+template <typename V>
+typename V::F sigmoid_kernel(typename V::F x) {
+    using F = typename V::F;
+    const F e = exp_kernel<V>(V::sub(V::set(0.0f), x));
+    return V::div(V::set(1.0f), V::add(V::set(1.0f), e));
+}
+
+// Cephes erff: x P(x^2) below 1; above, 1 - erfc with
+// erfc(x) = e^-x^2 / x * R(1/x^2), one R for [1, 2) and one beyond. The
+// square is split so e^-x^2 does not inherit its rounding error.
+template <typename V>
+typename V::F erf_kernel(typename V::F x) {
+    using F = typename V::F;
+    const F a = V::min(V::abs(x), V::set(4.0f));
+    const F a2 = V::mul(a, a);
+
+    F t = V::set(7.853861353153693e-5f);
+    t = V::add(V::mul(t, a2), V::set(-8.010193625184903e-4f));
+    t = V::add(V::mul(t, a2), V::set(5.188327685732524e-3f));
+    t = V::add(V::mul(t, a2), V::set(-2.685381193529856e-2f));
+    t = V::add(V::mul(t, a2), V::set(1.128358514861418e-1f));
+    t = V::add(V::mul(t, a2), V::set(-3.761262582423300e-1f));
+    t = V::add(V::mul(t, a2), V::set(1.128379165726710e+0f));
+    const F small = V::mul(t, a);
+
+    const F q = V::div(V::set(1.0f), a);
+    const F q2 = V::mul(q, q);
+    F p = V::set(2.326819970068386e-2f);
+    p = V::add(V::mul(p, q2), V::set(-1.387039388740657e-1f));
+    p = V::add(V::mul(p, q2), V::set(3.687424674597105e-1f));
+    p = V::add(V::mul(p, q2), V::set(-5.824733027278666e-1f));
+    p = V::add(V::mul(p, q2), V::set(6.210004621745983e-1f));
+    p = V::add(V::mul(p, q2), V::set(-4.944515323274145e-1f));
+    p = V::add(V::mul(p, q2), V::set(3.404879937665872e-1f));
+    p = V::add(V::mul(p, q2), V::set(-2.741127028184656e-1f));
+    p = V::add(V::mul(p, q2), V::set(5.638259427386472e-1f));
+    F r = V::set(-1.047766399936249e+1f);
+    r = V::add(V::mul(r, q2), V::set(1.297719955372516e+1f));
+    r = V::add(V::mul(r, q2), V::set(-7.495518717768503e+0f));
+    r = V::add(V::mul(r, q2), V::set(2.921019019210786e+0f));
+    r = V::add(V::mul(r, q2), V::set(-1.015265279202700e+0f));
+    r = V::add(V::mul(r, q2), V::set(4.218463358204948e-1f));
+    r = V::add(V::mul(r, q2), V::set(-2.820767439740514e-1f));
+    r = V::add(V::mul(r, q2), V::set(5.641895067754075e-1f));
+    const F tail = V::select(V::lt(a, V::set(2.0f)), p, r);
+
+    // a = hi + lo with hi on a 1/1024 grid (12 bits below 4), so hi^2 is
+    // exact and e^-a^2 = e^-hi^2 e^-lo(a + hi), the second factor to
+    // second order.
+    const F hi = V::mul(V::floor(V::mul(a, V::set(1024.0f))), V::set(1.0f / 1024.0f));
+    const F d = V::mul(V::sub(a, hi), V::add(a, hi));
+    const F correction = V::add(V::sub(V::set(1.0f), d), V::mul(V::mul(d, d), V::set(0.5f)));
+    const F gauss = V::mul(exp_kernel<V>(V::sub(V::set(0.0f), V::mul(hi, hi))), correction);
+    const F large = V::sub(V::set(1.0f), V::mul(V::mul(gauss, q), tail));
+
+    const F y = V::select(V::lt(a, V::set(1.0f)), small, large);
+    return V::select(V::is_nan(x), x, V::copysign(y, x));
+}
+
+// pow in double: log by the atanh series on m in [sqrt(1/2), sqrt(2)) and
+// exp by Taylor on |r| <= ln2 / 2, each accurate far beyond float so only
+// the final rounding to float remains.
+template <typename V>
+typename V::F pow_kernel(typename V::F x, typename V::F y) {
+    using F = typename V::F;
+    const F ax = V::abs(x);
+    F e = V::exponent(ax);
+    F m = V::mantissa(ax);
+    const auto low = V::lt(m, V::set(0.70710678118654752));
+    e = V::sub(e, V::select(low, V::set(1.0), V::set(0.0)));
+    m = V::add(m, V::select(low, m, V::set(0.0)));
+    const F s = V::div(V::sub(m, V::set(1.0)), V::add(m, V::set(1.0)));
+    const F s2 = V::mul(s, s);
+    F series = V::set(1.0 / 13.0);
+    series = V::add(V::mul(series, s2), V::set(1.0 / 11.0));
+    series = V::add(V::mul(series, s2), V::set(1.0 / 9.0));
+    series = V::add(V::mul(series, s2), V::set(1.0 / 7.0));
+    series = V::add(V::mul(series, s2), V::set(1.0 / 5.0));
+    series = V::add(V::mul(series, s2), V::set(1.0 / 3.0));
+    series = V::add(V::mul(series, s2), V::set(1.0));
+    F log_ax = V::add(V::mul(e, V::set(0.69314718055994531)),
+                      V::mul(V::add(s, s), series));
+    const F inf = V::set(std::numeric_limits<double>::infinity());
+    log_ax = V::select(V::eq(ax, V::set(0.0)), V::neg(inf), log_ax);
+    log_ax = V::select(V::eq(ax, inf), inf, log_ax);
+
+    const F t = V::mul(y, log_ax);
+    const F tc = V::max(V::min(t, V::set(100.0)), V::set(-120.0));
+    const F n = V::floor(V::add(V::mul(tc, V::set(1.4426950408889634)), V::set(0.5)));
+    const F r = V::sub(tc, V::mul(n, V::set(0.69314718055994531)));
+    F p = V::set(1.0 / 3628800.0);
+    p = V::add(V::mul(p, r), V::set(1.0 / 362880.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 40320.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 5040.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 720.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 120.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 24.0));
+    p = V::add(V::mul(p, r), V::set(1.0 / 6.0));
+    p = V::add(V::mul(p, r), V::set(0.5));
+    p = V::add(V::mul(p, r), V::set(1.0));
+    p = V::add(V::mul(p, r), V::set(1.0));
+    F result = V::select(V::is_nan(t), t, V::mul(p, V::pow2i(n)));
+
+    // Negative bases: negated for odd integral exponents; finite ones are
+    // undefined for the rest, -inf gives the +0 or +inf of its magnitude.
+    const auto negative = V::lt(x, V::set(0.0));
+    const auto integral = V::eq(V::floor(y), y);
+    const F half = V::mul(y, V::set(0.5));
+    const auto odd = V::both(integral, V::neq(V::floor(half), half));
+    const F nan = V::set(std::numeric_limits<double>::quiet_NaN());
+    result = V::select(V::both(negative, odd), V::neg(result), result);
+    result = V::select(V::both(V::both(negative, V::lt(ax, inf)), V::neq(V::floor(y), y)), nan,
+                       result);
+    result = V::select(V::either(V::is_nan(x), V::is_nan(y)), nan, result);
+    // pow(x, 0) and pow(1, y) are 1 even for NaN, and pow(-1, +-inf) is 1.
+    const auto one = V::either(V::eq(x, V::set(1.0)),
+                               V::both(V::eq(ax, V::set(1.0)), V::eq(V::abs(y), inf)));
+    return V::select(V::either(V::eq(y, V::set(0.0)), one), V::set(1.0), result);
+}
+
+// Kernel wrappers so map_unary() can instantiate them per lane type.
+struct ExpKernel {
+    template <typename V>
+    static typename V::F run(typename V::F x) { return exp_kernel<V>(x); }
+};
+struct LogKernel {
+    template <typename V>
+    static typename V::F run(typename V::F x) { return log_kernel<V>(x); }
+};
+struct TanhKernel {
+    template <typename V>
+    static typename V::F run(typename V::F x) { return tanh_kernel<V>(x); }
+};
+struct SigmoidKernel {
+    template <typename V>
+    static typename V::F run(typename V::F x) { return sigmoid_kernel<V>(x); }
+};
+struct ErfKernel {
+    template <typename V>
+    static typename V::F run(typename V::F x) { return erf_kernel<V>(x); }
+};
+
+template <typename V, typename K>
+void map_lanes(const float* in, float* out, std::size_t n, std::size_t& i) {
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        V::store(out + i, K::template run<V>(V::load(in + i)));
+    }
+}
+
+// Widest available lanes, then the scalar kernel for the remainder, which
+// computes the same bits.
+template <typename K>
+void map_unary(const float* in, float* out, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__AVX512F__)
+    map_lanes<Avx512F, K>(in, out, n, i);
+#elif defined(__AVX2__)
+    map_lanes<Avx2F, K>(in, out, n, i);
+#elif defined(__wasm_simd128__)
+    map_lanes<Simd128F, K>(in, out, n, i);
+#endif
+    for (; i < n; ++i) {
+        out[i] = K::template run<ScalarF>(in[i]);
+    }
+}
+
+template <typename V>
+void pow_lanes(const float* base, const float* exponent, float exponent_value, float* out,
+               std::size_t n, std::size_t& i) {
+    const typename V::F fixed = V::set(exponent_value);
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        const typename V::F y = exponent ? V::load(exponent + i) : fixed;
+        V::store(out + i, pow_kernel<V>(V::load(base + i), y));
+    }
+}
+
+// `exponent` may be null, in which case every element uses
+// `exponent_value`.
+void pow_array(const float* base, const float* exponent, float exponent_value, float* out,
+               std::size_t n) {
+    std::size_t i = 0;
+#if defined(__AVX512F__)
+    pow_lanes<Avx512D>(base, exponent, exponent_value, out, n, i);
+#elif defined(__AVX2__)
+    pow_lanes<Avx2D>(base, exponent, exponent_value, out, n, i);
+#elif defined(__wasm_simd128__)
+    pow_lanes<Simd128D>(base, exponent, exponent_value, out, n, i);
+#endif
+    for (; i < n; ++i) {
+        const double y = exponent ? exponent[i] : exponent_value;
+        out[i] = static_cast<float>(pow_kernel<ScalarD>(base[i], y));
+    }
+}
+
+}  // namespace
+
+void vexp(const float* in, float* out, std::size_t n) { map_unary<ExpKernel>(in, out, n); }
+void vlog(const float* in, float* out, std::size_t n) { map_unary<LogKernel>(in, out, n); }
+void vtanh(const float* in, float* out, std::size_t n) { map_unary<TanhKernel>(in, out, n); }
+void vsigmoid(const float* in, float* out, std::size_t n) { map_unary<SigmoidKernel>(in, out, n); }
+void verf(const float* in, float* out, std::size_t n) { map_unary<ErfKernel>(in, out, n); }
+
+void vpow(const float* base, const float* exponent, float* out, std::size_t n) {
+    pow_array(base, exponent, 0.0f, out, n);
+}
+
+void vpow(const float* base, float exponent, float* out, std::size_t n) {
+    pow_array(base, nullptr, exponent, out, n);
+}
+
+float exp_approx(float x) { return exp_kernel<ScalarF>(x); }
+float log_approx(float x) { return log_kernel<ScalarF>(x); }
+float tanh_approx(float x) { return tanh_kernel<ScalarF>(x); }
+float sigmoid_approx(float x) { return sigmoid_kernel<ScalarF>(x); }
+float erf_approx(float x) { return erf_kernel<ScalarF>(x); }
+float pow_approx(float base, float exponent) {
+    return static_cast<float>(pow_kernel<ScalarD>(base, exponent));
+}
+
+}  // namespace probionis
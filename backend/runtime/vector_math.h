@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+namespace probionis {
+
+// Elementwise float math over arrays for activations and spectral
+// transforms. Each function is one polynomial kernel instantiated for
+// AVX-512, AVX2, WebAssembly SIMD128 and scalar code, built from the same
+// sequence of correctly rounded operations (no FMA, no reciprocal
+// estimates), so every path returns bit-identical results and any build,
+// the browser's included, reproduces any other. `out` may alias `in`.
+//
+// Maximum error against the exact result, measured over every seventh
+// float across the whole range:
+//
+//   vexp      1 ULP    results below FLT_MIN flush to 0
+//   vlog      1 ULP    -inf at 0, NaN for negative inputs
+//   vtanh     2 ULP
+//   vsigmoid  3 ULP    1 / (1 + exp(-x)); 0 below x = -88.7
+//   verf      3 ULP
+//   vpow      1 ULP    evaluated in double; C special cases for zero,
+//                      infinity, NaN and negative bases with integer
+//                      exponents, except that pow(-0, y) is treated as
+//                      pow(+0, y)
+//
+// The array forms run 5-10x faster than a libm loop, enough for
+// elementwise layers to be bound by memory bandwidth rather than math.
+void vexp(const float* in, float* out, std::size_t n);
+void vlog(const float* in, float* out, std::size_t n);
+void vtanh(const float* in, float* out, std::size_t n);
+void vsigmoid(const float* in, float* out, std::size_t n);
+void verf(const float* in, float* out, std::size_t n);
+void vpow(const float* base, const float* exponent, float* out, std::size_t n);
+void vpow(const float* base, float exponent, float* out, std::size_t n);
+
+// Single values through the same kernels, for code that must agree
+// bit-for-bit with the array forms.
+float exp_approx(float x);
+float log_approx(float x);
+float tanh_approx(float x);
+float sigmoid_approx(float x);
+float erf_approx(float x);
+float pow_approx(float base, float exponent);
+
+}  // namespace probionis
@@ -0,0 +1,202 @@
+#include "spectrum/batch_slab.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+BatchSlab::BatchSlab(std::size_t capacity, std::size_t channels, std::size_t row_multiple,
+                     std::size_t output_width)
+    : batch_(capacity, channels, row_multiple),
+      output_width_(output_width),
+      outputs_(capacity * output_width),
+      committed_(capacity, 0),
+      slot_sample_ids_(capacity),
+      slot_instrument_ids_(capacity),
+      row_of_(capacity, kNoRow) {}
+
+SlabSlot BatchSlab::try_claim(std::size_t limit, bool& last) {
+    last = false;
+    if (limit > capacity()) {
+        limit = capacity();
+    }
+    std::uint64_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+        if ((state & kSealedBit) != 0 || state >= limit) {
+            return SlabSlot();
+        }
+        if (state_.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel,
+                                         std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    // Taken before this slot can resolve, so dispatch cannot release the
+    // slab underneath it.
+    holds_.fetch_add(1, std::memory_order_relaxed);
+    last = state + 1 == limit;
+    return SlabSlot(this, static_cast<std::size_t>(state));
+}
+
+std::size_t BatchSlab::seal() {
+    const std::uint64_t before = state_.fetch_or(kSealedBit, std::memory_order_seq_cst);
+    const std::size_t claimed = static_cast<std::size_t>(before & ~kSealedBit);
+    if ((before & kSealedBit) == 0 && resolved_.load(std::memory_order_seq_cst) == claimed) {
+        dispatch(claimed);
+    }
+    return claimed;
+}
+
+bool BatchSlab::sealed() const {
+    return (state_.load(std::memory_order_acquire) & kSealedBit) != 0;
+}
+
+void BatchSlab::resolve(std::size_t slot, bool committed) {
+    committed_[slot] = committed ? 1 : 0;
+    const std::size_t resolved = resolved_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    // Either this load sees the seal or seal() sees this resolution; when
+    // both do, dispatched_ keeps the batch from running twice.
+    const std::uint64_t state = state_.load(std::memory_order_seq_cst);
+    if ((state & kSealedBit) != 0 && resolved == (state & ~kSealedBit)) {
+        dispatch(resolved);
+    }
+}
+
+void BatchSlab::dispatch(std::size_t claimed) {
+    if (dispatched_.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    // Slide committed rows down over abandoned ones. A row only ever moves
+    // to a lower index, so nothing is overwritten before it is read.
+    std::vector<std::string> sample_ids;
+    std::vector<std::string> instrument_ids;
+    sample_ids.reserve(claimed);
+    instrument_ids.reserve(claimed);
+    const std::size_t row_bytes = batch_.stride() * sizeof(float);
+    std::size_t dense = 0;
+    for (std::size_t slot = 0; slot < claimed; ++slot) {
+        if (!committed_[slot]) {
+            row_of_[slot] = kNoRow;
+            continue;
+        }
+        if (dense != slot) {
+            std::memcpy(batch_.row(dense), batch_.row(slot), row_bytes);
+        }
+        row_of_[slot] = static_cast<std::uint32_t>(dense);
+        sample_ids.push_back(std::move(slot_sample_ids_[slot]));
+        instrument_ids.push_back(std::move(slot_instrument_ids_[slot]));
+        ++dense;
+    }
+    abandoned_ = claimed - dense;
+    if (dense < claimed) {
+        // Vacated and abandoned rows may hold partial writes.
+        std::memset(batch_.row(dense), 0, (claimed - dense) * row_bytes);
+    }
+    batch_.adopt_rows(dense, std::move(sample_ids), std::move(instrument_ids));
+    if (on_ready_) {
+        on_ready_(*this);
+    } else {
+        complete();
+    }
+}
+
+void BatchSlab::complete() {
+    done_.store(1, std::memory_order_release);
+    done_event_.notify_all();
+    release();
+}
+
+void BatchSlab::fail(const std::string& error) {
+    error_ = error;
+    done_.store(2, std::memory_order_release);
+    done_event_.notify_all();
+    release();
+}
+
+void BatchSlab::release() {
+    if (holds_.fetch_sub(1, std::memory_order_acq_rel) == 1 && on_release_) {
+        on_release_(*this);
+    }
+}
+
+void BatchSlab::reset() {
+    batch_.clear();
+    state_.store(0, std::memory_order_relaxed);
+    resolved_.store(0, std::memory_order_relaxed);
+    holds_.store(1, std::memory_order_relaxed);
+    dispatched_.store(false, std::memory_order_relaxed);
+    done_.store(0, std::memory_order_relaxed);
+    error_.clear();
+    abandoned_ = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+SlabSlot::SlabSlot(SlabSlot&& other) noexcept
+    : slab_(std::exchange(other.slab_, nullptr)), slot_(other.slot_) {}
+
+SlabSlot& SlabSlot::operator=(SlabSlot&& other) noexcept {
+    if (this != &other) {
+        abandon();
+        slab_ = std::exchange(other.slab_, nullptr);
+        slot_ = other.slot_;
+    }
+    return *this;
+}
+
+SlabSlot::~SlabSlot() { abandon(); }
+
+float* SlabSlot::data() const { return slab_->batch_.row(slot_); }
+
+SlabTicket SlabSlot::commit(std::string sample_id, std::string instrument_id) {
+    if (!slab_) {
+        throw std::logic_error("SlabSlot::commit: empty slot");
+    }
+    BatchSlab* slab = std::exchange(slab_, nullptr);
+    slab->slot_sample_ids_[slot_] = std::move(sample_id);
+    slab->slot_instrument_ids_[slot_] = std::move(instrument_id);
+    // The slot's hold passes to the ticket.
+    SlabTicket ticket(slab, slot_);
+    slab->resolve(slot_, true);
+    return ticket;
+}
+
+void SlabSlot::abandon() {
+    if (BatchSlab* slab = std::exchange(slab_, nullptr)) {
+        slab->resolve(slot_, false);
+        slab->release();
+    }
+}
+
+SlabTicket::SlabTicket(SlabTicket&& other) noexcept
+    : slab_(std::exchange(other.slab_, nullptr)), slot_(other.slot_) {}
+
+SlabTicket& SlabTicket::operator=(SlabTicket&& other) noexcept {
+    if (this != &other) {
+        if (slab_) {
+            slab_->release();
+        }
+        slab_ = std::exchange(other.slab_, nullptr);
+        slot_ = other.slot_;
+    }
+    return *this;
+}
+
+SlabTicket::~SlabTicket() {
+    if (slab_) {
+        slab_->release();
+    }
+}
+
+void SlabTicket::wait() const {
+    slab_->done_event_.wait_until(
+        [this] { return slab_->done_.load(std::memory_order_acquire) != 0; });
+    if (slab_->done_.load(std::memory_order_acquire) == 2) {
+        throw std::runtime_error("batch failed: " + slab_->error_);
+    }
+}
+
+const float* SlabTicket::output() const {
+    return slab_->outputs_.data() + slab_->row_of_[slot_] * slab_->output_width_;
+}
+
+}  // namespace probionis
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "runtime/futex.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace probionis {
+
+class SlabSlot;
+class SlabTicket;
+
+// A preallocated batch tensor whose rows are written in place by the
+// threads handling requests, then preprocessed and fed to the model
+// without being copied again. Slabs are pooled and reused.
+//
+// One fill cycle: rows are claimed concurrently until the slab is sealed
+// (full, or its deadline passed), and each claimed row is committed or
+// abandoned by its owner. When the last one resolves, committed rows are
+// compacted into a dense SpectrumBatch and `on_ready` runs exactly once.
+// The consumer fills outputs() and calls complete() or fail(), waking
+// every ticket. `on_release` runs once the consumer and all tickets are
+// done with the slab, after which it may be reset() and reused.
+class BatchSlab {
+public:
+    BatchSlab(std::size_t capacity, std::size_t channels, std::size_t row_multiple,
+              std::size_t output_width);
+
+    BatchSlab(const BatchSlab&) = delete;
+    BatchSlab& operator=(const BatchSlab&) = delete;
+
+    void set_on_ready(std::function<void(BatchSlab&)> on_ready) { on_ready_ = std::move(on_ready); }
+    void set_on_release(std::function<void(BatchSlab&)> on_release) {
+        on_release_ = std::move(on_release);
+    }
+
+    // Claims a row if fewer than `limit` are claimed and the slab is not
+    // sealed; empty on failure. `last` reports that this claim reached the
+    // limit, in which case the caller should seal().
+    SlabSlot try_claim(std::size_t limit, bool& last);
+
+    // Stops further claims and returns the number of rows claimed. Never
+    // blocks: dispatch happens when the last outstanding row resolves.
+    std::size_t seal();
+    bool sealed() const;
+    // Rows claimed so far in the current cycle.
+    std::size_t claimed() const {
+        return static_cast<std::size_t>(state_.load(std::memory_order_acquire) & ~kSealedBit);
+    }
+
+    // Dense batch of the committed rows; valid from on_ready until reset().
+    SpectrumBatch& batch() { return batch_; }
+    // Model outputs, output_width() floats per dense row.
+    float* outputs() { return outputs_.data(); }
+    std::size_t output_width() const { return output_width_; }
+    std::size_t capacity() const { return batch_.capacity(); }
+    // Rows claimed and then abandoned in the current cycle.
+    std::size_t abandoned() const { return abandoned_; }
+
+    void complete();
+    void fail(const std::string& error);
+
+    // Extra hold for a consumer that keeps reading batch() and outputs()
+    // after complete(), e.g. to score a copy off the response path. Each
+    // retain() needs one release().
+    void retain() { holds_.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+
+    // Starts the next fill cycle. Only valid after on_release.
+    void reset();
+
+private:
+    friend class SlabSlot;
+    friend class SlabTicket;
+
+    static constexpr std::uint64_t kSealedBit = std::uint64_t{1} << 63;
+    static constexpr std::uint32_t kNoRow = ~std::uint32_t{0};
+
+    void resolve(std::size_t slot, bool committed);
+    void dispatch(std::size_t claimed);
+
+    SpectrumBatch batch_;
+    std::size_t output_width_;
+    std::vector<float> outputs_;
+    std::function<void(BatchSlab&)> on_ready_;
+    std::function<void(BatchSlab&)> on_release_;
+
+    // Claimed row count, plus kSealedBit once sealed.
+    alignas(kCacheLineSize) std::atomic<std::uint64_t> state_{0};
+    alignas(kCacheLineSize) std::atomic<std::size_t> resolved_{0};
+    // One hold per live slot or ticket, plus one for the consumer.
+    std::atomic<std::size_t> holds_{1};
+    std::atomic<bool> dispatched_{false};
+
+    // Per slot; each entry is written only by the slot's owner before it
+    // resolves, and read by the dispatcher after every slot resolved.
+    std::vector<std::uint8_t> committed_;
+    std::vector<std::string> slot_sample_ids_;
+    std::vector<std::string> slot_instrument_ids_;
+    // Dense row of each slot after compaction, kNoRow if abandoned.
+    std::vector<std::uint32_t> row_of_;
+    std::size_t abandoned_ = 0;
+
+    // 0 while pending, 1 completed, 2 failed.
+    std::atomic<std::uint32_t> done_{0};
+    std::string error_;
+    WaitEvent done_event_;
+};
+
+// Exclusive write access to one claimed row of a slab. The decoder writes
+// channels() floats through data() and commits; a slot destroyed without
+// commit() is abandoned and compacted out before the batch runs.
+class SlabSlot {
+public:
+    SlabSlot() = default;
+    SlabSlot(SlabSlot&& other) noexcept;
+    SlabSlot& operator=(SlabSlot&& other) noexcept;
+    ~SlabSlot();
+
+    explicit operator bool() const { return slab_ != nullptr; }
+    float* data() const;
+    std::size_t channels() const { return slab_->batch_.channels(); }
+
+    SlabTicket commit(std::string sample_id, std::string instrument_id = {});
+    void abandon();
+
+private:
+    friend class BatchSlab;
+    SlabSlot(BatchSlab* slab, std::size_t slot) : slab_(slab), slot_(slot) {}
+
+    BatchSlab* slab_ = nullptr;
+    std::size_t slot_ = 0;
+};
+
+// Claim on one committed row's model output.
+class SlabTicket {
+public:
+    SlabTicket() = default;
+    SlabTicket(SlabTicket&& other) noexcept;
+    SlabTicket& operator=(SlabTicket&& other) noexcept;
+    ~SlabTicket();
+
+    explicit operator bool() const { return slab_ != nullptr; }
+    // Blocks until the batch ran; throws std::runtime_error if it failed.
+    void wait() const;
+    // output_width() floats for this row, valid after wait() returned and
+    // for the ticket's lifetime.
+    const float* output() const;
+    std::size_t output_width() const { return slab_->output_width_; }
+
+private:
+    friend class SlabSlot;
+    SlabTicket(BatchSlab* slab, std::size_t slot) : slab_(slab), slot_(slot) {}
+
+    BatchSlab* slab_ = nullptr;
+    std::size_t slot_ = 0;
+};
+
+}  // namespace probionis
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace probionis {
+
+// A single acquisition as it travels through ingest, preprocessing and
+// inference. `axis` holds the wavenumber (or wavelength) of every channel in
+// ascending order and always has the same length as `intensity`.
+struct Spectrum {
+    std::string sample_id;
+    std::string instrument_id;
+    std::vector<float> axis;
+    std::vector<float> intensity;
+
+    std::size_t size() const { return intensity.size(); }
+    bool empty() const { return intensity.empty(); }
+};
+
+// Readers may decode channels in descending axis order (common for IR
+// wavenumbers); flip them so the ascending-axis invariant holds.
+inline void make_axis_ascending(Spectrum& spectrum) {
+    if (spectrum.axis.size() > 1 && spectrum.axis.front() > spectrum.axis.back()) {
+        std::reverse(spectrum.axis.begin(), spectrum.axis.end());
+        std::reverse(spectrum.intensity.begin(), spectrum.intensity.end());
+    }
+}
+
+}  // namespace probionis
@@ -0,0 +1,94 @@
+#include "spectrum/spectrum_batch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+std::size_t padded_stride(std::size_t channels, std::size_t row_multiple) {
+    // Round the multiple itself up to whole cache lines, then the row.
+    const std::size_t m = std::max(row_multiple, SpectrumBatch::kRowMultiple);
+    const std::size_t lines = (m + SpectrumBatch::kRowMultiple - 1) / SpectrumBatch::kRowMultiple;
+    const std::size_t multiple = lines * SpectrumBatch::kRowMultiple;
+    return (channels + multiple - 1) / multiple * multiple;
+}
+
+}  // namespace
+
+SpectrumBatch::SpectrumBatch(std::size_t capacity, std::size_t channels,
+                             std::size_t row_multiple)
+    : capacity_(capacity), channels_(channels), stride_(padded_stride(channels, row_multiple)) {
+    if (capacity == 0 || channels == 0) {
+        throw std::invalid_argument("SpectrumBatch: capacity and channels must be positive");
+    }
+    const std::size_t bytes = std::max<std::size_t>(capacity_ * stride_ * sizeof(float), kAlignment);
+    data_ = HugePageBuffer(bytes, MemoryKind::kBatch);
+    std::memset(data_.data(), 0, bytes);
+    sample_ids_.reserve(capacity_);
+    instrument_ids_.reserve(capacity_);
+}
+
+void SpectrumBatch::push(const Spectrum& spectrum) {
+    if (full()) {
+        throw std::length_error("SpectrumBatch::push: batch is full");
+    }
+    if (spectrum.size() != channels_) {
+        throw std::invalid_argument("SpectrumBatch::push: channel count mismatch");
+    }
+    if (count_ == 0) {
+        axis_ = spectrum.axis;
+    }
+    std::memcpy(row(count_), spectrum.intensity.data(), channels_ * sizeof(float));
+    sample_ids_.push_back(spectrum.sample_id);
+    instrument_ids_.push_back(spectrum.instrument_id);
+    ++count_;
+}
+
+void SpectrumBatch::adopt_rows(std::size_t count, std::vector<std::string> sample_ids,
+                               std::vector<std::string> instrument_ids) {
+    if (count > capacity_ || sample_ids.size() != count || instrument_ids.size() != count) {
+        throw std::invalid_argument("SpectrumBatch::adopt_rows: bad row count");
+    }
+    count_ = count;
+    sample_ids_ = std::move(sample_ids);
+    instrument_ids_ = std::move(instrument_ids);
+}
+
+Spectrum SpectrumBatch::extract(std::size_t index) const {
+    Spectrum spectrum;
+    spectrum.sample_id = sample_ids_[index];
+    spectrum.instrument_id = instrument_ids_[index];
+    spectrum.axis = axis_;
+    spectrum.intensity.assign(row(index), row(index) + channels_);
+    return spectrum;
+}
+
+void SpectrumBatch::set_axis(std::vector<float> axis) {
+    if (axis.size() != channels_) {
+        throw std::invalid_argument("SpectrumBatch::set_axis: length mismatch");
+    }
+    axis_ = std::move(axis);
+}
+
+void SpectrumBatch::clear() {
+    // Steps may have written into the padding; restore the zero invariant.
+    std::memset(data(), 0, count_ * stride_ * sizeof(float));
+    count_ = 0;
+    sample_ids_.clear();
+    instrument_ids_.clear();
+}
+
+void SpectrumBatch::zero_padding() {
+    if (stride_ == channels_) {
+        return;
+    }
+    for (std::size_t i = 0; i < count_; ++i) {
+        std::fill(row(i) + channels_, row(i) + stride_, 0.0f);
+    }
+}
+
+}  // namespace probionis
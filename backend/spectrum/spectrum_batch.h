@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "runtime/huge_page_allocator.h"
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// Several spectra on a shared axis stored as one row-major matrix, the
+// layout batch kernels, plugins and the model input consume. Each row is
+// padded to a multiple of `row_multiple` floats (at least 16, so every row
+// starts 64-byte aligned); padding is kept zero.
+class SpectrumBatch {
+public:
+    static constexpr std::size_t kAlignment = 64;
+    static constexpr std::size_t kRowMultiple = kAlignment / sizeof(float);
+
+    SpectrumBatch(std::size_t capacity, std::size_t channels,
+                  std::size_t row_multiple = kRowMultiple);
+
+    std::size_t size() const { return count_; }
+    std::size_t capacity() const { return capacity_; }
+    std::size_t channels() const { return channels_; }
+    // Floats between the starts of consecutive rows.
+    std::size_t stride() const { return stride_; }
+    bool full() const { return count_ == capacity_; }
+
+    float* row(std::size_t index) { return data() + index * stride_; }
+    const float* row(std::size_t index) const { return data() + index * stride_; }
+    float* data() { return data_.as<float>(); }
+    const float* data() const { return data_.as<float>(); }
+
+    // Appends a copy of `spectrum`, which must have channels() channels.
+    // The first spectrum added sets the shared axis.
+    void push(const Spectrum& spectrum);
+    // Takes rows [0, count) as written in place through row(), with their
+    // IDs, instead of copying them in with push(). Replaces any rows
+    // already in the batch.
+    void adopt_rows(std::size_t count, std::vector<std::string> sample_ids,
+                    std::vector<std::string> instrument_ids);
+    // Copies row `index` back out as a standalone spectrum.
+    Spectrum extract(std::size_t index) const;
+    void clear();
+    // Zeroes the padding of every row again, after code that may write
+    // into it, such as a plugin, has run on the batch.
+    void zero_padding();
+
+    const std::vector<float>& axis() const { return axis_; }
+    void set_axis(std::vector<float> axis);
+    const std::string& sample_id(std::size_t index) const { return sample_ids_[index]; }
+    const std::string& instrument_id(std::size_t index) const { return instrument_ids_[index]; }
+
+private:
+    std::size_t capacity_;
+    std::size_t channels_;
+    std::size_t stride_;
+    std::size_t count_ = 0;
+    // Batch tensors are read by every stage and the model, so they sit on
+    // huge pages when large enough (MemoryKind::kBatch).
+    HugePageBuffer data_;
+    std::vector<float> axis_;
+    std::vector<std::string> sample_ids_;
+    std::vector<std::string> instrument_ids_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,215 @@
+#include "storage/results_replication.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+namespace probionis {
+
+namespace {
+
+constexpr int kMaxWaitMs = 30000;
+constexpr std::size_t kMaxFetchBytes = 16u << 20;
+constexpr int kRetryDelayMs = 100;
+// Writes waiting for the committer; more block their writers until it
+// catches up.
+constexpr std::size_t kCommitQueue = 1024;
+// Batches appended by one commit, at most.
+constexpr std::size_t kMaxGroup = 64;
+
+std::uint64_t parameter_or(const std::string& target, const char* name, std::uint64_t fallback) {
+    const std::string value = query_parameter(target, name);
+    return value.empty() ? fallback : std::strtoull(value.c_str(), nullptr, 10);
+}
+
+}  // namespace
+
+ResultsPrimary::ResultsPrimary(const std::string& wal_path, const WalOptions& options)
+    : wal_(wal_path,
+           [this](std::uint64_t lsn, const ResultRecord& record) { store_.apply(lsn, record); },
+           options),
+      commits_(kCommitQueue),
+      committer_([this] { run_committer(); }) {}
+
+ResultsPrimary::~ResultsPrimary() {
+    commits_.close();
+    committer_.join();
+}
+
+std::uint64_t ResultsPrimary::write(const ResultRecord& record) {
+    return write_batch({record});
+}
+
+std::uint64_t ResultsPrimary::write_batch(const std::vector<ResultRecord>& records) {
+    Commit pending{&records, {}};
+    std::future<std::uint64_t> lsn = pending.done.get_future();
+    if (!commits_.push(&pending)) {
+        throw std::runtime_error("ResultsPrimary: closed");
+    }
+    return lsn.get();
+}
+
+void ResultsPrimary::run_committer() {
+    Commit* group[kMaxGroup];
+    while (const std::size_t count = commits_.pop_bulk(group, kMaxGroup)) {
+        commit(group, count);
+    }
+}
+
+void ResultsPrimary::commit(Commit** group, std::size_t count) {
+    std::vector<ResultRecord> joined;
+    if (count > 1) {
+        for (std::size_t i = 0; i < count; ++i) {
+            joined.insert(joined.end(), group[i]->records->begin(), group[i]->records->end());
+        }
+    }
+    const std::vector<ResultRecord>& records = count > 1 ? joined : *group[0]->records;
+    std::uint64_t first = 0;
+    try {
+        first = wal_.append_batch(records);
+    } catch (const std::invalid_argument&) {
+        // A record over the frame limit; nothing was appended. Retry the
+        // batches one at a time so only the one holding it fails.
+        if (count > 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                commit(group + i, 1);
+            }
+            return;
+        }
+        group[0]->done.set_exception(std::current_exception());
+        return;
+    } catch (...) {
+        for (std::size_t i = 0; i < count; ++i) {
+            group[i]->done.set_exception(std::current_exception());
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        store_.apply(first + i, records[i]);
+    }
+    // A writer may return, and free its records, as soon as its value is
+    // set.
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t size = group[i]->records->size();
+        group[i]->done.set_value(first);
+        first += size;
+    }
+}
+
+void ResultsPrimary::serve_wal(const HttpRequest& request, HttpResponse& response) const {
+    const std::uint64_t from = std::max<std::uint64_t>(1, parameter_or(request.target, "from", 1));
+    const auto max_bytes = static_cast<std::size_t>(
+        std::min<std::uint64_t>(parameter_or(request.target, "max_bytes", 1u << 20),
+                                kMaxFetchBytes));
+    const int wait_ms = static_cast<int>(
+        std::min<std::uint64_t>(parameter_or(request.target, "wait_ms", 0), kMaxWaitMs));
+
+    std::uint64_t head = wal_.head();
+    if (head < from && wait_ms > 0) {
+        head = wal_.wait_beyond(from - 1, wait_ms);
+    }
+    response.status = 200;
+    response.body.clear();
+    wal_.read_frames(from, max_bytes, response.body);
+    response.headers.emplace_back("Content-Type", "application/octet-stream");
+    response.headers.emplace_back(kWalHeadHeader, std::to_string(head));
+}
+
+ResultsReplica::ResultsReplica(ReplicaOptions options)
+    : options_(std::move(options)),
+      wal_(options_.wal_path,
+           [this](std::uint64_t lsn, const ResultRecord& record) { store_.apply(lsn, record); },
+           options_.wal) {
+    if (options_.primary_port == 0 || options_.max_staleness_ms <= 0) {
+        throw std::invalid_argument("ResultsReplica: primary port and staleness bound required");
+    }
+}
+
+ResultsReplica::~ResultsReplica() {
+    stop();
+}
+
+void ResultsReplica::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+}
+
+void ResultsReplica::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::int64_t ResultsReplica::staleness_ms() const {
+    const std::int64_t synced = synced_at_ns_.load(std::memory_order_acquire);
+    if (synced < 0) {
+        return -1;
+    }
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 Clock::now().time_since_epoch())
+                                 .count();
+    return (now - synced) / 1000000;
+}
+
+bool ResultsReplica::within_bound() const {
+    const std::int64_t staleness = staleness_ms();
+    return staleness >= 0 && staleness <= options_.max_staleness_ms;
+}
+
+void ResultsReplica::run() {
+    const int wait_ms = std::max(1, options_.max_staleness_ms / 4);
+    // The socket timeout must outlast the long poll.
+    HttpConnection connection(options_.primary_host, options_.primary_port, wait_ms + 5000);
+    const HttpHeaders no_headers;
+    const std::string no_body;
+    HttpResponse response;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+        }
+        const std::string target = "/wal?from=" + std::to_string(wal_.head() + 1) +
+                                   "&max_bytes=" + std::to_string(options_.fetch_bytes) +
+                                   "&wait_ms=" + std::to_string(wait_ms);
+        const Clock::time_point sent = Clock::now();
+        bool ok = connection.exchange("GET", target, no_headers, no_body, response) &&
+                  response.status == 200;
+        if (ok) {
+            try {
+                for (const auto& [lsn, record] :
+                     wal_.append_frames(response.body.data(), response.body.size())) {
+                    store_.apply(lsn, record);
+                }
+            } catch (const std::runtime_error&) {
+                // A gap or bad frame: refetch from our head next round.
+                ok = false;
+            }
+        }
+        if (ok) {
+            const std::string* head = find_header(response.headers, kWalHeadHeader);
+            if (head && wal_.head() >= std::strtoull(head->c_str(), nullptr, 10)) {
+                synced_at_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        sent.time_since_epoch())
+                                        .count(),
+                                    std::memory_order_release);
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait_for(lock, std::chrono::milliseconds(kRetryDelayMs), [this] { return stopping_; });
+    }
+}
+
+}  // namespace probionis
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "net/http.h"
+#include "runtime/mpmc_queue.h"
+#include "storage/results_store.h"
+#include "storage/results_wal.h"
+
+namespace probionis {
+
+// Set on /wal responses: the primary's newest LSN when the reply was built.
+inline constexpr const char* kWalHeadHeader = "X-Probionis-Wal-Head";
+// Set on replica query responses: how far behind the primary they may be.
+inline constexpr const char* kStalenessHeader = "X-Probionis-Staleness-Ms";
+
+// The writable results database: every write is made durable in the WAL
+// before it becomes visible, and the WAL is served to replicas.
+//
+// Writers do not take turns at the log. Each hands its batch to a single
+// committer thread through a lock-free queue and waits; the committer
+// takes every batch queued so far and appends them with one write and one
+// sync (group commit), so concurrent writers share a sync instead of
+// queueing behind one another's.
+class ResultsPrimary {
+public:
+    explicit ResultsPrimary(const std::string& wal_path, const WalOptions& options = {});
+    // Commits the writes already queued.
+    ~ResultsPrimary();
+
+    ResultsPrimary(const ResultsPrimary&) = delete;
+    ResultsPrimary& operator=(const ResultsPrimary&) = delete;
+
+    // Returns the LSN assigned to `record`.
+    std::uint64_t write(const ResultRecord& record);
+    // Durable with a single sync; returns the first LSN. Either all of
+    // `records` are written or none are: a record over the frame limit
+    // throws std::invalid_argument and fails only its own batch.
+    std::uint64_t write_batch(const std::vector<ResultRecord>& records);
+
+    // Handles GET /wal?from=LSN[&max_bytes=N][&wait_ms=W]: returns raw WAL
+    // frames starting at LSN, long-polling up to W ms when there are none
+    // yet so replicas hear about new writes as soon as they happen.
+    void serve_wal(const HttpRequest& request, HttpResponse& response) const;
+
+    const ResultsStore& store() const { return store_; }
+    const ResultsWal& wal() const { return wal_; }
+
+private:
+    struct Commit {
+        const std::vector<ResultRecord>* records;
+        std::promise<std::uint64_t> done;
+    };
+
+    void run_committer();
+    void commit(Commit** group, std::size_t count);
+
+    ResultsStore store_;
+    ResultsWal wal_;
+    // Only the committer appends and applies, which keeps LSN order and
+    // apply order identical.
+    MpmcQueue<Commit*> commits_;
+    std::thread committer_;
+};
+
+struct ReplicaOptions {
+    std::string primary_host = "127.0.0.1";
+    std::uint16_t primary_port = 0;
+    // The replica's own copy of the log, so a restart resumes where it
+    // left off instead of re-shipping everything.
+    std::string wal_path;
+    WalOptions wal;
+    // Queries are refused (503) once the replica cannot show it was caught
+    // up with the primary within this many milliseconds.
+    int max_staleness_ms = 2000;
+    std::size_t fetch_bytes = 1u << 20;
+};
+
+// Read-only copy of the results database for history and dashboard
+// queries. A background thread long-polls the primary's /wal endpoint,
+// appends the frames to the local log and applies them.
+//
+// Staleness is measured conservatively: each time a fetch shows the
+// replica has everything the primary had, the send time of that fetch is
+// recorded; staleness is the time since then. An idle primary still
+// answers the long poll within a quarter of the bound, so a healthy
+// replica of a quiet primary stays fresh.
+class ResultsReplica {
+public:
+    explicit ResultsReplica(ReplicaOptions options);
+    ~ResultsReplica();
+
+    ResultsReplica(const ResultsReplica&) = delete;
+    ResultsReplica& operator=(const ResultsReplica&) = delete;
+
+    void start();
+    void stop();
+
+    const ResultsStore& store() const { return store_; }
+    // -1 until the replica has caught up once.
+    std::int64_t staleness_ms() const;
+    bool within_bound() const;
+    const ReplicaOptions& options() const { return options_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void run();
+
+    ReplicaOptions options_;
+    ResultsStore store_;
+    ResultsWal wal_;
+    std::atomic<std::int64_t> synced_at_ns_{-1};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,161 @@
+#include "storage/results_service.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace probionis {
+
+namespace {
+
+std::string path_of(const std::string& target) {
+    return target.substr(0, target.find('?'));
+}
+
+void append_json_string(std::string& out, const std::string& s) {
+    out.push_back('"');
+    for (const char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+void bad_request(HttpResponse& response, const char* message) {
+    response.status = 400;
+    response.body = message;
+}
+
+}  // namespace
+
+bool handle_results_query(const ResultsStore& store, const HttpRequest& request,
+                          HttpResponse& response) {
+    const std::string path = path_of(request.target);
+    if (path == "/results/history") {
+        const std::string sample_id = query_parameter(request.target, "sample_id");
+        if (sample_id.empty()) {
+            bad_request(response, "sample_id is required\n");
+            return true;
+        }
+        const std::string limit = query_parameter(request.target, "limit");
+        const std::size_t max_entries = limit.empty() ? 100 : std::strtoul(limit.c_str(), nullptr, 10);
+        std::string body = "{\"sample_id\":";
+        append_json_string(body, sample_id);
+        body += ",\"results\":[";
+        bool first = true;
+        for (const ResultRecord& record : store.history(sample_id, max_entries)) {
+            body += first ? "{" : ",{";
+            first = false;
+            body += "\"model_version\":";
+            append_json_string(body, record.model_version);
+            body += ",\"label\":";
+            append_json_string(body, record.label);
+            char numbers[96];
+            std::snprintf(numbers, sizeof(numbers), ",\"score\":%.9g,\"timestamp_ms\":%llu}",
+                          record.score, static_cast<unsigned long long>(record.timestamp_ms));
+            body += numbers;
+        }
+        body += "]}\n";
+        response.status = 200;
+        response.headers.emplace_back("Content-Type", "application/json");
+        response.body = std::move(body);
+        return true;
+    }
+    if (path == "/results/summary") {
+        const std::string tenant = query_parameter(request.target, "tenant");
+        if (tenant.empty()) {
+            bad_request(response, "tenant is required\n");
+            return true;
+        }
+        const std::string since = query_parameter(request.target, "since_ms");
+        const TenantSummary summary =
+            store.summary(tenant, since.empty() ? 0 : std::strtoull(since.c_str(), nullptr, 10));
+        std::string body = "{\"tenant\":";
+        append_json_string(body, tenant);
+        char numbers[96];
+        std::snprintf(numbers, sizeof(numbers), ",\"count\":%llu,\"mean_score\":%.9g,\"labels\":{",
+                      static_cast<unsigned long long>(summary.count), summary.mean_score);
+        body += numbers;
+        bool first = true;
+        for (const auto& [label, count] : summary.labels) {
+            body += first ? "" : ",";
+            first = false;
+            append_json_string(body, label);
+            body += ":" + std::to_string(count);
+        }
+        body += "}}\n";
+        response.status = 200;
+        response.headers.emplace_back("Content-Type", "application/json");
+        response.body = std::move(body);
+        return true;
+    }
+    return false;
+}
+
+std::vector<ResultRecord> parse_result_lines(const std::string& body) {
+    const auto now_ms = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    std::vector<ResultRecord> records;
+    std::istringstream in(body);
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::size_t start = 0;
+        for (std::size_t tab; (tab = line.find('\t', start)) != std::string::npos; start = tab + 1) {
+            fields.push_back(line.substr(start, tab - start));
+        }
+        fields.push_back(line.substr(start));
+        char* end = nullptr;
+        ResultRecord record;
+        if (fields.size() == 5 || fields.size() == 6) {
+            record.score = std::strtof(fields[4].c_str(), &end);
+        }
+        if (!end || *end != '\0' || fields[0].empty()) {
+            throw std::invalid_argument("result line " + std::to_string(line_number) +
+                                        ": expected sample_id, tenant, model_version, label, "
+                                        "score[, timestamp_ms]");
+        }
+        record.sample_id = fields[0];
+        record.tenant = fields[1];
+        record.model_version = fields[2];
+        record.label = fields[3];
+        record.timestamp_ms =
+            fields.size() == 6 ? std::strtoull(fields[5].c_str(), nullptr, 10) : now_ms;
+        records.push_back(std::move(record));
+    }
+    return records;
+}
+
+std::string format_result_line(const ResultRecord& record) {
+    char numbers[64];
+    std::snprintf(numbers, sizeof(numbers), "%.9g\t%llu\n", record.score,
+                  static_cast<unsigned long long>(record.timestamp_ms));
+    return record.sample_id + "\t" + record.tenant + "\t" + record.model_version + "\t" +
+           record.label + "\t" + numbers;
+}
+
+}  // namespace probionis
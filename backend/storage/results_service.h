@@ -0,0 +1,26 @@
+#pragma once
+
+#include "net/http.h"
+#include "storage/results_store.h"
+
+namespace probionis {
+
+// Read endpoints shared by the primary and its replicas:
+//
+//   GET /results/history?sample_id=ID[&limit=N]
+//   GET /results/summary?tenant=T[&since_ms=MS]
+//
+// Returns false (leaving `response` untouched) for any other target.
+bool handle_results_query(const ResultsStore& store, const HttpRequest& request,
+                          HttpResponse& response);
+
+// Parses the body of POST /results: one record per line as
+// sample_id TAB tenant TAB model_version TAB label TAB score [TAB timestamp_ms].
+// A missing timestamp is filled with the current time. Throws
+// std::invalid_argument naming the bad line.
+std::vector<ResultRecord> parse_result_lines(const std::string& body);
+
+// One line of that format, timestamp included, ending in '\n'.
+std::string format_result_line(const ResultRecord& record);
+
+}  // namespace probionis
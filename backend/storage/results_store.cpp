@@ -0,0 +1,132 @@
+#include "storage/results_store.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "runtime/varint.h"
+
+namespace probionis {
+
+bool operator==(const ResultRecord& a, const ResultRecord& b) {
+    return a.timestamp_ms == b.timestamp_ms && a.score == b.score && a.sample_id == b.sample_id &&
+           a.tenant == b.tenant && a.model_version == b.model_version && a.label == b.label;
+}
+
+std::string encode_result_record(const ResultRecord& record) {
+    std::string out;
+    out.reserve(24 + record.sample_id.size() + record.tenant.size() +
+                record.model_version.size() + record.label.size());
+    put_varint(out, record.timestamp_ms);
+    put_string(out, record.sample_id);
+    put_string(out, record.tenant);
+    put_string(out, record.model_version);
+    put_string(out, record.label);
+    char score[sizeof(float)];
+    std::memcpy(score, &record.score, sizeof(score));
+    out.append(score, sizeof(score));
+    return out;
+}
+
+bool decode_result_record(const char* data, std::size_t size, ResultRecord& record) {
+    std::size_t offset = 0;
+    if (!get_varint(data, size, offset, record.timestamp_ms) ||
+        !get_string(data, size, offset, record.sample_id) ||
+        !get_string(data, size, offset, record.tenant) ||
+        !get_string(data, size, offset, record.model_version) ||
+        !get_string(data, size, offset, record.label) || size - offset != sizeof(float)) {
+        return false;
+    }
+    std::memcpy(&record.score, data + offset, sizeof(float));
+    return true;
+}
+
+void ResultsStore::apply(std::uint64_t lsn, const ResultRecord& record) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (lsn <= applied_lsn_) {
+        return;
+    }
+    const auto index = static_cast<std::uint32_t>(records_.size());
+    records_.push_back(record);
+    by_sample_[record.sample_id].push_back(index);
+    by_tenant_[record.tenant].push_back(index);
+    applied_lsn_ = lsn;
+}
+
+std::vector<ResultRecord> ResultsStore::history(const std::string& sample_id,
+                                                std::size_t limit) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<ResultRecord> result;
+    const auto it = by_sample_.find(sample_id);
+    if (it == by_sample_.end()) {
+        return result;
+    }
+    for (auto index = it->second.rbegin(); index != it->second.rend() && result.size() < limit;
+         ++index) {
+        result.push_back(records_[*index]);
+    }
+    return result;
+}
+
+TenantSummary ResultsStore::summary(const std::string& tenant, std::uint64_t since_ms) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    TenantSummary summary;
+    const auto it = by_tenant_.find(tenant);
+    if (it == by_tenant_.end()) {
+        return summary;
+    }
+    double total = 0.0;
+    for (const std::uint32_t index : it->second) {
+        const ResultRecord& record = records_[index];
+        if (record.timestamp_ms < since_ms) {
+            continue;
+        }
+        ++summary.count;
+        total += record.score;
+        ++summary.labels[record.label];
+    }
+    summary.mean_score = summary.count ? total / static_cast<double>(summary.count) : 0.0;
+    return summary;
+}
+
+bool ResultsStore::contains(const ResultRecord& record) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto it = by_sample_.find(record.sample_id);
+    if (it == by_sample_.end()) {
+        return false;
+    }
+    for (const std::uint32_t index : it->second) {
+        if (records_[index] == record) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<ResultRecord> ResultsStore::missing(const std::vector<ResultRecord>& records) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<ResultRecord> result;
+    for (const ResultRecord& record : records) {
+        const auto it = by_sample_.find(record.sample_id);
+        const bool stored =
+            it != by_sample_.end() &&
+            std::any_of(it->second.begin(), it->second.end(),
+                        [&](std::uint32_t index) { return records_[index] == record; });
+        if (!stored) {
+            result.push_back(record);
+        }
+    }
+    return result;
+}
+
+std::uint64_t ResultsStore::applied_lsn() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return applied_lsn_;
+}
+
+std::size_t ResultsStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return records_.size();
+}
+
+}  // namespace probionis
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace probionis {
+
+// One stored prediction.
+struct ResultRecord {
+    std::string sample_id;
+    std::string tenant;
+    std::string model_version;
+    std::string label;
+    float score = 0.0f;
+    std::uint64_t timestamp_ms = 0;
+};
+
+bool operator==(const ResultRecord& a, const ResultRecord& b);
+
+std::string encode_result_record(const ResultRecord& record);
+bool decode_result_record(const char* data, std::size_t size, ResultRecord& record);
+
+struct TenantSummary {
+    std::uint64_t count = 0;
+    double mean_score = 0.0;
+    std::map<std::string, std::uint64_t> labels;
+};
+
+// In-memory query state of the results database, rebuilt from the WAL on
+// start. The primary and every replica hold one; writes arrive through
+// apply() in log order, tagged with their log sequence number (LSN).
+class ResultsStore {
+public:
+    // Entries at or below applied_lsn() are ignored, so re-delivery after
+    // a reconnect is harmless.
+    void apply(std::uint64_t lsn, const ResultRecord& record);
+
+    // Most recent first, at most `limit` entries.
+    std::vector<ResultRecord> history(const std::string& sample_id, std::size_t limit) const;
+    // Aggregate over the tenant's results with timestamp >= since_ms.
+    TenantSummary summary(const std::string& tenant, std::uint64_t since_ms) const;
+
+    // Whether an identical record (every field equal) is stored; lets
+    // writers that may retry after a crash apply idempotently.
+    bool contains(const ResultRecord& record) const;
+    // The entries of `records` not stored yet, in order; one lock for the
+    // whole batch instead of one per contains() call.
+    std::vector<ResultRecord> missing(const std::vector<ResultRecord>& records) const;
+
+    std::uint64_t applied_lsn() const;
+    std::size_t size() const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::uint64_t applied_lsn_ = 0;
+    std::vector<ResultRecord> records_;
+    std::unordered_map<std::string, std::vector<std::uint32_t>> by_sample_;
+    std::unordered_map<std::string, std::vector<std::uint32_t>> by_tenant_;
+};
+
+}  // namespace probionis
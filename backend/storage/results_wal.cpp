@@ -0,0 +1,315 @@
+#include "storage/results_wal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "runtime/hash.h"
+
+namespace probionis {
+
+namespace {
+
+constexpr char kWalMagic[4] = {'P', 'B', 'W', 'L'};
+constexpr std::uint32_t kWalVersion = 1;
+constexpr std::size_t kHeaderSize = 8;
+constexpr std::size_t kFrameHeaderSize = 16;
+// Guards the reader against a garbage length in a corrupt frame.
+constexpr std::uint32_t kMaxPayload = 1u << 20;
+
+std::runtime_error wal_error(const std::string& what) {
+    return std::runtime_error("results WAL: " + what + ": " + std::strerror(errno));
+}
+
+std::uint32_t frame_checksum(std::uint64_t lsn, const char* payload, std::size_t size) {
+    const std::uint64_t seeded = fnv1a64(&lsn, sizeof(lsn));
+    return static_cast<std::uint32_t>(fnv1a64(payload, size, seeded));
+}
+
+std::string make_frame(std::uint64_t lsn, const std::string& payload) {
+    if (payload.size() > kMaxPayload) {
+        throw std::invalid_argument("results WAL: record of " + std::to_string(payload.size()) +
+                                    " bytes exceeds the frame limit");
+    }
+    std::string frame(kFrameHeaderSize, '\0');
+    const auto length = static_cast<std::uint32_t>(payload.size());
+    const std::uint32_t checksum = frame_checksum(lsn, payload.data(), payload.size());
+    std::memcpy(&frame[0], &length, 4);
+    std::memcpy(&frame[4], &checksum, 4);
+    std::memcpy(&frame[8], &lsn, 8);
+    frame += payload;
+    return frame;
+}
+
+void write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw wal_error("write failed");
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+}  // namespace
+
+bool ResultsWal::parse_frame(const char* data, std::size_t size, std::size_t& offset,
+                             std::uint64_t& lsn, ResultRecord& record) {
+    if (size - offset < kFrameHeaderSize) {
+        return false;
+    }
+    std::uint32_t length = 0;
+    std::uint32_t checksum = 0;
+    std::memcpy(&length, data + offset, 4);
+    std::memcpy(&checksum, data + offset + 4, 4);
+    std::memcpy(&lsn, data + offset + 8, 8);
+    if (length > kMaxPayload || size - offset - kFrameHeaderSize < length) {
+        return false;
+    }
+    const char* payload = data + offset + kFrameHeaderSize;
+    if (frame_checksum(lsn, payload, length) != checksum ||
+        !decode_result_record(payload, length, record)) {
+        return false;
+    }
+    offset += kFrameHeaderSize + length;
+    return true;
+}
+
+ResultsWal::ResultsWal(const std::string& path, const ReplayFn& replay, const WalOptions& options)
+    : options_(options) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw wal_error("cannot open " + path);
+    }
+    // One writer per log: a second process appending would hand out the
+    // same LSNs. The lock goes with the descriptor.
+    if (::flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+        const std::runtime_error error =
+            errno == EWOULDBLOCK
+                ? std::runtime_error("results WAL: " + path + " is open by another writer")
+                : wal_error("cannot lock " + path);
+        ::close(fd_);
+        throw error;
+    }
+    struct stat st{};
+    ::fstat(fd_, &st);
+    std::string contents(static_cast<std::size_t>(st.st_size), '\0');
+    if (!contents.empty() && ::pread(fd_, &contents[0], contents.size(), 0) != st.st_size) {
+        ::close(fd_);
+        throw wal_error("cannot read " + path);
+    }
+
+    if (contents.size() < kHeaderSize) {
+        // New (or header-torn) log.
+        char header[kHeaderSize];
+        std::memcpy(header, kWalMagic, 4);
+        std::memcpy(header + 4, &kWalVersion, 4);
+        if (::ftruncate(fd_, 0) != 0 || ::pwrite(fd_, header, kHeaderSize, 0) != kHeaderSize) {
+            ::close(fd_);
+            throw wal_error("cannot initialise " + path);
+        }
+        contents.assign(header, kHeaderSize);
+    } else {
+        std::uint32_t version = 0;
+        std::memcpy(&version, contents.data() + 4, 4);
+        if (std::memcmp(contents.data(), kWalMagic, 4) != 0 || version != kWalVersion) {
+            ::close(fd_);
+            throw std::runtime_error("results WAL: " + path + " is not a version 1 log");
+        }
+    }
+
+    std::size_t offset = kHeaderSize;
+    offsets_.push_back(offset);
+    std::uint64_t lsn = 0;
+    ResultRecord record;
+    while (offset < contents.size()) {
+        const std::size_t frame_start = offset;
+        if (!parse_frame(contents.data(), contents.size(), offset, lsn, record)) {
+            // Only the tail may be damaged: a frame with more data behind it
+            // that fails its checksum means the log itself is corrupt.
+            std::uint32_t length = 0;
+            if (contents.size() - frame_start >= 4) {
+                std::memcpy(&length, contents.data() + frame_start, 4);
+            }
+            if (contents.size() - frame_start >= kFrameHeaderSize &&
+                length <= kMaxPayload &&
+                contents.size() - frame_start - kFrameHeaderSize > length) {
+                ::close(fd_);
+                throw std::runtime_error("results WAL: corrupt frame in " + path);
+            }
+            break;
+        }
+        if (lsn != offsets_.size()) {
+            ::close(fd_);
+            throw std::runtime_error("results WAL: LSN gap in " + path);
+        }
+        replay(lsn, record);
+        offsets_.push_back(offset);
+    }
+    if (offsets_.back() != contents.size() && ::ftruncate(fd_, offsets_.back()) != 0) {
+        ::close(fd_);
+        throw wal_error("cannot truncate torn tail of " + path);
+    }
+    ::lseek(fd_, static_cast<off_t>(offsets_.back()), SEEK_SET);
+}
+
+ResultsWal::~ResultsWal() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void ResultsWal::write_locked(const char* data, std::size_t size) {
+    try {
+        write_all(fd_, data, size);
+        if (options_.sync_each_append && ::fdatasync(fd_) != 0) {
+            throw wal_error("fdatasync failed");
+        }
+    } catch (...) {
+        if (::ftruncate(fd_, static_cast<off_t>(offsets_.back())) == 0) {
+            ::lseek(fd_, static_cast<off_t>(offsets_.back()), SEEK_SET);
+        }
+        throw;
+    }
+}
+
+std::uint64_t ResultsWal::append(const ResultRecord& record) {
+    const std::string payload = encode_result_record(record);
+    std::uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lsn = offsets_.size();
+        const std::string frame = make_frame(lsn, payload);
+        write_locked(frame.data(), frame.size());
+        offsets_.push_back(offsets_.back() + frame.size());
+    }
+    appended_.notify_all();
+    return lsn;
+}
+
+std::uint64_t ResultsWal::append_batch(const std::vector<ResultRecord>& records) {
+    std::uint64_t first;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        first = offsets_.size();
+        if (records.empty()) {
+            return first;
+        }
+        std::string frames;
+        std::vector<std::size_t> sizes;
+        sizes.reserve(records.size());
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            const std::size_t before = frames.size();
+            frames += make_frame(first + i, encode_result_record(records[i]));
+            sizes.push_back(frames.size() - before);
+        }
+        write_locked(frames.data(), frames.size());
+        for (const std::size_t size : sizes) {
+            offsets_.push_back(offsets_.back() + size);
+        }
+    }
+    appended_.notify_all();
+    return first;
+}
+
+std::vector<std::pair<std::uint64_t, ResultRecord>> ResultsWal::append_frames(const char* data,
+                                                                              std::size_t size) {
+    std::vector<std::pair<std::uint64_t, ResultRecord>> appended;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::size_t offset = 0;
+        std::uint64_t lsn = 0;
+        ResultRecord record;
+        // Frames past the head are contiguous in `data`: [first, offset).
+        std::size_t first = size;
+        std::vector<std::size_t> sizes;
+        std::uint64_t head = offsets_.size() - 1;
+        while (offset < size) {
+            const std::size_t start = offset;
+            if (!parse_frame(data, size, offset, lsn, record)) {
+                throw std::runtime_error("results WAL: malformed shipped frame");
+            }
+            if (lsn <= head && appended.empty()) {
+                continue;
+            }
+            if (lsn != head + 1) {
+                throw std::runtime_error("results WAL: shipped frames skip from LSN " +
+                                         std::to_string(head) + " to " + std::to_string(lsn));
+            }
+            first = std::min(first, start);
+            sizes.push_back(offset - start);
+            appended.emplace_back(lsn, record);
+            head = lsn;
+        }
+        if (!appended.empty()) {
+            write_locked(data + first, offset - first);
+            for (const std::size_t frame_size : sizes) {
+                offsets_.push_back(offsets_.back() + frame_size);
+            }
+        }
+    }
+    if (!appended.empty()) {
+        appended_.notify_all();
+    }
+    return appended;
+}
+
+std::size_t ResultsWal::read_frames(std::uint64_t from_lsn, std::size_t max_bytes,
+                                    std::string& out) const {
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::uint64_t head = offsets_.size() - 1;
+        if (from_lsn == 0) {
+            from_lsn = 1;
+        }
+        if (from_lsn > head) {
+            return 0;
+        }
+        begin = offsets_[from_lsn - 1];
+        std::uint64_t last = from_lsn;
+        while (last < head && offsets_[last + 1] - begin <= max_bytes) {
+            ++last;
+        }
+        end = offsets_[last];
+        count = static_cast<std::size_t>(last - from_lsn + 1);
+    }
+    // Frames already indexed are never rewritten, so the copy needs no lock.
+    const std::size_t old_size = out.size();
+    out.resize(old_size + static_cast<std::size_t>(end - begin));
+    std::size_t done = 0;
+    while (done < end - begin) {
+        const ssize_t n = ::pread(fd_, &out[old_size + done], end - begin - done,
+                                  static_cast<off_t>(begin + done));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            throw wal_error("pread failed");
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return count;
+}
+
+std::uint64_t ResultsWal::wait_beyond(std::uint64_t lsn, int timeout_ms) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    appended_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                       [&] { return offsets_.size() - 1 > lsn; });
+    return offsets_.size() - 1;
+}
+
+std::uint64_t ResultsWal::head() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return offsets_.size() - 1;
+}
+
+}  // namespace probionis
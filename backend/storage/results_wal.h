@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "storage/results_store.h"
+
+namespace probionis {
+
+struct WalOptions {
+    // fdatasync after every append. Off, appends reach the page cache only
+    // and a host crash may lose the newest entries (never corrupt older ones).
+    bool sync_each_append = true;
+};
+
+// Append-only write-ahead log of result records. It is both the primary's
+// durability mechanism and the unit of replication: replicas receive the
+// primary's frames byte for byte and append them to their own log, so
+// every copy has identical LSNs.
+//
+// Layout: "PBWL" magic, u32 version, then frames of
+//   u32 payload length, u32 checksum, u64 LSN, payload
+// where the checksum covers LSN and payload. A torn final frame is cut off
+// on open.
+class ResultsWal {
+public:
+    using ReplayFn = std::function<void(std::uint64_t lsn, const ResultRecord& record)>;
+
+    // Opens or creates the log at `path`, passing every intact entry to
+    // `replay` in order. Throws std::runtime_error on I/O errors, a corrupt
+    // (not merely truncated) log, or a log another ResultsWal, in this
+    // process or any other, already has open.
+    ResultsWal(const std::string& path, const ReplayFn& replay, const WalOptions& options = {});
+    ~ResultsWal();
+
+    ResultsWal(const ResultsWal&) = delete;
+    ResultsWal& operator=(const ResultsWal&) = delete;
+
+    // Appends with the next LSN and returns it. Throws std::invalid_argument
+    // if the encoded record exceeds the frame limit (1 MiB), since recovery
+    // would stop at such a frame.
+    std::uint64_t append(const ResultRecord& record);
+    // Appends `records` with consecutive LSNs in one write and one sync;
+    // returns the first LSN (head() + 1 if `records` is empty). Either all
+    // records are appended or none are.
+    std::uint64_t append_batch(const std::vector<ResultRecord>& records);
+
+    // Appends frames shipped from another log. The first frame must carry
+    // head() + 1 and LSNs must be consecutive; frames at or below head()
+    // are skipped. Returns the records appended, in order, for the caller
+    // to apply. Throws std::runtime_error on a malformed frame or a gap.
+    std::vector<std::pair<std::uint64_t, ResultRecord>> append_frames(const char* data,
+                                                                      std::size_t size);
+
+    // Copies whole frames starting at `from_lsn` into `out`, stopping
+    // before `max_bytes` is exceeded (at least one frame is copied if any
+    // exists). Returns the number of frames.
+    std::size_t read_frames(std::uint64_t from_lsn, std::size_t max_bytes, std::string& out) const;
+
+    // Blocks until head() > lsn or `timeout_ms` passes; returns head().
+    std::uint64_t wait_beyond(std::uint64_t lsn, int timeout_ms) const;
+
+    std::uint64_t head() const;
+
+    // Parses one frame at `offset`; false if it is incomplete or corrupt.
+    static bool parse_frame(const char* data, std::size_t size, std::size_t& offset,
+                            std::uint64_t& lsn, ResultRecord& record);
+
+private:
+    // Appends encoded frames and syncs them if configured; on failure the
+    // file is cut back to the last indexed frame so later appends do not
+    // land behind a torn one. Callers index the frames only after it
+    // returns, so readers never see an LSN that is not durable.
+    void write_locked(const char* data, std::size_t size);
+
+    int fd_ = -1;
+    WalOptions options_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable appended_;
+    // offsets_[i] is the file offset of LSN i + 1; back() is the end.
+    std::vector<std::uint64_t> offsets_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,186 @@
+#include "storage/spectrum_pyramid.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace probionis {
+
+namespace {
+
+constexpr char kPyramidMagic[4] = {'P', 'B', 'P', 'Y'};
+constexpr std::uint32_t kPyramidVersion = 1;
+
+// Number of raw channels merged into bin `index` of `level`; only the last
+// bin of a level can be short.
+inline std::size_t bin_weight(std::size_t channels, unsigned level, std::size_t index) {
+    const std::size_t width = std::size_t{1} << level;
+    return std::min(width, channels - index * width);
+}
+
+void append_bytes(std::vector<std::uint8_t>& out, const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+template <typename T>
+void append_pod(std::vector<std::uint8_t>& out, T value) {
+    append_bytes(out, &value, sizeof(value));
+}
+
+template <typename T>
+T read_pod(const std::uint8_t* data, std::size_t size, std::size_t& offset) {
+    if (size - offset < sizeof(T)) {
+        throw std::runtime_error("SpectrumPyramid: truncated data");
+    }
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+}  // namespace
+
+SpectrumPyramid SpectrumPyramid::build(const Spectrum& spectrum, std::size_t top_bins) {
+    if (spectrum.axis.size() != spectrum.intensity.size()) {
+        throw std::invalid_argument("SpectrumPyramid::build: axis/intensity length mismatch");
+    }
+    SpectrumPyramid pyramid;
+    const std::size_t n = spectrum.size();
+    pyramid.channels_ = n;
+    top_bins = std::max<std::size_t>(top_bins, 1);
+
+    // Total size is below 2n bins; reserve once so level pointers are stable.
+    pyramid.bins_.reserve(2 * n + 1);
+    pyramid.level_offsets_.push_back(0);
+    for (std::size_t i = 0; i < n; ++i) {
+        const float v = spectrum.intensity[i];
+        pyramid.bins_.push_back({spectrum.axis[i], v, v, v});
+    }
+    pyramid.level_offsets_.push_back(pyramid.bins_.size());
+
+    unsigned level = 0;
+    std::size_t count = n;
+    while (count > top_bins) {
+        const std::size_t src = pyramid.level_offsets_[level];
+        const std::size_t next_count = (count + 1) / 2;
+        for (std::size_t j = 0; j < next_count; ++j) {
+            const PyramidBin a = pyramid.bins_[src + 2 * j];
+            if (2 * j + 1 >= count) {
+                pyramid.bins_.push_back(a);
+                continue;
+            }
+            const PyramidBin b = pyramid.bins_[src + 2 * j + 1];
+            const float wa = static_cast<float>(bin_weight(n, level, 2 * j));
+            const float wb = static_cast<float>(bin_weight(n, level, 2 * j + 1));
+            const float inv = 1.0f / (wa + wb);
+            pyramid.bins_.push_back({(a.x * wa + b.x * wb) * inv, std::min(a.min, b.min),
+                                     std::max(a.max, b.max),
+                                     (a.mean * wa + b.mean * wb) * inv});
+        }
+        pyramid.level_offsets_.push_back(pyramid.bins_.size());
+        count = next_count;
+        ++level;
+    }
+    return pyramid;
+}
+
+std::vector<std::uint8_t> SpectrumPyramid::serialize() const {
+    std::vector<std::uint8_t> out;
+    out.reserve(24 + level_offsets_.size() * sizeof(std::uint64_t) +
+                bins_.size() * sizeof(PyramidBin));
+    append_bytes(out, kPyramidMagic, sizeof(kPyramidMagic));
+    append_pod(out, kPyramidVersion);
+    append_pod(out, static_cast<std::uint64_t>(channels_));
+    append_pod(out, static_cast<std::uint32_t>(level_offsets_.size()));
+    for (std::size_t offset : level_offsets_) {
+        append_pod(out, static_cast<std::uint64_t>(offset));
+    }
+    append_bytes(out, bins_.data(), bins_.size() * sizeof(PyramidBin));
+    return out;
+}
+
+SpectrumPyramid SpectrumPyramid::deserialize(const std::uint8_t* data, std::size_t size) {
+    std::size_t offset = 0;
+    if (size < sizeof(kPyramidMagic) ||
+        std::memcmp(data, kPyramidMagic, sizeof(kPyramidMagic)) != 0) {
+        throw std::runtime_error("SpectrumPyramid: bad magic");
+    }
+    offset += sizeof(kPyramidMagic);
+    if (read_pod<std::uint32_t>(data, size, offset) != kPyramidVersion) {
+        throw std::runtime_error("SpectrumPyramid: unsupported version");
+    }
+
+    SpectrumPyramid pyramid;
+    pyramid.channels_ = static_cast<std::size_t>(read_pod<std::uint64_t>(data, size, offset));
+    const std::uint32_t offsets = read_pod<std::uint32_t>(data, size, offset);
+    for (std::uint32_t i = 0; i < offsets; ++i) {
+        pyramid.level_offsets_.push_back(
+            static_cast<std::size_t>(read_pod<std::uint64_t>(data, size, offset)));
+    }
+    // Level 0 is the raw channels and each level above halves the one
+    // below, rounding up; only a level of two or more bins is reduced.
+    const std::vector<std::size_t>& levels = pyramid.level_offsets_;
+    bool consistent =
+        levels.size() >= 2 && levels[0] == 0 && levels[1] == pyramid.channels_;
+    for (std::size_t k = 2; consistent && k < levels.size(); ++k) {
+        const std::size_t below = levels[k - 1] - levels[k - 2];
+        consistent = below > 1 && levels[k] > levels[k - 1] &&
+                     levels[k] - levels[k - 1] == (below + 1) / 2;
+    }
+    const std::size_t bins = consistent ? levels.back() : 0;
+    if (!consistent || (size - offset) / sizeof(PyramidBin) < bins) {
+        throw std::runtime_error("SpectrumPyramid: corrupt level table");
+    }
+    pyramid.bins_.resize(bins);
+    std::memcpy(pyramid.bins_.data(), data + offset, bins * sizeof(PyramidBin));
+    return pyramid;
+}
+
+bool SpectrumPyramid::describes(const Spectrum& spectrum) const {
+    if (channels_ != spectrum.size() || spectrum.axis.size() != spectrum.size() ||
+        levels() == 0) {
+        return false;
+    }
+    // Compare bits, so NaN channels match themselves.
+    for (std::size_t i = 0; i < channels_; ++i) {
+        const PyramidBin& bin = bins_[i];
+        if (std::memcmp(&bin.x, &spectrum.axis[i], sizeof(float)) != 0 ||
+            std::memcmp(&bin.mean, &spectrum.intensity[i], sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PyramidSlice SpectrumPyramid::level(unsigned index) const {
+    if (index >= levels()) {
+        return {};
+    }
+    const std::size_t begin = level_offsets_[index];
+    return {index, bins_.data() + begin, level_offsets_[index + 1] - begin};
+}
+
+PyramidSlice SpectrumPyramid::query(float x_lo, float x_hi, std::size_t max_points) const {
+    if (x_hi < x_lo) {
+        std::swap(x_lo, x_hi);
+    }
+    const auto by_x = [](const PyramidBin& bin, float x) { return bin.x < x; };
+    PyramidSlice slice;
+    for (unsigned k = 0; k < levels(); ++k) {
+        const PyramidSlice all = level(k);
+        const PyramidBin* end = all.bins + all.count;
+        // Include one bin either side so lines reach the viewport edges.
+        const PyramidBin* first = std::lower_bound(all.bins, end, x_lo, by_x);
+        const PyramidBin* last = std::lower_bound(first, end, x_hi, by_x);
+        if (first != all.bins) --first;
+        if (last != end) ++last;
+        slice = {k, first, static_cast<std::size_t>(last - first)};
+        if (slice.count <= max_points) {
+            break;
+        }
+    }
+    return slice;
+}
+
+}  // namespace probionis
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spectrum/spectrum.h"
+
+namespace probionis {
+
+// One bin of a pyramid level: the channels it covers summarized by their
+// centre position and intensity envelope. 16 bytes, so a level is a flat
+// array the UI can draw directly.
+struct PyramidBin {
+    float x;
+    float min;
+    float max;
+    float mean;
+};
+static_assert(sizeof(PyramidBin) == 16, "PyramidBin is serialized as-is");
+
+// Contiguous run of bins from a single level answering a viewport request.
+struct PyramidSlice {
+    unsigned level = 0;
+    const PyramidBin* bins = nullptr;
+    std::size_t count = 0;
+};
+
+// Min/max/mean summaries of a spectrum at power-of-two reductions. Level 0
+// holds the raw channels and level k merges 2^k of them, so any zoom level
+// is answered by one slice of a single level instead of re-reducing the
+// raw data.
+//
+// Built once per sample and kept next to it in serialize() form; the
+// report service stores one beside each sample's reports and reads it back
+// for every later render and for zoom requests (GET /reports/spectrum).
+class SpectrumPyramid {
+public:
+    // Levels are added until one has at most `top_bins` bins.
+    static SpectrumPyramid build(const Spectrum& spectrum, std::size_t top_bins = 32);
+
+    // Compact byte form stored with the sample; little-endian host layout.
+    // deserialize() throws std::runtime_error unless the level table is one
+    // build() could have produced: level 0 holds every channel and each
+    // level halves the one below, rounding up.
+    std::vector<std::uint8_t> serialize() const;
+    static SpectrumPyramid deserialize(const std::uint8_t* data, std::size_t size);
+
+    // True if level 0 holds exactly `spectrum`'s channels, bit for bit, so a
+    // stored pyramid can be trusted for it.
+    bool describes(const Spectrum& spectrum) const;
+
+    // Bins covering [x_lo, x_hi] from the finest level that needs at most
+    // `max_points` bins for that range.
+    PyramidSlice query(float x_lo, float x_hi, std::size_t max_points) const;
+
+    std::size_t channels() const { return channels_; }
+    std::size_t levels() const { return level_offsets_.empty() ? 0 : level_offsets_.size() - 1; }
+    PyramidSlice level(unsigned index) const;
+
+private:
+    std::size_t channels_ = 0;
+    // Bins of all levels back to back; level k spans
+    // [level_offsets_[k], level_offsets_[k + 1]).
+    std::vector<PyramidBin> bins_;
+    std::vector<std::size_t> level_offsets_;
+};
+
+}  // namespace probionis
@@ -0,0 +1,230 @@
+// Sources: inference/batch_scheduler.cpp inference/batch_tuner.cpp
+//          inference/shadow_evaluator.cpp spectrum/batch_slab.cpp spectrum/spectrum_batch.cpp
+//          preprocess/pipeline.cpp preprocess/qc_gate.cpp runtime/executor.cpp
+//          runtime/metrics.cpp runtime/huge_page_allocator.cpp runtime/vector_math.cpp
+//          runtime/deadline_timer.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "inference/batch_scheduler.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+constexpr std::size_t kChannels = 8;
+
+// Claims a row, fills it with `value` and commits it.
+SlabTicket submit(BatchScheduler& scheduler, float value, const std::string& sample_id) {
+    SlabSlot slot = scheduler.claim();
+    std::fill(slot.data(), slot.data() + kChannels, value);
+    SlabTicket ticket;
+    CHECK(scheduler.commit(slot, ticket, sample_id).ok());
+    return ticket;
+}
+
+// Doubles the first channel of each row.
+void doubler(SpectrumBatch& batch, float* outputs) {
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        outputs[i] = 2.0f * batch.row(i)[0];
+    }
+}
+
+std::uint64_t counter(const char* name) { return global_metrics().counter(name).value(); }
+
+BatchSchedulerOptions options(std::size_t max_batch, std::chrono::microseconds max_delay) {
+    BatchSchedulerOptions o;
+    o.channels = kChannels;
+    o.max_batch = max_batch;
+    o.max_delay = max_delay;
+    return o;
+}
+
+// The claim that fills a slab seals it; its deadline never fires.
+void test_full_seal(Executor& executor) {
+    const std::uint64_t deadline_seals = counter("probionis_batch_deadline_seals_total");
+    std::vector<std::size_t> sizes;
+    BatchScheduler scheduler(options(4, std::chrono::seconds(10)),
+                             [&sizes](SpectrumBatch& batch, float* outputs) {
+                                 sizes.push_back(batch.size());
+                                 doubler(batch, outputs);
+                             },
+                             executor);
+    std::vector<SlabTicket> tickets;
+    for (int i = 0; i < 4; ++i) {
+        tickets.push_back(submit(scheduler, static_cast<float>(i), "s" + std::to_string(i)));
+    }
+    for (int i = 0; i < 4; ++i) {
+        tickets[i].wait();
+        CHECK(tickets[i].output()[0] == 2.0f * static_cast<float>(i));
+    }
+    CHECK(sizes == std::vector<std::size_t>{4});
+    CHECK(counter("probionis_batch_deadline_seals_total") == deadline_seals);
+}
+
+// A slab that never fills is sealed max_delay after its first claim.
+void test_deadline_seal(Executor& executor) {
+    const std::uint64_t deadline_seals = counter("probionis_batch_deadline_seals_total");
+    std::atomic<std::size_t> rows{0};
+    BatchScheduler scheduler(options(64, std::chrono::milliseconds(20)),
+                             [&rows](SpectrumBatch& batch, float* outputs) {
+                                 rows += batch.size();
+                                 doubler(batch, outputs);
+                             },
+                             executor);
+    SlabTicket a = submit(scheduler, 1.0f, "a");
+    SlabTicket b = submit(scheduler, 2.0f, "b");
+    a.wait();
+    b.wait();
+    CHECK(rows.load() == 2);
+    CHECK(a.output()[0] == 2.0f && b.output()[0] == 4.0f);
+    CHECK(counter("probionis_batch_deadline_seals_total") == deadline_seals + 1);
+}
+
+// Rows the QC gate rejects, and rows their owner abandons, never reach the
+// batch; the others keep their own outputs.
+void test_qc_rejection_and_abandon(Executor& executor) {
+    const std::uint64_t rejected = counter("probionis_batch_qc_rejected_total");
+    const std::uint64_t abandoned = counter("probionis_batch_abandoned_rows_total");
+    QcThresholds thresholds;
+    thresholds.min_snr = 0.0;
+    auto pipeline = std::make_shared<Pipeline>();
+    pipeline->set_qc_gate(std::make_shared<QcGate>(thresholds));
+    BatchSchedulerOptions o = options(4, std::chrono::seconds(10));
+    o.pipeline = pipeline;
+    std::vector<std::string> batched;
+    BatchScheduler scheduler(o,
+                             [&batched](SpectrumBatch& batch, float* outputs) {
+                                 for (std::size_t i = 0; i < batch.size(); ++i) {
+                                     batched.push_back(batch.sample_id(i));
+                                 }
+                                 doubler(batch, outputs);
+                             },
+                             executor);
+    SlabTicket good = submit(scheduler, 100.0f, "good");
+
+    SlabSlot dark_slot = scheduler.claim();
+    std::fill(dark_slot.data(), dark_slot.data() + kChannels, 1.0f);
+    SlabTicket dark;
+    const QcResult qc = scheduler.commit(dark_slot, dark, "dark");
+    CHECK(qc.reason == QcReason::kDark && !dark);
+
+    SlabSlot dropped = scheduler.claim();
+    dropped.abandon();
+
+    SlabTicket last = submit(scheduler, 300.0f, "last");
+    good.wait();
+    last.wait();
+    CHECK(good.output()[0] == 200.0f && last.output()[0] == 600.0f);
+    CHECK((batched == std::vector<std::string>{"good", "last"}));
+    CHECK(counter("probionis_batch_qc_rejected_total") == rejected + 1);
+    CHECK(counter("probionis_batch_abandoned_rows_total") == abandoned + 2);
+}
+
+// A handler that throws fails every ticket of its batch.
+void test_handler_failure(Executor& executor) {
+    const std::uint64_t failures = counter("probionis_batch_failures_total");
+    BatchScheduler scheduler(options(3, std::chrono::seconds(10)),
+                             [](SpectrumBatch&, float*) {
+                                 throw std::runtime_error("model exploded");
+                             },
+                             executor);
+    std::vector<SlabTicket> tickets;
+    for (int i = 0; i < 3; ++i) {
+        tickets.push_back(submit(scheduler, 1.0f, "s" + std::to_string(i)));
+    }
+    for (const SlabTicket& ticket : tickets) {
+        CHECK_THROWS(ticket.wait(), std::runtime_error);
+    }
+    CHECK(counter("probionis_batch_failures_total") == failures + 1);
+}
+
+// Each lane preset keeps the caller's other options, and its batches run
+// at the lane's priority, so on a partitioned executor interactive batches
+// land on the reserved workers and bulk ones on the rest.
+void test_lane_presets() {
+    ExecutorOptions executor_options;
+    executor_options.threads = 4;
+    executor_options.blocking_threads = 1;
+    executor_options.latency_threads = 1;
+    Executor executor(executor_options);
+    CHECK(executor.partitioned());
+
+    BatchSchedulerOptions base;
+    base.channels = kChannels;
+    const BatchSchedulerOptions latency = latency_lane_options(base);
+    const BatchSchedulerOptions throughput = throughput_lane_options(base);
+    CHECK(latency.channels == kChannels && throughput.channels == kChannels);
+    CHECK(latency.max_batch < throughput.max_batch);
+    CHECK(latency.max_delay < throughput.max_delay);
+    CHECK(latency.priority == TaskPriority::kInteractive);
+    CHECK(throughput.priority == TaskPriority::kNormal);
+
+    std::atomic<int> interactive_priority{-1};
+    std::atomic<int> bulk_priority{-1};
+    const auto recording = [&executor](std::atomic<int>& seen) {
+        return [&executor, &seen](SpectrumBatch& batch, float* outputs) {
+            seen.store(static_cast<int>(executor.current_priority()));
+            doubler(batch, outputs);
+        };
+    };
+    BatchScheduler interactive(latency, recording(interactive_priority), executor);
+    BatchScheduler bulk(throughput, recording(bulk_priority), executor);
+    SlabTicket quick = submit(interactive, 1.5f, "i1");
+    SlabTicket slow = submit(bulk, 2.5f, "b1");
+    bulk.flush();
+    quick.wait();
+    slow.wait();
+    CHECK(quick.output()[0] == 3.0f && slow.output()[0] == 5.0f);
+    CHECK(interactive_priority.load() == static_cast<int>(TaskPriority::kInteractive));
+    CHECK(bulk_priority.load() == static_cast<int>(TaskPriority::kNormal));
+}
+
+// A tuner models as many parallel batches as its scheduler's lane has
+// workers: one reserved latency worker, two throughput ones here.
+void test_tuner_parallelism() {
+    ExecutorOptions executor_options;
+    executor_options.threads = 4;
+    executor_options.blocking_threads = 1;
+    executor_options.latency_threads = 1;
+    Executor executor(executor_options);
+
+    BatchSchedulerOptions base;
+    base.channels = kChannels;
+    BatchSchedulerOptions latency = latency_lane_options(base);
+    BatchSchedulerOptions throughput = throughput_lane_options(base);
+    BatchTunerOptions tuner;
+    tuner.name = "lane-latency";
+    latency.tuner = std::make_shared<BatchTuner>(tuner);
+    tuner.name = "lane-throughput";
+    throughput.tuner = std::make_shared<BatchTuner>(tuner);
+    BatchScheduler interactive(latency, doubler, executor);
+    BatchScheduler bulk(throughput, doubler, executor);
+    CHECK(latency.tuner->parallelism() == 1);
+    CHECK(throughput.tuner->parallelism() == 2);
+    CHECK(latency.tuner->limits().max_batch <= latency.max_batch);
+}
+
+}  // namespace
+
+int main() {
+    ExecutorOptions executor_options;
+    executor_options.threads = 3;
+    executor_options.blocking_threads = 1;
+    Executor executor(executor_options);
+    test_full_seal(executor);
+    test_deadline_seal(executor);
+    test_qc_rejection_and_abandon(executor);
+    test_handler_failure(executor);
+    test_lane_presets();
+    test_tuner_parallelism();
+    std::puts("batch_scheduler_test: ok");
+    return 0;
+}
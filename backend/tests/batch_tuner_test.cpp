@@ -0,0 +1,109 @@
+// Sources: inference/batch_tuner.cpp runtime/metrics.cpp
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "inference/batch_tuner.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+using std::chrono::microseconds;
+
+BatchTunerOptions tuner_options(const char* name) {
+    BatchTunerOptions o;
+    o.name = name;
+    o.window = 10;
+    o.interval = std::chrono::seconds(10);
+    return o;
+}
+
+// A batch of `rows` costs 100 us plus 20 us per row.
+std::chrono::nanoseconds service(std::size_t rows) {
+    return microseconds(100 + 20 * static_cast<long>(rows));
+}
+
+// Runs `windows` tuning windows of full batches at the current limits,
+// back to back, so arrivals outpace the model; returns how many of the
+// last `tail` windows changed the limits.
+int saturate(BatchTuner& tuner, int windows, int tail) {
+    int changes = 0;
+    for (int w = 0; w < windows; ++w) {
+        for (std::size_t i = 0; i < tuner.options().window; ++i) {
+            if (tuner.observe(tuner.limits().max_batch, microseconds(0),
+                              service(tuner.limits().max_batch)) &&
+                w >= windows - tail) {
+                ++changes;
+            }
+        }
+    }
+    return changes;
+}
+
+// Under saturation the size climbs by at most a factor of two per decision
+// and settles at the cap, never above it.
+void test_saturated_converges_to_cap() {
+    BatchTuner tuner(tuner_options("saturated"));
+    tuner.cap_batch(24);
+    CHECK(tuner.limits().max_batch == 16);
+    std::size_t previous = tuner.limits().max_batch;
+    for (int w = 0; w < 20; ++w) {
+        saturate(tuner, 1, 0);
+        const std::size_t now = tuner.limits().max_batch;
+        CHECK(now <= 24 && now <= 2 * previous && 2 * now >= previous);
+        previous = now;
+    }
+    CHECK(tuner.limits().max_batch == 24);
+    CHECK(saturate(tuner, 5, 5) == 0);  // the deadline is pinned at the minimum too
+}
+
+// A trickle of single rows brings the size down to the minimum and keeps
+// it there; the deadline follows the measured arrival rate.
+void test_light_load_converges_to_minimum() {
+    BatchTunerOptions o = tuner_options("light");
+    o.min_batch = 2;
+    BatchTuner tuner(o);
+    int stable_windows = 0;
+    for (int w = 0; w < 12; ++w) {
+        const std::size_t before = tuner.limits().max_batch;
+        for (std::size_t i = 0; i < o.window; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            tuner.observe(1, microseconds(50), service(1));
+        }
+        stable_windows = tuner.limits().max_batch == before ? stable_windows + 1 : 0;
+    }
+    CHECK(tuner.limits().max_batch == 2);
+    CHECK(stable_windows >= 3);
+    CHECK(tuner.limits().max_delay >= o.min_delay && tuner.limits().max_delay <= o.max_delay);
+}
+
+void test_parallelism() {
+    BatchTuner free_tuner(tuner_options("parallel-free"));
+    CHECK(free_tuner.parallelism() == 1);
+    free_tuner.set_parallelism(6);
+    CHECK(free_tuner.parallelism() == 6);
+    free_tuner.set_parallelism(0);
+    CHECK(free_tuner.parallelism() == 1);
+
+    BatchTunerOptions o = tuner_options("parallel-fixed");
+    o.parallelism = 3;
+    BatchTuner fixed(o);
+    fixed.set_parallelism(8);
+    CHECK(fixed.parallelism() == 3);
+
+    o.min_batch = 0;
+    CHECK_THROWS(BatchTuner{o}, std::invalid_argument);
+}
+
+}  // namespace
+
+int main() {
+    test_saturated_converges_to_cap();
+    test_light_load_converges_to_minimum();
+    test_parallelism();
+    std::puts("batch_tuner_test: ok");
+    return 0;
+}
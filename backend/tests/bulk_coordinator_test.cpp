@@ -0,0 +1,275 @@
+// Sources: bulk/bulk_coordinator.cpp bulk/work_leases.cpp bulk/bulk_worker.cpp net/socket.cpp
+//          net/http.cpp storage/results_replication.cpp storage/results_service.cpp
+//          storage/results_store.cpp storage/results_wal.cpp
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bulk/bulk_coordinator.h"
+#include "bulk/bulk_worker.h"
+#include "net/socket.h"
+#include "storage/results_service.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+using std::chrono::milliseconds;
+
+const std::string kManifest = scratch_path("bulk-manifest");
+const std::string kJournal = scratch_path("bulk-journal");
+const std::string kWal = scratch_path("bulk-wal");
+
+// Units expire, go to the next caller with a new token, and come back
+// when their holder is released.
+void test_lease_expiry_and_reassignment() {
+    LeaseTable table(10, 4, milliseconds(100));
+    CHECK(table.unit_count() == 3);
+    CHECK(table.unit(2).begin == 8 && table.unit(2).end == 10);
+    const LeaseTable::Clock::time_point t0 = LeaseTable::Clock::now();
+
+    const auto a0 = table.acquire(1, t0);
+    const auto a1 = table.acquire(1, t0);
+    const auto b2 = table.acquire(2, t0);
+    CHECK(a0 && a1 && b2 && a0->unit.id == 0 && a1->unit.id == 1 && b2->unit.id == 2);
+    CHECK(!table.acquire(3, t0));
+
+    // Unit 0 is renewed, unit 1 is not: only unit 1 is taken over.
+    CHECK(table.renew(0, a0->token, t0 + milliseconds(60)));
+    CHECK(!table.acquire(3, t0 + milliseconds(90)));
+    const auto c1 = table.acquire(3, t0 + milliseconds(120));
+    CHECK(c1 && c1->unit.id == 1 && c1->token != a1->token);
+    CHECK(!table.renew(1, a1->token, t0 + milliseconds(120)));
+    CHECK(table.stats().reclaimed == 1);
+
+    // The old holder's token no longer releases the unit; the new one's does.
+    table.release(1, a1->token);
+    CHECK(table.stats().leased == 3);
+    table.release_holder(2);
+    const auto c2 = table.acquire(3, t0 + milliseconds(130));
+    CHECK(c2 && c2->unit.id == 2);
+    CHECK(table.stats().reclaimed == 2);
+
+    CHECK(table.mark_done(0) && table.mark_done(1) && table.mark_done(2));
+    CHECK(!table.mark_done(1));
+    CHECK(table.finished() && !table.acquire(4, t0 + milliseconds(500)));
+}
+
+void write_manifest(int items) {
+    std::ofstream out(kManifest);
+    for (int i = 0; i < items; ++i) {
+        out << "in-" << i << "\n";
+    }
+}
+
+BulkJobOptions job(int lease_ms) {
+    BulkJobOptions options;
+    options.manifest_path = kManifest;
+    options.journal_path = kJournal;
+    options.unit_size = 3;
+    options.lease_ms = lease_ms;
+    options.host = "127.0.0.1";
+    options.port = 0;
+    return options;
+}
+
+ResultRecord scored(const std::string& input) {
+    ResultRecord r;
+    r.sample_id = input;
+    r.tenant = "clinic-a";
+    r.model_version = "v2";
+    r.label = "ok";
+    r.score = 0.5f;
+    r.timestamp_ms = 1700000000000ULL;
+    return r;
+}
+
+// A test worker speaking the protocol by hand.
+class Client {
+public:
+    explicit Client(std::uint16_t port) : socket_(tcp_connect("127.0.0.1", port, 5000)) {
+        CHECK(socket_.is_open());
+    }
+
+    // Sends LEASE; returns the reply kind and fills in the unit's inputs.
+    std::string lease(std::uint64_t& unit, std::uint64_t& token,
+                      std::vector<std::string>& inputs) {
+        CHECK(socket_.write("LEASE\n"));
+        std::string reply;
+        CHECK(socket_.read_line(reply));
+        std::istringstream words(reply);
+        std::string kind;
+        std::uint64_t lease_ms = 0, count = 0;
+        words >> kind >> unit >> token >> lease_ms >> count;
+        inputs.assign(kind == "UNIT" ? count : 0, "");
+        for (std::string& input : inputs) {
+            CHECK(socket_.read_line(input));
+        }
+        return kind;
+    }
+
+    std::string result(std::uint64_t unit, std::uint64_t token,
+                       const std::vector<std::string>& inputs) {
+        std::string request = "RESULT " + std::to_string(unit) + " " + std::to_string(token) +
+                              " " + std::to_string(inputs.size()) + "\n";
+        for (const std::string& input : inputs) {
+            request += format_result_line(scored(input));
+        }
+        CHECK(socket_.write(request));
+        std::string reply;
+        CHECK(socket_.read_line(reply));
+        return reply;
+    }
+
+private:
+    LineSocket socket_;
+};
+
+// Two workers score the same unit after a lease expiry: the first result
+// is merged, the second is answered DUPLICATE and leaves no trace.
+void test_duplicate_merged_once() {
+    std::remove(kJournal.c_str());
+    std::remove(kWal.c_str());
+    write_manifest(3);
+    ResultsPrimary store(kWal);
+    BulkCoordinator coordinator(job(50), store);
+    coordinator.start();
+
+    Client slow(coordinator.port());
+    Client fast(coordinator.port());
+    std::uint64_t unit = 0, slow_token = 0, fast_token = 0;
+    std::vector<std::string> inputs;
+    CHECK(slow.lease(unit, slow_token, inputs) == "UNIT" && unit == 0);
+    std::this_thread::sleep_for(milliseconds(80));
+    CHECK(fast.lease(unit, fast_token, inputs) == "UNIT" && unit == 0);
+    CHECK(fast_token != slow_token);
+
+    CHECK(fast.result(0, fast_token, inputs) == "OK");
+    CHECK(slow.result(0, slow_token, inputs) == "DUPLICATE");
+    // A token this connection was never given is refused outright.
+    CHECK(slow.result(0, fast_token, inputs).compare(0, 5, "ERROR") == 0);
+    CHECK(fast.lease(unit, fast_token, inputs) == "DONE");
+
+    const BulkJobProgress progress = coordinator.progress();
+    CHECK(progress.results_merged == 3 && progress.duplicates == 1 && progress.unapplied == 0);
+    CHECK(store.store().size() == 3);
+    CHECK(store.store().history("in-1", 10).size() == 1);
+    coordinator.stop();
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// A crash after the commit point: the unit's store write may or may not
+// have happened and its A line is missing, and a later block is torn.
+// Reopening re-applies the unit exactly once and trims the tail.
+void test_journal_replay_after_crash() {
+    std::remove(kJournal.c_str());
+    std::remove(kWal.c_str());
+    write_manifest(6);
+    {
+        ResultsPrimary store(kWal);
+        BulkCoordinator coordinator(job(60000), store);
+        coordinator.start();
+        Client client(coordinator.port());
+        std::uint64_t unit = 0, token = 0;
+        std::vector<std::string> inputs;
+        CHECK(client.lease(unit, token, inputs) == "UNIT" && unit == 0);
+        CHECK(client.result(unit, token, inputs) == "OK");
+        coordinator.stop();
+    }
+    std::string journal = read_file(kJournal);
+    const std::size_t applied = journal.find("A 0\n");
+    CHECK(applied != std::string::npos);
+    journal.erase(applied, 4);
+    const std::size_t intact = journal.size();
+    journal += "C 1 3\n" + format_result_line(scored("in-3")) + "in-4\t";
+    std::ofstream(kJournal, std::ios::trunc) << journal;
+
+    // The store write had finished: nothing is written twice.
+    {
+        ResultsPrimary store(kWal);
+        CHECK(store.store().size() == 3);
+        BulkCoordinator coordinator(job(60000), store);
+        const BulkJobProgress progress = coordinator.progress();
+        CHECK(progress.results_merged == 0);
+        CHECK(progress.leases.done == 1 && progress.leases.pending == 1);
+        CHECK(store.store().size() == 3);
+    }
+    CHECK(read_file(kJournal).size() == intact + 4);  // the A line is back
+
+    // The store write had not happened: the journal alone restores it.
+    std::remove(kWal.c_str());
+    journal.resize(intact);
+    std::ofstream(kJournal, std::ios::trunc) << journal;
+    {
+        ResultsPrimary store(kWal);
+        BulkCoordinator coordinator(job(60000), store);
+        CHECK(coordinator.progress().results_merged == 3);
+        CHECK(store.store().size() == 3);
+        CHECK(store.store().history("in-2", 10).size() == 1);
+    }
+
+    // A journal from another manifest is refused.
+    write_manifest(7);
+    {
+        ResultsPrimary store(kWal);
+        CHECK_THROWS(BulkCoordinator(job(60000), store), std::runtime_error);
+    }
+}
+
+// Real workers finish the job between them, each unit merged once.
+void test_workers_finish_job() {
+    std::remove(kJournal.c_str());
+    std::remove(kWal.c_str());
+    write_manifest(20);
+    ResultsPrimary store(kWal);
+    BulkCoordinator coordinator(job(60000), store);
+    coordinator.start();
+    BulkWorkerOptions options;
+    options.coordinator_port = coordinator.port();
+    options.reconnect_ms = 10;
+    const UnitScorer scorer = [](const std::vector<std::string>& inputs) {
+        std::vector<ResultRecord> records;
+        for (const std::string& input : inputs) {
+            records.push_back(scored(input));
+        }
+        return records;
+    };
+    BulkWorkerStats stats[2];
+    std::thread workers[2];
+    for (int i = 0; i < 2; ++i) {
+        workers[i] = std::thread([&, i] { stats[i] = BulkWorker(options, scorer).run(); });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    CHECK(coordinator.finished());
+    CHECK(stats[0].units + stats[1].units == 7);
+    CHECK(stats[0].results + stats[1].results == 20);
+    CHECK(store.store().size() == 20);
+    coordinator.stop();
+}
+
+}  // namespace
+
+int main() {
+    test_lease_expiry_and_reassignment();
+    test_duplicate_merged_once();
+    test_journal_replay_after_crash();
+    test_workers_finish_job();
+    std::remove(kManifest.c_str());
+    std::remove(kJournal.c_str());
+    std::remove(kWal.c_str());
+    std::puts("bulk_coordinator_test: ok");
+    return 0;
+}
@@ -0,0 +1,256 @@
+// Sources: preprocess/calibration_transfer.cpp preprocess/pipeline.cpp preprocess/qc_gate.cpp
+//          spectrum/spectrum_batch.cpp runtime/vector_math.cpp runtime/huge_page_allocator.cpp
+//          runtime/metrics.cpp
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "preprocess/calibration_transfer.h"
+#include "spectrum/spectrum_batch.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+// A known banded transfer matrix in dense form, B[i][j], with its offset.
+struct DenseTransfer {
+    std::size_t channels;
+    std::size_t half_bandwidth;
+    std::vector<double> matrix;
+    std::vector<float> offset;
+
+    // The same matrix as the row windows BandedOperator::from_row_windows
+    // takes.
+    BandedOperator banded() const {
+        const std::size_t width = 2 * half_bandwidth + 1;
+        std::vector<float> rows(channels * width, 0.0f);
+        for (std::size_t i = 0; i < channels; ++i) {
+            for (std::size_t k = 0; k < width; ++k) {
+                const std::ptrdiff_t j = static_cast<std::ptrdiff_t>(i + k) -
+                                         static_cast<std::ptrdiff_t>(half_bandwidth);
+                if (j >= 0 && j < static_cast<std::ptrdiff_t>(channels)) {
+                    rows[i * width + k] = static_cast<float>(matrix[i * channels + j]);
+                }
+            }
+        }
+        return BandedOperator::from_row_windows(channels, half_bandwidth, rows, offset);
+    }
+
+    std::vector<double> apply(const std::vector<float>& x) const {
+        std::vector<double> y(channels);
+        for (std::size_t i = 0; i < channels; ++i) {
+            y[i] = offset[i];
+            for (std::size_t j = 0; j < channels; ++j) {
+                y[i] += matrix[i * channels + j] * x[j];
+            }
+        }
+        return y;
+    }
+};
+
+DenseTransfer random_transfer(std::size_t channels, std::size_t half_bandwidth,
+                              std::mt19937& random) {
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    DenseTransfer t{channels, half_bandwidth, std::vector<double>(channels * channels, 0.0),
+                    std::vector<float>(channels)};
+    for (std::size_t i = 0; i < channels; ++i) {
+        for (std::size_t j = 0; j < channels; ++j) {
+            const std::size_t distance = i > j ? i - j : j - i;
+            if (distance <= half_bandwidth) {
+                // Rounded to float, as the operator stores it.
+                t.matrix[i * channels + j] = static_cast<float>(value(random));
+            }
+        }
+        t.offset[i] = value(random);
+    }
+    return t;
+}
+
+std::vector<float> random_spectrum(std::size_t channels, std::mt19937& random) {
+    std::uniform_real_distribution<float> value(0.0f, 100.0f);
+    std::vector<float> x(channels);
+    for (float& v : x) {
+        v = value(random);
+    }
+    return x;
+}
+
+void check_close(const std::vector<float>& got, const std::vector<double>& want) {
+    CHECK(got.size() == want.size());
+    for (std::size_t i = 0; i < got.size(); ++i) {
+        CHECK(std::fabs(got[i] - want[i]) <= 1e-4 * (1.0 + std::fabs(want[i])));
+    }
+}
+
+// The operator reproduces a known transfer matrix at every row: the
+// vectorised interior and the bounds-checked edges, and operators narrower
+// than their bandwidth.
+void test_known_matrix() {
+    std::mt19937 random(3);
+    for (const std::size_t channels : {5, 40, 203}) {
+        for (const std::size_t half_bandwidth : {0, 1, 3}) {
+            const DenseTransfer t = random_transfer(channels, half_bandwidth, random);
+            const BandedOperator op = t.banded();
+            CHECK(op.channels() == channels && op.diagonal_count() == 2 * half_bandwidth + 1);
+            const std::vector<float> x = random_spectrum(channels, random);
+            std::vector<float> y(channels);
+            op.apply(x.data(), y.data());
+            check_close(y, t.apply(x));
+        }
+    }
+    CHECK_THROWS(BandedOperator::from_row_windows(4, 1, std::vector<float>(11), {}),
+                 std::invalid_argument);
+}
+
+// An axis shifted by a quarter channel, with gain and offset: a straight
+// line is resampled exactly, extrapolated past the measured range too.
+void test_wavelength_intensity_correction() {
+    const std::size_t n = 32;
+    std::vector<float> source_axis(n), target_axis(n), line(n), gain(n, 2.0f), offset(n, 1.0f);
+    for (std::size_t i = 0; i < n; ++i) {
+        source_axis[i] = 1000.0f + static_cast<float>(i) + 0.25f;
+        target_axis[i] = 1000.0f + static_cast<float>(i);
+        line[i] = 3.0f * static_cast<float>(i) + 0.75f;  // 3 * (axis - 1000)
+    }
+    const BandedOperator op =
+        BandedOperator::wavelength_intensity_correction(source_axis, target_axis, 1, gain, offset);
+    CHECK(op.target_axis() == target_axis);
+    std::vector<float> y(n);
+    op.apply(line.data(), y.data());
+    for (std::size_t i = 0; i < n; ++i) {
+        CHECK(std::fabs(y[i] - (2.0f * 3.0f * static_cast<float>(i) + 1.0f)) < 1e-4f);
+    }
+
+    std::vector<float> far(source_axis);
+    for (float& x : far) {
+        x += 5.0f;
+    }
+    CHECK_THROWS(BandedOperator::wavelength_intensity_correction(far, target_axis, 2, {}, {}),
+                 std::invalid_argument);
+}
+
+// compose(a, b) is b after a, with its bandwidth the sum of theirs.
+void test_compose() {
+    std::mt19937 random(5);
+    const std::size_t n = 50;
+    const BandedOperator a = random_transfer(n, 2, random).banded();
+    const BandedOperator b = random_transfer(n, 1, random).banded();
+    const BandedOperator ab = BandedOperator::compose(a, b);
+    CHECK(ab.half_bandwidth() == 3);
+    const std::vector<float> x = random_spectrum(n, random);
+    std::vector<float> once(n), twice(n), composed(n);
+    a.apply(x.data(), once.data());
+    b.apply(once.data(), twice.data());
+    ab.apply(x.data(), composed.data());
+    check_close(composed, std::vector<double>(twice.begin(), twice.end()));
+}
+
+// Saved operators load back bit for bit; damaged files are refused.
+void test_save_and_load() {
+    std::mt19937 random(9);
+    BandedOperator op = random_transfer(24, 2, random).banded();
+    std::vector<float> axis(24);
+    for (std::size_t i = 0; i < axis.size(); ++i) {
+        axis[i] = 400.0f + 2.0f * static_cast<float>(i);
+    }
+    op.set_target_axis(axis);
+    const std::string path = scratch_path("instrument.pbcal");
+    save_calibration(path, "inst-7", op);
+    std::string id;
+    const BandedOperator loaded = load_calibration(path, &id);
+    CHECK(id == "inst-7" && loaded.fingerprint() == op.fingerprint());
+
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(path, std::ios::binary | std::ios::trunc)
+        << bytes.substr(0, bytes.size() - 4);
+    CHECK_THROWS(load_calibration(path, &id), std::runtime_error);
+    bytes[0] = 'X';
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+    CHECK_THROWS(load_calibration(path, &id), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+Spectrum spectrum_from(const std::string& instrument, const std::vector<float>& x) {
+    Spectrum s;
+    s.sample_id = "sample-" + instrument;
+    s.instrument_id = instrument;
+    s.intensity = x;
+    s.axis.resize(x.size());
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        s.axis[i] = static_cast<float>(i);
+    }
+    return s;
+}
+
+// The step applies each instrument's operator, single and batched, passes
+// unknown instruments through unless calibration is required, and leaves
+// a batch untouched when its rows would end up on different axes.
+void test_transfer_step() {
+    std::mt19937 random(11);
+    const std::size_t n = 36;
+    const DenseTransfer t = random_transfer(n, 2, random);
+    auto op = std::make_shared<BandedOperator>(t.banded());
+    std::vector<float> reference_axis(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        reference_axis[i] = 0.5f * static_cast<float>(i);
+    }
+    op->set_target_axis(reference_axis);
+    auto registry = std::make_shared<CalibrationRegistry>();
+    registry->put("inst-a", op);
+    CHECK(registry->fingerprint("inst-a") == op->fingerprint() &&
+          registry->fingerprint("other") == 0);
+
+    const CalibrationTransferStep step(registry);
+    const std::vector<float> x = random_spectrum(n, random);
+    Spectrum calibrated = spectrum_from("inst-a", x);
+    step.apply(calibrated);
+    check_close(calibrated.intensity, t.apply(x));
+    CHECK(calibrated.axis == reference_axis);
+    CHECK(step.state_fingerprint(calibrated) == op->fingerprint());
+
+    Spectrum unknown = spectrum_from("inst-b", x);
+    step.apply(unknown);
+    CHECK(unknown.intensity == x);
+    const CalibrationTransferStep strict(registry, true);
+    CHECK_THROWS(strict.apply(unknown), std::runtime_error);
+    Spectrum short_spectrum = spectrum_from("inst-a", std::vector<float>(n - 1, 1.0f));
+    CHECK_THROWS(step.apply(short_spectrum), std::runtime_error);
+
+    SpectrumBatch batch(2, n);
+    batch.push(spectrum_from("inst-a", x));
+    batch.push(spectrum_from("inst-a", x));
+    step.apply_batch(batch);
+    CHECK(batch.axis() == reference_axis);
+    for (std::size_t r = 0; r < batch.size(); ++r) {
+        check_close(std::vector<float>(batch.row(r), batch.row(r) + n), t.apply(x));
+    }
+
+    SpectrumBatch mixed(2, n);
+    mixed.push(spectrum_from("inst-a", x));
+    mixed.push(spectrum_from("inst-b", x));
+    const std::vector<float> axis_before = mixed.axis();
+    CHECK_THROWS(step.apply_batch(mixed), std::runtime_error);
+    CHECK(mixed.axis() == axis_before);
+    CHECK(std::vector<float>(mixed.row(0), mixed.row(0) + n) == x);
+}
+
+}  // namespace
+
+int main() {
+    test_known_matrix();
+    test_wavelength_intensity_correction();
+    test_compose();
+    test_save_and_load();
+    test_transfer_step();
+    std::puts("calibration_transfer_test: ok");
+    return 0;
+}
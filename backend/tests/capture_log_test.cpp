@@ -0,0 +1,147 @@
+// Sources: replay/capture_log.cpp net/http_server.cpp net/http.cpp net/socket.cpp
+//          runtime/executor.cpp runtime/metrics.cpp runtime/huge_page_allocator.cpp
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "net/http_server.h"
+#include "replay/capture_log.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+CapturedRequest sample(std::uint64_t i) {
+    CapturedRequest request;
+    request.offset_ns = i * 1000003;
+    request.method = i % 2 ? "POST" : "GET";
+    request.target = "/v1/score?sample=" + std::to_string(i);
+    request.headers = {{"Content-Type", "application/json"}, {"X-Trace", std::to_string(i)}};
+    request.body = std::string(i * 37 % 300, static_cast<char>('a' + i % 26));
+    request.status = 200;
+    request.response_hash = 0x9e3779b97f4a7c15ULL * (i + 1);
+    return request;
+}
+
+bool same(const CapturedRequest& a, const CapturedRequest& b) {
+    return a.offset_ns == b.offset_ns && a.method == b.method && a.target == b.target &&
+           a.headers == b.headers && a.body == b.body && a.status == b.status &&
+           a.response_hash == b.response_hash;
+}
+
+void test_encode_decode() {
+    const CapturedRequest request = sample(7);
+    const std::string encoded = encode_captured_request(request);
+    CapturedRequest decoded;
+    CHECK(decode_captured_request(encoded.data(), encoded.size(), decoded));
+    CHECK(same(request, decoded));
+    // Every strict prefix, and trailing garbage, is rejected.
+    for (std::size_t size = 0; size < encoded.size(); ++size) {
+        CHECK(!decode_captured_request(encoded.data(), size, decoded));
+    }
+    const std::string longer = encoded + "x";
+    CHECK(!decode_captured_request(longer.data(), longer.size(), decoded));
+}
+
+// Records written through the writer read back in order; a log cut off
+// mid-record yields every whole record before the cut.
+void test_log_round_trip_and_truncated_tail() {
+    const std::string path = scratch_path("capture.pbrc");
+    constexpr std::size_t kRecords = 200;
+    {
+        CaptureWriter writer(path);
+        for (std::size_t i = 0; i < kRecords; ++i) {
+            writer.record(sample(i));
+        }
+        writer.close();
+        const CaptureStats stats = writer.stats();
+        CHECK(stats.recorded == kRecords && stats.dropped == 0 && stats.write_failed == 0);
+    }
+    const std::vector<CapturedRequest> all = CaptureReader::read_all(path);
+    CHECK(all.size() == kRecords);
+    for (std::size_t i = 0; i < kRecords; ++i) {
+        CHECK(same(all[i], sample(i)));
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    const std::string whole((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+    const std::size_t payload =
+        whole.size() - encode_captured_request(sample(kRecords - 1)).size();
+    // Cut just after the final record's length prefix, inside its payload,
+    // and one byte short of the end.
+    for (const std::size_t cut : {payload, payload + 3, whole.size() - 1}) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(whole.data(), cut);
+        const std::vector<CapturedRequest> truncated = CaptureReader::read_all(path);
+        CHECK(truncated.size() == kRecords - 1);
+        CHECK(same(truncated.back(), sample(kRecords - 2)));
+    }
+    ::unlink(path.c_str());
+}
+
+// A device that refuses every write: records are counted as failed, not
+// reported as written, and nothing is printed.
+void test_write_failure_is_counted() {
+    if (::access("/dev/full", W_OK) != 0) {
+        return;
+    }
+    CaptureWriter writer("/dev/full");
+    for (std::size_t i = 0; i < 10; ++i) {
+        writer.record(sample(i));
+    }
+    writer.close();
+    const CaptureStats stats = writer.stats();
+    CHECK(stats.recorded == 10);
+    CHECK(stats.write_failed == 10);
+    CHECK(stats.bytes_written == 0);
+}
+
+// The server records requests without their credential headers.
+void test_server_drops_credentials() {
+    const std::string path = scratch_path("capture-server.pbrc");
+    HttpServerOptions options;
+    options.host = "127.0.0.1";
+    options.port = 0;
+    options.connection_threads = 1;
+    options.capture = std::make_shared<CaptureWriter>(path);
+    HttpServer server(options, [](const HttpRequest&, HttpResponse& response) {
+        response.body = "ok";
+    });
+    server.start();
+    HttpConnection connection("127.0.0.1", server.port(), 2000);
+    HttpResponse response;
+    const HttpHeaders headers = {{"Authorization", "Bearer secret"},
+                                 {"cookie", "session=secret"},
+                                 {"X-Api-Key", "secret"},
+                                 {"X-Trace", "t1"}};
+    CHECK(connection.exchange("POST", "/v1/score", headers, "{}", response));
+    CHECK(response.status == 200);
+    server.stop();
+    options.capture->close();
+
+    const std::vector<CapturedRequest> all = CaptureReader::read_all(path);
+    CHECK(all.size() == 1);
+    CHECK(find_header(all[0].headers, "X-Trace") != nullptr);
+    for (const auto& header : all[0].headers) {
+        CHECK(header.second.find("secret") == std::string::npos);
+    }
+    CHECK(is_credential_header("PROXY-AUTHORIZATION") && !is_credential_header("Accept"));
+    ::unlink(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    test_encode_decode();
+    test_log_round_trip_and_truncated_tail();
+    test_write_failure_is_counted();
+    test_server_drops_credentials();
+    std::puts("capture_log_test: ok");
+    return 0;
+}
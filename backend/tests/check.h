@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+// Test assertion that stays on under NDEBUG: prints the failed condition
+// and exits nonzero.
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                             \
+            std::exit(1);                                                         \
+        }                                                                         \
+    } while (0)
+
+// CHECK that `statement` throws `exception_type`.
+#define CHECK_THROWS(statement, exception_type) \
+    do {                                        \
+        bool threw_ = false;                    \
+        try {                                   \
+            statement;                          \
+        } catch (const exception_type&) {       \
+            threw_ = true;                      \
+        }                                       \
+        CHECK(threw_ && #statement);            \
+    } while (0)
+
+// Path for a scratch file or directory, unique to this process.
+inline std::string scratch_path(const std::string& name) {
+    const char* tmp = std::getenv("TMPDIR");
+    return std::string(tmp && *tmp ? tmp : "/tmp") + "/probionis-" +
+           std::to_string(::getpid()) + "-" + name;
+}
@@ -0,0 +1,77 @@
+// Sources: runtime/deadline_timer.cpp
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "runtime/deadline_timer.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+using Clock = DeadlineTimer::Clock;
+using std::chrono::milliseconds;
+
+// Callbacks run in deadline order, whatever order they were scheduled in;
+// a cancelled one never runs.
+void test_order_and_cancel() {
+    DeadlineTimer timer;
+    std::mutex mutex;
+    std::vector<int> order;
+    std::promise<void> last;
+    const Clock::time_point now = Clock::now();
+    const auto record = [&](int value) {
+        return [&, value] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(value);
+        };
+    };
+    timer.schedule(now + milliseconds(30), record(3));
+    timer.schedule(now + milliseconds(10), record(1));
+    const DeadlineTimer::Id dropped = timer.schedule(now + milliseconds(20), record(99));
+    timer.schedule(now + milliseconds(20), record(2));
+    timer.schedule(now + milliseconds(40), [&] { last.set_value(); });
+    CHECK(timer.cancel(dropped));
+    CHECK(!timer.cancel(dropped));
+    last.get_future().wait();
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK((order == std::vector<int>{1, 2, 3}));
+    CHECK(timer.pending() == 0);
+}
+
+// A callback may schedule the next one, and one that throws does not stop
+// the timer.
+void test_reschedule_and_throw() {
+    DeadlineTimer timer;
+    std::promise<void> done;
+    timer.schedule(Clock::now(), [] { throw std::runtime_error("ignored"); });
+    timer.schedule(Clock::now(), [&] {
+        timer.schedule(Clock::now() + milliseconds(5), [&] { done.set_value(); });
+    });
+    CHECK(done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+}
+
+// Destroying the timer drops what is still pending.
+void test_pending_dropped() {
+    bool ran = false;
+    {
+        DeadlineTimer timer;
+        timer.schedule(Clock::now() + std::chrono::hours(1), [&] { ran = true; });
+        CHECK(timer.pending() == 1);
+    }
+    CHECK(!ran);
+}
+
+}  // namespace
+
+int main() {
+    test_order_and_cancel();
+    test_reschedule_and_throw();
+    test_pending_dropped();
+    std::puts("deadline_timer_test: ok");
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Sources: runtime/executor.cpp
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "runtime/executor.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+ExecutorOptions options(std::size_t compute) {
+    ExecutorOptions o;
+    o.blocking_threads = 1;
+    o.threads = compute + o.blocking_threads;
+    return o;
+}
+
+// Every task runs exactly once, including tasks submitted by tasks.
+void test_runs_everything() {
+    constexpr int kOuter = 2000;
+    constexpr int kInner = 4;
+    std::atomic<int> ran{0};
+    {
+        Executor executor(options(4));
+        CHECK(executor.worker_count() == 4);
+        for (int i = 0; i < kOuter; ++i) {
+            executor.submit([&] {
+                ran.fetch_add(1);
+                for (int j = 0; j < kInner; ++j) {
+                    executor.submit([&] { ran.fetch_add(1); });
+                }
+            });
+        }
+        // The destructor drains everything queued, nested tasks included.
+    }
+    CHECK(ran.load() == kOuter * (1 + kInner));
+}
+
+// On one worker, queued tasks run highest priority first.
+void test_priority_order() {
+    Executor executor(options(1));
+    std::promise<void> release;
+    std::shared_future<void> gate = release.get_future().share();
+    std::mutex mutex;
+    std::vector<TaskPriority> order;
+    executor.submit([gate] { gate.wait(); });
+    for (const TaskPriority priority :
+         {TaskPriority::kBackground, TaskPriority::kNormal, TaskPriority::kInteractive,
+          TaskPriority::kBackground, TaskPriority::kInteractive}) {
+        executor.submit(
+            [&, priority] {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(priority);
+            },
+            priority);
+    }
+    release.set_value();
+    std::promise<void> done;
+    executor.submit([&] { done.set_value(); }, TaskPriority::kBackground);
+    done.get_future().wait();
+    const std::vector<TaskPriority> expected = {
+        TaskPriority::kInteractive, TaskPriority::kInteractive, TaskPriority::kNormal,
+        TaskPriority::kBackground, TaskPriority::kBackground};
+    CHECK(order == expected);
+}
+
+// Tasks a worker queues for itself are taken by idle workers.
+void test_stealing() {
+    Executor executor(options(4));
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::promise<void> done;
+    std::atomic<int> left{64};
+    executor.submit([&] {
+        for (int i = 0; i < 64; ++i) {
+            executor.submit([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.insert(std::this_thread::get_id());
+                }
+                if (left.fetch_sub(1) == 1) {
+                    done.set_value();
+                }
+            });
+        }
+    });
+    done.get_future().wait();
+    CHECK(executor.stats().stolen > 0);
+    CHECK(threads.size() > 1);
+}
+
+void test_failures_are_contained() {
+    Executor executor(options(2));
+    std::promise<int> worker;
+    executor.submit([] { throw std::runtime_error("task failed"); });
+    executor.submit_blocking([] { throw std::runtime_error("blocking task failed"); });
+    executor.submit([&] { worker.set_value(executor.current_worker()); });
+    const int index = worker.get_future().get();
+    CHECK(index >= 0 && index < 2);
+    std::promise<int> blocking;
+    executor.submit_blocking([&] { blocking.set_value(executor.current_worker()); });
+    // Blocking tasks never occupy a compute worker.
+    CHECK(blocking.get_future().get() == -1);
+    CHECK(executor.current_worker() == -1);
+    // Stats are updated after a task returns; wait for the last one.
+    for (int i = 0; i < 1000 && executor.stats().failed < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(executor.stats().failed == 2);
+}
+
+// A task sees the priority it was queued at, so work it fans out can
+// inherit it; other threads see kNormal.
+void test_current_priority() {
+    Executor executor(options(2));
+    CHECK(executor.current_priority() == TaskPriority::kNormal);
+    for (TaskPriority priority : {TaskPriority::kInteractive, TaskPriority::kNormal,
+                                  TaskPriority::kBackground}) {
+        std::promise<TaskPriority> seen;
+        executor.submit([&] { seen.set_value(executor.current_priority()); }, priority);
+        CHECK(seen.get_future().get() == priority);
+    }
+    std::promise<TaskPriority> blocking;
+    executor.submit_blocking([&] { blocking.set_value(executor.current_priority()); });
+    CHECK(blocking.get_future().get() == TaskPriority::kNormal);
+}
+
+void test_thread_budget() {
+    ExecutorOptions o;
+    o.threads = 16;
+    CHECK(resolved_thread_count(o) == 16);
+    Executor executor(o);
+    // One in eight threads goes to the blocking pool by default.
+    CHECK(executor.blocking_thread_count() == 2);
+    CHECK(executor.worker_count() == 14);
+    // The blocking pool is carved out of the total, never added to it.
+    o.threads = 4;
+    o.blocking_threads = 8;
+    Executor capped(o);
+    CHECK(capped.blocking_thread_count() == 3);
+    CHECK(capped.worker_count() == 1);
+    // Below the minimum of one thread of each kind.
+    o.threads = 1;
+    o.blocking_threads = 0;
+    CHECK(resolved_thread_count(o) == 2);
+    Executor smallest(o);
+    CHECK(smallest.blocking_thread_count() == 1);
+    CHECK(smallest.worker_count() == 1);
+    o.threads = 0;
+    CHECK(resolved_thread_count(o) >= 2);
+
+    // The shared executor also leaves a quarter to HttpServer connections,
+    // while it can spare them.
+    o.threads = 16;
+    ThreadBudget budget = split_thread_budget(o);
+    CHECK(budget.blocking == 2 && budget.connections == 4 && budget.compute == 10);
+    o.threads = 2;
+    budget = split_thread_budget(o);
+    CHECK(budget.blocking == 1 && budget.connections == 0 && budget.compute == 1);
+}
+
+}  // namespace
+
+int main() {
+    test_runs_everything();
+    test_priority_order();
+    test_stealing();
+    test_failures_are_contained();
+    test_current_priority();
+    test_thread_budget();
+    std::puts("executor_test: ok");
+    return 0;
+}
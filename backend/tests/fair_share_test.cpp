@@ -0,0 +1,125 @@
+// Sources: inference/fair_share.cpp runtime/executor.cpp runtime/metrics.cpp
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "inference/fair_share.h"
+#include "runtime/executor.h"
+#include "runtime/metrics.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+ExecutorOptions options() {
+    ExecutorOptions o;
+    o.threads = 3;
+    o.blocking_threads = 1;
+    return o;
+}
+
+// Burns about `us` microseconds of thread CPU, so measured costs are alike.
+void spin(std::uint64_t us) {
+    const std::uint64_t until = thread_cpu_ns() + us * 1000;
+    while (thread_cpu_ns() < until) {
+    }
+}
+
+// Holds the scheduler's only slot until released, so later submissions
+// queue and are ordered by the scheduler rather than by arrival.
+struct Gate {
+    std::promise<void> open;
+    std::shared_future<void> opened = open.get_future().share();
+};
+
+struct Order {
+    std::mutex mutex;
+    std::vector<std::string> tenants;
+
+    void add(const std::string& tenant) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tenants.push_back(tenant);
+    }
+};
+
+// A tenant that queues behind another's flood runs after at most one of
+// the flood's tasks, not after all of them.
+void test_flood_does_not_starve(Executor& executor) {
+    FairShareOptions fair;
+    fair.slots = 1;
+    Order order;
+    {
+        FairShareScheduler scheduler(fair, executor);
+        Gate gate;
+        scheduler.submit("gate", [opened = gate.opened] { opened.wait(); });
+        for (int i = 0; i < 20; ++i) {
+            scheduler.submit("flood", [&order] {
+                spin(200);
+                order.add("flood");
+            });
+        }
+        scheduler.submit("quiet", [&order] { order.add("quiet"); });
+        CHECK(scheduler.queued() == 21);
+        gate.open.set_value();
+    }
+    CHECK(order.tenants.size() == 21);
+    std::size_t position = 0;
+    while (order.tenants[position] != "quiet") {
+        ++position;
+    }
+    CHECK(position <= 1);
+}
+
+// Backlogged tenants split the slot in proportion to their shares.
+void test_shares(Executor& executor) {
+    FairShareOptions fair;
+    fair.slots = 1;
+    Order order;
+    {
+        FairShareScheduler scheduler(fair, executor);
+        scheduler.set_share("heavy", 3.0);
+        CHECK_THROWS(scheduler.set_share("heavy", 0.0), std::invalid_argument);
+        Gate gate;
+        scheduler.submit("gate", [opened = gate.opened] { opened.wait(); });
+        for (int i = 0; i < 40; ++i) {
+            for (const char* tenant : {"heavy", "light"}) {
+                scheduler.submit(tenant, [&order, tenant] {
+                    spin(300);
+                    order.add(tenant);
+                });
+            }
+        }
+        gate.open.set_value();
+    }
+    // While both are backlogged (the first 40 of 80), about 3 of every 4.
+    std::size_t heavy = 0;
+    for (std::size_t i = 0; i < 40; ++i) {
+        heavy += order.tenants[i] == "heavy";
+    }
+    CHECK(heavy >= 24 && heavy <= 36);
+}
+
+// Tenant names are client input; they reach the metrics escaped.
+void test_tenant_label_is_escaped(Executor& executor) {
+    {
+        FairShareScheduler scheduler({}, executor);
+        scheduler.submit("a\"b\\c\nd", [] {});
+    }
+    const std::string metrics = global_metrics().render_prometheus();
+    CHECK(metrics.find("probionis_tenant_cpu_us_total{tenant=\"a\\\"b\\\\c\\nd\"}") !=
+          std::string::npos);
+}
+
+}  // namespace
+
+int main() {
+    Executor executor(options());
+    test_flood_does_not_starve(executor);
+    test_shares(executor);
+    test_tenant_label_is_escaped(executor);
+    std::puts("fair_share_test: ok");
+    return 0;
+}
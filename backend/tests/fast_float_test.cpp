@@ -0,0 +1,157 @@
+// Sources: io/fast_float.cpp
+
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "io/fast_float.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+// Parses all of `text`, or fails the test.
+double whole_double(const std::string& text) {
+    double value = 0.0;
+    CHECK(parse_double(text.data(), text.data() + text.size(), &value) ==
+          text.data() + text.size());
+    return value;
+}
+
+float whole_float(const std::string& text) {
+    float value = 0.0f;
+    CHECK(parse_float(text.data(), text.data() + text.size(), &value) ==
+          text.data() + text.size());
+    return value;
+}
+
+// Characters of `text` the parser consumes.
+std::ptrdiff_t consumed(const std::string& text) {
+    double value = 0.0;
+    return parse_double(text.data(), text.data() + text.size(), &value) - text.data();
+}
+
+bool same_bits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Shortest round-trip text of random finite doubles and floats parses back
+// to the same bits, and short decimals agree with strtod on the fast path.
+void test_round_trip() {
+    std::mt19937_64 random(7);
+    char text[64];
+    for (int i = 0; i < 200000; ++i) {
+        const std::uint64_t bits = random();
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        if (std::isfinite(d)) {
+            std::snprintf(text, sizeof(text), "%.17g", d);
+            CHECK(same_bits(whole_double(text), d));
+        }
+        const std::uint32_t float_bits = static_cast<std::uint32_t>(bits >> 32);
+        float f;
+        std::memcpy(&f, &float_bits, sizeof(f));
+        if (std::isfinite(f)) {
+            std::snprintf(text, sizeof(text), "%.9g", static_cast<double>(f));
+            CHECK(same_bits(whole_float(text), f));
+        }
+        const long long mantissa = static_cast<long long>(bits % 1000000000000000ULL);
+        const int exponent = static_cast<int>(bits >> 58) % 23 - 11;
+        std::snprintf(text, sizeof(text), "%lld.%03de%d", mantissa, static_cast<int>(i % 1000),
+                      exponent);
+        CHECK(same_bits(whole_double(text), std::strtod(text, nullptr)));
+    }
+    CHECK(whole_double("3.25E+04") == 32500.0 && whole_double("-.5") == -0.5);
+    CHECK(whole_double("+7") == 7.0 && std::signbit(whole_double("-0")));
+}
+
+void test_subnormals() {
+    CHECK(whole_double("4.9406564584124654e-324") == std::numeric_limits<double>::denorm_min());
+    CHECK(whole_double("2.2250738585072009e-308") == std::nextafter(
+                                                         std::numeric_limits<double>::min(), 0.0));
+    CHECK(whole_double("1e-330") == 0.0);
+    CHECK(whole_float("1.4e-45") == std::numeric_limits<float>::denorm_min());
+    CHECK(whole_float("1.17549421e-38") ==
+          std::nextafter(std::numeric_limits<float>::min(), 0.0f));
+}
+
+// More significant digits than the 64-bit mantissa holds go to the exact
+// slow path; leading zeros do not count against the limit.
+void test_long_mantissas() {
+    const char* const cases[] = {
+        "1234567890123456789",
+        "12345678901234567890123",
+        "9007199254740993",
+        "0.1000000000000000055511151231257827",
+        "3.14159265358979323846264338327950288",
+        "123456789012345678901234567890e-10",
+        "0.000000000000000000000000000000000012345678901234567890",
+    };
+    for (const char* text : cases) {
+        CHECK(same_bits(whole_double(text), std::strtod(text, nullptr)));
+    }
+    CHECK(whole_double("0000000000000000000000000001.5") == 1.5);
+    CHECK(whole_double("00000000.000000000000000000001") == 1e-21);
+    CHECK(whole_float("1.00000005960464477539062500001") == std::nextafter(1.0f, 2.0f));
+}
+
+// Exponents past the double range give infinity or zero; a run of exponent
+// digits of any length is consumed, and an incomplete exponent is not.
+void test_exponent_range() {
+    const double inf = std::numeric_limits<double>::infinity();
+    CHECK(whole_double("1e400") == inf && whole_double("-1e400") == -inf);
+    CHECK(whole_double("1e-400") == 0.0 && std::signbit(whole_double("-1e-400")));
+    CHECK(whole_double("1e999999999999999999") == inf);
+    CHECK(whole_double("0e999999999") == 0.0);
+    CHECK(whole_double("1e22") == 1e22 && whole_double("1e23") == 1e23);
+    CHECK(whole_float("1e39") == std::numeric_limits<float>::infinity());
+    CHECK(consumed("1e") == 1 && consumed("2.5E+") == 3 && consumed("4e-x") == 1);
+    CHECK(consumed("abc") == 0 && consumed("-") == 0 && consumed(".") == 0 && consumed("") == 0);
+    CHECK(whole_double("inf") == inf && std::isnan(whole_double("nan")));
+}
+
+// The slow path ignores the process locale; skipped when no locale with a
+// comma decimal separator is installed.
+void test_process_locale() {
+    const char* const candidates[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8",
+                                      "fr_FR.utf8", "de_DE", "fr_FR"};
+    const char* chosen = nullptr;
+    for (const char* name : candidates) {
+        if (std::setlocale(LC_ALL, name) && *std::localeconv()->decimal_point == ',') {
+            chosen = name;
+            break;
+        }
+    }
+    if (!chosen) {
+        std::setlocale(LC_ALL, "C");
+        std::puts("fast_float_test: locale check skipped, no comma-decimal locale installed");
+        return;
+    }
+    CHECK(whole_double("3.25") == 3.25);
+    CHECK(whole_double("3.2500000000000000000001") == 3.25);
+    CHECK(whole_double("1.5e300") == 1.5e300 && whole_double("2.5e-310") > 0.0);
+    std::setlocale(LC_ALL, "C");
+}
+
+}  // namespace
+
+int main() {
+    test_round_trip();
+    test_subnormals();
+    test_long_mantissas();
+    test_exponent_range();
+    test_process_locale();
+    std::puts("fast_float_test: ok");
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Sources: inference/gemm.cpp runtime/executor.cpp
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "inference/gemm.h"
+#include "runtime/executor.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+struct Layer {
+    std::size_t rows;
+    std::size_t inputs;
+    std::size_t outputs;
+    std::vector<float> in;
+    std::vector<float> w;
+    std::vector<float> bias;
+};
+
+Layer layer(std::size_t rows, std::size_t inputs, std::size_t outputs) {
+    std::mt19937 rng(11);
+    std::normal_distribution<float> value(0.0f, 1.0f);
+    Layer l{rows, inputs, outputs, {}, {}, {}};
+    for (std::size_t i = 0; i < rows * inputs; ++i) l.in.push_back(value(rng));
+    for (std::size_t i = 0; i < inputs * outputs; ++i) l.w.push_back(value(rng) * 0.1f);
+    for (std::size_t i = 0; i < outputs; ++i) l.bias.push_back(value(rng));
+    return l;
+}
+
+// The loop the kernels replaced: the bias, then each product added in
+// input order.
+std::vector<float> reference(const Layer& l) {
+    std::vector<float> out(l.rows * l.outputs);
+    for (std::size_t r = 0; r < l.rows; ++r) {
+        float* o = out.data() + r * l.outputs;
+        std::memcpy(o, l.bias.data(), l.outputs * sizeof(float));
+        for (std::size_t k = 0; k < l.inputs; ++k) {
+            const float a = l.in[r * l.inputs + k];
+            const float* wk = l.w.data() + k * l.outputs;
+            for (std::size_t j = 0; j < l.outputs; ++j) {
+                o[j] += a * wk[j];
+            }
+        }
+    }
+    return out;
+}
+
+// Every ISA, tile, input block and split gives the reference bit for bit,
+// so tuning can never change a prediction.
+void test_every_config_is_bit_identical(Executor& executor) {
+    // Row and column counts leave tails for every tile and vector width.
+    for (const Layer& l : {layer(8, 256, 64), layer(7, 37, 53)}) {
+        const std::vector<float> expected = reference(l);
+        std::vector<float> out(expected.size());
+        std::size_t configs = 0;
+        for (GemmIsa isa : gemm_isas()) {
+            for (const auto& [rows, vectors] : gemm_tiles(isa)) {
+                for (std::uint32_t k_block : {0u, 1u, 5u, 64u}) {
+                    for (std::uint8_t splits : {1, 2, 3, 8}) {
+                        GemmConfig config;
+                        config.isa = isa;
+                        config.tile_rows = rows;
+                        config.tile_vectors = vectors;
+                        config.k_block = k_block;
+                        config.splits = splits;
+                        std::fill(out.begin(), out.end(), -1.0f);
+                        gemm_bias(l.in.data(), l.inputs, l.rows, l.w.data(), l.inputs,
+                                  l.outputs, l.bias.data(), out.data(), l.outputs, config,
+                                  executor);
+                        if (std::memcmp(out.data(), expected.data(),
+                                        out.size() * sizeof(float)) != 0) {
+                            std::fprintf(stderr, "differs: %s\n",
+                                         format_gemm_config(config).c_str());
+                            CHECK(false);
+                        }
+                        ++configs;
+                    }
+                }
+            }
+        }
+        CHECK(configs >= 14 * 4 * 4);
+    }
+}
+
+// A codebook layer gives exactly its float-expanded matrix on every ISA.
+void test_codebook_matches_expanded(Executor& executor) {
+    Layer l = layer(5, 40, 33);
+    std::vector<float> codebook(16);
+    for (std::size_t i = 0; i < codebook.size(); ++i) {
+        codebook[i] = (static_cast<float>(i) - 7.5f) * 0.03f;
+    }
+    const std::size_t row_bytes = weight_row_bytes(WeightFormat::kCodebook4, l.outputs);
+    // Padding past the last row lets vector lookups read a whole register.
+    std::vector<std::uint8_t> packed(l.inputs * row_bytes + 64);
+    for (std::size_t k = 0; k < l.inputs; ++k) {
+        for (std::size_t j = 0; j < l.outputs; ++j) {
+            const std::uint8_t index = static_cast<std::uint8_t>((k * 7 + j * 3) % 16);
+            packed[k * row_bytes + j / 2] |= static_cast<std::uint8_t>(index << (j % 2 * 4));
+            l.w[k * l.outputs + j] = codebook[index];
+        }
+    }
+    const std::vector<float> expected = reference(l);
+    GemmWeights weights;
+    weights.format = WeightFormat::kCodebook4;
+    weights.data = packed.data();
+    weights.codebook = codebook.data();
+    std::vector<float> out(expected.size());
+    for (GemmIsa isa : gemm_isas()) {
+        GemmConfig config;
+        config.isa = isa;
+        config.splits = 2;
+        gemm_bias(l.in.data(), l.inputs, l.rows, weights, l.inputs, l.outputs, l.bias.data(),
+                  out.data(), l.outputs, config, executor);
+        CHECK(std::memcmp(out.data(), expected.data(), out.size() * sizeof(float)) == 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    ExecutorOptions options;
+    options.blocking_threads = 1;
+    options.threads = 4;
+    Executor executor(options);
+    test_every_config_is_bit_identical(executor);
+    test_codebook_matches_expanded(executor);
+    std::puts("gemm_test: ok");
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Sources: runtime/huge_page_allocator.cpp runtime/metrics.cpp
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "runtime/huge_page_allocator.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+// Explicit 2 MB pages the kernel still has free; a request larger than
+// that cannot be served from the pool.
+std::size_t free_explicit_pages() {
+    std::FILE* meminfo = std::fopen("/proc/meminfo", "r");
+    CHECK(meminfo);
+    char line[256];
+    unsigned long pages = 0;
+    while (std::fgets(line, sizeof(line), meminfo)) {
+        if (std::sscanf(line, "HugePages_Free: %lu", &pages) == 1) {
+            break;
+        }
+    }
+    std::fclose(meminfo);
+    return pages;
+}
+
+bool aligned(const void* p, std::size_t alignment) {
+    return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+
+// A request the explicit pool cannot hold falls back to a 2 MB-aligned THP
+// mapping, and the stats count it there.
+void test_explicit_falls_back_to_transparent() {
+    HugePageAllocator allocator;
+    const std::size_t bytes = (free_explicit_pages() + 1) * kHugePageSize - 4096;
+    void* p = allocator.allocate(bytes, MemoryKind::kWeights);
+    CHECK(allocator.backing(p) == PageBacking::kTransparent);
+    CHECK(aligned(p, kHugePageSize));
+    std::memset(p, 1, bytes);
+
+    const HugePageStats stats = allocator.stats(true);
+    const HugePageKindStats& weights = stats.kinds[static_cast<std::size_t>(MemoryKind::kWeights)];
+    CHECK(weights.requested_bytes == bytes);
+    CHECK(weights.explicit_bytes == 0 && weights.small_bytes == 0);
+    CHECK(weights.transparent_bytes == bytes + 4096);
+    CHECK(weights.transparent_backed_bytes <= weights.transparent_bytes);
+    CHECK(stats.kinds[static_cast<std::size_t>(MemoryKind::kBatch)].requested_bytes == 0);
+    allocator.deallocate(p);
+    CHECK(allocator.stats().kinds[0].transparent_bytes == 0);
+}
+
+// Small requests, and every request when huge pages are disallowed, get
+// plain 64-byte aligned memory.
+void test_small_fallback() {
+    HugePageAllocator allocator;
+    void* small = allocator.allocate(1000, MemoryKind::kBatch);
+    CHECK(allocator.backing(small) == PageBacking::kSmall && aligned(small, kSimdAlignment));
+
+    HugePagePolicy none;
+    none.allow_explicit = false;
+    none.allow_transparent = false;
+    HugePageAllocator plain(none);
+    void* large = plain.allocate(4 * kHugePageSize, MemoryKind::kActivations);
+    CHECK(plain.backing(large) == PageBacking::kSmall && aligned(large, kSimdAlignment));
+    const HugePageKindStats s =
+        plain.stats().kinds[static_cast<std::size_t>(MemoryKind::kActivations)];
+    CHECK(s.small_bytes == 4 * kHugePageSize && s.coverage() == 0.0);
+    allocator.deallocate(small);
+    plain.deallocate(large);
+}
+
+// Coverage is over mapped bytes, whatever was requested.
+void test_coverage() {
+    HugePageKindStats s;
+    CHECK(s.coverage() == 0.0);
+    s.requested_bytes = 3 * kHugePageSize;
+    s.explicit_bytes = 2 * kHugePageSize;
+    s.transparent_bytes = 2 * kHugePageSize;
+    s.transparent_backed_bytes = kHugePageSize;
+    s.small_bytes = 0;
+    CHECK(s.coverage() == 0.75);
+}
+
+// Between scans publish_metrics() reports the last measurement, never more
+// THP-backed bytes than are still mapped.
+void test_metrics_reuse_measurement() {
+    HugePagePolicy policy;
+    policy.allow_explicit = false;
+    policy.smaps_interval = std::chrono::hours(1);
+    HugePageAllocator allocator(policy);
+    MetricsRegistry registry;
+    Gauge& backed =
+        registry.gauge("probionis_hugepage_transparent_backed_bytes{kind=\"weights\"}");
+    Gauge& mapped = registry.gauge("probionis_hugepage_transparent_bytes{kind=\"weights\"}");
+
+    void* first = allocator.allocate(kHugePageSize, MemoryKind::kWeights);
+    std::memset(first, 1, kHugePageSize);
+    allocator.publish_metrics(registry);
+    const double measured = backed.value();
+    CHECK(mapped.value() == kHugePageSize && measured <= kHugePageSize);
+
+    void* second = allocator.allocate(kHugePageSize, MemoryKind::kWeights);
+    std::memset(second, 1, kHugePageSize);
+    allocator.publish_metrics(registry);
+    CHECK(mapped.value() == 2 * kHugePageSize && backed.value() == measured);
+
+    allocator.deallocate(first);
+    allocator.deallocate(second);
+    allocator.publish_metrics(registry);
+    CHECK(mapped.value() == 0 && backed.value() == 0);
+}
+
+}  // namespace
+
+int main() {
+    test_explicit_falls_back_to_transparent();
+    test_small_fallback();
+    test_coverage();
+    test_metrics_reuse_measurement();
+    std::puts("huge_page_allocator_test: ok");
+    return 0;
+}
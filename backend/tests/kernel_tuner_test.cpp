@@ -0,0 +1,84 @@
+// Sources: inference/kernel_tuner.cpp inference/gemm.cpp inference/model.cpp
+//          inference/activations.cpp spectrum/spectrum_batch.cpp runtime/executor.cpp
+//          runtime/metrics.cpp runtime/huge_page_allocator.cpp runtime/vector_math.cpp
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "inference/kernel_tuner.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+LayerWeights dense(std::size_t inputs, std::size_t outputs) {
+    LayerWeights layer;
+    layer.inputs = inputs;
+    layer.outputs = outputs;
+    layer.weights = HugePageBuffer(inputs * outputs * sizeof(float), MemoryKind::kWeights);
+    float* w = layer.weights.as<float>();
+    for (std::size_t i = 0; i < inputs * outputs; ++i) {
+        w[i] = 0.01f * static_cast<float>(i % 13);
+    }
+    layer.bias.assign(outputs, 0.0f);
+    return layer;
+}
+
+Model model() {
+    auto store = LayerStore::create();
+    std::vector<DenseLayer> layers(2);
+    layers[0].weights = store->intern(dense(24, 16));
+    layers[1].weights = store->intern(dense(16, 3));
+    return Model("m", std::move(layers));
+}
+
+KernelTunerOptions options(const std::string& cache_path) {
+    KernelTunerOptions o;
+    o.cache_path = cache_path;
+    o.rows = 4;
+    o.repetitions = 1;
+    o.max_splits = 2;
+    return o;
+}
+
+// A tuned model is cached, and the cache file configures a new tuner.
+void test_cache(Executor& executor) {
+    const std::string path = scratch_path("kernel-cache");
+    {
+        KernelTuner tuner(options(path), executor);
+        Model m = model();
+        CHECK(!tuner.tune(m));
+        CHECK(tuner.tune(m));
+        CHECK(tuner.cached_models() == 1 && tuner.last_save_error().empty());
+    }
+    KernelTuner reloaded(options(path), executor);
+    Model m = model();
+    CHECK(reloaded.tune(m));
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+}
+
+// A cache file that cannot be written leaves the model tuned and the
+// reason with the tuner.
+void test_save_failure(Executor& executor) {
+    KernelTuner tuner(options(scratch_path("missing-dir") + "/kernel-cache"), executor);
+    Model m = model();
+    CHECK(!tuner.tune(m));
+    CHECK(!tuner.last_save_error().empty());
+    CHECK(tuner.tune(m));
+}
+
+}  // namespace
+
+int main() {
+    ExecutorOptions executor_options;
+    executor_options.threads = 2;
+    executor_options.blocking_threads = 1;
+    Executor executor(executor_options);
+    test_cache(executor);
+    test_save_failure(executor);
+    std::puts("kernel_tuner_test: ok");
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Sources: none beyond this file (runtime/mpmc_queue.h is header-only).
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "runtime/mpmc_queue.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+void test_capacity() {
+    CHECK_THROWS(MpmcQueue<int>(0), std::invalid_argument);
+    CHECK_THROWS(MpmcQueue<int>(3), std::invalid_argument);
+    CHECK_THROWS(MpmcQueue<int>(1), std::invalid_argument);
+    MpmcQueue<int> queue(4);
+    CHECK(queue.capacity() == 4);
+    for (int i = 0; i < 4; ++i) {
+        CHECK(queue.try_push(i));
+    }
+    CHECK(queue.size_approx() == 4);
+    CHECK(!queue.try_push(4));
+    int value = -1;
+    for (int i = 0; i < 4; ++i) {
+        CHECK(queue.try_pop(value) && value == i);
+    }
+    CHECK(queue.size_approx() == 0);
+    CHECK(!queue.try_pop(value));
+}
+
+void test_bulk_wraps() {
+    MpmcQueue<int> queue(8);
+    int in[8];
+    int out[8];
+    int next_in = 0;
+    int next_out = 0;
+    // Odd batch sizes walk the claimed ranges across the end of the ring.
+    for (int round = 0; round < 50; ++round) {
+        const std::size_t count = 1 + round % 5;
+        for (std::size_t i = 0; i < count; ++i) {
+            in[i] = next_in + static_cast<int>(i);
+        }
+        const std::size_t pushed = queue.try_push_bulk(in, count);
+        next_in += static_cast<int>(pushed);
+        const std::size_t popped = queue.try_pop_bulk(out, 3);
+        for (std::size_t i = 0; i < popped; ++i) {
+            CHECK(out[i] == next_out++);
+        }
+    }
+    while (std::size_t popped = queue.try_pop_bulk(out, 8)) {
+        for (std::size_t i = 0; i < popped; ++i) {
+            CHECK(out[i] == next_out++);
+        }
+    }
+    CHECK(next_out == next_in);
+}
+
+void test_move_only() {
+    MpmcQueue<std::unique_ptr<int>> queue(2);
+    CHECK(queue.push(std::make_unique<int>(7)));
+    std::unique_ptr<int> out;
+    CHECK(queue.pop(out) && *out == 7);
+}
+
+void test_close_drains() {
+    MpmcQueue<int> queue(4);
+    CHECK(queue.push(1));
+    queue.close();
+    CHECK(!queue.push(2));
+    int value = 0;
+    CHECK(queue.pop(value) && value == 1);
+    CHECK(!queue.pop(value));
+}
+
+void test_close_wakes_waiters() {
+    MpmcQueue<int> queue(2);
+    std::atomic<bool> returned{false};
+    std::thread consumer([&] {
+        int value;
+        CHECK(!queue.pop(value));
+        returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!returned);
+    queue.close();
+    consumer.join();
+    CHECK(returned);
+}
+
+// Every item pushed by any producer is popped exactly once, and each
+// producer's items come out in the order it pushed them.
+void test_concurrent() {
+    constexpr int kProducers = 4;
+    constexpr int kConsumers = 4;
+    constexpr std::uint64_t kPerProducer = 100000;
+    MpmcQueue<std::uint64_t> queue(64);
+    std::vector<std::vector<std::uint64_t>> seen(kConsumers);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < kConsumers; ++c) {
+        threads.emplace_back([&, c] {
+            std::uint64_t batch[16];
+            while (std::size_t n = c % 2 ? queue.pop_bulk(batch, 16) : queue.pop(batch[0])) {
+                seen[c].insert(seen[c].end(), batch, batch + n);
+            }
+        });
+    }
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p] {
+            for (std::uint64_t i = 0; i < kPerProducer; ++i) {
+                CHECK(queue.push(static_cast<std::uint64_t>(p) << 32 | i));
+            }
+        });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    queue.close();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<std::uint64_t> count(kProducers * kPerProducer, 0);
+    for (const auto& items : seen) {
+        std::vector<std::int64_t> last(kProducers, -1);
+        for (const std::uint64_t item : items) {
+            const std::size_t producer = item >> 32;
+            const std::uint64_t index = item & 0xffffffffu;
+            CHECK(static_cast<std::int64_t>(index) > last[producer]);
+            last[producer] = static_cast<std::int64_t>(index);
+            ++count[producer * kPerProducer + index];
+        }
+    }
+    for (const std::uint64_t n : count) {
+        CHECK(n == 1);
+    }
+}
+
+}  // namespace
+
+int main() {
+    test_capacity();
+    test_bulk_wraps();
+    test_move_only();
+    test_close_drains();
+    test_close_wakes_waiters();
+    test_concurrent();
+    std::puts("mpmc_queue_test: ok");
+    return 0;
+}
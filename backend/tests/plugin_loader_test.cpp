@@ -0,0 +1,154 @@
+// Sources: preprocess/plugin_loader.cpp preprocess/pipeline.cpp preprocess/qc_gate.cpp
+//          spectrum/spectrum_batch.cpp runtime/huge_page_allocator.cpp runtime/metrics.cpp
+//          runtime/vector_math.cpp
+//
+// Builds preprocess/plugins/linear_baseline.c and a few broken plugins with
+// $CC (default cc) and loads them; skipped without a C compiler.
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "preprocess/plugin_loader.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+const std::string kScratch = scratch_path("plugins");
+
+std::string backend_dir() {
+    const std::string file = __FILE__;
+    const std::size_t tests = file.rfind("tests/");
+    return tests == 0 || tests == std::string::npos ? "." : file.substr(0, tests - 1);
+}
+
+std::string compiler() {
+    const char* cc = std::getenv("CC");
+    return cc && *cc ? cc : "cc";
+}
+
+// Compiles `source` into a shared object in the scratch directory.
+std::string build(const std::string& source, const std::string& name) {
+    const std::string so = kScratch + "/" + name + ".so";
+    const std::string command = compiler() + " -std=c99 -O2 -shared -fPIC -I " + backend_dir() +
+                                " " + source + " -o " + so;
+    CHECK(std::system(command.c_str()) == 0);
+    return so;
+}
+
+// A test plugin from a descriptor body, with do-nothing create and process
+// unless `functions` defines them.
+std::string build_broken(const std::string& name, const std::string& functions,
+                         const std::string& descriptor) {
+    const std::string source = kScratch + "/" + name + ".c";
+    std::ofstream(source) << "#include <string.h>\n#include \"preprocess/plugin_abi.h\"\n"
+                          << functions << "\nstatic const probionis_plugin d = {" << descriptor
+                          << "};\nconst probionis_plugin* probionis_plugin_entry(void) "
+                             "{ return &d; }\n";
+    return build(source, name);
+}
+
+Spectrum spectrum(bool with_axis) {
+    Spectrum s;
+    s.sample_id = "s";
+    for (int j = 0; j < 12; ++j) {
+        const float x = 1000.0f + 2.0f * static_cast<float>(j);
+        if (with_axis) {
+            s.axis.push_back(x);
+        }
+        // A sloped baseline with a bump in the middle.
+        s.intensity.push_back(5.0f + 0.25f * (x - 1000.0f) + (j == 6 ? 3.0f : 0.0f));
+    }
+    return s;
+}
+
+// The example plugin loads, runs on whole batches and on single spectra,
+// and its padding is zeroed again afterwards.
+void test_example_plugin(const std::string& so) {
+    const auto library = PluginLibrary::open(so);
+    CHECK(std::strcmp(library->descriptor().name, "linear_baseline") == 0);
+    PluginStep step(library, "anchor=1");
+
+    SpectrumBatch batch(3, 12, step.row_multiple());
+    for (int i = 0; i < 3; ++i) {
+        batch.push(spectrum(true));
+    }
+    std::fill(batch.row(0) + 12, batch.row(0) + batch.stride(), 9.0f);
+    step.apply_batch(batch);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        CHECK(std::fabs(batch.row(i)[0]) < 1e-4f && std::fabs(batch.row(i)[11]) < 1e-4f);
+        CHECK(std::fabs(batch.row(i)[6] - 3.0f) < 1e-4f);
+    }
+    for (std::size_t j = 12; j < batch.stride(); ++j) {
+        CHECK(batch.row(0)[j] == 0.0f);
+    }
+
+    Spectrum single = spectrum(true);
+    step.apply(single);
+    CHECK(std::fabs(single.intensity[6] - 3.0f) < 1e-4f);
+
+    // No axis: refused before the plugin would read a null pointer.
+    Spectrum bare = spectrum(false);
+    CHECK_THROWS(step.apply(bare), std::runtime_error);
+
+    try {
+        PluginStep bad(library, "anchor=0");
+        CHECK(false);
+    } catch (const std::runtime_error& e) {
+        CHECK(std::strstr(e.what(), "expected anchor=N") != nullptr);
+    }
+    PluginStep wide(library, "anchor=7");
+    CHECK_THROWS(wide.apply(single), std::runtime_error);
+}
+
+// Plugins that fill the error buffer without terminating it, and ones the
+// loader must refuse.
+void test_broken_plugins() {
+    const std::string fill =
+        "static void* create(const char* c, char* e, size_t n) "
+        "{ (void)c; memset(e, 'x', n); return 0; }\n"
+        "static void destroy(void* s) { (void)s; }\n"
+        "static int process(void* s, probionis_batch* b, char* e, size_t n) "
+        "{ (void)s; (void)b; memset(e, 'x', n); return PROBIONIS_PLUGIN_ERROR; }\n";
+    const auto noisy = PluginLibrary::open(build_broken(
+        "noisy", fill,
+        "PROBIONIS_PLUGIN_ABI_VERSION, sizeof(probionis_plugin), \"noisy\", \"1\", "
+        "{0, 0, 0, 0}, create, destroy, process"));
+    try {
+        PluginStep step(noisy, "");
+        CHECK(false);
+    } catch (const std::runtime_error& e) {
+        CHECK(std::strlen(e.what()) < 600);
+    }
+
+    const std::string wrong_version = build_broken(
+        "wrong_version", fill,
+        "99, sizeof(probionis_plugin), \"v\", \"1\", {0, 0, 0, 0}, create, destroy, process");
+    CHECK_THROWS(PluginLibrary::open(wrong_version), std::runtime_error);
+    const std::string missing = build_broken(
+        "missing", fill,
+        "PROBIONIS_PLUGIN_ABI_VERSION, sizeof(probionis_plugin), \"m\", \"1\", {0, 0, 0, 0}, "
+        "create, destroy, 0");
+    CHECK_THROWS(PluginLibrary::open(missing), std::runtime_error);
+    CHECK_THROWS(PluginLibrary::open(kScratch + "/absent.so"), std::runtime_error);
+}
+
+}  // namespace
+
+int main() {
+    if (std::system((compiler() + " --version >/dev/null 2>&1").c_str()) != 0) {
+        std::puts("plugin_loader_test: skipped, needs a C compiler");
+        return 0;
+    }
+    CHECK(std::system(("mkdir -p " + kScratch).c_str()) == 0);
+    test_example_plugin(build(backend_dir() + "/preprocess/plugins/linear_baseline.c",
+                              "linear_baseline"));
+    test_broken_plugins();
+    CHECK(std::system(("rm -rf " + kScratch).c_str()) == 0);
+    std::puts("plugin_loader_test: ok");
+    return 0;
+}
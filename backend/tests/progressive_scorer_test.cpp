@@ -0,0 +1,118 @@
+// Sources: inference/progressive_scorer.cpp runtime/executor.cpp runtime/metrics.cpp
+//          runtime/huge_page_allocator.cpp runtime/vector_math.cpp inference/model.cpp
+//          inference/gemm.cpp inference/kernel_tuner.cpp inference/activations.cpp
+//          spectrum/spectrum_batch.cpp preprocess/pipeline.cpp preprocess/qc_gate.cpp
+//          io/wire_decode.cpp io/fast_float.cpp io/repeat_codec.cpp net/http.cpp
+//          net/socket.cpp
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "inference/progressive_scorer.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+ExecutorOptions executor_options() {
+    ExecutorOptions o;
+    o.threads = 3;
+    o.blocking_threads = 1;
+    return o;
+}
+
+Spectrum spectrum() {
+    Spectrum s;
+    s.sample_id = "S1";
+    s.axis = {1.0f, 2.0f, 3.0f, 4.0f};
+    s.intensity = {0.1f, 0.2f, 0.3f, 0.4f};
+    return s;
+}
+
+ProgressiveStage stage(const std::string& name, StageFunction compute) {
+    ProgressiveStage s;
+    s.name = name;
+    s.compute = std::move(compute);
+    return s;
+}
+
+std::vector<std::string> score(ProgressiveScorer& scorer) {
+    std::vector<std::string> lines;
+    scorer.score(spectrum(), [&lines](const std::string& line) {
+        lines.push_back(line);
+        return true;
+    });
+    return lines;
+}
+
+bool has(const std::string& line, const std::string& part) {
+    return line.find(part) != std::string::npos;
+}
+
+// The screening line leads even when a refinement finishes first; a stage
+// that throws, whatever it throws, is reported as failed.
+void test_order_and_failures(Executor& executor) {
+    std::promise<void> refined;
+    std::shared_future<void> refined_done = refined.get_future().share();
+    ProgressiveOptions options;
+    options.axis = spectrum().axis;
+    options.stages.push_back(stage("screening", [refined_done](const SpectrumBatch& sample) {
+        refined_done.wait();
+        return "\"outputs\":[" + std::to_string(sample.row(0)[3]) + "]";
+    }));
+    options.stages.push_back(stage("full", [&refined](const SpectrumBatch&) {
+        refined.set_value();
+        return std::string("\"outputs\":[1]");
+    }));
+    options.stages.push_back(
+        stage("odd", [](const SpectrumBatch&) -> std::string { throw 42; }));
+    ProgressiveScorer scorer(options, executor);
+    const std::vector<std::string> lines = score(scorer);
+    CHECK(lines.size() == 3);
+    CHECK(has(lines[0], "\"stage\":\"screening\"") && has(lines[0], "\"outputs\":[0.4"));
+    CHECK(has(lines[0], "\"remaining\":2"));
+    CHECK(has(lines[2], "\"remaining\":0}\n"));
+    std::size_t errors = 0;
+    for (const std::string& line : lines) {
+        errors += has(line, "\"stage\":\"odd\"") && has(line, "\"error\":");
+    }
+    CHECK(errors == 1);
+}
+
+// At the deadline, results held back behind a late screening stage still
+// go out; only the stage without a result is reported as timed out.
+void test_deadline_sends_ready_results(Executor& executor) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    ProgressiveOptions options;
+    options.axis = spectrum().axis;
+    options.deadline = std::chrono::milliseconds(100);
+    options.stages.push_back(stage("screening", [released](const SpectrumBatch&) {
+        released.wait();
+        return std::string("\"outputs\":[0]");
+    }));
+    options.stages.push_back(
+        stage("full", [](const SpectrumBatch&) { return std::string("\"outputs\":[1]"); }));
+    {
+        ProgressiveScorer scorer(options, executor);
+        const std::vector<std::string> lines = score(scorer);
+        CHECK(lines.size() == 2);
+        CHECK(has(lines[0], "\"stage\":\"screening\"") && has(lines[0], "\"timed_out\":true"));
+        CHECK(has(lines[1], "\"stage\":\"full\"") && has(lines[1], "\"outputs\":[1]"));
+        CHECK(!has(lines[1], "timed_out"));
+        release.set_value();
+    }
+}
+
+}  // namespace
+
+int main() {
+    Executor executor(executor_options());
+    test_order_and_failures(executor);
+    test_deadline_sends_ready_results(executor);
+    std::puts("progressive_scorer_test: ok");
+    return 0;
+}
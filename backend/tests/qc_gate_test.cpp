@@ -0,0 +1,166 @@
+// Sources: preprocess/qc_gate.cpp
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "preprocess/qc_gate.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+// Odd, so the vector pass is followed by a scalar tail.
+constexpr std::size_t kChannels = 517;
+
+// A clean acquisition: a flat background of 1000 counts, one band of 500
+// at channel 200 and +-`noise` counts of uniform noise.
+std::vector<float> acquisition(float noise = 2.0f) {
+    std::mt19937 random(17);
+    std::uniform_real_distribution<float> jitter(-noise, noise);
+    std::vector<float> x(kChannels);
+    for (std::size_t i = 0; i < kChannels; ++i) {
+        const float d = (static_cast<float>(i) - 200.0f) / 15.0f;
+        x[i] = 1000.0f + 500.0f * std::exp(-d * d) + jitter(random);
+    }
+    return x;
+}
+
+QcReason screen(const std::vector<float>& x) {
+    return QcGate().screen(x.data(), x.size()).reason;
+}
+
+// Channels 100, 140, ... raised by `height`.
+std::vector<float> with_spikes(std::size_t count, float height) {
+    std::vector<float> x = acquisition();
+    for (std::size_t k = 0; k < count; ++k) {
+        x[100 + 40 * k] += height;
+    }
+    return x;
+}
+
+void test_clean_passes() {
+    const std::vector<float> x = acquisition();
+    const QcResult result = QcGate().screen(x.data(), x.size());
+    CHECK(result.ok() && result.stats.channels == kChannels);
+    CHECK(result.stats.non_finite == 0 && result.stats.saturated == 0 &&
+          result.stats.spikes == 0);
+    double sum = 0.0;
+    for (const float v : x) {
+        sum += v;
+    }
+    CHECK(std::fabs(result.stats.mean_intensity - sum / kChannels) < 1e-3);
+    CHECK(result.stats.max_intensity > 1490.0f && result.stats.min_intensity < 1000.0f);
+    CHECK(result.stats.snr > 10.0);
+
+    Spectrum spectrum;
+    spectrum.intensity = x;
+    CHECK(QcGate().screen(spectrum).ok());
+}
+
+void test_empty() {
+    CHECK(QcGate().screen(Spectrum()).reason == QcReason::kEmpty);
+}
+
+void test_non_finite() {
+    std::vector<float> x = acquisition();
+    x[300] = std::numeric_limits<float>::quiet_NaN();
+    CHECK(screen(x) == QcReason::kNonFinite);
+    x = acquisition();
+    x[kChannels - 1] = -std::numeric_limits<float>::infinity();
+    CHECK(screen(x) == QcReason::kNonFinite);
+    // The most definitive reason wins: a dark spectrum with a NaN.
+    for (float& v : x) {
+        v *= 0.01f;
+    }
+    CHECK(screen(x) == QcReason::kNonFinite);
+}
+
+// Up to max_saturated clipped channels are tolerated, one more is not.
+void test_saturated() {
+    std::vector<float> x = acquisition();
+    for (std::size_t i = 198; i < 201; ++i) {
+        x[i] = 65000.0f;
+    }
+    CHECK(screen(x) != QcReason::kSaturated);
+    x[201] = 65535.0f;
+    CHECK(screen(x) == QcReason::kSaturated);
+}
+
+void test_dark() {
+    std::vector<float> x = acquisition();
+    for (float& v : x) {
+        v *= 0.04f;
+    }
+    CHECK(screen(x) == QcReason::kDark);
+}
+
+// Cosmic-ray hits are single channels far above their neighbours; up to
+// max_spikes of them are not reported as spikes (they still raise the
+// noise estimate).
+void test_spikes() {
+    CHECK(screen(with_spikes(8, 5000.0f)) != QcReason::kSpikes);
+    const QcResult result = [] {
+        const std::vector<float> x = with_spikes(9, 5000.0f);
+        return QcGate().screen(x.data(), x.size());
+    }();
+    CHECK(result.reason == QcReason::kSpikes && result.stats.spikes == 9);
+}
+
+// A background climbing steeply towards the end of the range, as
+// fluorescence does, tilts the fitted baseline by more than four times the
+// mean intensity.
+void test_fluorescence() {
+    std::vector<float> x = acquisition();
+    for (std::size_t i = 0; i < kChannels; ++i) {
+        const float from_end = static_cast<float>(kChannels - i);
+        x[i] = 0.06f * x[i] + 20000.0f * std::exp(-from_end / 20.0f);
+    }
+    const QcResult result = QcGate().screen(x.data(), x.size());
+    CHECK(result.reason == QcReason::kFluorescence);
+    CHECK(result.stats.baseline_slope > 0.0);
+}
+
+// Noise as large as the band itself.
+void test_low_snr() {
+    const QcResult result = [] {
+        const std::vector<float> x = acquisition(400.0f);
+        return QcGate().screen(x.data(), x.size());
+    }();
+    CHECK(result.reason == QcReason::kLowSnr && result.stats.snr < 10.0);
+
+    QcThresholds lenient;
+    lenient.min_snr = 2.0;
+    const std::vector<float> x = acquisition(400.0f);
+    CHECK(QcGate(lenient).screen(x.data(), x.size()).ok());
+}
+
+// Reason codes are recorded with samples, so their values and names stay.
+void test_reason_names() {
+    const char* const names[] = {"ok",   "empty",   "non_finite",   "saturated",
+                                 "dark", "low_snr", "fluorescence", "spikes"};
+    for (int code = 0; code < 8; ++code) {
+        CHECK(std::string(qc_reason_name(static_cast<QcReason>(code))) == names[code]);
+    }
+    CHECK(static_cast<int>(QcReason::kSpikes) == 7);
+}
+
+}  // namespace
+
+int main() {
+    test_clean_passes();
+    test_empty();
+    test_non_finite();
+    test_saturated();
+    test_dark();
+    test_spikes();
+    test_fluorescence();
+    test_low_snr();
+    test_reason_names();
+    std::puts("qc_gate_test: ok");
+    return 0;
+}
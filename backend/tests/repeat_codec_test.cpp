@@ -0,0 +1,138 @@
+// Sources: io/repeat_codec.cpp
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "io/parse_error.h"
+#include "io/repeat_codec.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+constexpr std::size_t kChannels = 1000;  // not a multiple of the 64-channel block
+constexpr std::size_t kRepeats = 20;
+
+std::vector<std::vector<float>> acquisitions() {
+    std::mt19937 rng(5);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<std::vector<float>> repeats(kRepeats, std::vector<float>(kChannels));
+    for (std::size_t r = 0; r < kRepeats; ++r) {
+        for (std::size_t c = 0; c < kChannels; ++c) {
+            const float truth = 5000.0f + 3000.0f * std::sin(static_cast<float>(c) * 0.003f);
+            repeats[r][c] = truth + noise(rng) * std::sqrt(truth) * 0.2f;
+        }
+    }
+    repeats[7][100] += 20000.0f;  // a cosmic-ray hit
+    repeats[9][5] = std::numeric_limits<float>::quiet_NaN();
+    repeats[9][6] = -0.0f;
+    repeats[9][7] = std::numeric_limits<float>::infinity();
+    repeats[11][8] = std::numeric_limits<float>::denorm_min();
+    return repeats;
+}
+
+std::string encode(const std::vector<std::vector<float>>& repeats) {
+    RepeatEncoder encoder(repeats.front().size());
+    for (const auto& repeat : repeats) {
+        encoder.add(repeat.data());
+    }
+    CHECK(encoder.repeats() == repeats.size());
+    return encoder.bytes();
+}
+
+// Decoding gives back every acquisition bit for bit, specials included,
+// in well under the raw size.
+void test_round_trip() {
+    const auto repeats = acquisitions();
+    const std::string bytes = encode(repeats);
+    CHECK(bytes.size() < kRepeats * kChannels * sizeof(float) * 3 / 4);
+
+    RepeatDecoder decoder(bytes.data(), bytes.size());
+    CHECK(decoder.channels() == kChannels && decoder.repeats() == kRepeats);
+    std::vector<float> row(kChannels);
+    std::size_t read = 0;
+    while (decoder.next(row.data())) {
+        CHECK(read < kRepeats);
+        CHECK(std::memcmp(row.data(), repeats[read].data(), kChannels * sizeof(float)) == 0);
+        ++read;
+    }
+    CHECK(read == kRepeats && decoder.read() == kRepeats);
+}
+
+void test_single_repeat() {
+    const std::vector<std::vector<float>> one = {{1.0f, -2.5f, 3.0f}};
+    const std::string bytes = encode(one);
+    float out[3];
+    const RepeatSummary summary = reduce_repeats(bytes.data(), bytes.size(), 3, out);
+    CHECK(summary.repeats == 1 && summary.rejected == 0);
+    CHECK(out[0] == 1.0f && out[1] == -2.5f && out[2] == 3.0f);
+}
+
+// The clipped mean drops the spike and the non-finite values; elsewhere
+// it matches the plain mean.
+void test_reduce() {
+    const auto repeats = acquisitions();
+    const std::string bytes = encode(repeats);
+    std::vector<float> clipped(kChannels);
+    std::vector<float> mean(kChannels);
+    const RepeatSummary summary = reduce_repeats(bytes.data(), bytes.size(), kChannels,
+                                                 clipped.data());
+    reduce_repeats(bytes.data(), bytes.size(), kChannels, mean.data(),
+                   {RepeatReduction::kMean, 4.0f});
+    CHECK(summary.repeats == kRepeats && summary.rejected >= 3);
+
+    double others = 0.0;
+    for (std::size_t r = 0; r < kRepeats; ++r) {
+        others += r == 7 ? 0.0 : repeats[r][100];
+    }
+    others /= kRepeats - 1;
+    CHECK(std::fabs(clipped[100] - others) < 1.0);
+    CHECK(mean[100] > others + 500.0);
+    CHECK(std::isfinite(clipped[5]) && std::isfinite(clipped[7]));
+    CHECK(!std::isfinite(mean[7]));
+    for (std::size_t c = 9; c < kChannels; ++c) {
+        if (c != 100) {
+            CHECK(std::fabs(clipped[c] - mean[c]) < 50.0f);
+        }
+    }
+    CHECK_THROWS(reduce_repeats(bytes.data(), bytes.size(), kChannels + 1, mean.data()),
+                 ParseError);
+}
+
+// Truncated or damaged input throws ParseError rather than reading out of
+// bounds (run under -fsanitize=address to check the latter).
+void test_malformed() {
+    const std::string bytes = encode(acquisitions());
+    std::vector<float> out(kChannels);
+    for (std::size_t cut = 0; cut < bytes.size(); cut += 211) {
+        CHECK_THROWS(reduce_repeats(bytes.data(), cut, kChannels, out.data()), ParseError);
+    }
+    std::string bad_magic = bytes;
+    bad_magic[0] = 'X';
+    CHECK_THROWS(RepeatDecoder(bad_magic.data(), bad_magic.size()), ParseError);
+    std::mt19937 rng(1);
+    for (int i = 0; i < 200; ++i) {
+        std::string damaged = bytes;
+        damaged[8 + rng() % (damaged.size() - 8)] ^= static_cast<char>(1 << (rng() % 8));
+        try {
+            reduce_repeats(damaged.data(), damaged.size(), kChannels, out.data());
+        } catch (const ParseError&) {
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    test_round_trip();
+    test_single_repeat();
+    test_reduce();
+    test_malformed();
+    std::puts("repeat_codec_test: ok");
+    return 0;
+}
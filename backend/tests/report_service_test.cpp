@@ -0,0 +1,282 @@
+// Sources: report/report_service.cpp report/report_renderer.cpp
+//          storage/spectrum_pyramid.cpp preprocess/qc_gate.cpp net/http.cpp net/socket.cpp
+//          runtime/executor.cpp runtime/metrics.cpp runtime/vector_math.cpp
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+
+#include "report/report_service.h"
+#include "storage/spectrum_pyramid.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+ReportInput input(const std::string& sample_id, const std::string& model_version) {
+    ReportInput in;
+    in.sample_id = sample_id;
+    in.model_version = model_version;
+    in.spectrum.sample_id = sample_id;
+    for (int i = 0; i < 64; ++i) {
+        in.spectrum.axis.push_back(400.0f + static_cast<float>(i));
+        in.spectrum.intensity.push_back(static_cast<float>(i % 7));
+    }
+    in.predictions = {{"positive", 0.9f}};
+    return in;
+}
+
+ReportLookup wait_ready(ReportService& service, const std::string& sample_id) {
+    for (int i = 0; i < 2000; ++i) {
+        ReportLookup report = service.lookup(sample_id, "m1");
+        if (report.state == ReportState::kReady || report.state == ReportState::kFailed) {
+            return report;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(false && "report never finished");
+    return {};
+}
+
+HttpResponse get(ReportService& service, const std::string& sample_id,
+                 const std::string& etag = {}) {
+    HttpRequest request;
+    request.method = "GET";
+    request.target = "/reports?sample_id=" + sample_id + "&model_version=m1";
+    if (!etag.empty()) {
+        request.headers.emplace_back("If-None-Match", etag);
+    }
+    HttpResponse response;
+    CHECK(service.handle(request, response));
+    return response;
+}
+
+const std::string* header(const HttpResponse& response, const char* name) {
+    return find_header(response.headers, name);
+}
+
+// A miss renders in the background through the loader; the report is
+// then served with a private immutable cache policy and its ETag.
+void test_render_and_serve(Executor& executor) {
+    std::atomic<int> loads{0};
+    ReportService service({}, [&](const std::string& id, const std::string& version) {
+        loads.fetch_add(1);
+        return input(id, version);
+    }, executor);
+
+    HttpResponse first = get(service, "s1");
+    CHECK(first.status == 202 && header(first, "Retry-After"));
+    CHECK(wait_ready(service, "s1").state == ReportState::kReady);
+    HttpResponse ok = get(service, "s1");
+    CHECK(ok.status == 200 && ok.body.find("s1") != std::string::npos);
+    CHECK(header(ok, "Cache-Control") &&
+          header(ok, "Cache-Control")->rfind("private", 0) == 0);
+    const std::string etag = *header(ok, "ETag");
+    CHECK(get(service, "s1", etag).status == 304);
+    CHECK(loads.load() == 1);
+
+    // prepare() fills the cache without the loader.
+    service.prepare(input("s2", "m1"));
+    CHECK(wait_ready(service, "s2").state == ReportState::kReady);
+    CHECK(loads.load() == 1);
+
+    HttpRequest missing;
+    missing.target = "/reports?sample_id=s1";
+    HttpResponse bad;
+    CHECK(service.handle(missing, bad) && bad.status == 400);
+}
+
+// With a budget smaller than one report, each new report evicts the older
+// ones. The report being served is never the victim, even when it is the
+// oldest (a lookup that reloads it from disk).
+void test_eviction(Executor& executor, const std::string& directory) {
+    ReportServiceOptions options;
+    options.directory = directory;
+    options.memory_bytes = 1;
+    std::atomic<int> loads{0};
+    ReportService service(options, [&](const std::string& id, const std::string& version) {
+        loads.fetch_add(1);
+        return input(id, version);
+    }, executor);
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            const std::string id = "e" + std::to_string(i);
+            const ReportLookup report = wait_ready(service, id);
+            CHECK(report.state == ReportState::kReady);
+            CHECK(report.html->find(id) != std::string::npos);
+        }
+    }
+    // Evicted reports come back from disk, not from another render.
+    CHECK(loads.load() == 4);
+}
+
+// Files are named by a hash of (sample, model version, template version).
+// One written for another triple under the same name counts as a miss.
+void test_name_collision(Executor& executor, const std::string& directory) {
+    ReportServiceOptions options;
+    options.directory = directory;
+    ReportService service(options, [](const std::string& id, const std::string& version) {
+        return input(id, version);
+    }, executor);
+    const std::string key = report_key("x", "m1");
+    {
+        std::ofstream file(directory + "/" + key + ".html");
+        file << "<!-- probionis-report 00 -->\nsomeone else's report";
+    }
+    CHECK(service.lookup("x", "m1").state == ReportState::kRendering);
+    const ReportLookup report = wait_ready(service, "x");
+    CHECK(report.state == ReportState::kReady);
+    CHECK(report.html->find("someone else") == std::string::npos);
+    CHECK(report.key == key);
+}
+
+void test_failure_is_reported_once(Executor& executor) {
+    std::atomic<int> loads{0};
+    ReportService service({}, [&](const std::string&, const std::string&) -> ReportInput {
+        loads.fetch_add(1);
+        throw std::runtime_error("sample not found");
+    }, executor);
+    const ReportLookup failed = wait_ready(service, "gone");
+    CHECK(failed.state == ReportState::kFailed && failed.error == "sample not found");
+    // The next lookup retries.
+    CHECK(service.lookup("gone", "m1").state == ReportState::kRendering);
+    wait_ready(service, "gone");
+    CHECK(loads.load() == 2);
+}
+
+// A sample's pyramid is stored on its first render and read back by later
+// ones, here a report for another model version; a stored pyramid that no
+// longer matches the spectrum is rebuilt.
+void test_pyramid_is_stored(Executor& executor, const std::string& directory) {
+    ReportServiceOptions options;
+    options.directory = directory;
+    ReportService service(options, [](const std::string& id, const std::string& version) {
+        return input(id, version);
+    }, executor);
+    Counter& loaded = global_metrics().counter("probionis_report_pyramids_loaded_total");
+    const std::uint64_t before = loaded.value();
+
+    service.prepare(input("p1", "m1"));
+    CHECK(wait_ready(service, "p1").state == ReportState::kReady);
+    const std::string path = directory + "/" + pyramid_key("p1") + ".pyramid";
+    std::ifstream stored(path, std::ios::binary);
+    CHECK(stored.good());
+    const std::string bytes((std::istreambuf_iterator<char>(stored)),
+                            std::istreambuf_iterator<char>());
+    // After a line naming the sample.
+    const std::size_t header = bytes.find('\n') + 1;
+    CHECK(bytes.compare(0, header, "probionis-pyramid 7031\n") == 0);
+    const SpectrumPyramid pyramid = SpectrumPyramid::deserialize(
+        reinterpret_cast<const std::uint8_t*>(bytes.data()) + header, bytes.size() - header);
+    CHECK(pyramid.describes(input("p1", "m1").spectrum));
+    CHECK(loaded.value() == before);
+
+    service.prepare(input("p1", "m2"));
+    for (int i = 0; i < 2000 && service.lookup("p1", "m2").state != ReportState::kReady; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(loaded.value() == before + 1);
+
+    ReportInput changed = input("p1", "m3");
+    changed.spectrum.intensity[3] += 1.0f;
+    CHECK(!pyramid.describes(changed.spectrum));
+    service.prepare(std::move(changed));
+    for (int i = 0; i < 2000 && service.lookup("p1", "m3").state != ReportState::kReady; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(loaded.value() == before + 1);
+}
+
+HttpResponse viewport(ReportService& service, const std::string& query) {
+    HttpRequest request;
+    request.method = "GET";
+    request.target = "/reports/spectrum?" + query;
+    HttpResponse response;
+    CHECK(service.handle(request, response));
+    return response;
+}
+
+// Zooming reads bins from the stored pyramid: coarse for the whole range,
+// raw channels for a narrow one. Nothing is served before the first render
+// stores the pyramid, nor for another sample's file.
+void test_viewport(Executor& executor, const std::string& directory) {
+    ReportServiceOptions options;
+    options.directory = directory;
+    ReportService service(options, [](const std::string& id, const std::string& version) {
+        return input(id, version);
+    }, executor);
+    CHECK(viewport(service, "sample_id=v1").status == 404);
+    CHECK(viewport(service, "x_lo=1").status == 400);
+    CHECK(viewport(service, "sample_id=v1&x_lo=abc").status == 400);
+    CHECK(viewport(service, "sample_id=v1&points=0").status == 400);
+
+    service.prepare(input("v1", "m1"));
+    CHECK(wait_ready(service, "v1").state == ReportState::kReady);
+    const HttpResponse all = viewport(service, "sample_id=v1&points=40");
+    CHECK(all.status == 200 && all.body.size() == 32 * sizeof(PyramidBin));
+    CHECK(*header(all, "X-Probionis-Pyramid-Level") == "1");
+    PyramidBin first;
+    std::memcpy(&first, all.body.data(), sizeof(first));
+    CHECK(first.min == 0.0f && first.max == 1.0f);
+
+    // 410..420 plus one channel either side, at full resolution.
+    const HttpResponse zoomed = viewport(service, "sample_id=v1&x_lo=410&x_hi=420&points=64");
+    CHECK(zoomed.status == 200 && zoomed.body.size() == 12 * sizeof(PyramidBin));
+    CHECK(*header(zoomed, "X-Probionis-Pyramid-Level") == "0");
+    std::memcpy(&first, zoomed.body.data(), sizeof(first));
+    CHECK(first.x == 409.0f && first.mean == 9 % 7);
+
+    // A file under v2's name that belongs to v1 is not v2's.
+    const std::string from = directory + "/" + pyramid_key("v1") + ".pyramid";
+    const std::string to = directory + "/" + pyramid_key("v2") + ".pyramid";
+    CHECK(std::system(("cp '" + from + "' '" + to + "'").c_str()) == 0);
+    CHECK(viewport(service, "sample_id=v2").status == 404);
+}
+
+// deserialize() accepts only level tables build() could have produced.
+void test_pyramid_rejects_bad_levels() {
+    const SpectrumPyramid pyramid = SpectrumPyramid::build(input("q", "m1").spectrum, 4);
+    std::vector<std::uint8_t> bytes = pyramid.serialize();
+    CHECK(SpectrumPyramid::deserialize(bytes.data(), bytes.size()).levels() == pyramid.levels());
+    // magic, version, channels, level count, then one 64-bit offset per level.
+    constexpr std::size_t kFirstOffset = 4 + 4 + 8 + 4;
+    const auto with_offset = [&](std::size_t index, std::uint64_t value) {
+        std::vector<std::uint8_t> copy = bytes;
+        std::memcpy(copy.data() + kFirstOffset + index * 8, &value, sizeof(value));
+        return copy;
+    };
+    for (const auto& bad : {with_offset(0, 1), with_offset(1, 63), with_offset(2, 64 + 31),
+                            with_offset(2, 40), with_offset(3, UINT64_MAX)}) {
+        CHECK_THROWS(SpectrumPyramid::deserialize(bad.data(), bad.size()), std::runtime_error);
+    }
+    bytes.resize(bytes.size() - 1);
+    CHECK_THROWS(SpectrumPyramid::deserialize(bytes.data(), bytes.size()), std::runtime_error);
+}
+
+}  // namespace
+
+int main() {
+    const std::string directory = scratch_path("reports");
+    CHECK(::mkdir(directory.c_str(), 0700) == 0);
+    {
+        ExecutorOptions options;
+        options.threads = 4;
+        Executor executor(options);
+        test_render_and_serve(executor);
+        test_eviction(executor, directory);
+        test_name_collision(executor, directory);
+        test_failure_is_reported_once(executor);
+        test_pyramid_is_stored(executor, directory);
+        test_viewport(executor, directory);
+    }
+    test_pyramid_rejects_bad_levels();
+    CHECK(std::system(("rm -rf '" + directory + "'").c_str()) == 0);
+    std::puts("report_service_test: ok");
+    return 0;
+}
@@ -0,0 +1,224 @@
+// Sources: storage/results_wal.cpp storage/results_store.cpp storage/results_replication.cpp
+//          net/http.cpp net/socket.cpp
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "storage/results_replication.h"
+#include "storage/results_wal.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+using Replayed = std::vector<std::pair<std::uint64_t, ResultRecord>>;
+
+ResultRecord record(int i) {
+    ResultRecord r;
+    r.sample_id = "sample-" + std::to_string(i);
+    r.tenant = i % 2 ? "clinic-a" : "clinic-b";
+    r.model_version = "v3";
+    r.label = "label-" + std::to_string(i % 5);
+    r.score = 0.25f * static_cast<float>(i);
+    r.timestamp_ms = 1700000000000ULL + static_cast<std::uint64_t>(i);
+    return r;
+}
+
+Replayed reopen(const std::string& path) {
+    Replayed replayed;
+    ResultsWal wal(path, [&](std::uint64_t lsn, const ResultRecord& r) {
+        replayed.emplace_back(lsn, r);
+    });
+    CHECK(wal.head() == replayed.size());
+    return replayed;
+}
+
+off_t file_size(const std::string& path) {
+    struct stat st {};
+    CHECK(::stat(path.c_str(), &st) == 0);
+    return st.st_size;
+}
+
+void flip_byte(const std::string& path, off_t offset) {
+    const int fd = ::open(path.c_str(), O_RDWR);
+    CHECK(fd >= 0);
+    char c;
+    CHECK(::pread(fd, &c, 1, offset) == 1);
+    c = static_cast<char>(c ^ 0x5a);
+    CHECK(::pwrite(fd, &c, 1, offset) == 1);
+    ::close(fd);
+}
+
+// Every appended record comes back on reopen, in order, with its LSN.
+void test_recovery(const std::string& path) {
+    {
+        ResultsWal wal(path, [](std::uint64_t, const ResultRecord&) { CHECK(false); });
+        CHECK(wal.head() == 0);
+        CHECK(wal.append(record(1)) == 1);
+        CHECK(wal.append_batch({record(2), record(3), record(4)}) == 2);
+        CHECK(wal.append_batch({}) == 5);
+        CHECK(wal.head() == 4);
+    }
+    const Replayed replayed = reopen(path);
+    CHECK(replayed.size() == 4);
+    for (std::size_t i = 0; i < replayed.size(); ++i) {
+        CHECK(replayed[i].first == i + 1);
+        CHECK(replayed[i].second == record(static_cast<int>(i) + 1));
+    }
+}
+
+// A frame cut short by a crash is dropped on open and the next append
+// takes its LSN.
+void test_torn_tail(const std::string& path) {
+    CHECK(::truncate(path.c_str(), file_size(path) - 3) == 0);
+    CHECK(reopen(path).size() == 3);
+    {
+        ResultsWal wal(path, [](std::uint64_t, const ResultRecord&) {});
+        CHECK(wal.append(record(40)) == 4);
+    }
+    const Replayed replayed = reopen(path);
+    CHECK(replayed.size() == 4 && replayed[3].second == record(40));
+}
+
+// Damage before the last frame is corruption, not a torn write.
+void test_corruption(const std::string& path) {
+    // Magic and version, then the first frame's 16-byte header.
+    flip_byte(path, 8 + 16 + 2);
+    CHECK_THROWS(reopen(path), std::runtime_error);
+    flip_byte(path, 8 + 16 + 2);
+    CHECK(reopen(path).size() == 4);
+}
+
+// A record too large for recovery to accept is refused without using an
+// LSN, and a batch holding one is refused whole.
+void test_oversize(const std::string& path) {
+    ResultsWal wal(path, [](std::uint64_t, const ResultRecord&) {});
+    ResultRecord big = record(50);
+    big.label.assign(std::size_t{2} << 20, 'x');
+    CHECK_THROWS(wal.append(big), std::invalid_argument);
+    CHECK_THROWS(wal.append_batch({record(51), big}), std::invalid_argument);
+    CHECK(wal.head() == 4);
+    CHECK(wal.append(record(52)) == 5);
+}
+
+// A log has one writer at a time; it is free again once closed.
+void test_single_writer(const std::string& path) {
+    {
+        ResultsWal wal(path, [](std::uint64_t, const ResultRecord&) {});
+        CHECK_THROWS(ResultsWal(path, [](std::uint64_t, const ResultRecord&) {}),
+                     std::runtime_error);
+    }
+    ResultsWal reopened(path, [](std::uint64_t, const ResultRecord&) {});
+    CHECK(reopened.head() == 5);
+}
+
+// Shipped frames produce an identical log; duplicates are skipped and gaps
+// refused.
+void test_shipping(const std::string& path, const std::string& replica_path) {
+    ResultsWal primary(path, [](std::uint64_t, const ResultRecord&) {});
+    ResultsWal replica(replica_path, [](std::uint64_t, const ResultRecord&) {});
+    std::string frames;
+    CHECK(primary.read_frames(1, 1 << 20, frames) == 5);
+    const auto applied = replica.append_frames(frames.data(), frames.size());
+    CHECK(applied.size() == 5 && applied.front().first == 1 && applied.back().first == 5);
+    CHECK(replica.append_frames(frames.data(), frames.size()).empty());
+    CHECK(replica.head() == 5);
+
+    primary.append(record(60));
+    primary.append(record(61));
+    std::string gap;
+    CHECK(primary.read_frames(7, 1 << 20, gap) == 1);
+    CHECK_THROWS(replica.append_frames(gap.data(), gap.size()), std::runtime_error);
+    CHECK(replica.head() == 5);
+
+    // A byte budget smaller than one frame still ships one frame.
+    std::string one;
+    CHECK(primary.read_frames(6, 1, one) == 1);
+    CHECK(replica.append_frames(one.data(), one.size()).size() == 1);
+}
+
+// The shipped frames survive a reopen of the replica's log.
+void test_replica_reopens(const std::string& replica_path) {
+    CHECK(reopen(replica_path).size() == 6);
+}
+
+// Concurrent writers share commits: every LSN is handed out exactly once,
+// each batch's are consecutive, and an oversize record fails only its own
+// batch.
+void test_group_commit(const std::string& path) {
+    constexpr int kThreads = 8;
+    constexpr int kWrites = 40;
+    std::vector<std::vector<std::uint64_t>> lsns(kThreads);
+    {
+        ResultsPrimary primary(path);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < kThreads; ++t) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; i < kWrites; ++i) {
+                    const int id = t * 1000 + i * 2;
+                    const std::uint64_t first = primary.write_batch({record(id), record(id + 1)});
+                    lsns[t].push_back(first);
+                    lsns[t].push_back(first + 1);
+                    if (i % 10 == 0) {
+                        ResultRecord big = record(id);
+                        big.label.assign(std::size_t{2} << 20, 'x');
+                        CHECK_THROWS(primary.write_batch({record(id), big}),
+                                     std::invalid_argument);
+                    }
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        CHECK(primary.wal().head() == 2 * kThreads * kWrites);
+        CHECK(primary.store().size() == 2 * kThreads * kWrites);
+    }
+    std::vector<std::uint64_t> all;
+    for (const auto& thread_lsns : lsns) {
+        all.insert(all.end(), thread_lsns.begin(), thread_lsns.end());
+    }
+    std::sort(all.begin(), all.end());
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        CHECK(all[i] == i + 1);
+    }
+    const Replayed replayed = reopen(path);
+    for (std::size_t t = 0; t < lsns.size(); ++t) {
+        for (std::size_t i = 0; i < lsns[t].size(); ++i) {
+            const ResultRecord& r = replayed[lsns[t][i] - 1].second;
+            CHECK(r == record(static_cast<int>(t * 1000 + i)));
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    const std::string path = scratch_path("results.pbwl");
+    const std::string replica_path = scratch_path("replica.pbwl");
+    const std::string primary_path = scratch_path("primary.pbwl");
+    ::unlink(path.c_str());
+    ::unlink(replica_path.c_str());
+    ::unlink(primary_path.c_str());
+    test_recovery(path);
+    test_torn_tail(path);
+    test_corruption(path);
+    test_oversize(path);
+    test_single_writer(path);
+    test_shipping(path, replica_path);
+    test_replica_reopens(replica_path);
+    test_group_commit(primary_path);
+    ::unlink(path.c_str());
+    ::unlink(replica_path.c_str());
+    ::unlink(primary_path.c_str());
+    std::puts("results_wal_test: ok");
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Sources: cluster/router.cpp cluster/hash_ring.cpp cluster/cluster_config.cpp net/http.cpp
+//          net/http_server.cpp net/socket.cpp replay/capture_log.cpp runtime/executor.cpp
+//          runtime/metrics.cpp runtime/huge_page_allocator.cpp
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cluster/router.h"
+#include "net/http_server.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+std::string key(int i) {
+    return "sample-" + std::to_string(i);
+}
+
+// Owners are spread evenly, weighted nodes take their share, preference
+// lists start at the owner, and removing a node moves only its own keys.
+void test_ring_placement() {
+    HashRing ring(128);
+    ring.add_node("a");
+    ring.add_node("b");
+    ring.add_node("c");
+    std::map<std::string, int> owned;
+    std::vector<std::string> before;
+    for (int i = 0; i < 3000; ++i) {
+        before.push_back(ring.owner(key(i)));
+        ++owned[before.back()];
+        const std::vector<std::string> preference = ring.preference_list(key(i), 5);
+        CHECK(preference.size() == 3 && preference[0] == before.back());
+        CHECK(preference[1] != preference[0] && preference[2] != preference[0] &&
+              preference[2] != preference[1]);
+    }
+    for (const auto& entry : owned) {
+        CHECK(entry.second > 700 && entry.second < 1300);
+    }
+
+    ring.remove_node("b");
+    CHECK(!ring.contains("b") && ring.node_count() == 2);
+    for (int i = 0; i < 3000; ++i) {
+        if (before[i] != "b") {
+            CHECK(ring.owner(key(i)) == before[i]);
+        }
+    }
+
+    HashRing weighted(128);
+    weighted.add_node("small");
+    weighted.add_node("large", 3);
+    int large = 0;
+    for (int i = 0; i < 4000; ++i) {
+        large += weighted.owner(key(i)) == "large" ? 1 : 0;
+    }
+    CHECK(large > 2600 && large < 3400);
+    CHECK(HashRing().owner("anything").empty());
+}
+
+// A backend node that counts its requests, remembers the headers
+// of the last one, and stalls past the router's timeout while `stall`.
+struct Backend {
+    Backend()
+        : server(options(), [this](const HttpRequest& request, HttpResponse& response) {
+              hits.fetch_add(1);
+              std::vector<std::string> seen;
+              for (const auto& header : request.headers) {
+                  seen.push_back(header.first + ": " + header.second);
+              }
+              {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  headers = std::move(seen);
+              }
+              if (stall.load()) {
+                  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+              }
+              response.status = 200;
+              response.body = "ok";
+          }) {
+        server.start();
+    }
+
+    static HttpServerOptions options() {
+        HttpServerOptions o;
+        o.host = "127.0.0.1";
+        o.port = 0;
+        o.connection_threads = 2;
+        return o;
+    }
+
+    std::vector<std::string> last_headers() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return headers;
+    }
+
+    std::atomic<int> hits{0};
+    std::atomic<bool> stall{false};
+    std::mutex mutex;
+    std::vector<std::string> headers;
+    HttpServer server;
+};
+
+ClusterConfig two_nodes(const Backend& a, const Backend& b) {
+    ClusterConfig config;
+    config.nodes = {{"node-a", "127.0.0.1", a.server.port(), 1},
+                    {"node-b", "127.0.0.1", b.server.port(), 1}};
+    config.request_timeout_ms = 150;
+    config.unhealthy_after = 100;
+    return config;
+}
+
+HttpRequest request(const char* method, const std::string& sample) {
+    HttpRequest r;
+    r.method = method;
+    r.target = "/v1/score";
+    r.headers.emplace_back(kSampleHeader, sample);
+    r.body = method == std::string("POST") ? "{}" : "";
+    return r;
+}
+
+// Routing headers a client sends are replaced by the router's own, whatever
+// their case.
+void test_client_routing_headers_dropped() {
+    Backend a, b;
+    ClusterRouter router(two_nodes(a, b));
+    HttpRequest r = request("GET", "s-1");
+    r.headers.emplace_back("x-probionis-shard-key", "forged");
+    r.headers.emplace_back("X-PROBIONIS-ROUTE", "owner");
+    r.headers.emplace_back("X-Trace", "t1");
+    HttpResponse response;
+    router.handle(r, response);
+    CHECK(response.status == 200);
+
+    Backend& owner = router.route("s-1")[0] == "node-a" ? a : b;
+    int shard_keys = 0, routes = 0, traces = 0;
+    for (const std::string& header : owner.last_headers()) {
+        CHECK(header.find("forged") == std::string::npos);
+        shard_keys += header == std::string(kShardKeyHeader) + ": s-1" ? 1 : 0;
+        routes += header == std::string(kRouteHeader) + ": owner" ? 1 : 0;
+        traces += header == "X-Trace: t1" ? 1 : 0;
+    }
+    CHECK(shard_keys == 1 && routes == 1 && traces == 1);
+}
+
+// A POST the owner may have acted on is not re-sent to another node unless
+// it carries an idempotency key; a GET always fails over.
+void test_post_not_retried() {
+    Backend a, b;
+    ClusterRouter router(two_nodes(a, b));
+    const std::string sample = "s-2";
+    const bool a_owns = router.route(sample)[0] == "node-a";
+    Backend& owner = a_owns ? a : b;
+    Backend& successor = a_owns ? b : a;
+    CHECK(router.route(sample).size() == 2);
+    owner.stall.store(true);
+
+    HttpResponse response;
+    router.handle(request("POST", sample), response);
+    CHECK(response.status == 502);
+    CHECK(*find_header(response.headers, "X-Probionis-Node") == (a_owns ? "node-a" : "node-b"));
+    CHECK(owner.hits.load() == 1 && successor.hits.load() == 0);
+
+    HttpRequest keyed = request("POST", sample);
+    keyed.headers.emplace_back(kIdempotencyKeyHeader, "k-1");
+    HttpResponse retried;
+    router.handle(keyed, retried);
+    CHECK(retried.status == 200 && successor.hits.load() == 1);
+
+    HttpResponse read;
+    router.handle(request("GET", sample), read);
+    CHECK(read.status == 200 && successor.hits.load() == 2);
+    CHECK(successor.last_headers().back() == std::string(kRouteHeader) + ": failover");
+    owner.stall.store(false);
+}
+
+}  // namespace
+
+int main() {
+    test_ring_placement();
+    test_client_routing_headers_dropped();
+    test_post_not_retried();
+    std::puts("router_test: ok");
+    return 0;
+}
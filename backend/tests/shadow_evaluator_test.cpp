@@ -0,0 +1,150 @@
+// Sources: inference/shadow_evaluator.cpp spectrum/spectrum_batch.cpp runtime/executor.cpp
+//          runtime/metrics.cpp runtime/huge_page_allocator.cpp
+
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inference/shadow_evaluator.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+constexpr std::size_t kChannels = 4;
+
+SpectrumBatch batch_of(const std::vector<std::string>& ids) {
+    SpectrumBatch batch(ids.size(), kChannels);
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        Spectrum s;
+        s.sample_id = ids[i];
+        s.intensity.assign(kChannels, static_cast<float>(i));
+        batch.push(s);
+    }
+    return batch;
+}
+
+ShadowOptions options(const std::string& candidate) {
+    ShadowOptions o;
+    o.primary_model = "primary";
+    o.candidate_model = candidate;
+    o.sample_rate = 1.0;
+    return o;
+}
+
+void wait_for(const ShadowEvaluator& shadow, std::uint64_t compared, std::uint64_t failed = 0) {
+    for (int i = 0; i < 5000; ++i) {
+        const ShadowStats s = shadow.stats();
+        if (s.compared >= compared && s.failed_batches >= failed) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(false && "shadow batch never finished");
+}
+
+// Single outputs agree on the same side of the threshold, wider ones on the
+// same argmax; the ratio and mean delta reach the gauges.
+void test_agreement(Executor& executor) {
+    ShadowEvaluator single(options("single"), [](SpectrumBatch& batch, float* out) {
+        // Candidate = primary + 0.1, the primary being 0.2 * (row + 1).
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            out[i] = 0.2f * static_cast<float>(i + 1) + 0.1f;
+        }
+    }, executor);
+    const std::vector<float> primary = {0.2f, 0.4f, 0.6f, 0.8f};
+    single.observe(batch_of({"a", "b", "c", "d"}), primary.data(), 1, std::chrono::microseconds(5));
+    wait_for(single, 4);
+    ShadowStats s = single.stats();
+    CHECK(s.sampled == 4 && s.compared == 4 && s.agreed == 3 && s.dropped == 0);
+    CHECK(std::fabs(s.mean_abs_delta - 0.1) < 1e-6);
+    CHECK(global_metrics()
+              .gauge(labeled_name("probionis_shadow_agreement_ratio", "candidate", "single"))
+              .value() == 0.75);
+
+    ShadowEvaluator wide(options("wide"), [](SpectrumBatch& batch, float* out) {
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            out[i * 3 + 0] = 0.1f;
+            out[i * 3 + 1] = 0.7f;
+            out[i * 3 + 2] = 0.2f;
+        }
+    }, executor);
+    const std::vector<float> scores = {0.1f, 0.8f, 0.1f, 0.6f, 0.3f, 0.1f};
+    wide.observe(batch_of({"a", "b"}), scores.data(), 3, std::chrono::microseconds(5));
+    wait_for(wide, 2);
+    s = wide.stats();
+    CHECK(s.compared == 2 && s.agreed == 1);
+}
+
+// Sampling is by ID: the same sample is always in or always out, and the
+// rate is roughly honoured.
+void test_sampling(Executor& executor) {
+    ShadowOptions o = options("sampled");
+    o.sample_rate = 0.25;
+    ShadowEvaluator shadow(o, [](SpectrumBatch&, float*) {}, executor);
+    std::size_t in = 0;
+    for (int i = 0; i < 4000; ++i) {
+        const std::string id = "sample-" + std::to_string(i);
+        CHECK(shadow.sampled(id) == shadow.sampled(id));
+        in += shadow.sampled(id) ? 1 : 0;
+    }
+    CHECK(in > 800 && in < 1200);
+    o.sample_rate = 0.0;
+    ShadowEvaluator none(o, [](SpectrumBatch&, float*) {}, executor);
+    CHECK(!none.sampled("sample-1"));
+}
+
+// With the shadow queue full, sampled rows are dropped, not queued; once it
+// drains, batches are accepted again.
+void test_drop_on_backlog(Executor& executor) {
+    ShadowOptions o = options("backlog");
+    o.max_in_flight = 1;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    ShadowEvaluator shadow(o, [released](SpectrumBatch& batch, float* out) {
+        released.wait();
+        std::fill(out, out + batch.size(), 0.0f);
+    }, executor);
+    const std::vector<float> primary = {0.0f, 0.0f};
+    shadow.observe(batch_of({"a", "b"}), primary.data(), 1, std::chrono::microseconds(5));
+    shadow.observe(batch_of({"c", "d"}), primary.data(), 1, std::chrono::microseconds(5));
+    CHECK(shadow.stats().dropped == 2);
+    release.set_value();
+    wait_for(shadow, 2);
+    shadow.observe(batch_of({"e"}), primary.data(), 1, std::chrono::microseconds(5));
+    wait_for(shadow, 3);
+    const ShadowStats s = shadow.stats();
+    CHECK(s.sampled == 5 && s.dropped == 2 && s.compared == 3);
+}
+
+// A candidate that throws anything, not only std::exception, counts as a
+// failed batch and frees its slot.
+void test_failure_frees_slot(Executor& executor) {
+    ShadowOptions o = options("throws");
+    o.max_in_flight = 1;
+    ShadowEvaluator shadow(o, [](SpectrumBatch&, float*) { throw 42; }, executor);
+    const std::vector<float> primary = {0.0f};
+    shadow.observe(batch_of({"a"}), primary.data(), 1, std::chrono::microseconds(5));
+    wait_for(shadow, 0, 1);
+    shadow.observe(batch_of({"b"}), primary.data(), 1, std::chrono::microseconds(5));
+    wait_for(shadow, 0, 2);
+    CHECK(shadow.stats().dropped == 0 && shadow.stats().compared == 0);
+}
+
+}  // namespace
+
+int main() {
+    ExecutorOptions options;
+    options.threads = 2;
+    Executor executor(options);
+    test_agreement(executor);
+    test_sampling(executor);
+    test_drop_on_backlog(executor);
+    test_failure_frees_slot(executor);
+    std::puts("shadow_evaluator_test: ok");
+    return 0;
+}
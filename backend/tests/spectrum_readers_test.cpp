@@ -0,0 +1,219 @@
+// Sources: io/jcamp_reader.cpp io/spc_reader.cpp io/delimited_reader.cpp io/fast_float.cpp
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "io/delimited_reader.h"
+#include "io/jcamp_reader.h"
+#include "io/parse_error.h"
+#include "io/spc_reader.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+std::vector<Spectrum> jcamp(const std::string& text) {
+    return parse_jcamp(text.data(), text.size());
+}
+
+std::vector<Spectrum> delimited(const std::string& text, const DelimitedOptions& options = {}) {
+    return parse_delimited(text.data(), text.size(), options);
+}
+
+// Line a ParseError from `text` reports; 0 if it parsed.
+template <typename Parse>
+std::size_t error_line(Parse parse, const std::string& text) {
+    try {
+        parse(text.data(), text.size());
+    } catch (const ParseError& error) {
+        return error.line();
+    }
+    return 0;
+}
+
+// One compressed (X++(Y..Y)) table with SQZ, DIF, DUP and the DIF Y-check
+// at the start of the next line, then a linked block of XY pairs in
+// descending X.
+void test_jcamp() {
+    const std::vector<Spectrum> spectra = jcamp(
+        "##TITLE=compressed\n"
+        "##JCAMP-DX=5.01\n"
+        "##SPECTROMETER/DATA SYSTEM=bench\n"
+        "##FIRSTX=1\n"
+        "##LASTX=8\n"
+        "##YFACTOR=0.5\n"
+        "##NPOINTS=8\n"
+        "##XYDATA=(X++(Y..Y))\n"
+        "1A0JJJ%T\r\n"
+        "7A3B0J $$ the first value repeats the check\n"
+        "##TITLE=peaks\n"
+        "##XYPOINTS=(XY..XY)\n"
+        "3,30; 2,20\n"
+        "1, 1.5E+01\n"
+        "##END=\n");
+    CHECK(spectra.size() == 2);
+    const Spectrum& table = spectra[0];
+    CHECK(table.sample_id == "compressed" && table.instrument_id == "bench");
+    const std::vector<float> y = {5.0f, 5.5f, 6.0f, 6.5f, 6.5f, 6.5f, 10.0f, 10.5f};
+    CHECK(table.intensity == y);
+    CHECK(table.axis.size() == 8 && table.axis.front() == 1.0f && table.axis.back() == 8.0f);
+
+    const Spectrum& peaks = spectra[1];
+    CHECK(peaks.sample_id == "peaks" && peaks.instrument_id.empty());
+    CHECK((peaks.axis == std::vector<float>{1.0f, 2.0f, 3.0f}));
+    CHECK((peaks.intensity == std::vector<float>{15.0f, 20.0f, 30.0f}));
+
+    // ##DELTAX and the first line's X stand in for ##FIRSTX / ##LASTX.
+    const std::vector<Spectrum> stepped =
+        jcamp("##TITLE=s\n##DELTAX=-2\n##XYDATA=(X++(Y..Y))\n10 1 2 3\n");
+    CHECK((stepped[0].axis == std::vector<float>{6.0f, 8.0f, 10.0f}));
+    CHECK((stepped[0].intensity == std::vector<float>{3.0f, 2.0f, 1.0f}));
+
+    CHECK(error_line(parse_jcamp, "##TITLE=t\n##FIRSTX=1\n##LASTX=3\n##NPOINTS=3\n"
+                                  "##XYDATA=(X++(Y..Y))\n1 5 6\n##END=\n") == 7);
+    CHECK(error_line(parse_jcamp, "##TITLE=t\n##DELTAX=1\n##XYDATA=(X++(Y..Y))\n1 J1\n") == 4);
+    CHECK(error_line(parse_jcamp, "##TITLE=t\n##XYPOINTS=(XY..XY)\n1 2 3\n##END=\n") == 4);
+    CHECK(error_line(parse_jcamp, "##NPOINTS=1e30\n") == 1);
+    CHECK_THROWS(jcamp("1 2 3\n"), ParseError);
+}
+
+// Builds an SPC file: the 512-byte main header, then whatever follows.
+struct SpcFile {
+    explicit SpcFile(std::uint8_t flags, std::int8_t exponent, std::int32_t points)
+        : bytes(512, '\0') {
+        bytes[0] = static_cast<char>(flags);
+        bytes[1] = 0x4B;
+        bytes[3] = static_cast<char>(exponent);
+        put(4, points);
+        std::memcpy(&bytes[45], "bench", 5);
+    }
+
+    template <typename T>
+    void put(std::size_t offset, T value) {
+        std::memcpy(&bytes[offset], &value, sizeof(T));
+    }
+
+    template <typename T>
+    void append(const std::vector<T>& values) {
+        const std::size_t at = bytes.size();
+        bytes.resize(at + values.size() * sizeof(T));
+        std::memcpy(&bytes[at], values.data(), values.size() * sizeof(T));
+    }
+
+    // A subfile header with its own exponent and point count.
+    void subheader(std::int8_t exponent, std::int32_t points = 0) {
+        std::string sub(32, '\0');
+        sub[1] = static_cast<char>(exponent);
+        std::memcpy(&sub[16], &points, sizeof(points));
+        bytes += sub;
+    }
+
+    std::vector<Spectrum> parse() const { return parse_spc(bytes.data(), bytes.size()); }
+
+    std::string bytes;
+};
+
+void test_spc() {
+    // Single subfile, float Y, evenly spaced descending axis.
+    SpcFile single(0x00, -128, 4);
+    single.put(8, 1000.0);
+    single.put(16, 400.0);
+    single.subheader(0);
+    single.append(std::vector<float>{1.0f, 2.0f, 3.0f, 4.0f});
+    std::vector<Spectrum> spectra = single.parse();
+    CHECK(spectra.size() == 1 && spectra[0].instrument_id == "bench");
+    CHECK((spectra[0].axis == std::vector<float>{400.0f, 600.0f, 800.0f, 1000.0f}));
+    CHECK((spectra[0].intensity == std::vector<float>{4.0f, 3.0f, 2.0f, 1.0f}));
+
+    // Two subfiles of 16-bit scaled integers over an explicit shared axis.
+    SpcFile multi(0x01 | 0x04 | 0x80, 0, 3);
+    multi.put(24, std::int32_t{2});
+    multi.append(std::vector<float>{1.0f, 2.0f, 4.0f});
+    multi.subheader(17);
+    multi.append(std::vector<std::int16_t>{1, -2, 3});
+    multi.subheader(16);
+    multi.append(std::vector<std::int16_t>{100, 200, 300});
+    spectra = multi.parse();
+    CHECK(spectra.size() == 2);
+    CHECK((spectra[0].axis == std::vector<float>{1.0f, 2.0f, 4.0f}));
+    CHECK((spectra[0].intensity == std::vector<float>{2.0f, -4.0f, 6.0f}));
+    CHECK((spectra[1].intensity == std::vector<float>{100.0f, 200.0f, 300.0f}));
+
+    // XYXY: each subfile carries its own axis and length; 32-bit integers.
+    SpcFile xyxy(0x04 | 0x40 | 0x80, 0, 0);
+    xyxy.put(24, std::int32_t{2});
+    xyxy.subheader(32, 2);
+    xyxy.append(std::vector<float>{5.0f, 6.0f});
+    xyxy.append(std::vector<std::int32_t>{7, 8});
+    xyxy.subheader(-128, 1);
+    xyxy.append(std::vector<float>{9.0f});
+    xyxy.append(std::vector<float>{0.25f});
+    spectra = xyxy.parse();
+    CHECK(spectra.size() == 2 && spectra[0].size() == 2 && spectra[1].size() == 1);
+    CHECK((spectra[0].intensity == std::vector<float>{7.0f, 8.0f}));
+    CHECK(spectra[1].axis[0] == 9.0f && spectra[1].intensity[0] == 0.25f);
+
+    // Truncated data, header sizes the file cannot hold, and other layouts.
+    SpcFile truncated = single;
+    truncated.bytes.resize(truncated.bytes.size() - 1);
+    CHECK_THROWS(truncated.parse(), ParseError);
+    SpcFile huge(0x04, -128, 4);
+    huge.put(24, std::int32_t{1 << 30});
+    CHECK_THROWS(huge.parse(), ParseError);
+    SpcFile old = single;
+    old.bytes[1] = 0x4D;
+    CHECK_THROWS(old.parse(), ParseError);
+    CHECK_THROWS(parse_spc("short", 5), ParseError);
+}
+
+void test_delimited() {
+    // Header row naming the spectra, comments, CRLF, quotes, an empty field.
+    std::vector<Spectrum> spectra = delimited(
+        "# exported\r\n"
+        "\"wavenumber\",\"s1\",\"s2\"\r\n"
+        "1200.5,0.25,1e-3\r\n"
+        "\r\n"
+        "1100,0.5,\r\n"
+        "1000,0.75,3.5E+00\r\n");
+    CHECK(spectra.size() == 2);
+    CHECK(spectra[0].sample_id == "s1" && spectra[1].sample_id == "s2");
+    CHECK((spectra[0].axis == std::vector<float>{1000.0f, 1100.0f, 1200.5f}));
+    CHECK((spectra[0].intensity == std::vector<float>{0.75f, 0.5f, 0.25f}));
+    CHECK(spectra[1].axis == spectra[0].axis);
+    CHECK(spectra[1].intensity[0] == 3.5f && std::isnan(spectra[1].intensity[1]));
+    CHECK(spectra[1].intensity[2] == 0.001f);
+
+    // No header; tabs, semicolons and runs of spaces are detected.
+    for (const char* text : {"1\t2\t3\n2\t4\t6\n", "1;2;3\n2;4;6\n", "1  2 3\n 2 4   6\n"}) {
+        spectra = delimited(text);
+        CHECK(spectra.size() == 2 && spectra[0].sample_id.empty());
+        CHECK((spectra[1].intensity == std::vector<float>{3.0f, 6.0f}));
+    }
+    DelimitedOptions pipes;
+    pipes.delimiter = '|';
+    pipes.comment = '%';
+    CHECK(delimited("% note\n1|2\n", pipes)[0].intensity[0] == 2.0f);
+
+    CHECK(error_line([](const char* d, std::size_t n) { parse_delimited(d, n); },
+                     "x,a\n1,2\n2,oops\n") == 3);
+    CHECK(error_line([](const char* d, std::size_t n) { parse_delimited(d, n); },
+                     "1,2,3\n1,2\n") == 2);
+    CHECK(error_line([](const char* d, std::size_t n) { parse_delimited(d, n); },
+                     "1,2\n1,2,3\n") == 2);
+    CHECK_THROWS(delimited("# only a comment\n"), ParseError);
+    CHECK_THROWS(delimited("1\n2\n"), ParseError);
+}
+
+}  // namespace
+
+int main() {
+    test_jcamp();
+    test_spc();
+    test_delimited();
+    std::puts("spectrum_readers_test: ok");
+    return 0;
+}
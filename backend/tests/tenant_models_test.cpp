@@ -0,0 +1,174 @@
+// Sources: inference/tenant_models.cpp inference/fair_share.cpp inference/kernel_tuner.cpp
+//          inference/model.cpp inference/gemm.cpp spectrum/spectrum_batch.cpp
+//          runtime/executor.cpp runtime/metrics.cpp runtime/huge_page_allocator.cpp
+//          runtime/vector_math.cpp inference/activations.cpp
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "inference/tenant_models.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+constexpr std::size_t kChannels = 16;
+constexpr std::size_t kHidden = 8;
+
+LayerWeights dense(std::size_t inputs, std::size_t outputs, float seed) {
+    LayerWeights layer;
+    layer.inputs = inputs;
+    layer.outputs = outputs;
+    layer.weights = HugePageBuffer(inputs * outputs * sizeof(float), MemoryKind::kWeights);
+    float* w = layer.weights.as<float>();
+    for (std::size_t i = 0; i < inputs * outputs; ++i) {
+        w[i] = seed + 0.01f * static_cast<float>(i % 7);
+    }
+    layer.bias.assign(outputs, seed);
+    return layer;
+}
+
+// A body shared by every "shared-*" model and a head of its own; `body`
+// other than 0 gives a model with nothing in common with the others.
+void write_model(const std::string& path, const std::string& version, float head,
+                 float body = 0.0f) {
+    auto store = LayerStore::create();
+    std::vector<DenseLayer> layers(2);
+    layers[0].weights = store->intern(dense(kChannels, kHidden, 0.5f + body));
+    layers[0].activation = Activation::kRelu;
+    layers[1].weights = store->intern(dense(kHidden, 2, head));
+    save_model(path, Model(version, std::move(layers)));
+}
+
+std::size_t model_bytes() {
+    return (kChannels * kHidden + kHidden) * sizeof(float) + (kHidden * 2 + 2) * sizeof(float);
+}
+
+struct ModelDir {
+    std::string path = scratch_path("tenant-models");
+    std::vector<std::string> files;
+
+    ModelDir() {
+        std::string command = "mkdir -p " + path;
+        CHECK(std::system(command.c_str()) == 0);
+        add("default.pbmd", "default", 0.1f);
+        add("shared-a.pbmd", "shared-a", 0.2f);
+        add("shared-b.pbmd", "shared-b", 0.3f);
+        for (int i = 0; i < 3; ++i) {
+            const std::string name = "own-" + std::to_string(i);
+            add(name + ".pbmd", name, 0.4f + 0.1f * static_cast<float>(i),
+                1.0f + static_cast<float>(i));
+        }
+    }
+    ~ModelDir() {
+        for (const auto& file : files) {
+            ::unlink(file.c_str());
+        }
+        ::rmdir(path.c_str());
+    }
+
+    void add(const std::string& file, const std::string& version, float head, float body = 0) {
+        files.push_back(path + "/" + file);
+        write_model(files.back(), version, head, body);
+    }
+};
+
+ExecutorOptions executor_options() {
+    ExecutorOptions o;
+    o.threads = 3;
+    o.blocking_threads = 1;
+    return o;
+}
+
+void score(TenantModelHost& host, const std::string& tenant) {
+    SpectrumBatch batch(2, kChannels);
+    Spectrum spectrum;
+    spectrum.sample_id = "s";
+    spectrum.axis.assign(kChannels, 0.0f);
+    spectrum.intensity.assign(kChannels, 1.0f);
+    batch.push(spectrum);
+    float outputs[4] = {};
+    host.score(tenant, batch, outputs);
+    CHECK(outputs[0] != 0.0f);
+}
+
+// Variants that differ only in their head store the body once; tenants
+// without a variant get the default model.
+void test_sharing(const ModelDir& dir, Executor& executor) {
+    TenantModelOptions options;
+    options.model_dir = dir.path;
+    TenantModelHost host(options, executor);
+    const auto a = host.acquire("shared-a");
+    const auto b = host.acquire("shared-b");
+    CHECK(a->version() == "shared-a" && b->version() == "shared-b");
+    CHECK(a->layers()[0].weights == b->layers()[0].weights);
+    CHECK(host.acquire("shared-a") == a);
+    CHECK(host.acquire("nobody")->version() == "default");
+    const TenantHostStats stats = host.stats();
+    CHECK(stats.loads == 3 && stats.loaded_models == 3);
+    CHECK(stats.shared_bytes == 2 * (kChannels * kHidden + kHidden) * sizeof(float));
+    score(host, "shared-b");
+    CHECK_THROWS(host.acquire("../etc"), std::invalid_argument);
+}
+
+// A model over its tenant's quota fails to load, and keeps failing.
+void test_quota(const ModelDir& dir, Executor& executor) {
+    TenantModelOptions options;
+    options.model_dir = dir.path;
+    TenantModelHost host(options, executor);
+    TenantQuota quota;
+    quota.memory_bytes = model_bytes() - 1;
+    host.set_quota("shared-a", quota);
+    CHECK_THROWS(host.acquire("shared-a"), std::runtime_error);
+    CHECK_THROWS(score(host, "shared-a"), std::runtime_error);
+    CHECK(host.stats().loaded_models == 0);
+}
+
+// Over budget, idle models go least recently used first. Models in use
+// when the budget was exceeded go as soon as they are released.
+void test_eviction(const ModelDir& dir, Executor& executor) {
+    TenantModelOptions options;
+    options.model_dir = dir.path;
+    options.memory_budget_bytes = model_bytes();
+    TenantModelHost host(options, executor);
+
+    score(host, "own-0");
+    score(host, "own-1");
+    TenantHostStats stats = host.stats();
+    CHECK(stats.loaded_models == 1 && stats.evictions == 1);
+
+    {
+        // Every model busy: the host stays over budget for now.
+        const auto m0 = host.acquire("own-0");
+        const auto m1 = host.acquire("own-1");
+        const auto m2 = host.acquire("own-2");
+        stats = host.stats();
+        CHECK(stats.loaded_models == 3);
+        CHECK(stats.resident_bytes == 3 * model_bytes());
+    }
+    // The next use of any model brings the host back under budget.
+    const std::uint64_t loads = stats.loads;
+    score(host, "own-2");
+    stats = host.stats();
+    CHECK(stats.loaded_models == 1);
+    CHECK(stats.resident_bytes <= options.memory_budget_bytes);
+    CHECK(stats.loads == loads);
+    CHECK(host.acquire("own-2")->version() == "own-2");
+}
+
+}  // namespace
+
+int main() {
+    ModelDir dir;
+    Executor executor(executor_options());
+    test_sharing(dir, executor);
+    test_quota(dir, executor);
+    test_eviction(dir, executor);
+    std::puts("tenant_models_test: ok");
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Sources: preprocess/tensor_cache.cpp preprocess/pipeline.cpp preprocess/qc_gate.cpp
+//          preprocess/calibration_transfer.cpp spectrum/spectrum_batch.cpp
+//          runtime/vector_math.cpp runtime/huge_page_allocator.cpp runtime/metrics.cpp
+// Link with -lrt on older glibc.
+
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "preprocess/calibration_transfer.h"
+#include "preprocess/tensor_cache.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+constexpr std::size_t kChannels = 4;
+
+std::shared_ptr<BandedOperator> gain(float g) {
+    auto op = std::make_shared<BandedOperator>(kChannels, 0);
+    for (std::size_t i = 0; i < kChannels; ++i) {
+        op->coefficient(i, 0) = g;
+    }
+    return op;
+}
+
+Spectrum raw(const char* instrument_id, float value = 1.0f) {
+    Spectrum s;
+    s.sample_id = "s";
+    s.instrument_id = instrument_id;
+    s.axis = {1.0f, 2.0f, 3.0f, 4.0f};
+    s.intensity.assign(kChannels, value);
+    return s;
+}
+
+TensorCacheOptions options(const std::string& name) {
+    TensorCacheOptions o;
+    o.name = name;
+    o.capacity_bytes = std::size_t{1} << 20;
+    o.max_floats = 64;
+    o.ways = 4;
+    return o;
+}
+
+void test_lookup_insert(SharedTensorCache& cache) {
+    std::vector<float> out;
+    const TensorKey key{42, 1, 7};
+    CHECK(!cache.lookup(key, out));
+    const float data[3] = {1.5f, -2.0f, 3.25f};
+    cache.insert(key, data, 3);
+    CHECK(cache.lookup(key, out) && out == std::vector<float>(data, data + 3));
+    // Every field of the key matters.
+    CHECK(!cache.lookup(TensorKey{42, 2, 7}, out));
+    CHECK(!cache.lookup(TensorKey{42, 1, 8}, out));
+    CHECK(!cache.lookup(TensorKey{43, 1, 7}, out));
+    // Too long to cache.
+    const std::vector<float> big(cache.max_floats() + 1, 1.0f);
+    cache.insert(TensorKey{44, 1, 0}, big.data(), big.size());
+    CHECK(!cache.lookup(TensorKey{44, 1, 0}, out));
+}
+
+// The instrument is part of the raw identity, and the calibration
+// registered for it is part of the key, so replacing it stops serving the
+// old output.
+void test_keying(SharedTensorCache& cache) {
+    auto registry = std::make_shared<CalibrationRegistry>();
+    registry->put("i1", gain(2.0f));
+    Pipeline pipeline;
+    pipeline.add(std::make_shared<CalibrationTransferStep>(registry));
+
+    CHECK(raw_spectrum_hash(raw("i1")) != raw_spectrum_hash(raw("i2")));
+    CHECK(raw_spectrum_hash(raw("i1")) == raw_spectrum_hash(raw("i1")));
+    CHECK(raw_spectrum_hash(raw("i1")) != raw_spectrum_hash(raw("i1", 2.0f)));
+
+    const TensorCacheStats before = cache.stats();
+    Spectrum s = raw("i1");
+    CHECK(preprocess_cached(cache, pipeline, 1, s).ok() && s.intensity[0] == 2.0f);
+    s = raw("i1");
+    preprocess_cached(cache, pipeline, 1, s);
+    CHECK(s.intensity[0] == 2.0f && cache.stats().hits == before.hits + 1);
+
+    // Same bytes from an uncalibrated instrument.
+    s = raw("i2");
+    preprocess_cached(cache, pipeline, 1, s);
+    CHECK(s.intensity[0] == 1.0f);
+
+    registry->put("i1", gain(3.0f));
+    s = raw("i1");
+    preprocess_cached(cache, pipeline, 1, s);
+    CHECK(s.intensity[0] == 3.0f);
+
+    // A new recipe version never sees the old tensors.
+    const std::uint64_t hits = cache.stats().hits;
+    s = raw("i1");
+    preprocess_cached(cache, pipeline, 2, s);
+    CHECK(s.intensity[0] == 3.0f && cache.stats().hits == hits);
+}
+
+// With one set of two ways, the least recently used key is the one
+// evicted. Recency is stamped in milliseconds, hence the sleeps.
+void test_lru_eviction(const std::string& name) {
+    TensorCacheOptions o = options(name);
+    o.max_floats = 16;
+    o.ways = 2;
+    o.capacity_bytes = 4096 + 64 + 2 * 128;
+    SharedTensorCache::unlink(name);
+    SharedTensorCache cache(o);
+    CHECK(cache.set_count() == 1);
+
+    const float data[1] = {1.0f};
+    const TensorKey a{1, 1, 0};
+    const TensorKey b{2, 1, 0};
+    const TensorKey c{3, 1, 0};
+    std::vector<float> out;
+    cache.insert(a, data, 1);
+    ::usleep(5000);
+    cache.insert(b, data, 1);
+    ::usleep(5000);
+    CHECK(cache.lookup(a, out));
+    ::usleep(5000);
+    cache.insert(c, data, 1);
+    CHECK(cache.stats().evictions == 1);
+    CHECK(cache.lookup(a, out) && cache.lookup(c, out) && !cache.lookup(b, out));
+
+    // A writer that died holding the set's lock does not wedge the set.
+    // The set locks start right after the 4096-byte segment header.
+    const pid_t pid = ::fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        void* base = fd < 0 ? MAP_FAILED
+                            : ::mmap(nullptr, 4096 + 64, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                     fd, 0);
+        if (base == MAP_FAILED) {
+            ::_exit(1);
+        }
+        ::pthread_mutex_lock(reinterpret_cast<pthread_mutex_t*>(
+            static_cast<unsigned char*>(base) + 4096));
+        ::_exit(0);
+    }
+    int status = 0;
+    CHECK(::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    const float fresh[1] = {9.0f};
+    cache.insert(b, fresh, 1);
+    CHECK(cache.lookup(b, out) && out[0] == 9.0f);
+    cache.insert(a, fresh, 1);
+    CHECK(cache.lookup(a, out) && out[0] == 9.0f);
+    SharedTensorCache::unlink(name);
+}
+
+void test_shared_across_processes(SharedTensorCache& cache, const TensorCacheOptions& o) {
+    const pid_t pid = ::fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        SharedTensorCache child(o);
+        const float data[2] = {7.0f, 8.0f};
+        child.insert(TensorKey{777, 1, 0}, data, 2);
+        ::_exit(0);
+    }
+    int status = 0;
+    CHECK(::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    std::vector<float> out;
+    CHECK(cache.lookup(TensorKey{777, 1, 0}, out) && out == std::vector<float>({7.0f, 8.0f}));
+}
+
+// A segment its creator left unsized is initialised by the next process;
+// one with another geometry is refused.
+void test_segment_recovery(const std::string& name) {
+    SharedTensorCache::unlink(name);
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    CHECK(fd >= 0);
+    ::close(fd);
+    {
+        SharedTensorCache cache(options(name));
+        const float data[1] = {5.0f};
+        cache.insert(TensorKey{1, 1, 0}, data, 1);
+        std::vector<float> out;
+        CHECK(cache.lookup(TensorKey{1, 1, 0}, out) && out[0] == 5.0f);
+    }
+    TensorCacheOptions other = options(name);
+    other.max_floats = 128;
+    CHECK_THROWS(SharedTensorCache cache(other), std::runtime_error);
+    SharedTensorCache::unlink(name);
+}
+
+}  // namespace
+
+int main() {
+    const std::string name = "/probionis-test-" + std::to_string(::getpid());
+    SharedTensorCache::unlink(name);
+    {
+        const TensorCacheOptions o = options(name);
+        SharedTensorCache cache(o);
+        test_lookup_insert(cache);
+        test_keying(cache);
+        test_shared_across_processes(cache, o);
+    }
+    SharedTensorCache::unlink(name);
+    test_lru_eviction(name + "-lru");
+    test_segment_recovery(name + "-b");
+    std::puts("tensor_cache_test: ok");
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Sources: runtime/vector_math.cpp
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "runtime/vector_math.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+using ArrayFn = void (*)(const float*, float*, std::size_t);
+using ScalarFn = float (*)(float);
+using ReferenceFn = double (*)(double);
+
+// Floats visited per function: every 4291st bit pattern (a multiple of the
+// seven the documented bounds were measured on), both signs, so the check
+// covers the whole range in about a second.
+constexpr std::uint32_t kStride = 7 * 613;
+// Odd, so the SIMD loop is followed by a scalar tail on every call.
+constexpr std::size_t kChunk = 4093;
+
+float from_bits(std::uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+std::uint32_t to_bits(float f) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// Error of `result` in units in the last place of the exact value, or -1
+// when the exact value is outside the normal float range, where the
+// kernels flush or overflow by design and only special values are checked.
+double ulp_error(float result, double exact) {
+    if (std::isnan(exact)) {
+        return std::isnan(result) ? 0.0 : 1e9;
+    }
+    if (std::isinf(exact) || std::fabs(exact) < FLT_MIN || std::fabs(exact) > FLT_MAX) {
+        return -1.0;
+    }
+    int exponent = 0;
+    std::frexp(exact, &exponent);
+    return std::fabs(static_cast<double>(result) - exact) / std::ldexp(1.0, exponent - 24);
+}
+
+double sigmoid_reference(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+double exp_reference(double x) { return std::exp(x); }
+double log_reference(double x) { return std::log(x); }
+double tanh_reference(double x) { return std::tanh(x); }
+double erf_reference(double x) { return std::erf(x); }
+
+// Sweeps the float range through the array form, checks every result is
+// bit-identical to the scalar form, and returns the largest error against
+// the double reference.
+double sweep(ArrayFn array, ScalarFn scalar, ReferenceFn reference) {
+    std::vector<float> in;
+    std::vector<float> out(kChunk);
+    in.reserve(kChunk);
+    double worst = 0.0;
+    const auto flush = [&] {
+        array(in.data(), out.data(), in.size());
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            CHECK(to_bits(out[i]) == to_bits(scalar(in[i])));
+            worst = std::max(worst, ulp_error(out[i], reference(in[i])));
+        }
+        in.clear();
+    };
+    for (std::uint64_t bits = 0; bits <= 0xffffffffu; bits += kStride) {
+        in.push_back(from_bits(static_cast<std::uint32_t>(bits)));
+        if (in.size() == kChunk) {
+            flush();
+        }
+    }
+    flush();
+    return worst;
+}
+
+// Measured bounds from the kernel's commit, over every seventh float; the
+// subset swept here cannot do worse.
+void test_unary_bounds() {
+    CHECK(sweep(vexp, exp_approx, exp_reference) <= 0.98);
+    CHECK(sweep(vlog, log_approx, log_reference) <= 0.81);
+    CHECK(sweep(vtanh, tanh_approx, tanh_reference) <= 1.32);
+    CHECK(sweep(vsigmoid, sigmoid_approx, sigmoid_reference) <= 2.47);
+    CHECK(sweep(verf, erf_approx, erf_reference) <= 2.58);
+}
+
+// Positive bases across their range against a spread of exponents; pow is
+// evaluated in double, so little more than the final rounding is left.
+void test_pow_bound() {
+    const float exponents[] = {-3.0f, -1.5f, -0.37f, 0.5f, 1.0f, 2.2f, 7.0f};
+    std::vector<float> base;
+    for (std::uint32_t bits = 0x00800000u; bits < 0x7f800000u; bits += 4099) {
+        base.push_back(from_bits(bits));
+    }
+    std::vector<float> out(base.size());
+    std::vector<float> per_element(base.size());
+    double worst = 0.0;
+    for (const float y : exponents) {
+        vpow(base.data(), y, out.data(), base.size());
+        const std::vector<float> exponent(base.size(), y);
+        vpow(base.data(), exponent.data(), per_element.data(), base.size());
+        for (std::size_t i = 0; i < base.size(); ++i) {
+            CHECK(to_bits(out[i]) == to_bits(pow_approx(base[i], y)));
+            CHECK(to_bits(per_element[i]) == to_bits(out[i]));
+            worst = std::max(worst, ulp_error(out[i], std::pow(static_cast<double>(base[i]), y)));
+        }
+    }
+    CHECK(worst < 0.501);
+}
+
+// The edges the header documents; tanh and erf saturate at exactly +-1.
+void test_special_values() {
+    const float inf = std::numeric_limits<float>::infinity();
+    CHECK(exp_approx(-100.0f) == 0.0f && exp_approx(100.0f) == inf);
+    CHECK(log_approx(0.0f) == -inf && std::isnan(log_approx(-1.0f)));
+    CHECK(sigmoid_approx(-89.0f) == 0.0f && sigmoid_approx(0.0f) == 0.5f);
+    CHECK(tanh_approx(20.0f) == 1.0f && tanh_approx(-20.0f) == -1.0f);
+    CHECK(erf_approx(0.0f) == 0.0f && erf_approx(6.0f) == 1.0f);
+}
+
+// pow follows C on every special operand pair, through both forms, except
+// that a -0 base is taken as +0.
+void test_pow_special_cases() {
+    const float inf = std::numeric_limits<float>::infinity();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float bases[] = {0.0f, -0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 0.5f, -0.5f, inf, -inf, nan};
+    const float exponents[] = {0.0f, -0.0f, 1.0f, -1.0f, 2.0f,  3.0f, -3.0f,
+                               0.5f, -0.5f, inf,  -inf, nan,  1e30f};
+    for (const float x : bases) {
+        for (const float y : exponents) {
+            const float expected = static_cast<float>(std::pow(x == 0.0f ? 0.0 : x, y));
+            float array = 0.0f;
+            vpow(&x, &y, &array, 1);
+            const float scalar = pow_approx(x, y);
+            CHECK(std::isnan(expected) ? std::isnan(scalar) && std::isnan(array)
+                                       : to_bits(scalar) == to_bits(expected) &&
+                                             to_bits(array) == to_bits(expected));
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    test_unary_bounds();
+    test_pow_bound();
+    test_special_values();
+    test_pow_special_cases();
+    std::puts("vector_math_test: ok");
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Builds tools/probionis_preprocess natively and with Emscripten, runs the
+# browser build under node, and checks with cmp that both preprocess the
+# same raw spectrum to the same bytes. Needs emcc and node on PATH; exits
+# 77 (skipped) without them.
+#
+#   sh backend/tests/wasm_preprocess_test.sh
+
+set -eu
+
+backend=$(cd "$(dirname "$0")/.." && pwd)
+if ! command -v emcc >/dev/null 2>&1 || ! command -v node >/dev/null 2>&1; then
+    echo "wasm_preprocess_test: skipped, needs emcc and node" >&2
+    exit 77
+fi
+
+scratch="${TMPDIR:-/tmp}/probionis-$$-wasm"
+mkdir -p "$scratch"
+trap 'rm -rf "$scratch"' EXIT
+
+# The tool and the kernels it runs; nothing else links into the browser
+# build.
+sources="tools/probionis_preprocess.cpp
+         preprocess/pipeline.cpp preprocess/qc_gate.cpp preprocess/absorbance.cpp
+         preprocess/calibration_transfer.cpp spectrum/spectrum_batch.cpp
+         runtime/vector_math.cpp runtime/huge_page_allocator.cpp runtime/metrics.cpp"
+
+cd "$backend"
+${CXX:-g++} -std=c++17 -O2 -ffp-contract=off -I. $sources -o "$scratch/native"
+emcc -std=c++17 -O2 -ffp-contract=off -msimd128 -fexceptions -sNODERAWFS -I. $sources \
+     -o "$scratch/probionis_preprocess.js"
+
+# A smooth baseline with a peak and some jagged noise, 1500 channels.
+node -e '
+const n = 1500, a = new Float32Array(n);
+for (let i = 0; i < n; i++) {
+    const d = (i - 700) / 30;
+    a[i] = 20000 + 8000 * Math.sin(i * 0.01) + 3000 * Math.exp(-d * d) + (i * 7919) % 97;
+}
+process.stdout.write(Buffer.from(a.buffer));' > "$scratch/raw.f32"
+
+for steps in "--absorbance" "--qc --absorbance"; do
+    "$scratch/native" $steps < "$scratch/raw.f32" > "$scratch/native.f32"
+    node "$scratch/probionis_preprocess.js" $steps < "$scratch/raw.f32" > "$scratch/wasm.f32"
+    test -s "$scratch/native.f32"
+    cmp "$scratch/native.f32" "$scratch/wasm.f32"
+done
+echo "wasm_preprocess_test: ok"
@@ -0,0 +1,106 @@
+// Sources: inference/weight_codebook.cpp inference/model.cpp inference/gemm.cpp
+//          inference/activations.cpp spectrum/spectrum_batch.cpp runtime/huge_page_allocator.cpp
+//          runtime/metrics.cpp runtime/vector_math.cpp runtime/executor.cpp
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "inference/weight_codebook.h"
+#include "tests/check.h"
+
+using namespace probionis;
+
+namespace {
+
+LayerWeights dense(std::size_t inputs, std::size_t outputs, float (*value)(std::size_t)) {
+    LayerWeights layer;
+    layer.inputs = inputs;
+    layer.outputs = outputs;
+    layer.weights = HugePageBuffer(inputs * outputs * sizeof(float), MemoryKind::kWeights);
+    for (std::size_t i = 0; i < inputs * outputs; ++i) {
+        layer.weights.as<float>()[i] = value(i);
+    }
+    layer.bias.assign(outputs, 0.25f);
+    return layer;
+}
+
+float spread(std::size_t i) { return std::sin(0.37f * static_cast<float>(i)); }
+float three_values(std::size_t i) { return static_cast<float>(i % 3) - 1.0f; }
+
+// Every weight takes its nearest codebook value, in both widths, and the
+// layer keeps its shape and bias.
+void test_nearest_value() {
+    const LayerWeights layer = dense(24, 17, spread);
+    for (const WeightFormat format : {WeightFormat::kCodebook8, WeightFormat::kCodebook4}) {
+        const LayerWeights clustered = cluster_layer(layer, format);
+        CHECK(clustered.format == format && clustered.inputs == 24 && clustered.outputs == 17);
+        CHECK(clustered.codebook.size() == codebook_entries(format));
+        CHECK(clustered.bias == layer.bias);
+        for (std::size_t k = 0; k < layer.inputs; ++k) {
+            for (std::size_t j = 0; j < layer.outputs; ++j) {
+                const float w = layer.weight(k, j);
+                const float error = std::fabs(w - clustered.weight(k, j));
+                for (const float c : clustered.codebook) {
+                    CHECK(error <= std::fabs(w - c) + 1e-6f);
+                }
+            }
+        }
+    }
+}
+
+// Fewer distinct weights than codebook entries come back exactly.
+void test_few_values_exact() {
+    const LayerWeights layer = dense(8, 16, three_values);
+    const LayerWeights clustered = cluster_layer(layer, WeightFormat::kCodebook4);
+    for (std::size_t k = 0; k < layer.inputs; ++k) {
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            CHECK(clustered.weight(k, j) == layer.weight(k, j));
+        }
+    }
+}
+
+void test_rejected_layers() {
+    LayerWeights empty;
+    empty.outputs = 4;
+    CHECK_THROWS(cluster_layer(empty, WeightFormat::kCodebook8), std::invalid_argument);
+    LayerWeights bad = dense(4, 4, spread);
+    bad.weights.as<float>()[5] = std::numeric_limits<float>::quiet_NaN();
+    CHECK_THROWS(cluster_layer(bad, WeightFormat::kCodebook8), std::invalid_argument);
+    CHECK_THROWS(cluster_layer(dense(4, 4, spread), WeightFormat::kFloat32),
+                 std::invalid_argument);
+}
+
+// Large layers are clustered, small ones shared unchanged, and the version
+// says which codebook was used.
+void test_compress_model() {
+    auto store = LayerStore::create();
+    std::vector<DenseLayer> layers(2);
+    layers[0].weights = store->intern(dense(64, 80, spread));
+    layers[0].activation = Activation::kRelu;
+    layers[1].weights = store->intern(dense(80, 3, spread));
+    const Model model("v1", std::move(layers));
+
+    CodebookReport report;
+    const auto compressed = compress_model(model, *store, {}, &report);
+    CHECK(compressed->version() == "v1+codebook8");
+    CHECK(compressed->layers()[0].weights->format == WeightFormat::kCodebook8);
+    CHECK(compressed->layers()[1].weights == model.layers()[1].weights);
+    CHECK(report.layers.size() == 2 && report.bytes_after < report.bytes_before);
+    CHECK(report.layers[0].error_rms > 0.0 &&
+          report.layers[0].error_rms < 0.01 * report.layers[0].weight_rms);
+    CHECK(report.layers[1].error_rms == 0.0);
+}
+
+}  // namespace
+
+int main() {
+    test_nearest_value();
+    test_few_values_exact();
+    test_rejected_layers();
+    test_compress_model();
+    std::puts("weight_codebook_test: ok");
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Coordinates a distributed re-scoring job over an archive manifest and
+// merges the results into a results database WAL.
+//
+//   probionis_bulk_coordinator --manifest FILE --journal FILE --wal FILE
+//                              [--port P] [--unit-size N] [--lease-ms MS]
+//
+// Workers (probionis_bulk_worker, or any process running BulkWorker with
+// its own UnitScorer) connect on --port from any host. Rerunning with the
+// same journal resumes an interrupted job.
+//
+// The --wal file must not be in use by a running probionis_results
+// primary; the log admits one writer and this tool exits if it is taken.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+
+#include "bulk/bulk_coordinator.h"
+#include "storage/results_replication.h"
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_bulk_coordinator --manifest FILE --journal FILE --wal FILE "
+                 "[--port P] [--unit-size N] [--lease-ms MS]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    probionis::BulkJobOptions options;
+    std::string wal_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--manifest" && has_value) {
+            options.manifest_path = argv[++i];
+        } else if (arg == "--journal" && has_value) {
+            options.journal_path = argv[++i];
+        } else if (arg == "--wal" && has_value) {
+            wal_path = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--unit-size" && has_value) {
+            options.unit_size = static_cast<std::size_t>(std::atol(argv[++i]));
+        } else if (arg == "--lease-ms" && has_value) {
+            options.lease_ms = std::atoi(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.manifest_path.empty() || options.journal_path.empty() || wal_path.empty()) {
+        usage();
+        return 2;
+    }
+
+    try {
+        probionis::ResultsPrimary store(wal_path);
+        probionis::BulkCoordinator coordinator(options, store);
+        coordinator.start();
+        std::fprintf(stderr, "probionis_bulk_coordinator: %zu units, listening on %u\n",
+                     coordinator.progress().leases.units,
+                     static_cast<unsigned>(coordinator.port()));
+        const auto start = std::chrono::steady_clock::now();
+        while (!coordinator.finished()) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            const probionis::BulkJobProgress p = coordinator.progress();
+            std::fprintf(stderr, "units %zu/%zu done, %zu leased, %zu workers, %llu reclaimed\n",
+                         p.leases.done, p.leases.units, p.leases.leased, p.workers_connected,
+                         static_cast<unsigned long long>(p.leases.reclaimed));
+        }
+        // Give connected workers a moment to hear DONE.
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        coordinator.stop();
+        const probionis::BulkJobProgress p = coordinator.progress();
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("merged %llu results in %.1f s (%llu duplicate submissions discarded, "
+                    "%llu failed commits)\n",
+                    static_cast<unsigned long long>(p.results_merged), seconds,
+                    static_cast<unsigned long long>(p.duplicates),
+                    static_cast<unsigned long long>(p.failed));
+        if (p.unapplied > 0) {
+            std::fprintf(stderr,
+                         "probionis_bulk_coordinator: %zu committed units not in the store "
+                         "yet; rerun with the same journal to apply them\n",
+                         p.unapplied);
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_bulk_coordinator: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+// Scores units of a bulk re-scoring job for probionis_bulk_coordinator.
+//
+//   probionis_bulk_worker --model FILE.pbmd --tenant T [--host H] [--port P]
+//                         [--qc] [--calibration FILE.pbcal] [--absorbance]
+//                         [--labels NAME,NAME,...]
+//
+// Each input path is read (any format read_spectrum_file() knows),
+// preprocessed with the steps given, in order, and scored; the record
+// carries the highest output and its label (--labels names the outputs in
+// order, otherwise the output index). Inputs that cannot be read, fail QC
+// or do not have the model's channel count are left out. Run one per core
+// and on as many hosts as the archive mount reaches; the job finishes when
+// the coordinator says DONE.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bulk/bulk_worker.h"
+#include "inference/model.h"
+#include "io/spectrum_reader.h"
+#include "preprocess/absorbance.h"
+#include "preprocess/calibration_transfer.h"
+#include "preprocess/pipeline.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace {
+
+using namespace probionis;
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_bulk_worker --model FILE --tenant T [--host H] [--port P] "
+                 "[--qc] [--calibration FILE] [--absorbance] [--labels NAME,...]\n");
+}
+
+std::vector<std::string> split_commas(const std::string& text) {
+    std::vector<std::string> parts;
+    std::istringstream in(text);
+    for (std::string part; std::getline(in, part, ',');) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+struct Scoring {
+    std::shared_ptr<Model> model;
+    Pipeline pipeline;
+    std::string tenant;
+    std::vector<std::string> labels;
+
+    std::vector<ResultRecord> operator()(const std::vector<std::string>& inputs) const {
+        std::vector<Spectrum> spectra;
+        for (const std::string& path : inputs) {
+            std::vector<Spectrum> read;
+            try {
+                read = read_spectrum_file(path);
+            } catch (const std::exception&) {
+                continue;
+            }
+            for (Spectrum& spectrum : read) {
+                if (pipeline.run(spectrum).ok() &&
+                    spectrum.size() == model->input_channels()) {
+                    spectra.push_back(std::move(spectrum));
+                }
+            }
+        }
+        std::vector<ResultRecord> records;
+        if (spectra.empty()) {
+            return records;
+        }
+        SpectrumBatch batch(spectra.size(), model->input_channels());
+        for (const Spectrum& spectrum : spectra) {
+            batch.push(spectrum);
+        }
+        const std::size_t width = model->output_width();
+        std::vector<float> outputs(batch.size() * width);
+        model->run(batch, outputs.data());
+
+        const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const float* row = outputs.data() + i * width;
+            std::size_t best = 0;
+            for (std::size_t j = 1; j < width; ++j) {
+                best = row[j] > row[best] ? j : best;
+            }
+            ResultRecord record;
+            record.sample_id = batch.sample_id(i);
+            record.tenant = tenant;
+            record.model_version = model->version();
+            record.label = best < labels.size() ? labels[best] : std::to_string(best);
+            record.score = row[best];
+            record.timestamp_ms = static_cast<std::uint64_t>(now.count());
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        auto scoring = std::make_shared<Scoring>();
+        BulkWorkerOptions options;
+        std::string model_path;
+        auto registry = std::make_shared<CalibrationRegistry>();
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--model" && has_value) {
+                model_path = argv[++i];
+            } else if (arg == "--tenant" && has_value) {
+                scoring->tenant = argv[++i];
+            } else if (arg == "--host" && has_value) {
+                options.coordinator_host = argv[++i];
+            } else if (arg == "--port" && has_value) {
+                options.coordinator_port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+            } else if (arg == "--labels" && has_value) {
+                scoring->labels = split_commas(argv[++i]);
+            } else if (arg == "--qc") {
+                scoring->pipeline.set_qc_gate(std::make_shared<QcGate>());
+            } else if (arg == "--absorbance") {
+                scoring->pipeline.add(std::make_shared<AbsorbanceStep>());
+            } else if (arg == "--calibration" && has_value) {
+                std::string instrument_id;
+                auto op = std::make_shared<BandedOperator>(
+                    load_calibration(argv[++i], &instrument_id));
+                registry->put(instrument_id, std::move(op));
+                scoring->pipeline.add(std::make_shared<CalibrationTransferStep>(registry, true));
+            } else {
+                usage();
+                return 2;
+            }
+        }
+        if (model_path.empty() || scoring->tenant.empty()) {
+            usage();
+            return 2;
+        }
+        auto layers = LayerStore::create();
+        scoring->model = load_model(model_path, *layers);
+
+        BulkWorker worker(options, [scoring](const std::vector<std::string>& inputs) {
+            return (*scoring)(inputs);
+        });
+        const BulkWorkerStats stats = worker.run();
+        std::printf("scored %llu units, %llu results (%llu duplicate, %llu failed, "
+                    "%llu leases lost)\n",
+                    static_cast<unsigned long long>(stats.units),
+                    static_cast<unsigned long long>(stats.results),
+                    static_cast<unsigned long long>(stats.duplicates),
+                    static_cast<unsigned long long>(stats.failed),
+                    static_cast<unsigned long long>(stats.lost_leases));
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_bulk_worker: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
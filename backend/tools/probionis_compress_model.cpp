@@ -0,0 +1,141 @@
+// Clusters a model's weights into 4- or 8-bit codebooks and reports how
+// far the compressed model's outputs move, so the trade is measured before
+// the file is deployed.
+//
+//   probionis_compress_model IN.pbmd OUT.pbmd [--bits 4|8] [--min-weights N]
+//                            [--eval spectra.f32]
+//
+// `--eval` takes rows of float32 model inputs; without it the comparison
+// runs on uniform random inputs.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "inference/model.h"
+#include "inference/weight_codebook.h"
+#include "spectrum/spectrum_batch.h"
+
+namespace {
+
+constexpr std::size_t kRandomRows = 256;
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_compress_model IN OUT [--bits 4|8] [--min-weights N] "
+                 "[--eval FILE]\n");
+}
+
+std::vector<float> read_floats(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    std::vector<float> values;
+    float chunk[4096];
+    std::size_t got;
+    while ((got = std::fread(chunk, sizeof(float), 4096, file)) > 0) {
+        values.insert(values.end(), chunk, chunk + got);
+    }
+    std::fclose(file);
+    return values;
+}
+
+probionis::SpectrumBatch eval_batch(const std::string& path, std::size_t width) {
+    std::vector<float> values;
+    std::size_t rows = kRandomRows;
+    if (!path.empty()) {
+        values = read_floats(path);
+        if (values.empty() || values.size() % width != 0) {
+            throw std::runtime_error(path + " does not hold rows of " + std::to_string(width) +
+                                     " floats");
+        }
+        rows = values.size() / width;
+    } else {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        values.resize(rows * width);
+        for (float& v : values) {
+            v = uniform(rng);
+        }
+    }
+    probionis::SpectrumBatch batch(rows, width);
+    for (std::size_t r = 0; r < rows; ++r) {
+        std::copy_n(values.data() + r * width, width, batch.row(r));
+    }
+    batch.adopt_rows(rows, std::vector<std::string>(rows), std::vector<std::string>(rows));
+    return batch;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    using namespace probionis;
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+    CodebookOptions options;
+    std::string eval;
+    for (int i = 3; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--bits" && has_value) {
+            const std::string bits = argv[++i];
+            if (bits == "4") {
+                options.format = WeightFormat::kCodebook4;
+            } else if (bits == "8") {
+                options.format = WeightFormat::kCodebook8;
+            } else {
+                usage();
+                return 2;
+            }
+        } else if (arg == "--min-weights" && has_value) {
+            options.min_weights = static_cast<std::size_t>(std::atol(argv[++i]));
+        } else if (arg == "--eval" && has_value) {
+            eval = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    try {
+        auto store = LayerStore::create();
+        auto model = load_model(input, *store);
+        CodebookReport report;
+        auto compressed = compress_model(*model, *store, options, &report);
+        for (std::size_t i = 0; i < report.layers.size(); ++i) {
+            const LayerCodebookReport& layer = report.layers[i];
+            const LayerWeights& w = *model->layers()[i].weights;
+            std::printf("layer %zu  %5zu x %-5zu  %-9s  %9zu -> %9zu bytes  rel error %.4f\n", i,
+                        w.inputs, w.outputs, weight_format_name(layer.format), layer.bytes_before,
+                        layer.bytes_after,
+                        layer.weight_rms > 0 ? layer.error_rms / layer.weight_rms : 0.0);
+        }
+        std::printf("total    %zu -> %zu bytes (%.2fx)\n", report.bytes_before,
+                    report.bytes_after,
+                    static_cast<double>(report.bytes_before) /
+                        static_cast<double>(std::max<std::size_t>(report.bytes_after, 1)));
+
+        const SpectrumBatch batch = eval_batch(eval, model->layers().front().weights->inputs);
+        const OutputDrift drift = compare_models(*model, *compressed, batch);
+        std::printf("outputs  max drift %.3g  mean drift %.3g  top-1 agreement %.3f "
+                    "(%zu %s rows)\n",
+                    drift.max_abs, drift.mean_abs, drift.top1_agreement, batch.size(),
+                    eval.empty() ? "random" : "eval");
+
+        save_model(output, *compressed);
+        return 0;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_compress_model: %s\n", e.what());
+        return 1;
+    }
+}
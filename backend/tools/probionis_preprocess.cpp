@@ -0,0 +1,80 @@
+// Runs the preprocessing pipeline over one raw spectrum: float32
+// intensities on stdin, the preprocessed float32 intensities on stdout.
+// Steps run in the order given.
+//
+//   probionis_preprocess [--qc] [--calibration FILE.pbcal] [--absorbance]
+//                        < raw.f32 > out.f32
+//
+// Built natively and with Emscripten (see README.md), it checks that the
+// browser build reproduces the server byte for byte:
+//
+//   probionis_preprocess --qc --absorbance < raw.f32 > native.f32
+//   node probionis_preprocess.js --qc --absorbance < raw.f32 > wasm.f32
+//   cmp native.f32 wasm.f32
+
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "preprocess/absorbance.h"
+#include "preprocess/calibration_transfer.h"
+#include "preprocess/pipeline.h"
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_preprocess [--qc] [--calibration FILE] [--absorbance] "
+                 "< raw.f32 > out.f32\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    using namespace probionis;
+    try {
+        Pipeline pipeline;
+        auto registry = std::make_shared<CalibrationRegistry>();
+        std::string instrument_id;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--qc") {
+                pipeline.set_qc_gate(std::make_shared<QcGate>());
+            } else if (arg == "--absorbance") {
+                pipeline.add(std::make_shared<AbsorbanceStep>());
+            } else if (arg == "--calibration" && i + 1 < argc) {
+                auto op = std::make_shared<BandedOperator>(
+                    load_calibration(argv[++i], &instrument_id));
+                registry->put(instrument_id, std::move(op));
+                pipeline.add(std::make_shared<CalibrationTransferStep>(registry, true));
+            } else {
+                usage();
+                return 2;
+            }
+        }
+
+        Spectrum spectrum;
+        spectrum.instrument_id = instrument_id;
+        float chunk[4096];
+        std::size_t got;
+        while ((got = std::fread(chunk, sizeof(float), 4096, stdin)) > 0) {
+            spectrum.intensity.insert(spectrum.intensity.end(), chunk, chunk + got);
+        }
+
+        const QcResult verdict = pipeline.run(spectrum);
+        if (!verdict.ok()) {
+            std::fprintf(stderr, "probionis_preprocess: rejected by QC: %s\n",
+                         qc_reason_name(verdict.reason));
+            return 1;
+        }
+        std::fwrite(spectrum.intensity.data(), sizeof(float), spectrum.intensity.size(),
+                    stdout);
+        return std::fflush(stdout) == 0 ? 0 : 2;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_preprocess: %s\n", e.what());
+        return 2;
+    }
+}
@@ -0,0 +1,73 @@
+// Replays a capture log recorded by CaptureWriter against a running server.
+//
+//   probionis_replay capture.pbrc [--host H] [--port P]
+//                    [--speed X | --speed max] [--connections N] [--no-verify]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include "replay/capture_log.h"
+#include "replay/replayer.h"
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_replay CAPTURE [--host H] [--port P] "
+                 "[--speed X|max] [--connections N] [--no-verify]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    probionis::ReplayOptions options;
+    const std::string capture = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--speed" && has_value) {
+            const std::string value = argv[++i];
+            options.speed = value == "max" ? 0.0 : std::atof(value.c_str());
+        } else if (arg == "--connections" && has_value) {
+            options.connections = static_cast<std::size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--no-verify") {
+            options.verify = false;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    try {
+        auto requests = probionis::CaptureReader::read_all(capture);
+        const probionis::ReplayReport report = probionis::replay(std::move(requests), options);
+        std::printf("requests            %llu\n", static_cast<unsigned long long>(report.sent));
+        std::printf("wall time           %.3f s (%.1f req/s)\n", report.wall_seconds,
+                    report.wall_seconds > 0 ? report.sent / report.wall_seconds : 0.0);
+        std::printf("latency p50/p99/max %.1f / %.1f / %.1f us\n", report.percentile_us(0.50),
+                    report.percentile_us(0.99), report.percentile_us(1.0));
+        std::printf("transport errors    %llu\n",
+                    static_cast<unsigned long long>(report.transport_errors));
+        std::printf("status mismatches   %llu\n",
+                    static_cast<unsigned long long>(report.status_mismatches));
+        std::printf("body mismatches     %llu\n",
+                    static_cast<unsigned long long>(report.body_mismatches));
+        const bool identical = report.transport_errors == 0 && report.status_mismatches == 0 &&
+                               report.body_mismatches == 0;
+        return identical ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_replay: %s\n", e.what());
+        return 2;
+    }
+}
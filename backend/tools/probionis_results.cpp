@@ -0,0 +1,165 @@
+// Results database node: the writable primary or a read-only replica.
+//
+//   probionis_results --role primary --wal results.pbwl [--port P] [--no-sync]
+//   probionis_results --role replica --wal replica.pbwl --primary HOST:PORT
+//                     [--port P] [--max-staleness-ms MS]
+//
+// Both roles serve GET /results/history, /results/summary and /metrics.
+// The primary also accepts POST /results and serves its log at GET /wal; a
+// replica answers queries only while within its staleness bound and
+// returns 503 otherwise, so clients can fall back to the primary. Several
+// replicas of one primary can run on the same machine, each with its own
+// --wal file.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/http_server.h"
+#include "storage/results_replication.h"
+#include "storage/results_service.h"
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) {
+    g_stop.store(true);
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_results --role primary --wal FILE [--port P] [--no-sync]\n"
+                 "       probionis_results --role replica --wal FILE --primary HOST:PORT "
+                 "[--port P] [--max-staleness-ms MS]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string role;
+    std::string primary;
+    probionis::HttpServerOptions server_options;
+    probionis::ReplicaOptions replica_options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--role" && has_value) {
+            role = argv[++i];
+        } else if (arg == "--wal" && has_value) {
+            replica_options.wal_path = argv[++i];
+        } else if (arg == "--primary" && has_value) {
+            primary = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            server_options.port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--max-staleness-ms" && has_value) {
+            replica_options.max_staleness_ms = std::atoi(argv[++i]);
+        } else if (arg == "--no-sync") {
+            replica_options.wal.sync_each_append = false;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    const std::size_t colon = primary.rfind(':');
+    if (replica_options.wal_path.empty() || (role != "primary" && role != "replica") ||
+        (role == "replica" && colon == std::string::npos)) {
+        usage();
+        return 2;
+    }
+
+    try {
+        std::unique_ptr<probionis::ResultsPrimary> writer;
+        std::unique_ptr<probionis::ResultsReplica> replica;
+        probionis::HttpHandler handler;
+        if (role == "primary") {
+            writer = std::make_unique<probionis::ResultsPrimary>(replica_options.wal_path,
+                                                                 replica_options.wal);
+            handler = [&writer](const probionis::HttpRequest& request,
+                                probionis::HttpResponse& response) {
+                if (request.method == "POST" && request.target == "/results") {
+                    std::vector<probionis::ResultRecord> records;
+                    try {
+                        records = probionis::parse_result_lines(request.body);
+                    } catch (const std::invalid_argument& e) {
+                        response.status = 400;
+                        response.body = std::string(e.what()) + "\n";
+                        return;
+                    }
+                    std::uint64_t lsn = 0;
+                    try {
+                        // One batch, so a rejected record leaves none applied.
+                        lsn = writer->write_batch(records) + records.size() - 1;
+                    } catch (const std::invalid_argument& e) {
+                        response.status = 413;
+                        response.body = std::string(e.what()) + "\n";
+                        return;
+                    }
+                    response.body = std::to_string(records.empty() ? 0 : lsn) + "\n";
+                } else if (request.target.compare(0, 4, "/wal") == 0) {
+                    writer->serve_wal(request, response);
+                } else if (request.target == "/healthz") {
+                    response.body = "ok\n";
+                } else if (!probionis::handle_metrics(request, response) &&
+                           !probionis::handle_results_query(writer->store(), request, response)) {
+                    response.status = 404;
+                }
+            };
+        } else {
+            replica_options.primary_host = primary.substr(0, colon);
+            replica_options.primary_port =
+                static_cast<std::uint16_t>(std::atoi(primary.c_str() + colon + 1));
+            replica = std::make_unique<probionis::ResultsReplica>(replica_options);
+            handler = [&replica](const probionis::HttpRequest& request,
+                                 probionis::HttpResponse& response) {
+                const std::int64_t staleness = replica->staleness_ms();
+                response.headers.emplace_back(probionis::kStalenessHeader,
+                                              std::to_string(staleness));
+                if (request.target == "/healthz") {
+                    response.status = replica->within_bound() ? 200 : 503;
+                    response.body = replica->within_bound() ? "ok\n" : "stale\n";
+                    return;
+                }
+                if (probionis::handle_metrics(request, response)) {
+                    return;
+                }
+                if (!replica->within_bound()) {
+                    response.status = 503;
+                    response.headers.emplace_back("Retry-After", "1");
+                    response.body = "replica is behind its staleness bound\n";
+                    return;
+                }
+                if (!probionis::handle_results_query(replica->store(), request, response)) {
+                    response.status = 404;
+                }
+            };
+            replica->start();
+        }
+
+        probionis::HttpServer server(server_options, handler);
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+        server.start();
+        std::fprintf(stderr, "probionis_results: %s listening on %u\n", role.c_str(),
+                     static_cast<unsigned>(server.port()));
+        while (!g_stop.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        server.stop();
+        if (replica) {
+            replica->stop();
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_results: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
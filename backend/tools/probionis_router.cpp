@@ -0,0 +1,188 @@
+// Cluster front-end: shards requests across backend nodes by sample or
+// tenant ID.
+//
+//   probionis_router --config cluster.conf [--port P] [--threads N]
+//                    [--capture FILE [--capture-rate R]]
+//   probionis_router --local N --node-command CMD [--base-port B] [--port P]
+//
+// --local starts N node processes on this machine, running CMD through
+// /bin/sh with {port} and {id} replaced, and routes across them: the whole
+// cluster in one terminal, with no coordination service. Killing a node
+// process exercises failover; the router stops its children on exit.
+//
+// The router answers /healthz, /cluster/status and /metrics (its own
+// process's) itself and forwards everything else. --capture records the
+// forwarded traffic (a fraction R of it) for probionis_replay.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "cluster/cluster_config.h"
+#include "cluster/router.h"
+#include "net/http_server.h"
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) {
+    g_stop.store(true);
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: probionis_router --config FILE [--port P] [--threads N]\n"
+                 "       probionis_router --local N --node-command CMD [--base-port B] "
+                 "[--port P] [--threads N]\n"
+                 "       (either form) [--capture FILE [--capture-rate R]]\n");
+}
+
+std::string substitute(std::string text, const std::string& name, const std::string& value) {
+    for (std::size_t pos; (pos = text.find(name)) != std::string::npos;) {
+        text.replace(pos, name.size(), value);
+    }
+    return text;
+}
+
+pid_t spawn_node(const std::string& command) {
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        // Own process group so a terminal ^C reaches the router only and the
+        // router decides how nodes shut down.
+        ::setpgid(0, 0);
+        ::execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+std::string render_status(const probionis::ClusterRouter& router) {
+    std::string body = "{\"shard_key\":\"";
+    body += probionis::shard_key_name(router.config().shard_key);
+    body += "\",\"nodes\":[";
+    bool first = true;
+    for (const auto& node : router.status()) {
+        body += first ? "" : ",";
+        first = false;
+        body += "{\"id\":\"" + node.id + "\",\"healthy\":" + (node.healthy ? "true" : "false") +
+                ",\"forwarded\":" + std::to_string(node.forwarded) +
+                ",\"failures\":" + std::to_string(node.failures) + "}";
+    }
+    body += "]}\n";
+    return body;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string config_path;
+    std::string node_command;
+    std::size_t local_nodes = 0;
+    std::uint16_t base_port = 9100;
+    probionis::HttpServerOptions server_options;
+    // The router only waits on sockets, so its connection count is not
+    // tied to a compute budget.
+    server_options.connection_threads = 16;
+    std::string capture_path;
+    probionis::CaptureOptions capture_options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--config" && has_value) {
+            config_path = argv[++i];
+        } else if (arg == "--local" && has_value) {
+            local_nodes = static_cast<std::size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--node-command" && has_value) {
+            node_command = argv[++i];
+        } else if (arg == "--base-port" && has_value) {
+            base_port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--port" && has_value) {
+            server_options.port = static_cast<std::uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            server_options.connection_threads = static_cast<std::size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--capture" && has_value) {
+            capture_path = argv[++i];
+        } else if (arg == "--capture-rate" && has_value) {
+            capture_options.sample_rate = std::atof(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (config_path.empty() == (local_nodes == 0) || (local_nodes > 0 && node_command.empty())) {
+        usage();
+        return 2;
+    }
+
+    std::vector<pid_t> children;
+    int exit_code = 0;
+    try {
+        const probionis::ClusterConfig config =
+            local_nodes > 0 ? probionis::local_cluster_config(local_nodes, base_port)
+                            : probionis::load_cluster_config(config_path);
+        for (std::size_t i = 0; i < local_nodes; ++i) {
+            const auto& node = config.nodes[i];
+            std::string command = substitute(node_command, "{port}", std::to_string(node.port));
+            command = substitute(command, "{id}", node.id);
+            children.push_back(spawn_node(command));
+        }
+
+        if (!capture_path.empty()) {
+            server_options.capture =
+                std::make_shared<probionis::CaptureWriter>(capture_path, capture_options);
+        }
+        probionis::ClusterRouter router(config);
+        probionis::HttpServer server(
+            server_options,
+            [&router](const probionis::HttpRequest& request, probionis::HttpResponse& response) {
+                if (request.target == "/healthz") {
+                    response.body = "ok\n";
+                } else if (request.target == "/cluster/status") {
+                    response.headers.emplace_back("Content-Type", "application/json");
+                    response.body = render_status(router);
+                } else if (!probionis::handle_metrics(request, response)) {
+                    router.handle(request, response);
+                }
+            });
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+        router.start();
+        server.start();
+        std::fprintf(stderr, "probionis_router: %zu nodes, sharding by %s, listening on %u\n",
+                     config.nodes.size(), probionis::shard_key_name(config.shard_key),
+                     static_cast<unsigned>(server.port()));
+        while (!g_stop.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // Reap local nodes that exited so they do not linger as zombies.
+            while (::waitpid(-1, nullptr, WNOHANG) > 0) {
+            }
+        }
+        server.stop();
+        router.stop();
+        if (server_options.capture) {
+            server_options.capture->close();
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "probionis_router: %s\n", e.what());
+        exit_code = 1;
+    }
+
+    for (const pid_t pid : children) {
+        ::kill(-pid, SIGTERM);
+    }
+    for (const pid_t pid : children) {
+        ::waitpid(pid, nullptr, 0);
+    }
+    return exit_code;
+}